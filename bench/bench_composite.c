@@ -0,0 +1,161 @@
+//=====================================================================
+//
+// bench_composite.c - composite operator cost matrix
+//
+// runs every operator of ipixel_composite_get (IPIXEL_OP_SRC ...
+// IPIXEL_OP_OVERLAY) through ibitmap_composite, from an A8R8G8B8 source
+// to A8R8G8B8, X8R8G8B8, P8R8G8B8, R5G6B5 and R8G8B8 destinations, with
+// fully opaque, fully transparent and mixed source alpha.
+//
+// build:
+//   cc -O2 -I../pixellib -o bench_composite bench_composite.c
+//      ../pixellib/ibitmap.c ../pixellib/ibmbits.c ../pixellib/ibmcols.c
+//      ../pixellib/ibmsse2.c ../pixellib/ibmsimd.c ../pixellib/iblit386.c
+//      ../pixellib/ibmtask.c -lpthread -lm
+//
+// usage:
+//   bench_composite [-t ms] [-f op-filter] [-w width] [-h height]
+//                   [-l simd-level]
+//
+// output is one tab separated row per measurement:
+//   op  dst  alpha  width  height  ns/pixel  mpps
+//
+//=====================================================================
+#include "ibench.h"
+#include "ibitmap.h"
+
+
+//---------------------------------------------------------------------
+// configuration
+//---------------------------------------------------------------------
+static const int bench_dst_fmts[] = {
+	IPIX_FMT_A8R8G8B8,
+	IPIX_FMT_X8R8G8B8,
+	IPIX_FMT_P8R8G8B8,
+	IPIX_FMT_R5G6B5,
+	IPIX_FMT_R8G8B8,
+};
+
+#define BENCH_ALPHA_OPAQUE			0
+#define BENCH_ALPHA_TRANSPARENT		1
+#define BENCH_ALPHA_MIXED			2
+
+static const char *bench_alpha_names[] = { "opaque", "transparent", "mixed" };
+
+
+//---------------------------------------------------------------------
+// source with a given alpha distribution, the mixed one looks like
+// anti-aliased sprites: mostly 0 or 255 with ~25% partial coverage.
+//---------------------------------------------------------------------
+static void bench_source_init(IBITMAP *bmp, int alpha)
+{
+	int x, y;
+	for (y = 0; y < (int)bmp->h; y++) {
+		IUINT32 *row = (IUINT32*)bmp->line[y];
+		for (x = 0; x < (int)bmp->w; x++) {
+			IUINT32 c = ibench_rand() & 0xffffff;
+			IUINT32 a = 255, k;
+			switch (alpha) {
+			case BENCH_ALPHA_OPAQUE: a = 255; break;
+			case BENCH_ALPHA_TRANSPARENT: a = 0; break;
+			case BENCH_ALPHA_MIXED:
+				k = ibench_rand() >> 24;
+				if (k < 96) a = 0;
+				else if (k < 192) a = 255;
+				else a = (ibench_rand() >> 24);
+				break;
+			}
+			row[x] = c | (a << 24);
+		}
+	}
+}
+
+static IBITMAP *bench_bitmap(int w, int h, int fmt)
+{
+	IBITMAP *bmp = ibitmap_create(w, h, ipixelfmt[fmt].bpp);
+	if (bmp == NULL) {
+		fprintf(stderr, "can not create bitmap\n");
+		exit(1);
+	}
+	ibitmap_pixfmt_set(bmp, fmt);
+	return bmp;
+}
+
+
+//---------------------------------------------------------------------
+// main
+//---------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+	const char *filter = ibench_arg(argc, argv, "-f", NULL);
+	int ms = atoi(ibench_arg(argc, argv, "-t", "20"));
+	int w = atoi(ibench_arg(argc, argv, "-w", "512"));
+	int h = atoi(ibench_arg(argc, argv, "-h", "64"));
+	int level = ibench_simd(argc, argv);
+	int ndst = (int)(sizeof(bench_dst_fmts) / sizeof(bench_dst_fmts[0]));
+	IBITMAP *src[3];
+	IBITMAP *dst[5];
+	IBITMAP *base[5];
+	int op, i, alpha;
+
+	if (ms <= 0) ms = 1;
+	if (w <= 0) w = 512;
+	if (h <= 0) h = 64;
+
+	for (alpha = 0; alpha < 3; alpha++) {
+		src[alpha] = bench_bitmap(w, h, IPIX_FMT_A8R8G8B8);
+		bench_source_init(src[alpha], alpha);
+	}
+
+	// destinations are restored from a mixed-alpha base before each
+	// measurement so that every operator starts from the same content
+	for (i = 0; i < ndst; i++) {
+		int fmt = bench_dst_fmts[i];
+		IBITMAP *tmp = bench_bitmap(w, h, IPIX_FMT_A8R8G8B8);
+		bench_source_init(tmp, BENCH_ALPHA_MIXED);
+		base[i] = bench_bitmap(w, h, fmt);
+		dst[i] = bench_bitmap(w, h, fmt);
+		ibitmap_convert(base[i], 0, 0, tmp, 0, 0, w, h, NULL, 0);
+		ibitmap_release(tmp);
+	}
+
+	printf("# pixellib composite benchmark, %dx%d, %d ms per item, "
+		"simd %s\n", w, h, ms, ipixel_simd_name(level));
+	printf("# op\tdst\talpha\twidth\theight\tns/pixel\tmpps\n");
+
+	for (op = 0; op <= IPIXEL_OP_OVERLAY; op++) {
+		const char *name = ipixel_composite_opname(op);
+		if (!ibench_match(filter, name)) continue;
+		for (i = 0; i < ndst; i++) {
+			for (alpha = 0; alpha < 3; alpha++) {
+				IINT64 elapse = 0;
+				long times = 0;
+				double npixel, ns;
+				ibitmap_blit(dst[i], 0, 0, base[i], 0, 0, w, h, 0);
+				IBENCH_LOOP(ms, elapse, times,
+					ibitmap_composite(dst[i], 0, 0, src[alpha], 0, 0,
+						w, h, NULL, op, 0));
+				npixel = (double)w * (double)h * (double)times;
+				ns = (double)elapse / npixel;
+				printf("%s\t%s\t%s\t%d\t%d\t%.3f\t%.2f\n", name,
+					ipixelfmt[bench_dst_fmts[i]].name,
+					bench_alpha_names[alpha], w, h, ns,
+					(ns > 0.0)? 1000.0 / ns : 0.0);
+				fflush(stdout);
+			}
+		}
+	}
+
+	for (i = 0; i < ndst; i++) {
+		ibitmap_release(dst[i]);
+		ibitmap_release(base[i]);
+	}
+
+	for (alpha = 0; alpha < 3; alpha++) {
+		ibitmap_release(src[alpha]);
+	}
+
+	return 0;
+}
+
+
@@ -0,0 +1,179 @@
+//=====================================================================
+//
+// bench_pixel.c - fetch / store / fetchpixel / convert throughput
+//
+// measures MPixels/s of every IPIX_FMT_* accessor returned by
+// ipixel_get_fetch, ipixel_get_store and ipixel_get_fetchpixel in
+// both IPIXEL_ACCESS_MODE_NORMAL (lut) and ACCURATE, and ipixel_convert
+// for every format pair, at scanline widths of 16, 256 and 4096.
+//
+// build:
+//   cc -O2 -I../pixellib -o bench_pixel bench_pixel.c
+//      ../pixellib/ibitmap.c ../pixellib/ibmbits.c ../pixellib/ibmcols.c
+//      ../pixellib/ibmsse2.c ../pixellib/ibmsimd.c ../pixellib/iblit386.c
+//      ../pixellib/ibmtask.c -lpthread -lm
+//
+// usage:
+//   bench_pixel [-t ms] [-f name-filter] [-k fetch|store|pixel|convert]
+//               [-l simd-level]
+//
+// output is one tab separated row per measurement:
+//   kind  mode  src  dst  width  mpps
+// where mpps is millions of pixels per second, lines starting with '#'
+// are comments, the table can be diffed between releases directly.
+//
+//=====================================================================
+#include "ibench.h"
+
+
+//---------------------------------------------------------------------
+// configuration
+//---------------------------------------------------------------------
+static const int bench_widths[] = { 16, 256, 4096 };
+static const char *bench_modes[] = { "normal", "accurate" };
+
+#define BENCH_MAX_WIDTH		4096
+
+static IUINT32 bench_card[BENCH_MAX_WIDTH];
+static IUINT32 bench_work[BENCH_MAX_WIDTH];
+static IUINT8 bench_src[BENCH_MAX_WIDTH * 4];
+static IUINT8 bench_dst[BENCH_MAX_WIDTH * 4];
+
+static volatile IUINT32 bench_sink = 0;
+
+
+//---------------------------------------------------------------------
+// output
+//---------------------------------------------------------------------
+static void bench_report(const char *kind, const char *mode, int sfmt,
+	int dfmt, int width, IINT64 elapse, long times)
+{
+	double mpps = 0.0;
+	if (elapse > 0) {
+		mpps = ((double)width * (double)times * 1000.0) / (double)elapse;
+	}
+	printf("%s\t%s\t%s\t%s\t%d\t%.2f\n", kind, mode,
+		(sfmt >= 0)? ipixelfmt[sfmt].name : "-",
+		(dfmt >= 0)? ipixelfmt[dfmt].name : "-",
+		width, mpps);
+	fflush(stdout);
+}
+
+
+//---------------------------------------------------------------------
+// fetch, store, fetchpixel
+//---------------------------------------------------------------------
+static void bench_fetch(int fmt, int mode, int width, int ms)
+{
+	iFetchProc fetch = ipixel_get_fetch(fmt, mode);
+	const iColorIndex *index = _ipixel_src_index;
+	IINT64 elapse = 0;
+	long times = 0;
+	IBENCH_LOOP(ms, elapse, times,
+		fetch(bench_src, 0, width, bench_card, index));
+	bench_sink += bench_card[width - 1];
+	bench_report("fetch", bench_modes[mode], fmt, -1, width, elapse, times);
+}
+
+static void bench_store(int fmt, int mode, int width, int ms)
+{
+	iStoreProc store = ipixel_get_store(fmt, mode);
+	const iColorIndex *index = _ipixel_dst_index;
+	IINT64 elapse = 0;
+	long times = 0;
+	IBENCH_LOOP(ms, elapse, times,
+		store(bench_dst, bench_card, 0, width, index));
+	bench_sink += bench_dst[0];
+	bench_report("store", bench_modes[mode], -1, fmt, width, elapse, times);
+}
+
+static void bench_fetchpixel(int fmt, int mode, int width, int ms)
+{
+	iFetchPixelProc fetchpixel = ipixel_get_fetchpixel(fmt, mode);
+	const iColorIndex *index = _ipixel_src_index;
+	IINT64 elapse = 0;
+	long times = 0;
+	IBENCH_LOOP(ms, elapse, times, {
+		IUINT32 sum = 0;
+		int x;
+		for (x = 0; x < width; x++) sum += fetchpixel(bench_src, x, index);
+		bench_sink += sum;
+	});
+	bench_report("pixel", bench_modes[mode], fmt, -1, width, elapse, times);
+}
+
+
+//---------------------------------------------------------------------
+// ipixel_convert for a format pair, single scanline per call
+//---------------------------------------------------------------------
+static void bench_convert(int dfmt, int sfmt, int width, int ms)
+{
+	IINT64 elapse = 0;
+	long times = 0;
+	IBENCH_LOOP(ms, elapse, times,
+		ipixel_convert(dfmt, bench_dst, BENCH_MAX_WIDTH * 4, 0, sfmt,
+			bench_src, BENCH_MAX_WIDTH * 4, 0, width, 1, 0, 0,
+			NULL, NULL, bench_work));
+	bench_sink += bench_dst[0];
+	bench_report("convert", "-", sfmt, dfmt, width, elapse, times);
+}
+
+
+//---------------------------------------------------------------------
+// main
+//---------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+	const char *filter = ibench_arg(argc, argv, "-f", NULL);
+	const char *kind = ibench_arg(argc, argv, "-k", NULL);
+	int ms = atoi(ibench_arg(argc, argv, "-t", "5"));
+	int nwidths = (int)(sizeof(bench_widths) / sizeof(bench_widths[0]));
+	int level = ibench_simd(argc, argv);
+	int fmt, sfmt, dfmt, mode, i;
+
+	if (ms <= 0) ms = 1;
+
+	ibench_fill(bench_src, sizeof(bench_src));
+	ibench_fill(bench_card, sizeof(bench_card));
+
+	// initialize lookup tables before timing
+	ipixel_get_fetch(0, IPIXEL_ACCESS_MODE_NORMAL);
+
+	printf("# pixellib fetch/store/convert benchmark, %d ms per item, "
+		"simd %s\n", ms, ipixel_simd_name(level));
+	printf("# kind\tmode\tsrc\tdst\twidth\tmpps\n");
+
+	for (fmt = 0; fmt < IPIX_FMT_COUNT; fmt++) {
+		if (!ibench_match(filter, ipixelfmt[fmt].name)) continue;
+		for (mode = 0; mode < 2; mode++) {
+			for (i = 0; i < nwidths; i++) {
+				int w = bench_widths[i];
+				if (ibench_match(kind, "fetch"))
+					bench_fetch(fmt, mode, w, ms);
+				if (ibench_match(kind, "store"))
+					bench_store(fmt, mode, w, ms);
+				if (ibench_match(kind, "pixel"))
+					bench_fetchpixel(fmt, mode, w, ms);
+			}
+		}
+	}
+
+	if (ibench_match(kind, "convert")) {
+		for (sfmt = 0; sfmt < IPIX_FMT_COUNT; sfmt++) {
+			for (dfmt = 0; dfmt < IPIX_FMT_COUNT; dfmt++) {
+				if (!ibench_match(filter, ipixelfmt[sfmt].name) &&
+					!ibench_match(filter, ipixelfmt[dfmt].name))
+					continue;
+				for (i = 0; i < nwidths; i++) {
+					bench_convert(dfmt, sfmt, bench_widths[i], ms);
+				}
+			}
+		}
+	}
+
+	printf("# done (%u)\n", (unsigned)bench_sink);
+
+	return 0;
+}
+
+
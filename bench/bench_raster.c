@@ -0,0 +1,292 @@
+//=====================================================================
+//
+// bench_raster.c - rasterizer and ipaint benchmark
+//
+// renders fixed scenes into a headless A8R8G8B8 bitmap at every
+// anti-aliasing level of ipaint_anti_aliasing (0, 1, 2):
+//
+//   polygons  - thousands of small polygons (ipaint_draw_polygon)
+//   circles   - small filled circles (ipaint_draw_circle)
+//   lines     - long thin lines (ipaint_draw_line)
+//   gradient  - full size polygons filled with linear, radial and
+//               conical sources (ipixel_source_init_gradient_*)
+//   sprites   - rotated sprites (ibitmap_raster_draw_3d)
+//
+// build:
+//   cc -O2 -I../pixellib -o bench_raster bench_raster.c
+//      ../pixellib/ibitmap.c ../pixellib/ibmbits.c ../pixellib/ibmcols.c
+//      ../pixellib/ibmdata.c ../pixellib/ibmwink.c ../pixellib/ibmfont.c
+//      ../pixellib/ibmsse2.c ../pixellib/ibmsimd.c ../pixellib/iblit386.c
+//      ../pixellib/ibmtask.c -lpthread -lm
+//
+// usage:
+//   bench_raster [-t ms] [-f scene-filter] [-w width] [-h height]
+//                [-l simd-level]
+//
+// output is one tab separated row per measurement:
+//   scene  aa  width  height  prims/frame  frames  fps  us/prim
+//
+//=====================================================================
+#include <math.h>
+
+#include "ibench.h"
+#include "ibitmap.h"
+#include "ibmdata.h"
+#include "ibmwink.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+
+//---------------------------------------------------------------------
+// scene description: primitives are generated once from a fixed seed
+// so every frame, every level and every run draws exactly the same.
+//---------------------------------------------------------------------
+#define BENCH_POLYGONS		4000
+#define BENCH_CIRCLES		2000
+#define BENCH_LINES			1000
+#define BENCH_GRADIENTS		3
+#define BENCH_SPRITES		200
+
+typedef struct
+{
+	const char *name;
+	int count;
+	void (*draw)(ipaint_t *paint, int w, int h);
+}	BenchScene;
+
+static double bench_poly[BENCH_POLYGONS][9];
+static double bench_circle[BENCH_CIRCLES][3];
+static double bench_line[BENCH_LINES][4];
+static double bench_sprite[BENCH_SPRITES][5];
+static IUINT32 bench_color[BENCH_POLYGONS];
+static IBITMAP *bench_image = NULL;
+
+static double bench_uniform(double low, double high)
+{
+	return low + (high - low) * ((ibench_rand() >> 8) / 16777216.0);
+}
+
+static void bench_scene_init(int w, int h)
+{
+	int i, x, y;
+
+	for (i = 0; i < BENCH_POLYGONS; i++) {
+		double cx = bench_uniform(0, w), cy = bench_uniform(0, h);
+		double r = bench_uniform(4, 12);
+		int k;
+		for (k = 0; k < 4; k++) {
+			double t = (k + bench_uniform(0, 0.8)) * M_PI / 2;
+			bench_poly[i][k * 2 + 0] = cx + r * cos(t);
+			bench_poly[i][k * 2 + 1] = cy + r * sin(t);
+		}
+		bench_poly[i][8] = (i & 1)? 4 : 3;
+		bench_color[i] = ibench_rand() | 0x80000000;
+	}
+
+	for (i = 0; i < BENCH_CIRCLES; i++) {
+		bench_circle[i][0] = bench_uniform(0, w);
+		bench_circle[i][1] = bench_uniform(0, h);
+		bench_circle[i][2] = bench_uniform(2, 16);
+	}
+
+	for (i = 0; i < BENCH_LINES; i++) {
+		bench_line[i][0] = bench_uniform(0, w);
+		bench_line[i][1] = bench_uniform(0, h);
+		bench_line[i][2] = bench_uniform(0, w);
+		bench_line[i][3] = bench_uniform(0, h);
+	}
+
+	for (i = 0; i < BENCH_SPRITES; i++) {
+		bench_sprite[i][0] = bench_uniform(0, w);
+		bench_sprite[i][1] = bench_uniform(0, h);
+		bench_sprite[i][2] = bench_uniform(0.5, 1.5);
+		bench_sprite[i][3] = bench_uniform(-0.6, 0.6);
+		bench_sprite[i][4] = bench_uniform(0, 2 * M_PI);
+	}
+
+	// sprite: 64x64 with soft edged alpha
+	bench_image = ibitmap_create(64, 64, 32);
+	ibitmap_pixfmt_set(bench_image, IPIX_FMT_A8R8G8B8);
+	for (y = 0; y < 64; y++) {
+		IUINT32 *row = (IUINT32*)bench_image->line[y];
+		for (x = 0; x < 64; x++) {
+			double dx = x - 31.5, dy = y - 31.5;
+			double d = 1.0 - sqrt(dx * dx + dy * dy) / 32.0;
+			IUINT32 a = (d <= 0.0)? 0 : (IUINT32)(d * 255.0);
+			if (a > 255) a = 255;
+			row[x] = (a << 24) | ((x * 4) << 16) | ((y * 4) << 8) | 0x80;
+		}
+	}
+}
+
+
+//---------------------------------------------------------------------
+// scenes
+//---------------------------------------------------------------------
+static void bench_draw_polygons(ipaint_t *paint, int w, int h)
+{
+	ipixel_point_t pts[4];
+	int i, k;
+	for (i = 0; i < BENCH_POLYGONS; i++) {
+		int n = (int)bench_poly[i][8];
+		for (k = 0; k < n; k++) {
+			pts[k].x = bench_poly[i][k * 2 + 0];
+			pts[k].y = bench_poly[i][k * 2 + 1];
+		}
+		ipaint_set_color(paint, bench_color[i]);
+		ipaint_draw_polygon(paint, pts, n);
+	}
+}
+
+static void bench_draw_circles(ipaint_t *paint, int w, int h)
+{
+	int i;
+	for (i = 0; i < BENCH_CIRCLES; i++) {
+		ipaint_set_color(paint, bench_color[i]);
+		ipaint_draw_circle(paint, bench_circle[i][0], bench_circle[i][1],
+			bench_circle[i][2]);
+	}
+}
+
+static void bench_draw_lines(ipaint_t *paint, int w, int h)
+{
+	int i;
+	ipaint_line_width(paint, 1.0);
+	for (i = 0; i < BENCH_LINES; i++) {
+		ipaint_set_color(paint, bench_color[i]);
+		ipaint_draw_line(paint, bench_line[i][0], bench_line[i][1],
+			bench_line[i][2], bench_line[i][3]);
+	}
+}
+
+static void bench_draw_gradient(ipaint_t *paint, int w, int h)
+{
+	ipixel_gradient_stop_t stops[3];
+	ipixel_point_fixed_t p1, p2;
+	ipixel_source_t source;
+	ipixel_point_t pts[4];
+
+	stops[0].x = cfixed_from_double(0.0);
+	stops[0].color = 0xffff0000;
+	stops[1].x = cfixed_from_double(0.5);
+	stops[1].color = 0x8000ff00;
+	stops[2].x = cfixed_from_double(1.0);
+	stops[2].color = 0xff0000ff;
+
+	// slightly skewed quad covering the whole target
+	pts[0].x = -0.5; pts[0].y = 0.25;
+	pts[1].x = w + 0.5; pts[1].y = -0.25;
+	pts[2].x = w + 0.25; pts[2].y = h + 0.5;
+	pts[3].x = -0.25; pts[3].y = h + 0.25;
+
+	p1.x = cfixed_from_int(0);
+	p1.y = cfixed_from_int(0);
+	p2.x = cfixed_from_int(w);
+	p2.y = cfixed_from_int(h);
+
+	ipixel_source_init_gradient_linear(&source, &p1, &p2, stops, 3);
+	ipaint_source_set(paint, &source);
+	ipaint_draw_polygon(paint, pts, 4);
+
+	p1.x = p2.x = cfixed_from_int(w / 2);
+	p1.y = p2.y = cfixed_from_int(h / 2);
+	ipixel_source_init_gradient_radial(&source, &p1, &p2, 0,
+		cfixed_from_int(h / 2), stops, 3);
+	ipaint_source_set(paint, &source);
+	ipaint_draw_polygon(paint, pts, 4);
+
+	ipixel_source_init_gradient_conical(&source, &p1,
+		cfixed_from_double(30.0), stops, 3);
+	ipaint_source_set(paint, &source);
+	ipaint_draw_polygon(paint, pts, 4);
+
+	ipaint_source_set(paint, NULL);
+}
+
+static void bench_draw_sprites(ipaint_t *paint, int w, int h)
+{
+	int i;
+	for (i = 0; i < BENCH_SPRITES; i++) {
+		const double *s = bench_sprite[i];
+		ipaint_raster_draw_3d(paint, s[0], s[1], 0, bench_image, NULL,
+			32, 32, s[2], s[2], s[3], -s[3], s[4], 0xffffffff);
+	}
+}
+
+static BenchScene bench_scenes[] = {
+	{ "polygons", BENCH_POLYGONS, bench_draw_polygons },
+	{ "circles", BENCH_CIRCLES, bench_draw_circles },
+	{ "lines", BENCH_LINES, bench_draw_lines },
+	{ "gradient", BENCH_GRADIENTS, bench_draw_gradient },
+	{ "sprites", BENCH_SPRITES, bench_draw_sprites },
+	{ NULL, 0, NULL },
+};
+
+
+//---------------------------------------------------------------------
+// main
+//---------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+	const char *filter = ibench_arg(argc, argv, "-f", NULL);
+	int ms = atoi(ibench_arg(argc, argv, "-t", "500"));
+	int w = atoi(ibench_arg(argc, argv, "-w", "800"));
+	int h = atoi(ibench_arg(argc, argv, "-h", "600"));
+	int level = ibench_simd(argc, argv);
+	IBITMAP *screen;
+	ipaint_t *paint;
+	int i, aa;
+
+	if (ms <= 0) ms = 1;
+	if (w <= 0) w = 800;
+	if (h <= 0) h = 600;
+
+	bench_scene_init(w, h);
+
+	screen = ibitmap_create(w, h, 32);
+	ibitmap_pixfmt_set(screen, IPIX_FMT_A8R8G8B8);
+	paint = ipaint_create(screen);
+
+	if (paint == NULL) {
+		fprintf(stderr, "can not create paint\n");
+		return 1;
+	}
+
+	printf("# pixellib raster benchmark, %dx%d A8R8G8B8, %d ms per item, "
+		"simd %s\n", w, h, ms, ipixel_simd_name(level));
+	printf("# scene\taa\twidth\theight\tprims/frame\tframes\tfps\tus/prim\n");
+
+	for (i = 0; bench_scenes[i].name; i++) {
+		const BenchScene *scene = &bench_scenes[i];
+		if (!ibench_match(filter, scene->name)) continue;
+		for (aa = 0; aa <= 2; aa++) {
+			IINT64 elapse = 0, start;
+			long frames = 0;
+			double fps, us;
+			ipaint_anti_aliasing(paint, aa);
+			start = ibench_clock();
+			do {
+				ipaint_fill(paint, NULL, 0xff202020);
+				scene->draw(paint, w, h);
+				frames++;
+				elapse = ibench_clock() - start;
+			}	while (elapse < ((IINT64)ms) * 1000000);
+			fps = (double)frames * 1000000000.0 / (double)elapse;
+			us = (double)elapse / 1000.0 / (double)frames /
+				(double)scene->count;
+			printf("%s\t%d\t%d\t%d\t%d\t%ld\t%.2f\t%.3f\n", scene->name,
+				aa, w, h, scene->count, frames, fps, us);
+			fflush(stdout);
+		}
+	}
+
+	ipaint_destroy(paint);
+	ibitmap_release(screen);
+	ibitmap_release(bench_image);
+
+	return 0;
+}
+
+
@@ -0,0 +1,117 @@
+//=====================================================================
+//
+// ibench.h - shared helpers for the pixellib benchmarks
+//
+// NOTE:
+// the benchmarks are standalone programs, build them directly with
+// the library sources, see the header of each bench_*.c file.
+//
+//=====================================================================
+#ifndef __IBENCH_H__
+#define __IBENCH_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ibmbits.h"
+#include "ibmcols.h"
+#include "ibmsimd.h"
+
+#if defined(_WIN32) || defined(WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#include <sys/time.h>
+#endif
+
+
+//---------------------------------------------------------------------
+// high resolution clock in nanoseconds
+//---------------------------------------------------------------------
+static inline IINT64 ibench_clock(void)
+{
+#if defined(_WIN32) || defined(WIN32)
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+	if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (IINT64)((double)now.QuadPart * 1000000000.0 /
+		(double)freq.QuadPart);
+#elif defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((IINT64)ts.tv_sec) * 1000000000 + (IINT64)ts.tv_nsec;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return ((IINT64)tv.tv_sec) * 1000000000 + (IINT64)tv.tv_usec * 1000;
+#endif
+}
+
+
+//---------------------------------------------------------------------
+// deterministic random generator, results must be reproducible
+//---------------------------------------------------------------------
+static IUINT32 ibench_seed = 0x12345678;
+
+static inline IUINT32 ibench_rand(void)
+{
+	ibench_seed = ibench_seed * 1664525 + 1013904223;
+	return ibench_seed;
+}
+
+static inline void ibench_fill(void *ptr, long size)
+{
+	IUINT8 *p = (IUINT8*)ptr;
+	for (; size > 0; p++, size--) p[0] = (IUINT8)(ibench_rand() >> 24);
+}
+
+
+//---------------------------------------------------------------------
+// measuring loop: run the body until at least 'ms' milliseconds
+// elapsed, stores total nanoseconds and repeat count.
+//---------------------------------------------------------------------
+#define IBENCH_LOOP(ms, elapse, times, body) do { \
+		IINT64 __ts = ibench_clock(), __limit = ((IINT64)(ms)) * 1000000; \
+		(times) = 0; \
+		do { \
+			int __k; \
+			for (__k = 0; __k < 8; __k++) { body; } \
+			(times) += 8; \
+			(elapse) = ibench_clock() - __ts; \
+		}	while ((elapse) < __limit); \
+	}	while (0)
+
+
+//---------------------------------------------------------------------
+// argument helpers: -t ms, -f filter, -l simd level
+//---------------------------------------------------------------------
+static inline const char *ibench_arg(int argc, char *argv[],
+	const char *name, const char *defval)
+{
+	int i;
+	for (i = 1; i < argc - 1; i++) {
+		if (strcmp(argv[i], name) == 0) return argv[i + 1];
+	}
+	return defval;
+}
+
+static inline int ibench_match(const char *filter, const char *name)
+{
+	if (filter == NULL || filter[0] == 0) return 1;
+	return (strstr(name, filter) != NULL)? 1 : 0;
+}
+
+// install the kernels of '-l level' (IPIXEL_SIMD_AUTO by default),
+// call it before anything else, returns the level installed
+static inline int ibench_simd(int argc, char *argv[])
+{
+	int level = atoi(ibench_arg(argc, argv, "-l", "-1"));
+	return ipixel_simd_select(level);
+}
+
+
+#endif
+
+
@@ -28,6 +28,7 @@
  **********************************************************************/
 
 #include "ibitmap.h"
+#include "ibmtrace.h"
 
 #include <stddef.h>
 #include <stdlib.h>
@@ -283,6 +284,7 @@ int ibitmap_blit(struct IBITMAP *dst, int x, int y,
     int pixsize, r;
     char *pixel1;
     char *pixel2;
+    IBITMAP_TRACE_BEGIN(tracets);
 
     /* check whether parametes is error */
     assert(src && dst);
@@ -358,6 +360,7 @@ int ibitmap_blit(struct IBITMAP *dst, int x, int y,
             pixsize, linesize, src->mask, mode);
         if (r) ibitmap_blitfc(pixel1, pitch1, pixel2, pitch2, w, h,
             pixsize, linesize, src->mask, mode);
+        IBITMAP_TRACE_END(tracets, "ibitmap_blit", w, h, -1, -1);
         return 0;
     }
 
@@ -374,6 +377,8 @@ int ibitmap_blit(struct IBITMAP *dst, int x, int y,
             pixsize, linesize, src->mask);
     }
 
+    IBITMAP_TRACE_END(tracets, "ibitmap_blit", w, h, -1, -1);
+
     return 0;
 }
 
@@ -890,6 +895,118 @@ int ibitmap_fillc(char *dst, long pitch, int w, int h, int pixsize,
 }
 
 
+/* ibitmap_stretch_int - integer factor stretch without IBLIT_MASK: each
+ * source pixel is replicated fx times along the row with wide stores
+ * (16 bits for 8 bpp x2, 32 bits for 8 bpp x4 and 16 bpp x2, 64 bits 
+ * for 16 bpp x4 and 32 bpp x2 / x4 when long is 64 bits), then the
+ * finished row is duplicated fy - 1 times with memcpy.
+ */
+static void ibitmap_stretch_int(struct IBITMAP *dst, int dx, int dy, 
+    int fx, int fy, const struct IBITMAP *src, int sx, int sy, int sw, 
+    int sh, int mode)
+{
+    int nbytes = (src->bpp + 7) / 8;
+    long linesize = (long)sw * fx * nbytes;
+    int incx, incy, i, j, k;
+
+    if (mode & IBLIT_VFLIP) sy = sy + sh - 1, incy = -1;
+    else incy = 1;
+
+    for (j = 0; j < sh; j++, sy += incy) {
+        const unsigned char *srcpix = (const unsigned char*)src->line[sy];
+        unsigned char *dstrow = (unsigned char*)dst->line[dy];
+        unsigned char *dstpix = dstrow + nbytes * dx;
+        srcpix += nbytes * sx;
+        incx = nbytes;
+        if (mode & IBLIT_HFLIP) {
+            srcpix += (sw - 1) * nbytes;
+            incx = -nbytes;
+        }
+        switch (nbytes)
+        {
+        case 1:
+            if (fx == 2) {
+                for (i = sw; i > 0; i--, srcpix += incx, dstpix += 2) {
+                    *((unsigned short*)dstpix) = 
+                        (unsigned short)(srcpix[0] * 0x101);
+                }
+            }
+            else if (fx == 4) {
+                for (i = sw; i > 0; i--, srcpix += incx, dstpix += 4) {
+                    *((unsigned int*)dstpix) = srcpix[0] * 0x1010101u;
+                }
+            }
+            else {
+                for (i = sw; i > 0; i--, srcpix += incx, dstpix += fx) {
+                    memset(dstpix, srcpix[0], fx);
+                }
+            }
+            break;
+
+        case 2:
+            if (fx == 2) {
+                for (i = sw; i > 0; i--, srcpix += incx, dstpix += 4) {
+                    unsigned int c = *((const unsigned short*)srcpix);
+                    *((unsigned int*)dstpix) = c | (c << 16);
+                }
+            }
+            else if (fx == 4 && sizeof(unsigned long) == 8) {
+                for (i = sw; i > 0; i--, srcpix += incx, dstpix += 8) {
+                    unsigned long c = *((const unsigned short*)srcpix);
+                    c = c | (c << 16);
+                    *((unsigned long*)dstpix) = c | ((c << 16) << 16);
+                }
+            }
+            else {
+                for (i = sw; i > 0; i--, srcpix += incx) {
+                    unsigned short c = *((const unsigned short*)srcpix);
+                    for (k = fx; k > 0; k--, dstpix += 2) 
+                        *((unsigned short*)dstpix) = c;
+                }
+            }
+            break;
+
+        case 3:
+            for (i = sw; i > 0; i--, srcpix += incx) {
+                unsigned char c0 = srcpix[0];
+                unsigned char c1 = srcpix[1];
+                unsigned char c2 = srcpix[2];
+                for (k = fx; k > 0; k--, dstpix += 3) {
+                    dstpix[0] = c0;
+                    dstpix[1] = c1;
+                    dstpix[2] = c2;
+                }
+            }
+            break;
+
+        case 4:
+            if ((fx == 2 || fx == 4) && sizeof(unsigned long) == 8) {
+                for (i = sw; i > 0; i--, srcpix += incx) {
+                    unsigned long c = *((const unsigned int*)srcpix);
+                    c = c | ((c << 16) << 16);
+                    for (k = fx; k > 0; k -= 2, dstpix += 8)
+                        *((unsigned long*)dstpix) = c;
+                }
+            }
+            else {
+                for (i = sw; i > 0; i--, srcpix += incx) {
+                    unsigned int c = *((const unsigned int*)srcpix);
+                    for (k = fx; k > 0; k--, dstpix += 4) 
+                        *((unsigned int*)dstpix) = c;
+                }
+            }
+            break;
+        }
+
+        dstpix = dstrow + nbytes * dx;
+        for (k = 1, dy++; k < fy; k++, dy++) {
+            memcpy((unsigned char*)dst->line[dy] + nbytes * dx, dstpix, 
+                linesize);
+        }
+    }
+}
+
+
 /* ibitmap_stretch - copies a bitmap from a source rectangle into a 
  * destination rectangle, stretching or compressing the bitmap to fit 
  * the dimensions of the destination rectangle
@@ -931,6 +1048,13 @@ int ibitmap_stretch(struct IBITMAP *dst, int dx, int dy, int dw, int dh,
         sh <= 0 || sw <= 0 || dh <= 0 || dw <= 0) 
         return -20;
 
+    /* pixel art upscale: exact integer factors replicate pixels */
+    if ((mode & IBLIT_MASK) == 0 && dw % sw == 0 && dh % sh == 0) {
+        ibitmap_stretch_int(dst, dx, dy, dw / sw, dh / sh, src, sx, sy, 
+            sw, sh, mode);
+        return 0;
+    }
+
     dstwidth = dw;
     dstheight = dh;
     dstwidth2 = dw * 2;
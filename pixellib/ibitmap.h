@@ -158,6 +158,7 @@ int ibitmap_fill(struct IBITMAP *dst, int dx, int dy, int w, int h,
  * it uses bresenham like algorithm instead of fixed point or indexing 
  * to avoid integer size overflow and memory allocation, just use it 
  * when you don't have a stretch function.
+ * exact integer upscale without IBLIT_MASK replicates pixels directly.
  */
 int ibitmap_stretch(struct IBITMAP *dst, int dx, int dy, int dw, int dh,
     const struct IBITMAP *src, int sx, int sy, int sw, int sh, int mode);
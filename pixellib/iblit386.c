@@ -96,7 +96,7 @@ void _x86_cpuid(int op, int *eax, int *ebx, int *ecx, int *edx)
 		"	movl %%ecx, %2\n"
 		"	movl %%edx, %3\n"
 		"	popal\n"
-		: "=m" (a), "=m" (b), "=m" (c), "=m" (d) 
+		: "+m" (a), "=m" (b), "=m" (c), "=m" (d) 
 		: "a" (op): "memory");
 		#else
 		iulong x1, x2, x3, x4;
@@ -115,7 +115,7 @@ void _x86_cpuid(int op, int *eax, int *ebx, int *ecx, int *edx)
 		"	movq %5, %%rbx\n"
 		"	movq %6, %%rcx\n"
 		"	movq %7, %%rdx\n"
-		: "=m" (a), "=m" (b), "=m" (c), "=m" (d),
+		: "+m" (a), "=m" (b), "=m" (c), "=m" (d),
 		  "=m" (x1), "=m" (x2), "=m" (x3), "=m" (x4)
 		: "a" (op): "memory");
 		#endif
@@ -57,6 +57,12 @@
 
 #include "ibmbits.h"
 
+#if defined(_WIN32) || defined(WIN32)
+#include <windows.h>
+#else
+#include <sched.h>
+#endif
+
 
 /**********************************************************************
  * GLOBAL VARIABLES
@@ -263,29 +269,37 @@ void *(*ipixel_memcpy_hook)(void *dst, const void *src, size_t size) = NULL;
  * 256 PALETTE INTERFACE
  **********************************************************************/
 
+static IUINT32 ipixel_palette_diff[512 * 3];
+static ipixel_once_t ipixel_palette_once = IPIXEL_ONCE_INIT;
+
+/* calculate color difference lookup table:
+ * COLOR DIFF TABLE
+ * table1: diff_lookup[i | i = 256->511, n=0->(+255)] = (n * 30) ^ 2
+ * table2: diff_lookup[i | i = 256->1,   n=0->(-255)] = (n * 30) ^ 2
+ * result: f(n) = (n * 30) ^ 2 = diff_lookup[256 + n]
+ */
+static void ipixel_palette_init(void)
+{
+	IUINT32 *diff_lookup = ipixel_palette_diff;
+	long i, k;
+	for (i = 0; i < 256; i++) {
+		k = i * i;
+		diff_lookup[ 256 + i] = diff_lookup[ 256 - i] = k * 30 * 30;
+		diff_lookup[ 768 + i] = diff_lookup[ 768 - i] = k * 59 * 59;
+		diff_lookup[1280 + i] = diff_lookup[1280 - i] = k * 11 * 11;
+	}
+	diff_lookup[0] = 1;
+}
+
 /* find best fit color */
 int ipixel_palette_fit(const IRGB *pal, int r, int g, int b, int palsize)
 { 
-	static IUINT32 diff_lookup[512 * 3] = { 0 };
+	const IUINT32 *diff_lookup = ipixel_palette_diff;
 	long lowest = 0x7FFFFFFF, bestfit = 0;
-	long coldiff, i, k;
+	long coldiff, i;
 	IRGB *rgb;
 
-	/* calculate color difference lookup table:
-	 * COLOR DIFF TABLE
-	 * table1: diff_lookup[i | i = 256->511, n=0->(+255)] = (n * 30) ^ 2
-	 * table2: diff_lookup[i | i = 256->1,   n=0->(-255)] = (n * 30) ^ 2
-	 * result: f(n) = (n * 30) ^ 2 = diff_lookup[256 + n]
-	 */
-	if (diff_lookup[0] == 0) {
-		for (i = 0; i < 256; i++) {
-			k = i * i;
-			diff_lookup[ 256 + i] = diff_lookup[ 256 - i] = k * 30 * 30;
-			diff_lookup[ 768 + i] = diff_lookup[ 768 - i] = k * 59 * 59;
-			diff_lookup[1280 + i] = diff_lookup[1280 - i] = k * 11 * 11;
-		}
-		diff_lookup[0] = 1;
-	}
+	IPIXEL_ONCE(&ipixel_palette_once, ipixel_palette_init);
 
 	/* range correction */
 	r = r & 255;
@@ -1036,6 +1050,23 @@ static struct iPixelAccessProc ipixel_access_proc[IPIX_FMT_COUNT] =
 #undef IFETCH_PIXEL
 
 
+/* 16 bits formats use the lut in IPIXEL_ACCESS_MODE_NORMAL */
+static int ipixel_access_lut16 = 1;
+
+static int ipixel_access_lut_enabled(int pixfmt)
+{
+	if (ipixelfmt[pixfmt].bpp != 16) return 1;
+	return ipixel_access_lut16;
+}
+
+/* choose lut or ACCURATE procedures for 16 bits NORMAL access */
+int ipixel_set_lut16(int enable)
+{
+	int previous = ipixel_access_lut16;
+	ipixel_access_lut16 = enable? 1 : 0;
+	return previous;
+}
+
 /* set procedure */
 void ipixel_set_proc(int pixfmt, int type, void *proc)
 {
@@ -1205,13 +1236,69 @@ static const int ipixel_access_lut_fmt[IPIX_FMT_COUNT] = {
 #undef IFETCH_LUT_1
 #undef IFETCH_LUT_MAIN
 
-static int ipixel_lut_inited = 0;
 
-void ipixel_init_lut(void)
+/**********************************************************************
+ * INITIALIZING
+ **********************************************************************/
+#if defined(_WIN32) || defined(WIN32)
+	#define IPIXEL_ATOMIC_CAS(ptr, oldval, newval) \
+		(InterlockedCompareExchange((LONG volatile*)(ptr), \
+			(LONG)(newval), (LONG)(oldval)) == (LONG)(oldval))
+	#define IPIXEL_ATOMIC_STORE(ptr, val) \
+		InterlockedExchange((LONG volatile*)(ptr), (LONG)(val))
+	#define IPIXEL_ATOMIC_YIELD() Sleep(0)
+	#define IPIXEL_ATOMIC_LOAD(ptr) (*(ptr))
+#elif defined(__ATOMIC_ACQUIRE)
+	#define IPIXEL_ATOMIC_CAS(ptr, oldval, newval) \
+		__sync_bool_compare_and_swap(ptr, oldval, newval)
+	#define IPIXEL_ATOMIC_STORE(ptr, val) \
+		__atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+	#define IPIXEL_ATOMIC_LOAD(ptr) __atomic_load_n(ptr, __ATOMIC_RELAXED)
+	#define IPIXEL_ATOMIC_YIELD() sched_yield()
+#else
+	#define IPIXEL_ATOMIC_CAS(ptr, oldval, newval) \
+		__sync_bool_compare_and_swap(ptr, oldval, newval)
+	#define IPIXEL_ATOMIC_STORE(ptr, val) do { \
+			__sync_synchronize(); *(ptr) = (val); \
+		}	while (0)
+	#define IPIXEL_ATOMIC_LOAD(ptr) (*(ptr))
+	#define IPIXEL_ATOMIC_YIELD() sched_yield()
+#endif
+
+/* run init exactly once */
+void ipixel_once(ipixel_once_t *once, void (*init)(void))
 {
-	int i, j, k;
+	if (IPIXEL_ONCE_DONE(once)) return;
+	if (IPIXEL_ATOMIC_CAS(once, 0, 1)) {
+		init();
+		IPIXEL_ATOMIC_STORE(once, 2);
+		return;
+	}
+	while (!IPIXEL_ONCE_DONE(once)) {
+		IPIXEL_ATOMIC_YIELD();
+	}
+}
 
-	if (ipixel_lut_inited != 0) return;
+/* acquire spin lock */
+void ipixel_lock(ipixel_lock_t *lock)
+{
+	while (!IPIXEL_ATOMIC_CAS(lock, 0, 1)) {
+		while (IPIXEL_ATOMIC_LOAD(lock) != 0) IPIXEL_ATOMIC_YIELD();
+	}
+}
+
+/* release spin lock */
+void ipixel_unlock(ipixel_lock_t *lock)
+{
+	IPIXEL_ATOMIC_STORE(lock, 0);
+}
+
+
+static ipixel_once_t ipixel_lut_once = IPIXEL_ONCE_INIT;
+
+static void ipixel_lut_build(void)
+{
+	int i, j, k;
 
 	/* init bit scaling table */
 	for (i = 0; i < 9; i++) {
@@ -1287,7 +1374,12 @@ void ipixel_init_lut(void)
 			_ipixel_divlut[i][j] = 255;
 		}
 	}
-	ipixel_lut_inited = 1;
+}
+
+/* initialize lookup tables once */
+void ipixel_init_lut(void)
+{
+	IPIXEL_ONCE(&ipixel_lut_once, ipixel_lut_build);
 }
 
 /* get color fetching procedure */
@@ -1297,8 +1389,9 @@ iFetchProc ipixel_get_fetch(int pixfmt, int access_mode)
 	if (pixfmt < 0 || pixfmt >= IPIX_FMT_COUNT) return NULL;
 	if (access_mode == IPIXEL_ACCESS_MODE_NORMAL) {
 		int id = ipixel_access_lut_fmt[pixfmt];
-		if (ipixel_lut_inited == 0) ipixel_init_lut();
-		if (id >= 0) return ipixel_access_lut[id].fetch;
+		IPIXEL_ONCE(&ipixel_lut_once, ipixel_lut_build);
+		if (id >= 0 && ipixel_access_lut_enabled(pixfmt)) 
+			return ipixel_access_lut[id].fetch;
 		return ipixel_access_proc[pixfmt].fetch;
 	}
 	if (access_mode == IPIXEL_ACCESS_MODE_ACCURATE) {
@@ -1313,7 +1406,7 @@ iStoreProc ipixel_get_store(int pixfmt, int access_mode)
 	assert(pixfmt >= 0 && pixfmt < IPIX_FMT_COUNT);
 	if (pixfmt < 0 || pixfmt >= IPIX_FMT_COUNT) return NULL;
 	if (access_mode == IPIXEL_ACCESS_MODE_NORMAL) {
-		if (ipixel_lut_inited == 0) ipixel_init_lut();
+		IPIXEL_ONCE(&ipixel_lut_once, ipixel_lut_build);
 		return ipixel_access_proc[pixfmt].store;
 	}
 	if (access_mode == IPIXEL_ACCESS_MODE_ACCURATE) {
@@ -1329,8 +1422,9 @@ iFetchPixelProc ipixel_get_fetchpixel(int pixfmt, int access_mode)
 	if (pixfmt < 0 || pixfmt >= IPIX_FMT_COUNT) return NULL;
 	if (access_mode == IPIXEL_ACCESS_MODE_NORMAL) {
 		int id = ipixel_access_lut_fmt[pixfmt];
-		if (ipixel_lut_inited == 0) ipixel_init_lut();
-		if (id >= 0) return ipixel_access_lut[id].pixel;
+		IPIXEL_ONCE(&ipixel_lut_once, ipixel_lut_build);
+		if (id >= 0 && ipixel_access_lut_enabled(pixfmt)) 
+			return ipixel_access_lut[id].pixel;
 		return ipixel_access_proc[pixfmt].fetchpixel;
 	}
 	if (access_mode == IPIXEL_ACCESS_MODE_ACCURATE) {
@@ -1432,11 +1526,11 @@ static void ipixel_span_draw_proc_##fmt##_1(void *bits, \
 			} \
 			else if (r2 > 0 && cc > 0) { \
 				a1 = _imul_y_div_255(a1, cc); \
-				cc = _ipixel_fetch(bpp, dst, 0); \
-				IRGBA_FROM_PIXEL(fmt, cc, r2, g2, b2, a2); \
 				r1 = _imul_y_div_255(r1, cc); \
 				g1 = _imul_y_div_255(g1, cc); \
 				b1 = _imul_y_div_255(b1, cc); \
+				cc = _ipixel_fetch(bpp, dst, 0); \
+				IRGBA_FROM_PIXEL(fmt, cc, r2, g2, b2, a2); \
 				IBLEND_SRCOVER(r1, g1, b1, a1, r2, g2, b2, a2); \
 				cc = IRGBA_TO_PIXEL(fmt, r2, g2, b2, a2); \
 				_ipixel_store(bpp, dst, 0, cc); \
@@ -1570,12 +1664,12 @@ static void ipixel_span_draw_proc_##fmt##_1(void *bits, \
 			} \
 			else if (r2 > 0 && cc > 0) { \
 				a1 = _imul_y_div_255(a1, cc); \
-				r1 = dst[0]; \
-				cc = _ipixel_cvt_lut_##fmt[r1]; \
-				IRGBA_FROM_PIXEL(A8R8G8B8, cc, r2, g2, b2, a2); \
 				r1 = _imul_y_div_255(r1, cc); \
 				g1 = _imul_y_div_255(g1, cc); \
 				b1 = _imul_y_div_255(b1, cc); \
+				a2 = dst[0]; \
+				cc = _ipixel_cvt_lut_##fmt[a2]; \
+				IRGBA_FROM_PIXEL(A8R8G8B8, cc, r2, g2, b2, a2); \
 				IBLEND_SRCOVER(r1, g1, b1, a1, r2, g2, b2, a2); \
 				cc = IRGBA_TO_PIXEL(fmt, r2, g2, b2, a2); \
 				_ipixel_store(bpp, dst, 0, cc); \
@@ -1707,11 +1801,11 @@ static void ipixel_span_draw_proc_##fmt##_1(void *bits, \
 			} \
 			else if (r2 > 0 && cc > 0) { \
 				a1 = _imul_y_div_255(a1, cc); \
-				cc = _ipixel_fetch(bpp, dst, inc); \
-				IRGBA_FROM_PIXEL(fmt, cc, r2, g2, b2, a2); \
 				r1 = _imul_y_div_255(r1, cc); \
 				g1 = _imul_y_div_255(g1, cc); \
 				b1 = _imul_y_div_255(b1, cc); \
+				cc = _ipixel_fetch(bpp, dst, inc); \
+				IRGBA_FROM_PIXEL(fmt, cc, r2, g2, b2, a2); \
 				IBLEND_SRCOVER(r1, g1, b1, a1, r2, g2, b2, a2); \
 				cc = IRGBA_TO_PIXEL(fmt, r2, g2, b2, a2); \
 				_ipixel_store(bpp, dst, inc, cc); \
@@ -1973,7 +2067,7 @@ iSpanDrawProc ipixel_get_span_proc(int fmt, int op, int builtin)
 		abort();
 		return NULL;
 	}
-	if (ipixel_lut_inited == 0) ipixel_init_lut();
+	IPIXEL_ONCE(&ipixel_lut_once, ipixel_lut_build);
 	if (builtin) {
 		if (fmt < 0) return ipixel_span_draw_proc_over_32;
 		if (op == 0) return ipixel_span_proc_list[fmt].blend_builtin;
@@ -1994,7 +2088,7 @@ void ipixel_set_span_proc(int fmt, int op, iSpanDrawProc proc)
 		abort();
 		return;
 	}
-	if (ipixel_lut_inited == 0) ipixel_init_lut();
+	IPIXEL_ONCE(&ipixel_lut_once, ipixel_lut_build);
 	if (fmt < 0) {
 		if (proc != NULL) {
 			ipixel_span_draw_over = proc;
@@ -2037,7 +2131,7 @@ void ipixel_set_span_proc(int fmt, int op, iSpanDrawProc proc)
  **********************************************************************/
 
 /* reverse card */
-void ipixel_card_reverse(IUINT32 *card, int size)
+static void ipixel_card_reverse_default(IUINT32 *card, int size)
 {
 	IUINT32 *p1, *p2;
 	IUINT32 value;
@@ -2048,6 +2142,14 @@ void ipixel_card_reverse(IUINT32 *card, int size)
 	}
 }
 
+static void (*ipixel_card_reverse_proc)(IUINT32*, int) = 
+	ipixel_card_reverse_default;
+
+void ipixel_card_reverse(IUINT32 *card, int size)
+{
+	ipixel_card_reverse_proc(card, size);
+}
+
 
 /* multi card */
 void ipixel_card_multi_default(IUINT32 *card, int size, IUINT32 color)
@@ -2254,6 +2356,12 @@ void ipixel_card_set_proc(int id, void *proc)
 			ipixel_card_permute_proc = 
 				(void (*)(IUINT32*, int, int, int, int, int))proc;
 	}
+	else if (id == 5) {
+		if (proc == NULL)
+			ipixel_card_reverse_proc = ipixel_card_reverse_default;
+		else
+			ipixel_card_reverse_proc = (void (*)(IUINT32*, int))proc;
+	}
 }
 
 
@@ -2390,7 +2498,7 @@ static void ipixel_hline_draw_proc_##fmt##_2(void *bits, \
 	if (a1 == 0) return; \
 	if (cover == NULL) { \
 		r2 = g2 = b2 = a2 = 0; \
-		IBLEND_ADDITIVE(r1, g1, b1, a1, r2, g2, a2, b2); \
+		IBLEND_ADDITIVE(r1, g1, b1, a1, r2, g2, b2, a2); \
 		r1 = r2; g1 = g2; b1 = b2; a1 = a2; \
 		for (; w > 0; dst += nbytes, w--) { \
 			cc = _ipixel_fetch(bpp, dst, 0); \
@@ -2572,7 +2680,7 @@ static void ipixel_hline_draw_proc_##fmt##_2(void *bits, \
 	if (a1 == 0) return; \
 	if (cover == NULL) { \
 		r2 = g2 = b2 = a2 = 0; \
-		IBLEND_ADDITIVE(r1, g1, b1, a1, r2, g2, a2, b2); \
+		IBLEND_ADDITIVE(r1, g1, b1, a1, r2, g2, b2, a2); \
 		r1 = r2; g1 = g2; b1 = b2; a1 = a2; \
 		for (; w > 0; dst += nbytes, w--) { \
 			cc = _ipixel_fetch(bpp, dst, offset); \
@@ -2795,7 +2903,7 @@ iHLineDrawProc ipixel_get_hline_proc(int fmt, int op, int builtin)
 		abort();
 		return NULL;
 	}
-	if (ipixel_lut_inited == 0) ipixel_init_lut();
+	IPIXEL_ONCE(&ipixel_lut_once, ipixel_lut_build);
 	if (builtin) {
 		if (op == 0) 
 			return ipixel_hline_proc_list[fmt].blend_builtin;
@@ -2821,7 +2929,7 @@ void ipixel_set_hline_proc(int fmt, int op, iHLineDrawProc proc)
 		abort();
 		return;
 	}
-	if (ipixel_lut_inited == 0) ipixel_init_lut();
+	IPIXEL_ONCE(&ipixel_lut_once, ipixel_lut_build);
 	if (op == 0) {
 		if (proc != NULL) {
 			ipixel_hline_proc_list[fmt].blend = proc;
@@ -3291,25 +3399,23 @@ void ipixel_blit(int bpp, void *dst, long dpitch, int dx, const void *src,
  * CONVERTING
  **********************************************************************/
 static iPixelCvt ipixel_cvt_table[IPIX_FMT_COUNT][IPIX_FMT_COUNT][8];
-static int ipixel_cvt_inited = 0;
+static ipixel_once_t ipixel_cvt_once = IPIXEL_ONCE_INIT;
 
 /* initialize converting procedure table */
 static void ipixel_cvt_init(void)
 {
 	int dfmt, sfmt, i;
-	if (ipixel_cvt_inited) return;
 	for (dfmt = 0; dfmt < IPIX_FMT_COUNT; dfmt++) {
 		for (sfmt = 0; sfmt < IPIX_FMT_COUNT; sfmt++) {
 			for (i = 0; i < 8; i++) ipixel_cvt_table[dfmt][sfmt][i] = NULL;
 		}
 	}
-	ipixel_cvt_inited = 1;
 }
 
 /* get converting procedure */
 iPixelCvt ipixel_cvt_get(int dfmt, int sfmt, int index)
 {
-	if (ipixel_cvt_inited == 0) ipixel_cvt_init();
+	IPIXEL_ONCE(&ipixel_cvt_once, ipixel_cvt_init);
 	if (dfmt < 0 || dfmt >= IPIX_FMT_COUNT) return NULL;
 	if (sfmt < 0 || sfmt >= IPIX_FMT_COUNT) return NULL;
 	if (index < 0 || index >= 8) return NULL;
@@ -3319,7 +3425,7 @@ iPixelCvt ipixel_cvt_get(int dfmt, int sfmt, int index)
 /* set converting procedure */
 void ipixel_cvt_set(int dfmt, int sfmt, int index, iPixelCvt proc)
 {
-	if (ipixel_cvt_inited == 0) ipixel_cvt_init();
+	IPIXEL_ONCE(&ipixel_cvt_once, ipixel_cvt_init);
 	if (dfmt < 0 || dfmt >= IPIX_FMT_COUNT) return;
 	if (sfmt < 0 || sfmt >= IPIX_FMT_COUNT) return;
 	if (index < 0 || index >= 8) return;
@@ -3420,7 +3526,7 @@ long ipixel_convert(int dfmt, void *dbits, long dpitch, int dx, int sfmt,
 		return w * sizeof(IUINT32);
 	}
 
-	if (ipixel_cvt_inited == 0) ipixel_cvt_init();
+	IPIXEL_ONCE(&ipixel_cvt_once, ipixel_cvt_init);
 
 	assert(dfmt >= 0 && dfmt < IPIX_FMT_COUNT);
 	assert(sfmt >= 0 && sfmt < IPIX_FMT_COUNT);
@@ -3504,8 +3610,7 @@ int ipixel_fmt_init(iPixelFmt *fmt, int depth,
 	if (depth < 8 || depth > 32) {
 		return -1;
 	}
-	if (ipixel_lut_inited == 0) 
-		ipixel_init_lut();
+	IPIXEL_ONCE(&ipixel_lut_once, ipixel_lut_build);
 	for (i = 0; i < IPIX_FMT_COUNT; i++) {
 		if (ipixelfmt[i].amask == amask &&
 			ipixelfmt[i].rmask == rmask &&
@@ -3585,11 +3690,7 @@ void ipixel_fmt_set_writer(int depth, iPixelFmtWriter writer)
 iPixelFmtReader ipixel_fmt_get_reader(int depth, int isdefault)
 {
 	int index = ((depth + 7) / 8) - 1;
-	int inited = 0;
-	if (inited == 0) {
-		ipixel_init_lut();
-		inited = 1;
-	}
+	IPIXEL_ONCE(&ipixel_lut_once, ipixel_lut_build);
 	if (index < 0 || index >= 4) return NULL;
 	if (ipixel_fmt_reader[index] == NULL || isdefault != 0) {
 		return ipixel_fmt_reader_default;
@@ -4240,7 +4341,7 @@ int ipixel_clip(const int *clipdst, const int *clipsrc, int *x, int *y,
  * COMPOSITE
  **********************************************************************/
 static iPixelComposite ipixel_composite_table[40][2];
-static int ipixel_composite_inited = 0;
+static ipixel_once_t ipixel_composite_once = IPIXEL_ONCE_INIT;
 
 static void ipixel_comp_src(IUINT32 *dst, const IUINT32 *src, int w)
 {
@@ -4537,7 +4638,6 @@ static void ipixel_comp_overlay(IUINT32 *dst, const IUINT32 *src, int w)
 /* initialize compositors */
 static void ipixel_composite_init(void)
 {
-	if (ipixel_composite_inited) return;
 	#define ipixel_composite_install(opname, name) do { \
 		ipixel_composite_table[IPIXEL_OP_##opname][0] = ipixel_comp_##name; \
 		ipixel_composite_table[IPIXEL_OP_##opname][1] = ipixel_comp_##name; \
@@ -4585,14 +4685,13 @@ static void ipixel_composite_init(void)
 	#undef ipixel_composite_install
 
 	ipixel_init_lut();
-	ipixel_composite_inited = 1;
 }
 
 
 /* get compositor */
 iPixelComposite ipixel_composite_get(int op, int isdefault)
 {
-	if (ipixel_composite_inited == 0) ipixel_composite_init();
+	IPIXEL_ONCE(&ipixel_composite_once, ipixel_composite_init);
 	if (op < 0 || op > IPIXEL_OP_OVERLAY) return NULL;
 	return ipixel_composite_table[op][isdefault ? 1 : 0];
 }
@@ -4600,12 +4699,21 @@ iPixelComposite ipixel_composite_get(int op, int isdefault)
 /* set compositor */
 void ipixel_composite_set(int op, iPixelComposite composite)
 {
-	if (ipixel_composite_inited == 0) ipixel_composite_init();
+	IPIXEL_ONCE(&ipixel_composite_once, ipixel_composite_init);
 	if (op < 0 || op > IPIXEL_OP_OVERLAY) return;
 	if (composite == NULL) composite = ipixel_composite_table[op][1];
 	ipixel_composite_table[op][0] = composite;
 }
 
+/* initialize every table of this file */
+void ipixel_init(void)
+{
+	IPIXEL_ONCE(&ipixel_lut_once, ipixel_lut_build);
+	IPIXEL_ONCE(&ipixel_cvt_once, ipixel_cvt_init);
+	IPIXEL_ONCE(&ipixel_composite_once, ipixel_composite_init);
+	IPIXEL_ONCE(&ipixel_palette_once, ipixel_palette_init);
+}
+
 /* composite operator names */
 const char *ipixel_composite_opnames[] = {
 	"IPIXEL_OP_SRC",
@@ -411,6 +411,54 @@ extern unsigned char _ipixel_bit_scale[9][256];
 #define IPIXEL_FORMAT_ALOSS(pixfmt)    ipixelfmt[pixfmt].aloss
 
 
+/**********************************************************************
+ * INITIALIZING
+ **********************************************************************/
+
+/* one-time flag: 0 uninitialized, 1 running, 2 done */
+typedef volatile long ipixel_once_t;
+
+#define IPIXEL_ONCE_INIT		0
+
+/* run init exactly once, concurrent callers wait until it returns,
+ * init must not call ipixel_once with the same flag again */
+void ipixel_once(ipixel_once_t *once, void (*init)(void));
+
+/* fast path: check the flag (acquire) before calling ipixel_once */
+#if defined(__GNUC__) && defined(__ATOMIC_ACQUIRE)
+#define IPIXEL_ONCE_DONE(once) \
+		(__atomic_load_n((once), __ATOMIC_ACQUIRE) == 2)
+#else
+#define IPIXEL_ONCE_DONE(once) (*(once) == 2)
+#endif
+
+#define IPIXEL_ONCE(once, init) do { \
+		if (!IPIXEL_ONCE_DONE(once)) ipixel_once(once, init); \
+	}	while (0)
+
+/* spin lock for short critical sections such as caches */
+typedef volatile long ipixel_lock_t;
+
+#define IPIXEL_LOCK_INIT		0
+
+void ipixel_lock(ipixel_lock_t *lock);
+void ipixel_unlock(ipixel_lock_t *lock);
+
+/* thread local storage qualifier for static variables */
+#if defined(_MSC_VER) || defined(__BORLANDC__)
+	#define IPIXEL_TLS	__declspec(thread)
+#else
+	#define IPIXEL_TLS	__thread
+#endif
+
+/* initialize color lookup tables (thread safe, done on demand) */
+void ipixel_init_lut(void);
+
+/* initialize every table of this file: luts, converters, compositors
+ * and palette matching (thread safe, done on demand) */
+void ipixel_init(void);
+
+
 /**********************************************************************
  * BITS ACCESSING
  **********************************************************************/
@@ -435,6 +483,12 @@ iFetchPixelProc ipixel_get_fetchpixel(int pixfmt, int access_mode);
 /* set procedure */
 void ipixel_set_proc(int pixfmt, int type, void *proc);
 
+/* 16 bits formats in IPIXEL_ACCESS_MODE_NORMAL fetch through the lut
+ * (enable = 1, default) or through the ACCURATE procedures (enable = 0,
+ * exact field expansion, some channels differ by one from the lut and
+ * fetch / fetchpixel stay consistent). returns previous setting. */
+int ipixel_set_lut16(int enable);
+
 
 /* find the best fit color in palette */
 int ipixel_palette_fit(const IRGB *pal, int r, int g, int b, int palsize);
@@ -598,7 +652,8 @@ void ipixel_card_over(IUINT32 *dst, int size, const IUINT32 *card,
 /* card permute */
 void ipixel_card_permute(IUINT32 *card, int w, int a, int b, int c, int d);
 
-/* card proc set */
+/* card proc set: id 0=multi, 1=mask, 2=cover, 3=over, 4=permute,
+ * 5=reverse, proc == NULL restores the default one */
 void ipixel_card_set_proc(int id, void *proc);
 
 
@@ -2454,8 +2509,8 @@ extern IUINT32 _ipixel_cvt_lut_B2G2R2A2[256];
 		IUINT32 __DST_AG = ((color_dst) >> 8) & 0xff00ff; \
 		__DST_RB *= __A; \
 		__DST_AG *= __A; \
-		__DST_RB += __DST_RB >> 8; \
-		__DST_AG += __DST_AG >> 8; \
+		__DST_RB += (__DST_RB >> 8) & 0xff00ff; \
+		__DST_AG += (__DST_AG >> 8) & 0xff00ff; \
 		__DST_RB >>= 8; \
 		__DST_AG &= 0xff00ff00; \
 		__A = (__DST_RB & 0xff00ff) | __DST_AG; \
@@ -2481,8 +2536,8 @@ extern IUINT32 _ipixel_cvt_lut_B2G2R2A2[256];
 		__r2 = 255 - (__r2 >> 24); \
 		__r3 *= __r2; \
 		__r4 *= __r2; \
-		__r3 = ((__r3 + (__r3 >> 8)) >> 8) & 0xff00ff; \
-		__r4 = (__r4 + (__r4 >> 8)) & 0xff00ff00; \
+		__r3 = ((__r3 + ((__r3 >> 8) & 0xff00ff)) >> 8) & 0xff00ff; \
+		__r4 = (__r4 + ((__r4 >> 8) & 0xff00ff)) & 0xff00ff00; \
 		(color_dst) = (__r3 | __r4) + (__r1); \
 	}	while (0)
 
@@ -9,6 +9,10 @@
 
 #include "ibmcols.h"
 #include "ibmbits.h"
+#include "ibmtrace.h"
+#include "ibmtask.h"
+
+#include <math.h>
 
 
 #ifdef __BORLANDC__
@@ -19,6 +23,39 @@
 extern void*(*icmalloc)(size_t size);
 extern void (*icfree)(void *ptr);
 
+
+//---------------------------------------------------------------------
+// dispatch statistics
+//---------------------------------------------------------------------
+#ifdef IBITMAP_STATS
+typedef volatile IINT64 iStatsCounter[IBITMAP_STATS_COUNT][IPIX_FMT_COUNT];
+
+static iStatsCounter ibitmap_stats_calls;
+static iStatsCounter ibitmap_stats_pixels;
+
+// fetchers run in pool bands, so the counters are updated atomically
+#if defined(_WIN32) || defined(WIN32)
+#include <windows.h>
+#define IBITMAP_STATS_INC(ptr, n) \
+	InterlockedExchangeAdd64((LONGLONG volatile*)(ptr), (LONGLONG)(n))
+#define IBITMAP_STATS_LOAD(ptr) \
+	InterlockedCompareExchange64((LONGLONG volatile*)(ptr), 0, 0)
+#else
+#define IBITMAP_STATS_INC(ptr, n) __sync_fetch_and_add(ptr, (IINT64)(n))
+#define IBITMAP_STATS_LOAD(ptr) __sync_fetch_and_add(ptr, 0)
+#endif
+
+#define IBITMAP_STATS_ADD(path, fmt, n) do { \
+		int __fmt = (int)(fmt); \
+		if (__fmt >= 0 && __fmt < IPIX_FMT_COUNT) { \
+			IBITMAP_STATS_INC(&ibitmap_stats_calls[path][__fmt], 1); \
+			IBITMAP_STATS_INC(&ibitmap_stats_pixels[path][__fmt], n); \
+		} \
+	}	while (0)
+#else
+#define IBITMAP_STATS_ADD(path, fmt, n) do { } while (0)
+#endif
+
 //---------------------------------------------------------------------
 // λͼ
 //---------------------------------------------------------------------
@@ -82,7 +119,7 @@ void ibitmap_filter_set(IBITMAP *bmp, enum IPIXELFILTER filter)
 {
 	IMODE mode;
 	mode.mode = bmp->mode;
-	mode.filter = (unsigned char)(filter & 3);
+	mode.filter = (unsigned char)(filter & 7);
 	bmp->mode = mode.mode;
 }
 
@@ -129,16 +166,67 @@ int ibitmap_clipex(const IBITMAP *dst, int *dx, int *dy, const IBITMAP *src,
 	return 0;
 }
 
+// ɫ/תֿÿʹԼл
+typedef struct
+{
+	IBITMAP *dst;
+	const IBITMAP *src;
+	int dx, dy, sx, sy, w, h;
+	int dfmt, sfmt, flip;
+	int operate;				// СʱΪ ipixel_convert
+	IUINT32 color;
+	const iColorIndex *dindex;
+	const iColorIndex *sindex;
+}	iBlendTask;
+
+static void ibitmap_blend_band(void *ctx, int top, int bottom)
+{
+	iBlendTask *task = (iBlendTask*)ctx;
+	unsigned char _buffer[IBITMAP_STACK_BUFFER];
+	unsigned char *buffer = _buffer;
+	int sy;
+
+	if (task->w * 4 > IBITMAP_STACK_BUFFER) {
+		buffer = (unsigned char*)icmalloc(task->w * 4);
+		if (buffer == NULL) return;
+	}
+
+	// ֱתʱӦԴ [h - bottom, h - top) 
+	if (task->flip & IPIXEL_FLIP_VFLIP) {
+		sy = task->sy + task->h - bottom;
+	}	else {
+		sy = task->sy + top;
+	}
+
+	if (task->operate < 0) {
+		ipixel_convert(task->dfmt, task->dst->line[task->dy + top], 
+			(long)task->dst->pitch, task->dx, task->sfmt, 
+			task->src->line[sy], (long)task->src->pitch, task->sx, 
+			task->w, bottom - top, 0, task->flip, task->dindex, 
+			task->sindex, buffer);
+	}	else {
+		ipixel_blend(task->dfmt, task->dst->line[task->dy + top], 
+			(long)task->dst->pitch, task->dx, task->sfmt, 
+			task->src->line[sy], (long)task->src->pitch, task->sx, 
+			task->w, bottom - top, task->color, task->operate, 
+			task->flip, task->dindex, task->sindex, buffer);
+	}
+
+	if (buffer != _buffer) {
+		icfree(buffer);
+	}
+}
+
 // ɫ
 void ibitmap_blend(IBITMAP *dst, int dx, int dy, const IBITMAP *src, int sx, 
 	int sy, int w, int h, IUINT32 color, const IRECT *clip, int flags)
 {
-	unsigned char _buffer[IBITMAP_STACK_BUFFER];
-	unsigned char *buffer = _buffer;
 	int operate = IPIXEL_BLEND_OP_BLEND;
 	int retval = 0, flip = 0, sfmt, dfmt;
 	const iColorIndex *sindex;
 	const iColorIndex *dindex;
+	iBlendTask task;
+	IBITMAP_TRACE_BEGIN(tracets);
 
 	if ((flags & IBLIT_NOCLIP) == 0) {
 		retval = ibitmap_clipex(dst, &dx, &dy, src, &sx, &sy, &w, &h, 
@@ -146,11 +234,6 @@ void ibitmap_blend(IBITMAP *dst, int dx, int dy, const IBITMAP *src, int sx,
 		if (retval) return;
 	}
 
-	if (w * 4 > IBITMAP_STACK_BUFFER) {
-		buffer = (unsigned char*)icmalloc(w * 4);
-		if (buffer == NULL) return;
-	}
-
 	if (flags & IBLIT_ADDITIVE) 
 		operate = IPIXEL_BLEND_OP_ADD;
 
@@ -166,24 +249,35 @@ void ibitmap_blend(IBITMAP *dst, int dx, int dy, const IBITMAP *src, int sx,
 	if (sindex == NULL) sindex = _ipixel_src_index;
 	if (dindex == NULL) dindex = _ipixel_dst_index;
 
-	ipixel_blend(dfmt, dst->line[dy], (long)dst->pitch, dx, sfmt,
-		src->line[sy], (long)src->pitch, sx, w, h, color, 
-		operate, flip, dindex, sindex, buffer);
-
-	if (buffer != _buffer) {
-		icfree(buffer);
-	}
+	task.dst = dst;
+	task.src = src;
+	task.dx = dx;
+	task.dy = dy;
+	task.sx = sx;
+	task.sy = sy;
+	task.w = w;
+	task.h = h;
+	task.dfmt = dfmt;
+	task.sfmt = sfmt;
+	task.flip = flip;
+	task.operate = operate;
+	task.color = color;
+	task.dindex = dindex;
+	task.sindex = sindex;
+
+	ipixel_task_bands(ibitmap_blend_band, &task, w, h);
+
+	IBITMAP_TRACE_END(tracets, "ibitmap_blend", w, h, sfmt, dfmt);
 }
 
 // ʽת
 void ibitmap_convert(IBITMAP *dst, int dx, int dy, const IBITMAP *src,
 	int sx, int sy, int w, int h, const IRECT *clip, int flags)
 {
-	unsigned char _buffer[IBITMAP_STACK_BUFFER];
-	unsigned char *buffer = _buffer;
 	int retval = 0, flip = 0, sfmt, dfmt;
 	const iColorIndex *sindex;
 	const iColorIndex *dindex;
+	iBlendTask task;
 
 	if ((flags & IBLIT_NOCLIP) == 0) {
 		retval = ibitmap_clipex(dst, &dx, &dy, src, &sx, &sy, &w, &h,
@@ -210,19 +304,24 @@ void ibitmap_convert(IBITMAP *dst, int dx, int dy, const IBITMAP *src,
 		return;
 	}
 
-	if (w * 4 > IBITMAP_STACK_BUFFER) {
-		buffer = (unsigned char*)icmalloc(w * 4);
-		if (buffer == NULL) return;
-	}
-	
-	// execute converting
-	ipixel_convert(dfmt, dst->line[dy], (long)dst->pitch, dx, sfmt,
-		src->line[sy], (long)src->pitch, sx, w, h, 0, 
-		flip, dindex, sindex, buffer);
+	task.dst = dst;
+	task.src = src;
+	task.dx = dx;
+	task.dy = dy;
+	task.sx = sx;
+	task.sy = sy;
+	task.w = w;
+	task.h = h;
+	task.dfmt = dfmt;
+	task.sfmt = sfmt;
+	task.flip = flip;
+	task.operate = -1;
+	task.color = 0;
+	task.dindex = dindex;
+	task.sindex = sindex;
 
-	if (buffer != _buffer) {
-		icfree(buffer);
-	}
+	// execute converting
+	ipixel_task_bands(ibitmap_blend_band, &task, w, h);
 }
 
 
@@ -650,6 +749,144 @@ static inline IUINT32 ibitmap_fetch_pixel_bilinear(const IBITMAP *bmp,
 }
 
 
+//---------------------------------------------------------------------
+// ˣ˫ (a = -0.5)  Lanczos-3ȨΪ 14 λ
+//---------------------------------------------------------------------
+#define IBITMAP_KERNEL_BITS		14
+#define IBITMAP_KERNEL_PHASE	64
+
+// ˰뾶
+static int ibitmap_kernel_radius(int filter)
+{
+	return (filter == IPIXEL_FILTER_LANCZOS)? 3 : 2;
+}
+
+// ˵ֵ
+static double ibitmap_kernel_eval(int filter, double x)
+{
+	if (x < 0.0) x = -x;
+	if (filter == IPIXEL_FILTER_LANCZOS) {
+		const double pi = 3.14159265358979323846;
+		if (x < 1e-8) return 1.0;
+		if (x >= 3.0) return 0.0;
+		return 3.0 * sin(pi * x) * sin(pi * x / 3.0) / (pi * pi * x * x);
+	}
+	if (x < 1.0) return (1.5 * x - 2.5) * x * x + 1.0;
+	if (x < 2.0) return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0;
+	return 0.0;
+}
+
+// ȨתΪ㣬֤ܺΪ 1 << IBITMAP_KERNEL_BITS
+static void ibitmap_kernel_normalize(IINT16 *weight, const double *value, 
+	int taps)
+{
+	double sum = 0.0;
+	int total = 0, peak = 0, i;
+	for (i = 0; i < taps; i++) sum += value[i];
+	if (sum == 0.0) sum = 1.0;
+	for (i = 0; i < taps; i++) {
+		double w = value[i] * (1 << IBITMAP_KERNEL_BITS) / sum;
+		weight[i] = (IINT16)((w < 0.0)? (w - 0.5) : (w + 0.5));
+		total += weight[i];
+		if (weight[i] > weight[peak]) peak = i;
+	}
+	weight[peak] += (IINT16)((1 << IBITMAP_KERNEL_BITS) - total);
+}
+
+// õķȨر[0] ˫Σ[1] Lanczos
+static IINT16 ibitmap_kernel_phase_table[2][IBITMAP_KERNEL_PHASE][6];
+static ipixel_once_t ibitmap_kernel_phase_once[2] = { 
+	IPIXEL_ONCE_INIT, IPIXEL_ONCE_INIT };
+
+static void ibitmap_kernel_phase_build(int filter)
+{
+	int id = (filter == IPIXEL_FILTER_LANCZOS)? 1 : 0;
+	int radius = ibitmap_kernel_radius(filter);
+	double value[6];
+	int p, k;
+	for (p = 0; p < IBITMAP_KERNEL_PHASE; p++) {
+		double t = (double)p / IBITMAP_KERNEL_PHASE;
+		for (k = 0; k < radius * 2; k++) {
+			value[k] = ibitmap_kernel_eval(filter, k - (radius - 1) - t);
+		}
+		ibitmap_kernel_normalize(ibitmap_kernel_phase_table[id][p], 
+			value, radius * 2);
+	}
+}
+
+static void ibitmap_kernel_phase_bicubic(void)
+{
+	ibitmap_kernel_phase_build(IPIXEL_FILTER_BICUBIC);
+}
+
+static void ibitmap_kernel_phase_lanczos(void)
+{
+	ibitmap_kernel_phase_build(IPIXEL_FILTER_LANCZOS);
+}
+
+// ȡ÷Ȩرtaps Ϊ 4  6
+static const IINT16 *ibitmap_kernel_phase(int filter, int *taps)
+{
+	if (filter == IPIXEL_FILTER_LANCZOS) {
+		IPIXEL_ONCE(&ibitmap_kernel_phase_once[1], 
+			ibitmap_kernel_phase_lanczos);
+		*taps = 6;
+		return &ibitmap_kernel_phase_table[1][0][0];
+	}
+	IPIXEL_ONCE(&ibitmap_kernel_phase_once[0], ibitmap_kernel_phase_bicubic);
+	*taps = 4;
+	return &ibitmap_kernel_phase_table[0][0][0];
+}
+
+// ˫ / Lanczos ˮƽٴֱ ibitmap_scale ͬľ
+static IUINT32 ibitmap_fetch_pixel_kernel(const IBITMAP *bmp,
+	cfixed x, cfixed y, const IRECT *clip, iFetchPixelProc get_pixel,
+	int filter)
+{
+	const iColorIndex *index = (const iColorIndex*)bmp->extra;
+	const IINT16 *wx, *wy;
+	IINT32 sum[4], x1, y1;
+	int taps, inside, i, j, c;
+	IUINT32 cc;
+	wx = ibitmap_kernel_phase(filter, &taps);
+	x1 = x - cfixed_const_1 / 2;
+	y1 = y - cfixed_const_1 / 2;
+	wy = wx + ((y1 >> 10) & (IBITMAP_KERNEL_PHASE - 1)) * 6;
+	wx = wx + ((x1 >> 10) & (IBITMAP_KERNEL_PHASE - 1)) * 6;
+	x1 = cfixed_to_int(x1) - (taps / 2 - 1);
+	y1 = cfixed_to_int(y1) - (taps / 2 - 1);
+	inside = (x1 >= clip->left && y1 >= clip->top && 
+		x1 + taps <= clip->right && y1 + taps <= clip->bottom);
+	if (inside == 0 && ibitmap_overflow_get_fast(bmp) == IBOM_TRANSPARENT) {
+		if (x1 >= clip->right || y1 >= clip->bottom ||
+			x1 + taps <= clip->left || y1 + taps <= clip->top)
+			return (IUINT32)bmp->mask;
+	}
+	sum[0] = sum[1] = sum[2] = sum[3] = 0;
+	for (j = 0; j < taps; j++) {
+		IINT32 row[4] = { 0, 0, 0, 0 };
+		for (i = 0; i < taps; i++) {
+			if (inside) cc = get_pixel(bmp->line[y1 + j], x1 + i, index);
+			else cc = ibitmap_fetch_pixel(bmp, x1 + i, y1 + j, clip, 
+				get_pixel);
+			row[0] += (IINT32)(cc & 0xff) * wx[i];
+			row[1] += (IINT32)((cc >> 8) & 0xff) * wx[i];
+			row[2] += (IINT32)((cc >> 16) & 0xff) * wx[i];
+			row[3] += (IINT32)(cc >> 24) * wx[i];
+		}
+		for (c = 0; c < 4; c++) {
+			sum[c] += ((row[c] + 128) >> 8) * wy[j];
+		}
+	}
+	for (c = 0, cc = 0; c < 4; c++) {
+		IINT32 v = (sum[c] + (1 << 19)) >> 20;
+		v = (v < 0)? 0 : ((v > 255)? 255 : v);
+		cc |= (IUINT32)v << (c * 8);
+	}
+	return cc;
+}
+
+
 
 
 //=====================================================================
@@ -661,23 +898,20 @@ static iBitmapFetchFloat ibitmap_fetch_float_table[IPIX_FMT_COUNT][2];
 // պб
 static void ibitmap_fetch_proc_table_clear(void)
 {
-	static int inited = 0;
-	if (inited == 0) {
-		int i, j;
-		for (i = 0; i < IPIX_FMT_COUNT; i++) {
-			for (j = 0; j < 18; j++) {
-				ibitmap_fetch_proc_table[i][j][0] = NULL;
-				ibitmap_fetch_proc_table[i][j][1] = NULL;
-			}
-			ibitmap_fetch_float_table[i][0] = NULL;
-			ibitmap_fetch_float_table[i][1] = NULL;
+	int i, j;
+	for (i = 0; i < IPIX_FMT_COUNT; i++) {
+		for (j = 0; j < 18; j++) {
+			ibitmap_fetch_proc_table[i][j][0] = NULL;
+			ibitmap_fetch_proc_table[i][j][1] = NULL;
 		}
-		inited = 1;
+		ibitmap_fetch_float_table[i][0] = NULL;
+		ibitmap_fetch_float_table[i][1] = NULL;
 	}
 }
 
 // ʼб
 static void ibitmap_fetch_proc_table_init(void);
+static ipixel_once_t ibitmap_fetch_proc_once = IPIXEL_ONCE_INIT;
 
 
 // ͨöȡɨ
@@ -697,12 +931,8 @@ static void ibitmap_fetch_general_float(const IBITMAP *bmp, IUINT32 *card,
 iBitmapFetchProc ibitmap_scanline_get_proc(int pixfmt, int mode, int isdef)
 {
 	iBitmapFetchProc proc;
-	static int inited = 0;
 
-	if (inited == 0) {
-		ibitmap_fetch_proc_table_init();
-		inited = 1;
-	}
+	IPIXEL_ONCE(&ibitmap_fetch_proc_once, ibitmap_fetch_proc_table_init);
 
 	assert(pixfmt >= 0 && pixfmt < IPIX_FMT_COUNT && mode >= 0 && mode < 18);
 
@@ -712,6 +942,7 @@ iBitmapFetchProc ibitmap_scanline_get_proc(int pixfmt, int mode, int isdef)
 	proc = ibitmap_fetch_proc_table[pixfmt][mode][(isdef)? 0 : 1];
 
 	if (proc == NULL) {
+		IBITMAP_STATS_ADD(IBITMAP_STATS_FETCH_LOOKUP_MISS, pixfmt, 0);
 		return ibitmap_fetch_general;
 	}
 
@@ -722,12 +953,8 @@ iBitmapFetchProc ibitmap_scanline_get_proc(int pixfmt, int mode, int isdef)
 iBitmapFetchFloat ibitmap_scanline_get_float(int pixfmt, int isdefault)
 {
 	iBitmapFetchFloat proc;
-	static int inited = 0;
 
-	if (inited == 0) {
-		ibitmap_fetch_proc_table_init();
-		inited = 1;
-	}
+	IPIXEL_ONCE(&ibitmap_fetch_proc_once, ibitmap_fetch_proc_table_init);
 
 	assert(pixfmt >= 0 && pixfmt < IPIX_FMT_COUNT);
 
@@ -737,6 +964,7 @@ iBitmapFetchFloat ibitmap_scanline_get_float(int pixfmt, int isdefault)
 	proc = ibitmap_fetch_float_table[pixfmt][(isdefault)? 0 : 1];
 
 	if (proc == NULL) {
+		IBITMAP_STATS_ADD(IBITMAP_STATS_FETCH_LOOKUP_MISS, pixfmt, 0);
 		return ibitmap_fetch_general_float;
 	}
 
@@ -749,11 +977,7 @@ iBitmapFetchFloat ibitmap_scanline_get_float(int pixfmt, int isdefault)
 //---------------------------------------------------------------------
 void ibitmap_scanline_set_proc(int pixfmt, int mode, iBitmapFetchProc proc)
 {
-	static int inited = 0;
-	if (inited == 0) {
-		ibitmap_fetch_proc_table_init();
-		inited = 1;
-	}
+	IPIXEL_ONCE(&ibitmap_fetch_proc_once, ibitmap_fetch_proc_table_init);
 	assert(pixfmt >= 0 && pixfmt < IPIX_FMT_COUNT && mode >= 0 && mode < 18);
 
 	if (pixfmt < 0 || pixfmt >= IPIX_FMT_COUNT || mode < 0 || mode >= 18)
@@ -765,11 +989,7 @@ void ibitmap_scanline_set_proc(int pixfmt, int mode, iBitmapFetchProc proc)
 // ɨ߸㺯
 void ibitmap_scanline_set_float(int pixfmt, iBitmapFetchFloat proc)
 {
-	static int inited = 0;
-	if (inited == 0) {
-		ibitmap_fetch_proc_table_init();
-		inited = 1;
-	}
+	IPIXEL_ONCE(&ibitmap_fetch_proc_once, ibitmap_fetch_proc_table_init);
 	assert(pixfmt >= 0 && pixfmt < IPIX_FMT_COUNT);
 
 	if (pixfmt < 0 || pixfmt >= IPIX_FMT_COUNT)
@@ -791,9 +1011,15 @@ int ibitmap_scanline_get_mode(const IBITMAP *bmp, const cfixed *src,
 	int index;
 
 	overflow = (IBOM)ibitmap_imode_const(bmp, overflow);
-	filter = (IPIXELFILTER)ibitmap_imode_const(bmp, filter);
+	filter = (IPIXELFILTER)ibitmap_filter_sample(bmp);
+
+	// kernel filters are only sampled by the general fetchers
+	if (filter == IPIXEL_FILTER_BICUBIC || filter == IPIXEL_FILTER_LANCZOS)
+		return IBITMAP_FETCH_GENERAL_NEAREST;
 
 	if (src[2] != cfixed_const_1 || step[1] != 0 || step[2] != 0) {
+		IBITMAP_STATS_ADD(IBITMAP_STATS_FETCH_MODE_GENERAL, 
+			ibitmap_imode_const(bmp, pixfmt), 0);
 		if (filter == IPIXEL_FILTER_BILINEAR) 
 			return IBITMAP_FETCH_GENERAL_BILINEAR;
 		return IBITMAP_FETCH_GENERAL_NEAREST;
@@ -808,6 +1034,8 @@ int ibitmap_scanline_get_mode(const IBITMAP *bmp, const cfixed *src,
 	case IBOM_WRAP: index = IBITMAP_FETCH_WRAP_TRANSLATE_NEAREST; break;
 	case IBOM_MIRROR: index = IBITMAP_FETCH_MIRROR_TRANSLATE_NEAREST; break;
 	default:
+		IBITMAP_STATS_ADD(IBITMAP_STATS_FETCH_MODE_GENERAL, 
+			ibitmap_imode_const(bmp, pixfmt), 0);
 		if (filter == IPIXEL_FILTER_BILINEAR) 
 			return IBITMAP_FETCH_GENERAL_BILINEAR;
 		return IBITMAP_FETCH_GENERAL_NEAREST;
@@ -839,9 +1067,29 @@ static void ibitmap_fetch_general(const IBITMAP *bmp, IUINT32 *card,
 	dw = step[2];
 
 	mode = ibitmap_overflow_get_fast(bmp);
-	filter = (IPIXELFILTER)ibitmap_imode_const(bmp, filter);
+	filter = (IPIXELFILTER)ibitmap_filter_sample(bmp);
 	proc = ipixel_get_fetchpixel(ibitmap_imode_const(bmp, pixfmt), 0);
 
+	IBITMAP_STATS_ADD(IBITMAP_STATS_FETCH_GENERAL, 
+		ibitmap_imode_const(bmp, pixfmt), width);
+
+	if (filter == IPIXEL_FILTER_BICUBIC || filter == IPIXEL_FILTER_LANCZOS) {
+		for (; width > 0; u += du, v += dv, w += dw, card++, width--) {
+			if (mask != NULL && *mask++ == 0) continue;
+			if (w == cfixed_const_1) {
+				x = u, y = v;
+			}	else if (w != 0) {
+				x = cfixed_div(u, w);
+				y = cfixed_div(v, w);
+			}	else {
+				x = 0, y = 0;
+			}
+			*card = ibitmap_fetch_pixel_kernel(bmp, x, y, clip, proc, 
+				(int)filter);
+		}
+		return;
+	}
+
 	if (filter == IPIXEL_FILTER_BILINEAR) {
 		if (w == cfixed_const_1 && dw == 0) {
 			if (mask == NULL) {
@@ -887,7 +1135,7 @@ static void ibitmap_fetch_general(const IBITMAP *bmp, IUINT32 *card,
 			}
 		}
 	}
-	else if (filter == IPIXEL_FILTER_NEAREST) {
+	else {
 		if (w == cfixed_const_1 && dw == 0) {
 			if (mask == NULL) {
 				for (; width > 0; u += du, v += dv, card++, width--) {
@@ -953,9 +1201,24 @@ static void ibitmap_fetch_general_float(const IBITMAP *bmp, IUINT32 *card,
 	dw = step[2];
 
 	mode = ibitmap_overflow_get_fast(bmp);
-	filter = (IPIXELFILTER)ibitmap_imode_const(bmp, filter);
+	filter = (IPIXELFILTER)ibitmap_filter_sample(bmp);
 	proc = ipixel_get_fetchpixel(ibitmap_imode_const(bmp, pixfmt), 0);
 
+	IBITMAP_STATS_ADD(IBITMAP_STATS_FETCH_GENERAL_FLOAT, 
+		ibitmap_imode_const(bmp, pixfmt), width);
+
+	if (filter == IPIXEL_FILTER_BICUBIC || filter == IPIXEL_FILTER_LANCZOS) {
+		for (; width > 0; u += du, v += dv, w += dw, card++, width--) {
+			if (mask != NULL && *mask++ == 0) continue;
+			iw = (w == 0.0f)? 0.0f : (65536.0f / w);
+			x = (cfixed)(u * iw);
+			y = (cfixed)(v * iw);
+			*card = ibitmap_fetch_pixel_kernel(bmp, x, y, clip, proc, 
+				(int)filter);
+		}
+		return;
+	}
+
 	if (cfloat_ieee_enable()) {
 		if (filter == IPIXEL_FILTER_BILINEAR) {
 			if (w == 1.0f && dw == 0.0f) {
@@ -989,7 +1252,7 @@ static void ibitmap_fetch_general_float(const IBITMAP *bmp, IUINT32 *card,
 				}
 			}
 		}
-		else if (filter == IPIXEL_FILTER_NEAREST) {
+		else {
 			if (w == 1.0f && dw == 0.0f) {
 				if (mask == NULL) {
 					for (; width > 0; u += du, v += dv, card++, width--) {
@@ -1054,7 +1317,7 @@ static void ibitmap_fetch_general_float(const IBITMAP *bmp, IUINT32 *card,
 			}
 		}
 	}
-	else if (filter == IPIXEL_FILTER_NEAREST) {
+	else {
 		if (w == 1.0f && dw == 0.0f) {
 			if (mask == NULL) {
 				for (; width > 0; u += du, v += dv, card++, width--) {
@@ -1401,8 +1664,12 @@ static void ibitmap_fetch_general_##fmt(const IBITMAP *bmp, IUINT32 *card, \
 	dv = step[1]; \
 	dw = step[2]; \
 	mode = ibitmap_overflow_get_fast(bmp); \
-	filter = (IPIXELFILTER)ibitmap_imode_const(bmp, filter); \
-	if (filter == IPIXEL_FILTER_BILINEAR) { \
+	filter = (IPIXELFILTER)ibitmap_filter_sample(bmp); \
+	if (filter == IPIXEL_FILTER_BICUBIC || \
+		filter == IPIXEL_FILTER_LANCZOS) { \
+		ibitmap_fetch_general(bmp, card, width, source, step, mask, clip); \
+	} \
+	else if (filter == IPIXEL_FILTER_BILINEAR) { \
 		if (w == cfixed_const_1 && dw == 0) { \
 			for (; width > 0; u += du, v += dv, card++, width--) { \
 				*card = ibitmap_fetch_pixel_bilinear_##fmt(	\
@@ -1420,7 +1687,7 @@ static void ibitmap_fetch_general_##fmt(const IBITMAP *bmp, IUINT32 *card, \
 			} \
 		} \
 	} \
-	else if (filter == IPIXEL_FILTER_NEAREST) { \
+	else { \
 		if (w == cfixed_const_1 && dw == 0) { \
 			for (; width > 0; u += du, v += dv, card++, width--) { \
 				*card = ibitmap_fetch_pixel_nearest_##fmt( \
@@ -1619,7 +1886,7 @@ void ibitmap_fetch_scale_A8R8G8B8_nearest(const IBITMAP *bmp, IUINT32 *card,
 	const IUINT8 *cover, const IRECT *clip)
 {
 	int pixfmt = ibitmap_pixfmt_guess(bmp);
-	int filter = ibitmap_imode_const(bmp, filter);
+	int filter = ibitmap_filter_sample(bmp);
 	int overflow = ibitmap_imode_const(bmp, overflow);
 	cfixed u = source[0] - cfixed_const_e;
 	cfixed v = source[1] - cfixed_const_e;
@@ -1728,7 +1995,7 @@ void ibitmap_fetch_scale_A8R8G8B8_bilinear(const IBITMAP *bmp, IUINT32 *card,
 	const IUINT8 *cover, const IRECT *clip)
 {
 	int pixfmt = ibitmap_pixfmt_guess(bmp);
-	int filter = ibitmap_imode_const(bmp, filter);
+	int filter = ibitmap_filter_sample(bmp);
 	int overflow = ibitmap_imode_const(bmp, overflow);
 	cfixed x = source[0] - cfixed_const_half;
 	cfixed y = source[1] - cfixed_const_half;
@@ -1972,9 +2239,7 @@ void ibitmap_fetch_scale_A8R8G8B8_bilinear(const IBITMAP *bmp, IUINT32 *card,
 // ʼұ
 static void ibitmap_fetch_proc_table_init(void)
 {
-	static int inited = 0;
 	int fmt, i;
-	if (inited != 0) return;
 	ibitmap_fetch_proc_table_clear();
 	#define ibitmap_fetch_proc_table_init_general(fmt) do { \
 				int z; \
@@ -2063,7 +2328,6 @@ static void ibitmap_fetch_proc_table_init(void)
 	#endif
 #endif
 	#undef ibitmap_fetch_proc_table_init_general
-	inited = 1;
 }
 
 
@@ -2995,9 +3259,598 @@ int ibitmap_clip_scale(const IRECT *clipdst, const IRECT *clipsrc,
 }
 
 
-// Ż
-int ibitmap_scale(IBITMAP *dst, const IRECT *bound_dst, const IBITMAP *src,
-	const IRECT *bound_src, const IRECT *clip, int mode)
+//---------------------------------------------------------------------
+// ˫ţˮƽ˲ԴллλУÿĿֻ
+// ֱֵŴʱĿйԴжԣˮƽ˲ֻһΡ
+//---------------------------------------------------------------------
+
+// Ķ룬ԵȡȨ 8 λ
+static void ibitmap_scale_table(IINT32 *idx0, IINT32 *idx1, IINT32 *dist,
+	int dstsize, int srcsize, int flip)
+{
+	int i;
+	for (i = 0; i < dstsize; i++) {
+		int k = flip? (dstsize - 1 - i) : i;
+		IINT64 num = (IINT64)(2 * i + 1) * srcsize - dstsize;
+		IINT32 pos = (num <= 0)? 0 : (IINT32)((num * 128) / dstsize);
+		IINT32 p0 = pos >> 8;
+		IINT32 p1 = p0 + 1;
+		if (p0 >= srcsize - 1) p0 = srcsize - 1, pos = 0;
+		if (p1 >= srcsize - 1) p1 = srcsize - 1;
+		idx0[k] = p0;
+		idx1[k] = p1;
+		dist[k] = pos & 0xff;
+	}
+}
+
+// ˮƽ˲һУ 16 λȣ
+static void ibitmap_scale_horz(IUINT16 *row, const IUINT32 *card, 
+	const IINT32 *xidx0, const IINT32 *xidx1, const IINT32 *xdist, int w)
+{
+	int i;
+	for (i = 0; i < w; i++) {
+		IUINT32 c0 = card[xidx0[i]];
+		IUINT32 c1 = card[xidx1[i]];
+		IUINT32 d1 = (IUINT32)xdist[i];
+		IUINT32 d0 = 256 - d1;
+		row[0] = (IUINT16)((c0 & 0xff) * d0 + (c1 & 0xff) * d1);
+		row[1] = (IUINT16)(((c0 >> 8) & 0xff) * d0 + ((c1 >> 8) & 0xff) * d1);
+		row[2] = (IUINT16)(((c0 >> 16) & 0xff) * d0 + 
+			((c1 >> 16) & 0xff) * d1);
+		row[3] = (IUINT16)((c0 >> 24) * d0 + (c1 >> 24) * d1);
+		row += 4;
+	}
+}
+
+// ֱֵ ipixel_biline_interp һ
+static void ibitmap_scale_vert(IUINT32 *card, const IUINT16 *row0,
+	const IUINT16 *row1, IUINT32 d1, int w)
+{
+	IUINT32 d0 = 256 - d1;
+	int i;
+	if (d1 == 0) {
+		for (i = 0; i < w; i++, row0 += 4) {
+			card[i] = ((IUINT32)(row0[0] >> 8)) | 
+				((IUINT32)(row0[1] >> 8) << 8) |
+				((IUINT32)(row0[2] >> 8) << 16) |
+				((IUINT32)(row0[3] >> 8) << 24);
+		}
+		return;
+	}
+	for (i = 0; i < w; i++, row0 += 4, row1 += 4) {
+		IUINT32 b = (row0[0] * d0 + row1[0] * d1) >> 16;
+		IUINT32 g = (row0[1] * d0 + row1[1] * d1) >> 16;
+		IUINT32 r = (row0[2] * d0 + row1[2] * d1) >> 16;
+		IUINT32 a = (row0[3] * d0 + row1[3] * d1) >> 16;
+		card[i] = b | (g << 8) | (r << 16) | (a << 24);
+	}
+}
+
+// ˫ţѾüϣ֧ IBLIT_MASK
+static int ibitmap_scale_bilinear(IBITMAP *dst, const IRECT *dstrect,
+	const IBITMAP *src, const IRECT *srcrect, int mode,
+	const iColorIndex *dindex, const iColorIndex *sindex, int j0, int j1)
+{
+	int dw = dstrect->right - dstrect->left;
+	int dh = dstrect->bottom - dstrect->top;
+	int sw = srcrect->right - srcrect->left;
+	int sh = srcrect->bottom - srcrect->top;
+	IINT32 *xidx0, *xidx1, *xdist;
+	IINT32 *yidx0, *yidx1, *ydist;
+	IUINT32 *card, *output;
+	IUINT16 *rows[2];
+	int tags[2];
+	iFetchProc fetch;
+	iStoreProc store;
+	char *buffer;
+	long size;
+	int j;
+
+	if (dw <= 0 || dh <= 0 || sw <= 0 || sh <= 0)
+		return -1;
+
+	size = ((long)dw * 3 + (long)dh * 3) * sizeof(IINT32) + 
+		((long)sw + (long)dw) * sizeof(IUINT32) + (long)dw * 16;
+
+	buffer = (char*)icmalloc(size);
+	if (buffer == NULL) return -2;
+
+	xidx0 = (IINT32*)buffer;
+	xidx1 = xidx0 + dw;
+	xdist = xidx1 + dw;
+	yidx0 = xdist + dw;
+	yidx1 = yidx0 + dh;
+	ydist = yidx1 + dh;
+	card = (IUINT32*)(ydist + dh);
+	output = card + sw;
+	rows[0] = (IUINT16*)(output + dw);
+	rows[1] = rows[0] + dw * 4;
+	tags[0] = -1;
+	tags[1] = -1;
+
+	ibitmap_scale_table(xidx0, xidx1, xdist, dw, sw, mode & IBLIT_HFLIP);
+	ibitmap_scale_table(yidx0, yidx1, ydist, dh, sh, mode & IBLIT_VFLIP);
+
+	fetch = ipixel_get_fetch(ibitmap_pixfmt_guess(src), 0);
+	store = ipixel_get_store(ibitmap_pixfmt_guess(dst), 0);
+
+	for (j = j0; j < j1; j++) {
+		int need[2], slot[2], k;
+		need[0] = yidx0[j];
+		need[1] = yidx1[j];
+		slot[0] = (tags[0] == need[0])? 0 : ((tags[1] == need[0])? 1 : -1);
+		slot[1] = (tags[0] == need[1])? 0 : ((tags[1] == need[1])? 1 : -1);
+		for (k = 0; k < 2; k++) {
+			if (slot[k] < 0) {
+				// ̭һ㲻ʹõ
+				int s = (slot[k ^ 1] == 0)? 1 : 0;
+				fetch(src->line[srcrect->top + need[k]], srcrect->left, 
+					sw, card, sindex);
+				ibitmap_scale_horz(rows[s], card, xidx0, xidx1, xdist, dw);
+				tags[s] = need[k];
+				slot[k] = s;
+				if (need[k ^ 1] == need[k]) slot[k ^ 1] = s;
+			}
+		}
+		ibitmap_scale_vert(output, rows[slot[0]], rows[slot[1]], 
+			(IUINT32)ydist[j], dw);
+		store(dst->line[dstrect->top + j], output, dstrect->left, dw, 
+			dindex);
+	}
+
+	icfree(buffer);
+
+	return 0;
+}
+
+
+//---------------------------------------------------------------------
+// ʽСȷƽÿԴֻȡһΣȰȨۼӵ
+// кͣڴ棬ԶһĿɺˮƽԼ
+//---------------------------------------------------------------------
+
+// ԴصĿصĸǣidx ΪǵĵһĿأweight Ϊ
+// еĲ֣ʣ unit - weight һĿ
+static void ibitmap_scale_box_table(IINT32 *idx, IINT32 *weight,
+	int dstsize, int srcsize, int flip, int *unit, int *span)
+{
+	int a = srcsize, b = dstsize, k;
+	IINT64 u, s;
+	while (b != 0) { int t = a % b; a = b; b = t; }
+	u = dstsize / a;
+	s = srcsize / a;
+	for (k = 0; k < srcsize; k++) {
+		IINT64 pos = k * u;
+		IINT32 i = (IINT32)(pos / s);
+		IINT64 edge = (i + 1) * s;
+		IINT32 w = (IINT32)((pos + u <= edge)? u : (edge - pos));
+		if (flip == 0) {
+			idx[k] = i;
+			weight[k] = w;
+		}	else {
+			// ת󸲸ǵ˳෴һĿؿʼ
+			idx[k] = (w < u)? (dstsize - 2 - i) : (dstsize - 1 - i);
+			weight[k] = (w < u)? (IINT32)(u - w) : w;
+		}
+	}
+	*unit = (int)u;
+	*span = (int)s;
+}
+
+// кۼӣֽ sum[i] += src[i] * weightֽ޹
+static void ibitmap_scale_box_column(IUINT32 *sum, const IUINT8 *src,
+	IUINT32 weight, int size)
+{
+	for (; size > 0; size--) {
+		*sum++ += (IUINT32)(*src++) * weight;
+	}
+}
+
+static iBoxColumnProc ibitmap_scale_box_proc = ibitmap_scale_box_column;
+
+// кۼӺNULL ָĬ
+void ibitmap_scale_box_set_proc(iBoxColumnProc proc)
+{
+	ibitmap_scale_box_proc = proc? proc : ibitmap_scale_box_column;
+}
+
+// ˮƽԼƽ
+static void ibitmap_scale_box_reduce(IUINT32 *output, IUINT64 *accum,
+	const IUINT32 *sum, const IINT32 *xidx, const IINT32 *xweight, 
+	int xunit, int sw, int dw, IUINT64 total)
+{
+	IUINT64 half = total >> 1;
+	int i, k;
+	memset(accum, 0, sizeof(IUINT64) * 4 * dw);
+	for (k = 0; k < sw; k++, sum += 4) {
+		IUINT64 *dst = accum + xidx[k] * 4;
+		IUINT32 w0 = (IUINT32)xweight[k];
+		dst[0] += (IUINT64)sum[0] * w0;
+		dst[1] += (IUINT64)sum[1] * w0;
+		dst[2] += (IUINT64)sum[2] * w0;
+		dst[3] += (IUINT64)sum[3] * w0;
+		if (w0 < (IUINT32)xunit) {
+			IUINT32 w1 = (IUINT32)xunit - w0;
+			dst[4] += (IUINT64)sum[0] * w1;
+			dst[5] += (IUINT64)sum[1] * w1;
+			dst[6] += (IUINT64)sum[2] * w1;
+			dst[7] += (IUINT64)sum[3] * w1;
+		}
+	}
+	for (i = 0; i < dw * 4; i++) {
+		((IUINT8*)output)[i] = (IUINT8)((accum[i] + half) / total);
+	}
+}
+
+// ʽСѾüϣҪ dw <= sw, dh <= sh
+static int ibitmap_scale_box(IBITMAP *dst, const IRECT *dstrect,
+	const IBITMAP *src, const IRECT *srcrect, int mode,
+	const iColorIndex *dindex, const iColorIndex *sindex, int j0, int j1)
+{
+	int dw = dstrect->right - dstrect->left;
+	int dh = dstrect->bottom - dstrect->top;
+	int sw = srcrect->right - srcrect->left;
+	int sh = srcrect->bottom - srcrect->top;
+	IINT32 *xidx, *xweight, *yidx, *yweight;
+	IUINT32 *card, *output, *sums[2];
+	int xunit, yunit, xspan, yspan;
+	IUINT64 *accum, total;
+	iFetchProc fetch;
+	iStoreProc store;
+	char *buffer;
+	long size;
+	int j, k, k0;
+
+	if (dw <= 0 || dh <= 0 || sw < dw || sh < dh)
+		return -1;
+
+	size = (long)dw * 4 * sizeof(IUINT64) + 
+		(long)(sw * 2 + sh * 2) * sizeof(IINT32) +
+		(long)(sw + dw) * sizeof(IUINT32) + 
+		(long)sw * 8 * sizeof(IUINT32);
+
+	buffer = (char*)icmalloc(size);
+	if (buffer == NULL) return -2;
+
+	accum = (IUINT64*)buffer;
+	xidx = (IINT32*)(accum + dw * 4);
+	xweight = xidx + sw;
+	yidx = xweight + sw;
+	yweight = yidx + sh;
+	card = (IUINT32*)(yweight + sh);
+	output = card + sw;
+	sums[0] = output + dw;
+	sums[1] = sums[0] + sw * 4;
+
+	ibitmap_scale_box_table(xidx, xweight, dw, sw, mode & IBLIT_HFLIP,
+		&xunit, &xspan);
+	ibitmap_scale_box_table(yidx, yweight, dh, sh, 0, &yunit, &yspan);
+	total = (IUINT64)xspan * (IUINT64)yspan;
+
+	fetch = ipixel_get_fetch(ibitmap_pixfmt_guess(src), 0);
+	store = ipixel_get_store(ibitmap_pixfmt_guess(dst), 0);
+
+	memset(sums[0], 0, sizeof(IUINT32) * 8 * sw);
+
+	//  j0 ĵһԴпʼһԴпԽ߽ʱʼ
+	// ʱɵ j0 - 1 в
+	for (k0 = 0; k0 < sh && yidx[k0] < j0; k0++);
+	if (k0 > 0 && k0 < sh && yweight[k0 - 1] < yunit) k0--;
+
+	for (k = k0, j = (k0 < sh)? yidx[k0] : j1; k < sh && j < j1; k++) {
+		IUINT32 w0 = (IUINT32)yweight[k];
+		fetch(src->line[srcrect->top + k], srcrect->left, sw, card, sindex);
+		ibitmap_scale_box_proc(sums[0], (const IUINT8*)card, w0, sw * 4);
+		if (w0 < (IUINT32)yunit) {
+			ibitmap_scale_box_proc(sums[1], (const IUINT8*)card, 
+				yunit - w0, sw * 4);
+		}
+		// ǰĿеѾ
+		if (k == sh - 1 || yidx[k + 1] != j) {
+			IUINT32 *t = sums[0];
+			int y = (mode & IBLIT_VFLIP)? (dh - 1 - j) : j;
+			if (j >= j0) {
+				ibitmap_scale_box_reduce(output, accum, sums[0], xidx, 
+					xweight, xunit, sw, dw, total);
+				store(dst->line[dstrect->top + y], output, dstrect->left,
+					dw, dindex);
+			}
+			sums[0] = sums[1];
+			sums[1] = t;
+			memset(sums[1], 0, sizeof(IUINT32) * 4 * sw);
+			j++;
+		}
+	}
+
+	icfree(buffer);
+
+	return 0;
+}
+
+
+//---------------------------------------------------------------------
+// ˫ / Lanczos ţɷȨر˲Դȣ
+// Ŀ곤ȣ棬ˮƽ˲зڻλУÿֻһΡ
+//---------------------------------------------------------------------
+typedef struct
+{
+	int filter;
+	int srcsize;
+	int dstsize;
+	int taps;
+	int refcnt;			// 汾һ
+	IINT32 *index;		// ÿĿصĵһԴ
+	IINT16 *weight;		// dstsize * taps Ȩ
+}	iKernelTable;
+
+#define IBITMAP_KERNEL_CACHE	8
+
+static iKernelTable *ibitmap_kernel_cache[IBITMAP_KERNEL_CACHE];
+static int ibitmap_kernel_cache_next = 0;
+static ipixel_lock_t ibitmap_kernel_lock = IPIXEL_LOCK_INIT;
+
+// ȨرСʱչˣԽԴ۵Ե
+static iKernelTable *ibitmap_kernel_table_new(int filter, int srcsize,
+	int dstsize)
+{
+	double scale = (double)srcsize / dstsize;
+	double support = ibitmap_kernel_radius(filter);
+	double *value;
+	iKernelTable *table;
+	int taps, i, k;
+
+	if (scale < 1.0) scale = 1.0;
+	support *= scale;
+	taps = (int)ceil(support * 2.0);
+	if (taps > srcsize) taps = srcsize;
+
+	table = (iKernelTable*)icmalloc(sizeof(iKernelTable) + 
+		sizeof(IINT32) * dstsize + sizeof(IINT16) * dstsize * taps +
+		sizeof(double) * taps);
+
+	if (table == NULL) return NULL;
+
+	table->filter = filter;
+	table->srcsize = srcsize;
+	table->dstsize = dstsize;
+	table->taps = taps;
+	table->refcnt = 1;
+	table->index = (IINT32*)(table + 1);
+	value = (double*)(table->index + dstsize);
+	table->weight = (IINT16*)(value + taps);
+
+	for (i = 0; i < dstsize; i++) {
+		double center = (i + 0.5) * srcsize / dstsize - 0.5;
+		int first = (int)floor(center - support) + 1;
+		int start = first;
+		if (start + taps > srcsize) start = srcsize - taps;
+		if (start < 0) start = 0;
+		for (k = 0; k < taps; k++) value[k] = 0.0;
+		for (k = first; k < first + (int)ceil(support * 2.0); k++) {
+			double w = ibitmap_kernel_eval(filter, (k - center) / scale);
+			int pos = (k < 0)? 0 : ((k >= srcsize)? (srcsize - 1) : k);
+			value[pos - start] += w;
+		}
+		table->index[i] = start;
+		ibitmap_kernel_normalize(table->weight + i * taps, value, taps);
+	}
+
+	return table;
+}
+
+// ͷһã̭ʹʱͷ
+static void ibitmap_kernel_table_release(const iKernelTable *table)
+{
+	iKernelTable *self = (iKernelTable*)table;
+	int refcnt;
+	if (self == NULL) return;
+	ipixel_lock(&ibitmap_kernel_lock);
+	refcnt = --self->refcnt;
+	ipixel_unlock(&ibitmap_kernel_lock);
+	if (refcnt == 0) icfree(self);
+}
+
+// ӻȡȨرã releaseûʱɲ滻
+// һУ߳ͬʱͬһűʱø
+static const iKernelTable *ibitmap_kernel_table(int filter, int srcsize,
+	int dstsize)
+{
+	iKernelTable *table, *evict = NULL;
+	int i;
+	ipixel_lock(&ibitmap_kernel_lock);
+	for (i = 0; i < IBITMAP_KERNEL_CACHE; i++) {
+		table = ibitmap_kernel_cache[i];
+		if (table && table->filter == filter && table->srcsize == srcsize &&
+			table->dstsize == dstsize) {
+			table->refcnt++;
+			ipixel_unlock(&ibitmap_kernel_lock);
+			return table;
+		}
+	}
+	ipixel_unlock(&ibitmap_kernel_lock);
+	table = ibitmap_kernel_table_new(filter, srcsize, dstsize);
+	if (table == NULL) return NULL;
+	ipixel_lock(&ibitmap_kernel_lock);
+	table->refcnt++;
+	i = ibitmap_kernel_cache_next;
+	ibitmap_kernel_cache_next = (i + 1) % IBITMAP_KERNEL_CACHE;
+	if (ibitmap_kernel_cache[i]) {
+		if (--ibitmap_kernel_cache[i]->refcnt == 0) 
+			evict = ibitmap_kernel_cache[i];
+	}
+	ibitmap_kernel_cache[i] = table;
+	ipixel_unlock(&ibitmap_kernel_lock);
+	if (evict) icfree(evict);
+	return table;
+}
+
+// ˮƽΪ 8.6 
+static void ibitmap_scale_kernel_horz(IINT16 *row, const IUINT32 *card,
+	const IINT32 *index, const IINT16 *weight, int taps, int width)
+{
+	int i, k;
+	for (i = 0; i < width; i++, row += 4, weight += taps) {
+		const IUINT32 *src = card + index[i];
+		IINT32 b = 128, g = 128, r = 128, a = 128;
+		for (k = 0; k < taps; k++) {
+			IUINT32 cc = src[k];
+			IINT32 w = weight[k];
+			b += (IINT32)(cc & 0xff) * w;
+			g += (IINT32)((cc >> 8) & 0xff) * w;
+			r += (IINT32)((cc >> 16) & 0xff) * w;
+			a += (IINT32)(cc >> 24) * w;
+		}
+		row[0] = (IINT16)(b >> 8);
+		row[1] = (IINT16)(g >> 8);
+		row[2] = (IINT16)(r >> 8);
+		row[3] = (IINT16)(a >> 8);
+	}
+}
+
+// ֱ͵ A8R8G8B8
+static void ibitmap_scale_kernel_vert(IUINT32 *card, const IINT16 **rows,
+	const IINT16 *weight, int taps, int width)
+{
+	int i, k, c;
+	for (i = 0; i < width; i++) {
+		IUINT32 cc = 0;
+		for (c = 0; c < 4; c++) {
+			IINT32 sum = 1 << 19;
+			for (k = 0; k < taps; k++) {
+				sum += (IINT32)rows[k][i * 4 + c] * weight[k];
+			}
+			sum >>= 20;
+			sum = (sum < 0)? 0 : ((sum > 255)? 255 : sum);
+			cc |= (IUINT32)sum << (c * 8);
+		}
+		card[i] = cc;
+	}
+}
+
+static iKernelHorzProc ibitmap_scale_kernel_horz_proc = 
+	ibitmap_scale_kernel_horz;
+
+static iKernelVertProc ibitmap_scale_kernel_vert_proc = 
+	ibitmap_scale_kernel_vert;
+
+// þid 0 ˮƽ1 ֱNULL ָĬ
+void ibitmap_scale_kernel_set_proc(int id, void *proc)
+{
+	if (id == 0) {
+		ibitmap_scale_kernel_horz_proc = (proc)? 
+			(iKernelHorzProc)proc : ibitmap_scale_kernel_horz;
+	}
+	else if (id == 1) {
+		ibitmap_scale_kernel_vert_proc = (proc)? 
+			(iKernelVertProc)proc : ibitmap_scale_kernel_vert;
+	}
+}
+
+// ˫ / Lanczos ţѾüϣ֧ IBLIT_MASK
+static int ibitmap_scale_kernel(IBITMAP *dst, const IRECT *dstrect,
+	const IBITMAP *src, const IRECT *srcrect, int mode, int filter,
+	const iColorIndex *dindex, const iColorIndex *sindex, int j0, int j1)
+{
+	int dw = dstrect->right - dstrect->left;
+	int dh = dstrect->bottom - dstrect->top;
+	int sw = srcrect->right - srcrect->left;
+	int sh = srcrect->bottom - srcrect->top;
+	const iKernelTable *tx, *ty;
+	const IINT16 **window;
+	IINT16 *rows, *xweight;
+	IINT32 *xindex, *tags;
+	IUINT32 *card, *output;
+	iFetchProc fetch;
+	iStoreProc store;
+	char *buffer;
+	long size;
+	int j, k;
+
+	if (dw <= 0 || dh <= 0 || sw <= 0 || sh <= 0)
+		return -1;
+
+	tx = ibitmap_kernel_table(filter, sw, dw);
+	ty = ibitmap_kernel_table(filter, sh, dh);
+
+	if (tx == NULL || ty == NULL) {
+		ibitmap_kernel_table_release(tx);
+		ibitmap_kernel_table_release(ty);
+		return -2;
+	}
+
+	size = (long)(sw + dw) * sizeof(IUINT32) + 
+		(long)dw * (tx->taps * sizeof(IINT16) + sizeof(IINT32)) +
+		(long)ty->taps * (dw * 4 * sizeof(IINT16) + sizeof(IINT32) + 
+		sizeof(IINT16*));
+
+	buffer = (char*)icmalloc(size);
+	if (buffer == NULL) {
+		ibitmap_kernel_table_release(tx);
+		ibitmap_kernel_table_release(ty);
+		return -3;
+	}
+
+	window = (const IINT16**)buffer;
+	card = (IUINT32*)(window + ty->taps);
+	output = card + sw;
+	xindex = (IINT32*)(output + dw);
+	tags = xindex + dw;
+	xweight = (IINT16*)(tags + ty->taps);
+	rows = xweight + dw * tx->taps;
+
+	// ˮƽתʱתĿе˳
+	for (k = 0; k < dw; k++) {
+		int n = (mode & IBLIT_HFLIP)? (dw - 1 - k) : k;
+		xindex[k] = tx->index[n];
+		memcpy(xweight + k * tx->taps, tx->weight + n * tx->taps,
+			sizeof(IINT16) * tx->taps);
+	}
+
+	for (k = 0; k < ty->taps; k++) tags[k] = -1;
+
+	fetch = ipixel_get_fetch(ibitmap_pixfmt_guess(src), 0);
+	store = ipixel_get_store(ibitmap_pixfmt_guess(dst), 0);
+
+	for (j = j0; j < j1; j++) {
+		int y = (mode & IBLIT_VFLIP)? (dh - 1 - j) : j;
+		int start = ty->index[y];
+		for (k = 0; k < ty->taps; k++) {
+			int line = start + k;
+			int slot = line % ty->taps;
+			IINT16 *row = rows + slot * dw * 4;
+			if (tags[slot] != line) {
+				fetch(src->line[srcrect->top + line], srcrect->left, sw, 
+					card, sindex);
+				ibitmap_scale_kernel_horz_proc(row, card, xindex, xweight,
+					tx->taps, dw);
+				tags[slot] = line;
+			}
+			window[k] = row;
+		}
+		ibitmap_scale_kernel_vert_proc(output, window, 
+			ty->weight + y * ty->taps, ty->taps, dw);
+		store(dst->line[dstrect->top + j], output, dstrect->left, dw,
+			dindex);
+	}
+
+	icfree(buffer);
+	ibitmap_kernel_table_release(tx);
+	ibitmap_kernel_table_release(ty);
+
+	return 0;
+}
+
+
+// ͳưü
+#define IBITMAP_STATS_BAND(path, fmt, n) do { \
+		if (band == 0) IBITMAP_STATS_ADD(path, fmt, n); \
+	}	while (0)
+
+// һˮƽĿβüĵ band / nbands ֣֮
+// صȫɺһŵĽȫͬ
+static int ibitmap_scale_band(IBITMAP *dst, const IRECT *bound_dst,
+	const IBITMAP *src, const IRECT *bound_src, const IRECT *clip, int mode,
+	int band, int nbands)
 {
 	const iColorIndex *sindex;
 	iColorIndex *dindex;
@@ -3008,6 +3861,7 @@ int ibitmap_scale(IBITMAP *dst, const IRECT *bound_dst, const IBITMAP *src,
 	IUINT32 mask;
 	int dw, dh;
 	int sw, sh;
+	int j0, j1;
 	int sfmt;
 	int dfmt;
 
@@ -3072,7 +3926,13 @@ int ibitmap_scale(IBITMAP *dst, const IRECT *bound_dst, const IBITMAP *src,
 				&sw, &sh, clip, mode))
 				return -100;
 		}
-		return ibitmap_blit(dst, dx,dy, src, sx, sy, sw, sh, mode);
+		IBITMAP_STATS_BAND(IBITMAP_STATS_SCALE_BLIT, sfmt, sw * sh);
+		j0 = (int)((IINT64)sh * band / nbands);
+		j1 = (int)((IINT64)sh * (band + 1) / nbands);
+		if (j0 >= j1) return 0;
+		sy += (mode & IBLIT_VFLIP)? (sh - j1) : j0;
+		return ibitmap_blit(dst, dx, dy + j0, src, sx, sy, sw, j1 - j0, 
+			mode);
 	}
 
 	sindex = (const iColorIndex*)(src->extra);
@@ -3101,11 +3961,45 @@ int ibitmap_scale(IBITMAP *dst, const IRECT *bound_dst, const IBITMAP *src,
 		sh = srcrect.bottom - srcrect.top;
 	}
 
+	// destination rows [j0, j1) belong to this band
+	j0 = (int)((IINT64)dh * band / nbands);
+	j1 = (int)((IINT64)dh * (band + 1) / nbands);
+
+	// bicubic and lanczos-3 with cached weight tables
+	if ((ibitmap_filter_get(src) == IPIXEL_FILTER_BICUBIC ||
+		ibitmap_filter_get(src) == IPIXEL_FILTER_LANCZOS) && 
+		(mode & IBLIT_MASK) == 0) {
+		IBITMAP_STATS_BAND(IBITMAP_STATS_SCALE_KERNEL, sfmt, dw * dh);
+		return ibitmap_scale_kernel(dst, &dstrect, src, &srcrect, mode,
+			(int)ibitmap_filter_get(src), dindex, sindex, j0, j1);
+	}
+
+	// area averaging for reduction, falls back to bilinear for enlarging
+	if (ibitmap_filter_get(src) == IPIXEL_FILTER_BOX && 
+		(mode & IBLIT_MASK) == 0) {
+		if (dw <= sw && dh <= sh) {
+			IBITMAP_STATS_BAND(IBITMAP_STATS_SCALE_BOX, sfmt, sw * sh);
+			return ibitmap_scale_box(dst, &dstrect, src, &srcrect, mode,
+				dindex, sindex, j0, j1);
+		}
+		mode |= IBLIT_BILINEAR;
+	}
+
+	// bilinear filter with cached horizontal rows
+	if ((mode & IBLIT_BILINEAR) != 0 && (mode & IBLIT_MASK) == 0) {
+		IBITMAP_STATS_BAND(IBITMAP_STATS_SCALE_BILINEAR, sfmt, dw * dh);
+		return ibitmap_scale_bilinear(dst, &dstrect, src, &srcrect, mode,
+			dindex, sindex, j0, j1);
+	}
+
 	// use bresenham algorithm for large picture
 	if (dst->w >= 32767 || dst->h >= 32767 || 
 		src->w >= 32767 || src->h >= 32767) {
 		if (sfmt != dfmt) 
 			return -300;
+		if (band > 0)
+			return 0;
+		IBITMAP_STATS_BAND(IBITMAP_STATS_SCALE_STRETCH, sfmt, dw * dh);
 		// 2048 ms
 		return ibitmap_stretch(dst, dstrect.left, dstrect.top, 
 			dstrect.right - dstrect.left, dstrect.bottom - dstrect.top,
@@ -3119,7 +4013,7 @@ int ibitmap_scale(IBITMAP *dst, const IRECT *bound_dst, const IBITMAP *src,
 		int i, j;
 
 		#define IBITMAP_SCALE_BITS(bpp, nbytes) { \
-			for (j = 0; j < dh; sv += dv, j++) { \
+			for (j = j0; j < j1; sv += dv, j++) { \
 				int srcline = cfixed_to_int(sv); \
 				const IUINT8 *srcrow = (const IUINT8*)src->line[srcline]; \
 				IUINT8 *dstrow = (IUINT8*)dst->line[dstrect.top + j]; \
@@ -3162,8 +4056,11 @@ int ibitmap_scale(IBITMAP *dst, const IRECT *bound_dst, const IBITMAP *src,
 			du = cfixed_div(cfixed_from_int(sw), cfixed_from_int(dw));
 		}
 
+		sv += dv * j0;
 		mask = (IUINT32)src->mask;
 
+		IBITMAP_STATS_BAND(IBITMAP_STATS_SCALE_SAME_FORMAT, sfmt, dw * dh);
+
 		switch (src->bpp)
 		{
 		case  8: IBITMAP_SCALE_BITS( 8, 1); break;
@@ -3199,9 +4096,12 @@ int ibitmap_scale(IBITMAP *dst, const IRECT *bound_dst, const IBITMAP *src,
 
 		dstbytes = ipixelfmt[dfmt].pixelbyte;
 		srcbytes = ipixelfmt[sfmt].pixelbyte;
+		sv += dv * j0;
 		mask = (IUINT32)src->mask;
 
-		for (j = 0; j < dh; sv += dv, j++) {
+		IBITMAP_STATS_BAND(IBITMAP_STATS_SCALE_CONVERT, sfmt, dw * dh);
+
+		for (j = j0; j < j1; sv += dv, j++) {
 			int srcline = cfixed_to_int(sv);
 			int dstline = dstrect.top + j;
 			const IUINT8 *srcrow = (const IUINT8*)src->line[srcline];
@@ -3668,6 +4568,81 @@ int ibitmap_scale(IBITMAP *dst, const IRECT *bound_dst, const IBITMAP *src,
 	return 0;
 }
 
+#undef IBITMAP_STATS_BAND
+
+// һֻ¼һ¼¼ߴΪüǰĿ
+#define IBITMAP_TRACE_SCALE(ts, dst, bound_dst, src, clip) 	IBITMAP_TRACE_END(ts, "ibitmap_scale", 		(bound_dst)? ((bound_dst)->right - (bound_dst)->left) : 		((clip)? ((clip)->right - (clip)->left) : (int)(dst)->w), 		(bound_dst)? ((bound_dst)->bottom - (bound_dst)->top) : 		((clip)? ((clip)->bottom - (clip)->top) : (int)(dst)->h), 		ibitmap_pixfmt_guess(src), ibitmap_pixfmt_guess(dst))
+
+
+// Ż
+int ibitmap_scale(IBITMAP *dst, const IRECT *bound_dst, const IBITMAP *src,
+	const IRECT *bound_src, const IRECT *clip, int mode)
+{
+	int retval;
+	IBITMAP_TRACE_BEGIN(tracets);
+	retval = ibitmap_scale_band(dst, bound_dst, src, bound_src, clip, mode, 
+		0, 1);
+	IBITMAP_TRACE_SCALE(tracets, dst, bound_dst, src, clip);
+	return retval;
+}
+
+// Զִʱÿ
+#define IBITMAP_SCALE_BAND_MIN	32
+
+// ŵĲÿһ
+typedef struct
+{
+	IBITMAP *dst;
+	const IRECT *bound_dst;
+	const IBITMAP *src;
+	const IRECT *bound_src;
+	const IRECT *clip;
+	int mode;
+	int nbands;
+	volatile long retval;
+}	iScaleTask;
+
+static void ibitmap_scale_task(void *ctx, int index)
+{
+	iScaleTask *task = (iScaleTask*)ctx;
+	int hr = ibitmap_scale_band(task->dst, task->bound_dst, task->src,
+		task->bound_src, task->clip, task->mode, index, task->nbands);
+	if (hr != 0) task->retval = hr;
+}
+
+// ţĿֳˮƽ ipixel_task_run ibitmap_scale
+// λͬnbands <= 0 ʱ߳Զѡ
+int ibitmap_scale_parallel(IBITMAP *dst, const IRECT *bound_dst, 
+	const IBITMAP *src, const IRECT *bound_src, const IRECT *clip, 
+	int mode, int nbands)
+{
+	iScaleTask task;
+	IBITMAP_TRACE_BEGIN(tracets);
+	if (nbands <= 0) {
+		int h = (bound_dst)? (bound_dst->bottom - bound_dst->top) : 
+			((clip)? (clip->bottom - clip->top) : (int)dst->h);
+		nbands = ipixel_task_threads() * 2;
+		if (nbands > h / IBITMAP_SCALE_BAND_MIN) 
+			nbands = h / IBITMAP_SCALE_BAND_MIN;
+	}
+	if (nbands <= 1) {
+		return ibitmap_scale(dst, bound_dst, src, bound_src, clip, mode);
+	}
+	task.dst = dst;
+	task.bound_dst = bound_dst;
+	task.src = src;
+	task.bound_src = bound_src;
+	task.clip = clip;
+	task.mode = mode;
+	task.nbands = nbands;
+	task.retval = 0;
+	ipixel_task_run(ibitmap_scale_task, &task, nbands);
+	IBITMAP_TRACE_SCALE(tracets, dst, bound_dst, src, clip);
+	return (int)task.retval;
+}
+
+#undef IBITMAP_TRACE_SCALE
+
 
 // ȫ BLITֲ֧ͬظʽ
 int ibitmap_blit2(IBITMAP *dst, int x, int y, const IBITMAP *src,
@@ -3736,9 +4711,9 @@ int ibitmap_blit2(IBITMAP *dst, int x, int y, const IBITMAP *src,
 }
 
 
-// ²
-IBITMAP *ibitmap_resample(const IBITMAP *src, const IRECT *bound, 
-	int newwidth, int newheight, int mode)
+// ²nbands Ϊ 1 ʱУ ibitmap_scale_parallel
+static IBITMAP *ibitmap_resample_band(const IBITMAP *src, const IRECT *bound,
+	int newwidth, int newheight, int mode, int nbands)
 {
 	IBITMAP *bitmap;
 	IRECT srect;
@@ -3765,38 +4740,294 @@ IBITMAP *ibitmap_resample(const IBITMAP *src, const IRECT *bound,
 	drect.bottom = newheight;
 
 	if (mode == 0) {
-		ibitmap_smooth_resize(bitmap, &drect, src, &srect);
+		ibitmap_smooth_resize(bitmap, &drect, src, bound);
 	}	
+	else if (mode == 6) {
+		ibitmap_scale_parallel(bitmap, &drect, src, bound, NULL, 
+			IBLIT_BILINEAR, nbands);
+	}
+	else if (mode >= 3 && mode <= 5) {
+		static const IPIXELFILTER filters[3] = { IPIXEL_FILTER_BOX,
+			IPIXEL_FILTER_BICUBIC, IPIXEL_FILTER_LANCZOS };
+		IBITMAP copy = *src;
+		ibitmap_filter_set(&copy, filters[mode - 3]);
+		ibitmap_scale_parallel(bitmap, &drect, &copy, bound, NULL, 0, 
+			nbands);
+	}
 	else {
-		ibitmap_scale(bitmap, &drect, src, &srect, NULL, 0);
+		ibitmap_scale_parallel(bitmap, &drect, src, bound, NULL, 0, nbands);
 	}
 
 	return bitmap;
 }
 
+// ²
+IBITMAP *ibitmap_resample(const IBITMAP *src, const IRECT *bound, 
+	int newwidth, int newheight, int mode)
+{
+	return ibitmap_resample_band(src, bound, newwidth, newheight, mode, 1);
+}
+
+// ²ƽģʽ (mode 0) Ϊ˲Ȼ
+IBITMAP *ibitmap_resample_parallel(const IBITMAP *src, const IRECT *bound, 
+	int newwidth, int newheight, int mode)
+{
+	return ibitmap_resample_band(src, bound, newwidth, newheight, mode, 0);
+}
+
+
+//---------------------------------------------------------------------
+// ༶
+//---------------------------------------------------------------------
+
+// ÿ߼루ȡСΪ 1ֱ 1x1
+static int ibitmap_mipmap_count(const IBITMAP *base)
+{
+	int w = (int)base->w;
+	int h = (int)base->h;
+	int count = 1;
+	while ((w > 1 || h > 1) && count < IBITMAP_MIPMAP_MAX) {
+		w = (w > 1)? (w >> 1) : 1;
+		h = (h > 1)? (h >> 1) : 1;
+		count++;
+	}
+	return count;
+}
+
+// 2x2 ƽ
+static inline IUINT32 ibitmap_mipmap_average(IUINT32 c0, IUINT32 c1,
+	IUINT32 c2, IUINT32 c3)
+{
+	IUINT32 rb = (c0 & 0xff00ff) + (c1 & 0xff00ff) + 
+		(c2 & 0xff00ff) + (c3 & 0xff00ff) + 0x20002;
+	IUINT32 ag = ((c0 >> 8) & 0xff00ff) + ((c1 >> 8) & 0xff00ff) +
+		((c2 >> 8) & 0xff00ff) + ((c3 >> 8) & 0xff00ff) + 0x20002;
+	return ((rb >> 2) & 0xff00ff) | ((ag << 6) & 0xff00ff00);
+}
+
+// һһ㣬߳һ/б
+static IBITMAP *ibitmap_mipmap_reduce(const IBITMAP *src)
+{
+	int sw = (int)src->w;
+	int sh = (int)src->h;
+	int dw = (sw > 1)? (sw >> 1) : 1;
+	int dh = (sh > 1)? (sh >> 1) : 1;
+	int fmt = ibitmap_pixfmt_guess(src);
+	const iColorIndex *index = (const iColorIndex*)src->extra;
+	IUINT32 *buffer = NULL;
+	const IUINT32 *r0, *r1;
+	iFetchProc fetch;
+	IBITMAP *dst;
+	int x, y;
+
+	dst = ibitmap_create(dw, dh, 32);
+	if (dst == NULL) return NULL;
+
+	ibitmap_pixfmt_set(dst, IPIX_FMT_A8R8G8B8);
+
+	if (fmt != IPIX_FMT_A8R8G8B8) {
+		buffer = (IUINT32*)icmalloc(sizeof(IUINT32) * sw * 2);
+		if (buffer == NULL) {
+			ibitmap_release(dst);
+			return NULL;
+		}
+	}
+
+	if (index == NULL) index = _ipixel_src_index;
+	fetch = ipixel_get_fetch(fmt, 0);
+
+	for (y = 0; y < dh; y++) {
+		int y0 = (sh > 1)? (y * 2) : 0;
+		int y1 = (sh > 1)? (y * 2 + 1) : 0;
+		IUINT32 *out = (IUINT32*)dst->line[y];
+		if (buffer == NULL) {
+			r0 = (const IUINT32*)src->line[y0];
+			r1 = (const IUINT32*)src->line[y1];
+		}	else {
+			fetch(src->line[y0], 0, sw, buffer, index);
+			fetch(src->line[y1], 0, sw, buffer + sw, index);
+			r0 = buffer;
+			r1 = buffer + sw;
+		}
+		if (sw > 1) {
+			for (x = 0; x < dw; x++, r0 += 2, r1 += 2) {
+				out[x] = ibitmap_mipmap_average(r0[0], r0[1], r1[0], r1[1]);
+			}
+		}	else {
+			out[0] = ibitmap_mipmap_average(r0[0], r0[0], r1[0], r1[0]);
+		}
+	}
+
+	if (buffer) icfree(buffer);
+
+	return dst;
+}
+
+// ༶
+IMIPMAP *ibitmap_mipmap_new(const IBITMAP *base)
+{
+	IMIPMAP *mip;
+	int i;
+	mip = (IMIPMAP*)icmalloc(sizeof(IMIPMAP));
+	if (mip == NULL) return NULL;
+	mip->base = base;
+	mip->count = ibitmap_mipmap_count(base);
+	for (i = 0; i < IBITMAP_MIPMAP_MAX; i++) 
+		mip->level[i] = NULL;
+	mip->lock = IPIXEL_LOCK_INIT;
+	return mip;
+}
+
+// ͷѾɵĲ㣺ժ£ͷ
+void ibitmap_mipmap_invalidate(IMIPMAP *mip)
+{
+	IBITMAP *level[IBITMAP_MIPMAP_MAX];
+	int i;
+	ipixel_lock(&mip->lock);
+	for (i = 1; i < IBITMAP_MIPMAP_MAX; i++) {
+		level[i] = mip->level[i];
+		mip->level[i] = NULL;
+	}
+	mip->count = ibitmap_mipmap_count(mip->base);
+	ipixel_unlock(&mip->lock);
+	for (i = 1; i < IBITMAP_MIPMAP_MAX; i++) {
+		if (level[i]) ibitmap_release(level[i]);
+	}
+}
+
+// ɾ༶
+void ibitmap_mipmap_delete(IMIPMAP *mip)
+{
+	if (mip) {
+		ibitmap_mipmap_invalidate(mip);
+		icfree(mip);
+	}
+}
+
+// ȡõ level 㣬ҪʱɣСУɺò
+// ΪղŷԼɵĽѾĲֻ invalidate
+// ͷţ뱾صʹ prev ǰȫ
+const IBITMAP *ibitmap_mipmap_level(IMIPMAP *mip, int level)
+{
+	const IBITMAP *result = NULL;
+	int i;
+	if (level < 0 || level >= mip->count) return NULL;
+	if (level == 0) return mip->base;
+	for (i = 1; i <= level; i++) {
+		const IBITMAP *prev;
+		IBITMAP *reduced;
+		ipixel_lock(&mip->lock);
+		result = mip->level[i];
+		prev = (i == 1)? mip->base : mip->level[i - 1];
+		ipixel_unlock(&mip->lock);
+		if (result != NULL) continue;
+		if (prev == NULL) return NULL;
+		reduced = ibitmap_mipmap_reduce(prev);
+		if (reduced == NULL) return NULL;
+		ipixel_lock(&mip->lock);
+		if (mip->level[i] == NULL) {
+			mip->level[i] = reduced;
+			reduced = NULL;
+		}
+		result = mip->level[i];
+		ipixel_unlock(&mip->lock);
+		if (reduced) ibitmap_release(reduced);
+		if (result == NULL) return NULL;
+	}
+	return result;
+}
+
 
 //---------------------------------------------------------------------
 // غϳ
 //---------------------------------------------------------------------
 
-// λͼϳ
-int ibitmap_composite(IBITMAP *dst, int dx, int dy, const IBITMAP *src, 
-	int sx, int sy, int w, int h, const IRECT *clip, int op, int flags)
+// ϳɷֿ
+typedef struct
 {
-	unsigned char _buffer[IBITMAP_STACK_BUFFER];
-	unsigned char *buffer = _buffer;
-	int retval = 0, sfmt, dfmt;
-	const iColorIndex *sindex;
-	const iColorIndex *dindex;
+	IBITMAP *dst;
+	const IBITMAP *src;
+	int dx, dy, sx, sy, w, h;
+	int dfmt, sfmt, flip;
 	iPixelComposite composite;
-	iFetchProc fetchsrc, fetchdst;
+	iFetchProc fetchsrc;
+	iFetchProc fetchdst;
 	iStoreProc storedst;
+	const iColorIndex *dindex;
+	const iColorIndex *sindex;
+	volatile int retval;
+}	iCompositeTask;
+
+static void ibitmap_composite_band(void *ctx, int top, int bottom)
+{
+	iCompositeTask *task = (iCompositeTask*)ctx;
+	unsigned char _buffer[IBITMAP_STACK_BUFFER];
+	unsigned char *buffer = _buffer;
+	int sfmt = task->sfmt, dfmt = task->dfmt;
+	int flip = task->flip, sx = task->sx, dx = task->dx, w = task->w;
 	const void *sline;
 	IUINT32 *target;
 	void *dline;
 	long dpitch;
 	long spitch;
-	int flip, i;
+	int i;
+
+	if (w * 8 > IBITMAP_STACK_BUFFER) {
+		buffer = (unsigned char*)icmalloc(w * 8);
+		if (buffer == NULL) {
+			task->retval = -3;
+			return;
+		}
+	}
+
+	sline = (void*)task->src->line[task->sy + top];
+	spitch = (long)task->src->pitch;
+	dline = (void*)task->dst->line[task->dy + top];
+	dpitch = (long)task->dst->pitch;
+
+	if ((flip & IBLIT_VFLIP) != 0) {
+		sline = task->src->line[task->sy + task->h - 1 - top];
+		spitch = -spitch;
+	}
+
+	target = (IUINT32*)((IUINT8*)buffer + w * 4);
+
+	for (i = top; i < bottom; i++) {
+		const IUINT32 *card;
+		if (sfmt == IPIX_FMT_A8R8G8B8 && (flip & IBLIT_HFLIP) == 0) {
+			card = ((const IUINT32*)sline) + sx;
+		}	else {
+			card = (const IUINT32*)buffer;
+			task->fetchsrc(sline, sx, w, (IUINT32*)buffer, task->sindex);
+			if (flip & IBLIT_HFLIP) {
+				ipixel_card_reverse((IUINT32*)buffer, w);
+			}
+		}
+		if (dfmt == IPIX_FMT_A8R8G8B8) {
+			task->composite((IUINT32*)dline + dx, card, w);
+		}	else {
+			task->fetchdst(dline, dx, w, target, task->dindex);
+			task->composite(target, card, w);
+			task->storedst(dline, target, dx, w, task->dindex);
+		}
+		sline = (const char*)sline + spitch;
+		dline = (char*)dline + dpitch;
+	}
+
+	if (buffer != _buffer) {
+		icfree(buffer);
+	}
+}
+
+// λͼϳ
+int ibitmap_composite(IBITMAP *dst, int dx, int dy, const IBITMAP *src, 
+	int sx, int sy, int w, int h, const IRECT *clip, int op, int flags)
+{
+	int retval = 0, sfmt, dfmt;
+	iPixelComposite composite;
+	iCompositeTask task;
+	int flip;
+	IBITMAP_TRACE_BEGIN(tracets);
 
 	flip = flags & (IBLIT_HFLIP | IBLIT_VFLIP);
 
@@ -3809,21 +5040,6 @@ int ibitmap_composite(IBITMAP *dst, int dx, int dy, const IBITMAP *src,
 	composite = ipixel_composite_get(op, 0);
 	if (composite == NULL) return -2;
 
-	if (w * 8 > IBITMAP_STACK_BUFFER) {
-		buffer = (unsigned char*)icmalloc(w * 4);
-		if (buffer == NULL) return -3;
-	}
-	
-	sline = (void*)src->line[sy];
-	spitch = (long)src->pitch;
-	dline = (void*)dst->line[dy];
-	dpitch = (long)dst->pitch;
-
-	if ((flip & IBLIT_VFLIP) != 0) {
-		sline = src->line[sy + h - 1];
-		spitch = -spitch;
-	}
-
 	sfmt = ibitmap_pixfmt_guess(src);
 	dfmt = ibitmap_pixfmt_guess(dst);
 
@@ -3838,42 +5054,127 @@ int ibitmap_composite(IBITMAP *dst, int dx, int dy, const IBITMAP *src,
 		dfmt = IPIX_FMT_A8R8G8B8;
 	}
 
-	fetchsrc = ipixel_get_fetch(sfmt, 0);
-	fetchdst = ipixel_get_fetch(dfmt, 0);
-	storedst = ipixel_get_store(dfmt, 0);
+	task.dst = dst;
+	task.src = src;
+	task.dx = dx;
+	task.dy = dy;
+	task.sx = sx;
+	task.sy = sy;
+	task.w = w;
+	task.h = h;
+	task.dfmt = dfmt;
+	task.sfmt = sfmt;
+	task.flip = flip;
+	task.composite = composite;
+	task.fetchsrc = ipixel_get_fetch(sfmt, 0);
+	task.fetchdst = ipixel_get_fetch(dfmt, 0);
+	task.storedst = ipixel_get_store(dfmt, 0);
+	task.sindex = (const iColorIndex*)(src->extra);
+	task.dindex = (iColorIndex*)(dst->extra);
+	task.retval = 0;
+
+	if (sfmt != IPIX_FMT_A8R8G8B8 || (flip & IBLIT_HFLIP) != 0) {
+		IBITMAP_STATS_ADD(IBITMAP_STATS_COMPOSITE_SRC_FETCH, sfmt, w * h);
+	}
 
-	sindex = (const iColorIndex*)(src->extra);
-	dindex = (iColorIndex*)(dst->extra);
-	target = (IUINT32*)((IUINT8*)buffer + w * 4);
-	
-	for (i = 0; i < h; i++) {
-		const IUINT32 *card;
-		if (sfmt == IPIX_FMT_A8R8G8B8 && (flip & IBLIT_HFLIP) == 0) {
-			card = ((const IUINT32*)sline) + sx;
-		}	else {
-			card = (const IUINT32*)buffer;
-			fetchsrc(sline, sx, w, (IUINT32*)buffer, sindex);
-			if (flip & IBLIT_HFLIP) {
-				ipixel_card_reverse((IUINT32*)buffer, w);
+	if (dfmt == IPIX_FMT_A8R8G8B8) {
+		IBITMAP_STATS_ADD(IBITMAP_STATS_COMPOSITE_DIRECT, dfmt, w * h);
+	}	else {
+		IBITMAP_STATS_ADD(IBITMAP_STATS_COMPOSITE_CONVERT, dfmt, w * h);
+	}
+
+	ipixel_task_bands(ibitmap_composite_band, &task, w, h);
+
+	IBITMAP_TRACE_END(tracets, "ibitmap_composite", w, h, sfmt, dfmt);
+
+	return task.retval;
+}
+
+
+//---------------------------------------------------------------------
+// dispatch statistics
+//---------------------------------------------------------------------
+static const char *ibitmap_stats_names[IBITMAP_STATS_COUNT] = {
+	"FETCH_LOOKUP_MISS",
+	"FETCH_MODE_GENERAL",
+	"FETCH_GENERAL",
+	"FETCH_GENERAL_FLOAT",
+	"SCALE_BLIT",
+	"SCALE_STRETCH",
+	"SCALE_SAME_FORMAT",
+	"SCALE_CONVERT",
+	"COMPOSITE_DIRECT",
+	"COMPOSITE_CONVERT",
+	"COMPOSITE_SRC_FETCH",
+	"SCALE_BILINEAR",
+	"SCALE_BOX",
+	"SCALE_KERNEL",
+};
+
+// returns non-zero if statistics are compiled in
+int ibitmap_stats_enabled(void)
+{
+#ifdef IBITMAP_STATS
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+// query counters of a path, pixfmt < 0 for the sum of all formats
+void ibitmap_stats_get(int path, int pixfmt, IINT64 *calls, IINT64 *pixels)
+{
+	IINT64 c = 0, p = 0;
+#ifdef IBITMAP_STATS
+	if (path >= 0 && path < IBITMAP_STATS_COUNT) {
+		if (pixfmt < 0) {
+			int i;
+			for (i = 0; i < IPIX_FMT_COUNT; i++) {
+				c += IBITMAP_STATS_LOAD(&ibitmap_stats_calls[path][i]);
+				p += IBITMAP_STATS_LOAD(&ibitmap_stats_pixels[path][i]);
 			}
 		}
-		if (dfmt == IPIX_FMT_A8R8G8B8) {
-			composite((IUINT32*)dline + dx, card, w);
-		}	else {
-			fetchdst(dline, dx, w, target, dindex);
-			composite(target, card, w);
-			storedst(dline, target, dx, w, dindex);
+		else if (pixfmt < IPIX_FMT_COUNT) {
+			c = IBITMAP_STATS_LOAD(&ibitmap_stats_calls[path][pixfmt]);
+			p = IBITMAP_STATS_LOAD(&ibitmap_stats_pixels[path][pixfmt]);
 		}
-		sline = (const char*)sline + spitch;
-		dline = (char*)dline + dpitch;
 	}
+#endif
+	if (calls) calls[0] = c;
+	if (pixels) pixels[0] = p;
+}
 
-	if (buffer != _buffer) {
-		icfree(buffer);
-		buffer = _buffer;
+// reset all counters
+void ibitmap_stats_reset(void)
+{
+#ifdef IBITMAP_STATS
+	int i, j;
+	for (i = 0; i < IBITMAP_STATS_COUNT; i++) {
+		for (j = 0; j < IPIX_FMT_COUNT; j++) {
+			ibitmap_stats_calls[i][j] = 0;
+			ibitmap_stats_pixels[i][j] = 0;
+		}
 	}
+#endif
+}
 
-	return 0;
+// name of the path
+const char *ibitmap_stats_name(int path)
+{
+	if (path < 0 || path >= IBITMAP_STATS_COUNT) return "UNKNOWN";
+	return ibitmap_stats_names[path];
+}
+
+//---------------------------------------------------------------------
+// ʼ
+//---------------------------------------------------------------------
+void pixellib_init(void)
+{
+	int taps;
+	ipixel_init();
+	IPIXEL_ONCE(&ibitmap_fetch_proc_once, ibitmap_fetch_proc_table_init);
+	ibitmap_kernel_phase(IPIXEL_FILTER_BICUBIC, &taps);
+	ibitmap_kernel_phase(IPIXEL_FILTER_LANCZOS, &taps);
 }
 
 
@@ -60,6 +60,10 @@ enum IPIXELFILTER
 {
 	IPIXEL_FILTER_BILINEAR	= 0,	// ˲ģʽ˫Թ˲
 	IPIXEL_FILTER_NEAREST	= 1,	// ˲ģʽ
+	IPIXEL_FILTER_BOX		= 2,	// ˲ģʽСʱƽͬ
+	IPIXEL_FILTER_BICUBIC	= 3,	// ˲ģʽ˫ξ
+	IPIXEL_FILTER_LANCZOS	= 4,	// ˲ģʽLanczos-3 
+	IPIXEL_FILTER_TRILINEAR	= 5,	// ˲ģʽ༶ԣͬ˫
 };
 
 // 
@@ -81,7 +85,7 @@ struct IMODE
 			unsigned char pixfmt : 6;	// ɫʽ
 			unsigned char fmtset : 1;	// Ƿɫʽ
 			unsigned char overflow : 2;	// Խģʽ IBOM
-			unsigned char filter : 2;	// 
+			unsigned char filter : 3;	// 
 			unsigned char refbits : 1;	// Ƿ
 			unsigned char subpixel : 2;	// ģʽ
 		};
@@ -100,6 +104,15 @@ typedef enum IPIXELFILTER IPIXELFILTER;
 extern "C" {
 #endif
 
+//---------------------------------------------------------------------
+// ʼ
+//---------------------------------------------------------------------
+
+// ԤȽȫұͺ״ʹʱҲ̰߳ȫԶ
+// ʼ߳ȾǰһοԱ֡ʱ̵߳ȴ
+void pixellib_init(void);
+
+
 //---------------------------------------------------------------------
 // λͼ
 //---------------------------------------------------------------------
@@ -138,6 +151,7 @@ int ibitmap_clipex(const IBITMAP *dst, int *dx, int *dy, const IBITMAP *src,
 
 #define IBLIT_NOCLIP	16
 #define IBLIT_ADDITIVE	32
+#define IBLIT_BILINEAR	64
 
 // ɫ
 void ibitmap_blend(IBITMAP *dst, int dx, int dy, const IBITMAP *src, int sx, 
@@ -280,6 +294,11 @@ void ibitmap_scanline_fixed(const IBITMAP *bmp, IUINT32 *card, int w,
 #define ibitmap_imode_const(bmp, _FIELD) \
 	(((const IMODE*)&((bmp)->mode))->_FIELD)
 
+// ʹõĹڵϰ˫Բ
+#define ibitmap_filter_sample(bmp) \
+	((ibitmap_imode_const(bmp, filter) == IPIXEL_FILTER_TRILINEAR)? \
+	 IPIXEL_FILTER_BILINEAR : ibitmap_imode_const(bmp, filter))
+
 #ifndef IBITMAP_STACK_BUFFER
 	#define IBITMAP_STACK_BUFFER	16384
 #endif
@@ -344,17 +363,80 @@ int ibitmap_clip_scale(const IRECT *clipdst, const IRECT *clipsrc,
 	IRECT *bound_dst, IRECT *bound_src, int mode);
 
 // ŻƣIBLIT_MASK IBLIT_HFLIP, IBLIT_VFLIP
+// IBLIT_BILINEAR ʹ˫Թˣˮƽ˲У IBLIT_MASK
+// Դλͼ˲Ϊ IPIXEL_FILTER_BOX ʱСʹƽΪ BICUBIC 
+// LANCZOS ʱʹÿɷ
 int ibitmap_scale(IBITMAP *dst, const IRECT *bound_dst, const IBITMAP *src,
 	const IRECT *bound_src, const IRECT *clip, int mode);
 
+// ţĿֳ nbands ˮƽͨ ipixel_task_run ִУ
+// ibmtask.h԰װԼִ ibitmap_scale λͬ
+// nbands <= 0 ʱ߳Զѡÿ 32 
+int ibitmap_scale_parallel(IBITMAP *dst, const IRECT *bound_dst, 
+	const IBITMAP *src, const IRECT *bound_src, const IRECT *clip, 
+	int mode, int nbands);
+
+// ƽСкۼӣsum[i] += src[i] * weight size ֽ
+typedef void (*iBoxColumnProc)(IUINT32 *sum, const IUINT8 *src,
+	IUINT32 weight, int size);
+
+// кۼӺproc == NULL ָĬ
+void ibitmap_scale_box_set_proc(iBoxColumnProc proc);
+
+// ŵˮƽrow Ϊ width * 4  8.6 ȨΪ 14 λ
+typedef void (*iKernelHorzProc)(IINT16 *row, const IUINT32 *card,
+	const IINT32 *index, const IINT16 *weight, int taps, int width);
+
+// ŵĴֱrows Ϊ taps ˮƽ͵ A8R8G8B8
+typedef void (*iKernelVertProc)(IUINT32 *card, const IINT16 **rows,
+	const IINT16 *weight, int taps, int width);
+
+// þid 0 ˮƽ1 ֱproc == NULL ָĬ
+void ibitmap_scale_kernel_set_proc(int id, void *proc);
+
 // ȫ BLITֲ֧ͬظʽ
 int ibitmap_blit2(IBITMAP *dst, int x, int y, const IBITMAP *src,
 	const IRECT *bound_src, const IRECT *clip, int mode);
 
-// ²
+// ²mode 0 ƽ3 ƽ4 ˫Σ5 Lanczos6 ˫
+// IBLIT_BILINEAR л棩 1, 2ʹԴλͼĹ
 IBITMAP *ibitmap_resample(const IBITMAP *src, const IRECT *bound, 
 	int newwidth, int newheight, int mode);
 
+// ²ͬϣmode 0 Ȼ
+IBITMAP *ibitmap_resample_parallel(const IBITMAP *src, const IRECT *bound, 
+	int newwidth, int newheight, int mode);
+
+
+//=====================================================================
+// ༶Դλͼϵ 2x2 ƽС㰴
+//=====================================================================
+#define IBITMAP_MIPMAP_MAX		32
+
+struct IMIPMAP
+{
+	const IBITMAP *base;				//  0 㣬Դλͼ
+	int count;							// ܲ 0 
+	IBITMAP *level[IBITMAP_MIPMAP_MAX];	// ѾɵĲ㣨A8R8G8B8
+	ipixel_lock_t lock;					//  level 
+};
+
+typedef struct IMIPMAP IMIPMAP;
+
+// ༶ɸ
+IMIPMAP *ibitmap_mipmap_new(const IBITMAP *base);
+
+// ɾ༶ͷԴλͼ
+void ibitmap_mipmap_delete(IMIPMAP *mip);
+
+// ԴλͼݸıãͷѾɵĲ㣬´ʹʱ
+// ͷ֮ǰȡõĲ㣺 ibitmap_mipmap_level κʹøö༶
+// Ļƣ̳߳еķֿ飩ͬʱУҪб֤
+void ibitmap_mipmap_invalidate(IMIPMAP *mip);
+
+// ȡõ level 㣬0 ΪԴλͼҪʱɣʧܷ NULL
+const IBITMAP *ibitmap_mipmap_level(IMIPMAP *mip, int level);
+
 
 //=====================================================================
 // غϳ
@@ -369,6 +451,42 @@ int ibitmap_composite(IBITMAP *dst, int dx, int dy, const IBITMAP *src,
 	int sx, int sy, int w, int h, const IRECT *clip, int op, int flags);
 
 
+//=====================================================================
+// Dispatch statistics: compile with -DIBITMAP_STATS to enable, or the
+// counters will always be zero. counters are per path and per pixel
+// format (source format for fetch/scale, dest format for composite),
+// they are updated atomically (pool bands run in several threads).
+// reset them while nothing draws.
+//=====================================================================
+#define IBITMAP_STATS_FETCH_LOOKUP_MISS		0	// get_proc: no fetcher
+#define IBITMAP_STATS_FETCH_MODE_GENERAL	1	// get_mode: non-affine
+#define IBITMAP_STATS_FETCH_GENERAL			2	// ibitmap_fetch_general
+#define IBITMAP_STATS_FETCH_GENERAL_FLOAT	3	// ..._general_float
+#define IBITMAP_STATS_SCALE_BLIT			4	// scale: same size blit
+#define IBITMAP_STATS_SCALE_STRETCH			5	// scale: bresenham
+#define IBITMAP_STATS_SCALE_SAME_FORMAT		6	// scale: same format
+#define IBITMAP_STATS_SCALE_CONVERT			7	// scale: per pixel cvt
+#define IBITMAP_STATS_COMPOSITE_DIRECT		8	// composite: in place
+#define IBITMAP_STATS_COMPOSITE_CONVERT		9	// composite: fetch/store
+#define IBITMAP_STATS_COMPOSITE_SRC_FETCH	10	// composite: src fetch
+#define IBITMAP_STATS_SCALE_BILINEAR		11	// scale: cached bilinear
+#define IBITMAP_STATS_SCALE_BOX				12	// scale: area averaging
+#define IBITMAP_STATS_SCALE_KERNEL			13	// scale: bicubic, lanczos
+#define IBITMAP_STATS_COUNT					14
+
+// returns non-zero if statistics are compiled in
+int ibitmap_stats_enabled(void);
+
+// query counters of a path, pixfmt < 0 for the sum of all formats
+void ibitmap_stats_get(int path, int pixfmt, IINT64 *calls, IINT64 *pixels);
+
+// reset all counters
+void ibitmap_stats_reset(void);
+
+// name of the path
+const char *ibitmap_stats_name(int path);
+
+
 //=====================================================================
 // Inline Utilities
 //=====================================================================
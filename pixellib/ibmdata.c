@@ -1570,6 +1570,62 @@ int ipixel_trapezoid_spans(const ipixel_trapezoid_t *t, int n, int subpixel,
 }
 
 
+//---------------------------------------------------------------------
+// ֲ߳̾ڴ
+//---------------------------------------------------------------------
+static IPIXEL_TLS char *ipixel_scratch_data[IPIXEL_SCRATCH_SLOTS];
+static IPIXEL_TLS long ipixel_scratch_size[IPIXEL_SCRATCH_SLOTS];
+static IPIXEL_TLS IBITMAP *ipixel_scratch_mask = NULL;
+
+// ȡùڴ棬 2 ݴ
+void *ipixel_scratch(int slot, long size)
+{
+	long block;
+	char *data;
+	assert(slot >= 0 && slot < IPIXEL_SCRATCH_SLOTS);
+	if (size <= ipixel_scratch_size[slot]) 
+		return ipixel_scratch_data[slot];
+	for (block = 256; block < size; ) block <<= 1;
+	data = (char*)malloc(block);
+	if (data == NULL) return NULL;
+	if (ipixel_scratch_data[slot]) free(ipixel_scratch_data[slot]);
+	ipixel_scratch_data[slot] = data;
+	ipixel_scratch_size[slot] = block;
+	return data;
+}
+
+// ȡ A8 λͼ߷ֱ
+IBITMAP *ipixel_scratch_alpha(int w, int h)
+{
+	IBITMAP *alpha = ipixel_scratch_mask;
+	if (alpha && (int)alpha->w >= w && (int)alpha->h >= h)
+		return alpha;
+	if (alpha) {
+		if ((int)alpha->w > w) w = (int)alpha->w;
+		if ((int)alpha->h > h) h = (int)alpha->h;
+	}
+	alpha = ibitmap_create(w, h, 8);
+	if (alpha == NULL) return NULL;
+	ibitmap_pixfmt_set(alpha, IPIX_FMT_A8);
+	if (ipixel_scratch_mask) ibitmap_release(ipixel_scratch_mask);
+	ipixel_scratch_mask = alpha;
+	return alpha;
+}
+
+// ͷŵǰ߳ȫڴ
+void ipixel_scratch_release(void)
+{
+	int i;
+	for (i = 0; i < IPIXEL_SCRATCH_SLOTS; i++) {
+		if (ipixel_scratch_data[i]) free(ipixel_scratch_data[i]);
+		ipixel_scratch_data[i] = NULL;
+		ipixel_scratch_size[i] = 0;
+	}
+	if (ipixel_scratch_mask) ibitmap_release(ipixel_scratch_mask);
+	ipixel_scratch_mask = NULL;
+}
+
+
 //---------------------------------------------------------------------
 // λ
 //---------------------------------------------------------------------
@@ -1718,16 +1774,11 @@ int ipixel_traps_from_polygon_ex(ipixel_trapezoid_t *trap,
 	char _buffer[2048];
 	char *buffer = _buffer;
 	long size = sizeof(ipixel_point_fixed_t) * n;
-	int count;
 	if (size > 2048) {
-		buffer = (char*)malloc(size);
+		buffer = (char*)ipixel_scratch(IPIXEL_SCRATCH_POLYGON, size);
 		if (buffer == NULL) return 0;
 	}
-	count = ipixel_traps_from_polygon(trap, pts, n, clockwise, buffer);
-	if (buffer != _buffer) {
-		free(buffer);
-	}
-	return count;
+	return ipixel_traps_from_polygon(trap, pts, n, clockwise, buffer);
 }
 
 
@@ -1804,12 +1855,19 @@ iBitmapFetchProc ipixel_span_get_proc(const IBITMAP *image,
 		mode = 2;
 	}
 
-	if (ibitmap_imode_const(image, filter) == IPIXEL_FILTER_BILINEAR) 
+	if (ibitmap_filter_sample(image) == IPIXEL_FILTER_BILINEAR) 
 		filter = 1;
 
 	fmt = ibitmap_pixfmt_guess(image);
 	overflow = (int)ibitmap_overflow_get(image);
 
+	// kernel filters are only sampled by the general fetchers
+	if (ibitmap_imode_const(image, filter) == IPIXEL_FILTER_BICUBIC ||
+		ibitmap_imode_const(image, filter) == IPIXEL_FILTER_LANCZOS) {
+		return ibitmap_scanline_get_proc(fmt, 
+				IBITMAP_FETCH_GENERAL_NEAREST, 0);
+	}
+
 	if (filter == 0) {
 		if (ipixel_transform_is_translate(t)) {
 			mode = 2 + overflow * 4;
@@ -1835,15 +1893,159 @@ iBitmapFetchProc ipixel_span_get_proc(const IBITMAP *image,
 }
 
 
+//---------------------------------------------------------------------
+// ༶Զȡ
+//---------------------------------------------------------------------
+#define IPIXEL_MIPMAP_SPAN	256
+
+// ԴĿ仯ʣȡ x, y Ľϴߣ
+static double ipixel_span_mipmap_scale(const ipixel_transform_t *t,
+	double x, double y)
+{
+	double m[3][3], X, Y, W, u, v, ux, uy, vx, vy, sx, sy;
+	int i, j;
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < 3; j++) 
+			m[i][j] = cfixed_to_double(t->matrix[i][j]);
+	}
+	X = m[0][0] * x + m[0][1] * y + m[0][2];
+	Y = m[1][0] * x + m[1][1] * y + m[1][2];
+	W = m[2][0] * x + m[2][1] * y + m[2][2];
+	if (W == 0.0) return 1.0;
+	u = X / W;
+	v = Y / W;
+	ux = (m[0][0] - u * m[2][0]) / W;
+	uy = (m[0][1] - u * m[2][1]) / W;
+	vx = (m[1][0] - v * m[2][0]) / W;
+	vy = (m[1][1] - v * m[2][1]) / W;
+	sx = ux * ux + vx * vx;
+	sy = uy * uy + vy * vy;
+	return sqrt((sx > sy)? sx : sy);
+}
+
+// ˫Զȡĳһ㣺任ͲüΰòͬԴλͼı
+static int ipixel_span_fetch_level(IMIPMAP *mip, int level, int offset,
+	int line, int width, IUINT32 *card, const ipixel_transform_t *t,
+	const IUINT8 *mask, const IRECT *clip)
+{
+	const IBITMAP *base = mip->base;
+	const IBITMAP *image;
+	ipixel_transform_t matrix;
+	iBitmapFetchProc proc;
+	IBITMAP view;
+	IRECT bound;
+	double rx, ry;
+	int i;
+
+	image = ibitmap_mipmap_level(mip, level);
+	if (image == NULL) return -2;
+
+	view = *image;
+	ibitmap_imode(&view, filter) = IPIXEL_FILTER_BILINEAR;
+	ibitmap_imode(&view, overflow) = ibitmap_imode_const(base, overflow);
+	view.mask = base->mask;
+
+	if (level == 0) {
+		proc = ipixel_span_get_proc(&view, t);
+		return ipixel_span_fetch(&view, offset, line, width, card, t,
+			proc, mask, clip);
+	}
+
+	rx = (double)image->w / (double)base->w;
+	ry = (double)image->h / (double)base->h;
+
+	if (t == NULL) ipixel_transform_init_identity(&matrix);
+	else matrix = *t;
+
+	for (i = 0; i < 3; i++) {
+		matrix.matrix[0][i] = cfixed_from_double(
+			cfixed_to_double(matrix.matrix[0][i]) * rx);
+		matrix.matrix[1][i] = cfixed_from_double(
+			cfixed_to_double(matrix.matrix[1][i]) * ry);
+	}
+
+	if (clip != NULL) {
+		bound.left = (int)floor(clip->left * rx);
+		bound.top = (int)floor(clip->top * ry);
+		bound.right = (int)ceil(clip->right * rx);
+		bound.bottom = (int)ceil(clip->bottom * ry);
+		clip = &bound;
+	}
+
+	proc = ipixel_span_get_proc(&view, &matrix);
+
+	return ipixel_span_fetch(&view, offset, line, width, card, &matrix,
+		proc, mask, clip);
+}
+
+// Զȡÿ IPIXEL_MIPMAP_SPAN ذ任űѡ
+// 㣬ֱ˫ԲϸڼСֲֵ
+int ipixel_span_fetch_mipmap(IMIPMAP *mip, int offset, int line,
+	int width, IUINT32 *card, const ipixel_transform_t *t,
+	const IUINT8 *mask, const IRECT *clip)
+{
+	IUINT32 cache[IPIXEL_MIPMAP_SPAN];
+	int pos, size, i;
+
+	for (pos = 0; pos < width; pos += size) {
+		const IUINT8 *cover = (mask == NULL)? NULL : (mask + pos);
+		IUINT32 *output = card + pos;
+		double lod = 0.0;
+		int level, frac;
+
+		size = width - pos;
+		if (size > IPIXEL_MIPMAP_SPAN) size = IPIXEL_MIPMAP_SPAN;
+
+		if (t != NULL) {
+			double scale = ipixel_span_mipmap_scale(t, 
+				offset + pos + size * 0.5, line + 0.5);
+			if (scale > 1.0) lod = log(scale) * 1.4426950408889634;
+		}
+
+		level = (int)lod;
+		frac = (int)((lod - level) * 256.0);
+
+		if (level >= mip->count - 1) {
+			level = mip->count - 1;
+			frac = 0;
+		}
+
+		if (ipixel_span_fetch_level(mip, level, offset + pos, line, size,
+			output, t, cover, clip) != 0) 
+			return -1;
+
+		if (frac == 0) continue;
+
+		if (ipixel_span_fetch_level(mip, level + 1, offset + pos, line,
+			size, cache, t, cover, clip) != 0)
+			return -1;
+
+		for (i = 0; i < size; i++) {
+			IUINT32 c0 = output[i];
+			IUINT32 c1 = cache[i];
+			IUINT32 rb, ag;
+			if (cover != NULL && cover[i] == 0) continue;
+			rb = ((c0 & 0xff00ff) * (256 - frac) + 
+				(c1 & 0xff00ff) * frac) >> 8;
+			ag = (((c0 >> 8) & 0xff00ff) * (256 - frac) + 
+				((c1 >> 8) & 0xff00ff) * frac);
+			output[i] = (rb & 0xff00ff) | (ag & 0xff00ff00);
+		}
+	}
+
+	return 0;
+}
+
+
 
 //=====================================================================
 // λͼ͸/任
 //=====================================================================
 
-// Ͳιդλͼ
-int ibitmap_raster_low(IBITMAP *dst, const ipixel_point_fixed_t *pts, 
-	const IBITMAP *src, const IRECT *rect, IUINT32 color, int flags,
-	const IRECT *clip, void *workmem)
+// դλͼmip Ϊ NULL ԴλͼΪʱ༶
+static int ibitmap_raster_core(IBITMAP *dst, const ipixel_point_fixed_t *pts,
+	const IBITMAP *src, IMIPMAP *mip, const IRECT *rect, IUINT32 color,
+	int flags, const IRECT *clip, void *workmem)
 {
 	int ntraps, width, height, startx, starty, endx, i, j, sm, sn;
 	const iColorIndex *dindex = (const iColorIndex*)dst->extra;
@@ -2090,8 +2292,13 @@ int ibitmap_raster_low(IBITMAP *dst, const ipixel_point_fixed_t *pts,
 		}
 
 		// ȡñͼ
-		ipixel_span_fetch(src, xl, line, xw, card, &matrix, fetch, 
-			NULL, rect);
+		if (mip == NULL) {
+			ipixel_span_fetch(src, xl, line, xw, card, &matrix, fetch, 
+				NULL, rect);
+		}	else {
+			ipixel_span_fetch_mipmap(mip, xl, line, xw, card, &matrix,
+				NULL, rect);
+		}
 
 		// ɫӳ
 		if (color != 0xffffffff) 
@@ -2141,6 +2348,28 @@ int ibitmap_raster_low(IBITMAP *dst, const ipixel_point_fixed_t *pts,
 }
 
 
+// Ͳιդλͼ
+int ibitmap_raster_low(IBITMAP *dst, const ipixel_point_fixed_t *pts, 
+	const IBITMAP *src, const IRECT *rect, IUINT32 color, int flags,
+	const IRECT *clip, void *workmem)
+{
+	return ibitmap_raster_core(dst, pts, src, NULL, rect, color, flags,
+		clip, workmem);
+}
+
+// Ͳιդ༶
+int ibitmap_raster_mipmap(IBITMAP *dst, const ipixel_point_fixed_t *pts, 
+	IMIPMAP *mip, const IRECT *rect, IUINT32 color, int flags,
+	const IRECT *clip, void *workmem)
+{
+	const IBITMAP *src = mip->base;
+	if (ibitmap_imode_const(src, filter) != IPIXEL_FILTER_TRILINEAR) 
+		mip = NULL;
+	return ibitmap_raster_core(dst, pts, src, mip, rect, color, flags,
+		clip, workmem);
+}
+
+
 // ͲιդҪڴ棬ջϷ
 int ibitmap_raster_base(IBITMAP *dst, const ipixel_point_fixed_t *pts, 
 	const IBITMAP *src, const IRECT *rect, IUINT32 color, int flags,
@@ -2153,18 +2382,14 @@ int ibitmap_raster_base(IBITMAP *dst, const ipixel_point_fixed_t *pts,
 	size = ibitmap_raster_low(dst, pts, src, rect, color, flags, clip, NULL);
 
 	if (size > IBITMAP_STACK_BUFFER) {
-		buffer = (char*)malloc(size);
-		if (buffer == NULL);
-		return -1;
+		buffer = (char*)ipixel_scratch(IPIXEL_SCRATCH_RASTER, size);
+		if (buffer == NULL)
+			return -1;
 	}
 
 	retval = ibitmap_raster_low(dst, pts, src, rect, color, flags,
 		clip, buffer);
 
-	if (buffer != _buffer) {
-		free(buffer);
-	}
-
 	return retval;
 }
 
@@ -2676,6 +2901,7 @@ void ipixel_source_init_bitmap(ipixel_source_t *source, IBITMAP *bmp)
 	source->srect.bottom = (int)bmp->h;
 	source->transform = NULL;
 	source->fetch = NULL;
+	source->mipmap = NULL;
 	ipixel_source_update(source);
 }
 
@@ -2785,6 +3011,16 @@ void ipixel_source_set_filter(ipixel_source_t *source,
 	}
 }
 
+// ö༶
+void ipixel_source_set_mipmap(ipixel_source_t *source, IMIPMAP *mipmap)
+{
+	if (source->type != IPIXEL_SOURCE_BITMAP) 
+		return;
+	if (mipmap != NULL && mipmap->base != source->source.bitmap)
+		return;
+	source->mipmap = mipmap;
+}
+
 // òü
 void ipixel_source_set_bound(ipixel_source_t *source,
 	const IRECT *bound)
@@ -2825,6 +3061,11 @@ static int ipixel_source_fetch_bitmap(const ipixel_source_t *source,
 	src = source->source.bitmap;
 	if (source->fetch == NULL) 
 		return -1000;
+	if (source->mipmap != NULL && 
+		ibitmap_imode_const(src, filter) == IPIXEL_FILTER_TRILINEAR) {
+		return ipixel_span_fetch_mipmap(source->mipmap, offset, line, 
+			width, card, source->transform, mask, &source->srect);
+	}
 	retval = ipixel_span_fetch(src, offset, line, width, card, 
 		source->transform, source->fetch, mask, &source->srect);
 	return retval;
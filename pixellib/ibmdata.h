@@ -288,6 +288,27 @@ int ipixel_trapezoid_spans(const ipixel_trapezoid_t *t, int n, int subpixel,
 
 
 
+//---------------------------------------------------------------------
+// ֲ߳̾ڴ棺ֻε֮临ã֮߳以
+//---------------------------------------------------------------------
+#define IPIXEL_SCRATCH_RASTER		0	// ibitmap_raster_base
+#define IPIXEL_SCRATCH_POLYGON		1	// ipixel_traps_from_polygon_ex
+#define IPIXEL_SCRATCH_SPANS		2	// ipixel_render_traps
+#define IPIXEL_SCRATCH_POINTS		3	// ipixel_render_polygon
+#define IPIXEL_SCRATCH_TRAPS		4	// ipixel_render_polygon
+#define IPIXEL_SCRATCH_SLOTS		8
+
+// ȡõǰ߳ slot Źڴ棬 size ֽڣݲʧܷ NULL
+// ͬһ slot Ƕ׵вͬʱʹ
+void *ipixel_scratch(int slot, long size);
+
+// ȡõǰ̵߳ A8 λͼ w x h Сݲ
+IBITMAP *ipixel_scratch_alpha(int w, int h);
+
+// ͷŵǰ߳ȫڴ棬߳˳ǰ
+void ipixel_scratch_release(void);
+
+
 //---------------------------------------------------------------------
 // λ
 //---------------------------------------------------------------------
@@ -319,6 +340,11 @@ int ipixel_span_fetch(const IBITMAP *image, int offset, int line,
 iBitmapFetchProc ipixel_span_get_proc(const IBITMAP *image, 
 	const ipixel_transform_t *t);
 
+// Զȡ任űڶ༶ֵ֮
+int ipixel_span_fetch_mipmap(IMIPMAP *mip, int offset, int line,
+	int width, IUINT32 *card, const ipixel_transform_t *t,
+	const IUINT8 *mask, const IRECT *clip);
+
 
 
 //---------------------------------------------------------------------
@@ -337,6 +363,12 @@ int ibitmap_raster_low(IBITMAP *dst, const ipixel_point_fixed_t *pts,
 	const IBITMAP *src, const IRECT *rect, IUINT32 color, int flags,
 	const IRECT *clip, void *workmem);
 
+// Ͳιդ༶ԴλͼΪ IPIXEL_FILTER_TRILINEAR ʱ
+// ͬ ibitmap_raster_low  mip->base
+int ibitmap_raster_mipmap(IBITMAP *dst, const ipixel_point_fixed_t *pts, 
+	IMIPMAP *mip, const IRECT *rect, IUINT32 color, int flags,
+	const IRECT *clip, void *workmem);
+
 // ͲιդҪڴ棬ջϷ
 int ibitmap_raster_base(IBITMAP *dst, const ipixel_point_fixed_t *pts, 
 	const IBITMAP *src, const IRECT *rect, IUINT32 color, int flags,
@@ -486,6 +518,7 @@ struct ipixel_source
 	IUINT32 transparent;
 	iBitmapFetchProc fetch;
 	IRECT srect;
+	IMIPMAP *mipmap;
 	union ipixel_source_union source;
 };
 
@@ -525,6 +558,10 @@ void ipixel_source_set_overflow(ipixel_source_t *source,
 void ipixel_source_set_filter(ipixel_source_t *source,
 	enum IPIXELFILTER filter);
 
+// ö༶Ϊ IPIXEL_FILTER_TRILINEAR ʱʹãNULL ȡ
+// ڼ䲻ܵ ibitmap_mipmap_invalidateֱʹøλͼ
+void ipixel_source_set_mipmap(ipixel_source_t *source, IMIPMAP *mipmap);
+
 // òü
 void ipixel_source_set_bound(ipixel_source_t *source,
 	const IRECT *bound);
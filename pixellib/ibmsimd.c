@@ -0,0 +1,2940 @@
+//=====================================================================
+//
+// ibmsimd.c - x86-64 runtime cpu dispatch
+//
+// NOTE:
+// for more information, please see the readme file
+//
+//=====================================================================
+
+#include "ibmsimd.h"
+#include "ibitmap.h"
+#include "ibmbits.h"
+#include "ibmcols.h"
+#include "iblit386.h"
+#include "ibmsse2.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+//---------------------------------------------------------------------
+// platform: x86-64 with a compiler accepting intrinsics of a higher
+// instruction set inside a function (target attribute for gcc/clang)
+//---------------------------------------------------------------------
+#if (defined(__x86_64__) || defined(__amd64__) || defined(_M_X64) || \
+	defined(_M_AMD64)) && (!defined(IPIXEL_NO_SIMD))
+	#if defined(_MSC_VER) && (!defined(__clang__))
+		#if (_MSC_VER >= 1700)
+			#define IPIXEL_SIMD_X64
+			#define IPIXEL_SIMD_TARGET(isa)
+		#endif
+	#elif defined(__clang__)
+		#define IPIXEL_SIMD_X64
+		#define IPIXEL_SIMD_TARGET(isa) __attribute__((target(isa)))
+	#elif defined(__GNUC__)
+		#if (__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9))
+			#define IPIXEL_SIMD_X64
+			#define IPIXEL_SIMD_TARGET(isa) __attribute__((target(isa)))
+		#endif
+	#endif
+#endif
+
+#ifdef IPIXEL_SIMD_X64
+	#if defined(_MSC_VER) && (!defined(__clang__))
+		#include <intrin.h>
+	#else
+		#include <cpuid.h>
+	#endif
+	#include <immintrin.h>
+#endif
+
+
+//---------------------------------------------------------------------
+// global definition
+//---------------------------------------------------------------------
+static int ipixel_simd_detected = IPIXEL_SIMD_NONE;
+static ipixel_once_t ipixel_simd_detect_once = IPIXEL_ONCE_INIT;
+static int ipixel_simd_current = IPIXEL_SIMD_NONE;
+
+static const char *ipixel_simd_names[IPIXEL_SIMD_COUNT] = {
+	"c", "sse2", "ssse3", "sse4.1", "avx2", "avx512bw",
+};
+
+
+#ifdef IPIXEL_SIMD_X64
+//---------------------------------------------------------------------
+// cpuid / xgetbv
+//---------------------------------------------------------------------
+static void ipixel_simd_cpuid(int leaf, int sub, unsigned int *regs)
+{
+#if defined(_MSC_VER) && (!defined(__clang__))
+	int info[4];
+	__cpuidex(info, leaf, sub);
+	regs[0] = (unsigned int)info[0];
+	regs[1] = (unsigned int)info[1];
+	regs[2] = (unsigned int)info[2];
+	regs[3] = (unsigned int)info[3];
+#else
+	unsigned int a, b, c, d;
+	__cpuid_count(leaf, sub, a, b, c, d);
+	regs[0] = a;
+	regs[1] = b;
+	regs[2] = c;
+	regs[3] = d;
+#endif
+}
+
+// XCR0: register states enabled by the os
+static unsigned int ipixel_simd_xgetbv(void)
+{
+#if defined(_MSC_VER) && (!defined(__clang__))
+	return (unsigned int)_xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ __volatile__ (".byte 0x0f, 0x01, 0xd0"
+		: "=a"(eax), "=d"(edx) : "c"(0));
+	return eax;
+#endif
+}
+
+static int ipixel_simd_probe(void)
+{
+	unsigned int regs[4], maxleaf, ecx1, ebx7 = 0, xcr0 = 0;
+	int level = IPIXEL_SIMD_SSE2;
+
+	ipixel_simd_cpuid(0, 0, regs);
+	maxleaf = regs[0];
+	if (maxleaf < 1) return level;
+
+	ipixel_simd_cpuid(1, 0, regs);
+	ecx1 = regs[2];
+
+	if (maxleaf >= 7) {
+		ipixel_simd_cpuid(7, 0, regs);
+		ebx7 = regs[1];
+	}
+
+	// OSXSAVE: xgetbv is usable
+	if (ecx1 & (1u << 27)) {
+		xcr0 = ipixel_simd_xgetbv();
+	}
+
+	if ((ecx1 & (1u << 9)) == 0) return level;		// SSSE3
+	level = IPIXEL_SIMD_SSSE3;
+
+	if ((ecx1 & (1u << 19)) == 0) return level;		// SSE4.1
+	level = IPIXEL_SIMD_SSE41;
+
+	// AVX + AVX2, os saves xmm and ymm
+	if ((ecx1 & (1u << 28)) == 0 || (ebx7 & (1u << 5)) == 0) return level;
+	if ((xcr0 & 0x06) != 0x06) return level;
+	level = IPIXEL_SIMD_AVX2;
+
+	// AVX512F + AVX512BW, os saves opmask, zmm_hi256 and hi16_zmm
+	if ((ebx7 & (1u << 16)) == 0 || (ebx7 & (1u << 30)) == 0) return level;
+	if ((xcr0 & 0xe6) != 0xe6) return level;
+	level = IPIXEL_SIMD_AVX512BW;
+
+	return level;
+}
+
+
+//---------------------------------------------------------------------
+// restore every hook this file may install
+//---------------------------------------------------------------------
+static void ipixel_simd_restore(void)
+{
+	int fmt, i;
+	for (fmt = 0; fmt < IPIX_FMT_COUNT; fmt++) {
+		ipixel_set_proc(fmt, IPIXEL_PROC_TYPE_FETCH, NULL);
+		ipixel_set_proc(fmt, IPIXEL_PROC_TYPE_STORE, NULL);
+		ipixel_set_proc(fmt, IPIXEL_PROC_TYPE_FETCHPIXEL, NULL);
+		for (i = 0; i < 3; i++) {
+			ipixel_set_span_proc(fmt, i, NULL);
+			ipixel_set_hline_proc(fmt, i, NULL);
+		}
+	}
+	for (i = 0; i <= IPIXEL_OP_OVERLAY; i++) {
+		ipixel_composite_set(i, NULL);
+	}
+	for (i = 0; i < 6; i++) {
+		ipixel_card_set_proc(i, NULL);
+	}
+	for (fmt = IPIX_FMT_A8R8G8B8; fmt <= IPIX_FMT_B8G8R8X8; fmt++) {
+		ipixel_cvt_set(fmt, IPIX_FMT_R8G8B8, 0, NULL);
+		ipixel_cvt_set(fmt, IPIX_FMT_B8G8R8, 0, NULL);
+		ipixel_cvt_set(IPIX_FMT_R8G8B8, fmt, 0, NULL);
+		ipixel_cvt_set(IPIX_FMT_B8G8R8, fmt, 0, NULL);
+	}
+	ibitmap_funcset(IBITMAP_BLITER_NORM, NULL);
+	ibitmap_funcset(IBITMAP_BLITER_MASK, NULL);
+	ibitmap_funcset(IBITMAP_BLITER_FLIP, NULL);
+	for (fmt = 0; fmt < IPIX_FMT_COUNT; fmt++) {
+		for (i = 0; i < 18; i++) {
+			ibitmap_scanline_set_proc(fmt, i, 
+				ibitmap_scanline_get_proc(fmt, i, 1));
+		}
+	}
+	ibitmap_scale_box_set_proc(NULL);
+	ibitmap_scale_kernel_set_proc(0, NULL);
+	ibitmap_scale_kernel_set_proc(1, NULL);
+}
+
+
+//---------------------------------------------------------------------
+// blitters: rows are copied by the procedures below, ibitmap_blit
+// calls the c blitter when one returns nonzero (24 bits h-flip).
+//---------------------------------------------------------------------
+
+// colour key replicated in a 32 bits word
+static IUINT32 ipixel_simd_key(int pixsize, unsigned long mask)
+{
+	switch (pixsize) {
+	case 1: return ((IUINT32)mask & 0xff) * 0x01010101;
+	case 2: return ((IUINT32)mask & 0xffff) * 0x00010001;
+	case 3: return (IUINT32)mask & 0xffffff;
+	}
+	return (IUINT32)mask;
+}
+
+// scalar pixels, source moves 'step' bytes per pixel
+static void ipixel_simd_pixels(char *dst, const char *src, int count,
+	int pixsize, int step, int masked, IUINT32 key)
+{
+	const unsigned char *p = (const unsigned char*)src;
+	IUINT32 c = 0;
+	for (; count > 0; count--, dst += pixsize, p += step) {
+		if (masked) {
+			switch (pixsize) {
+			case 1: c = p[0] | (key & 0xffffff00); break;
+			case 2: c = (p[0] | (p[1] << 8)) | (key & 0xffff0000); break;
+			case 3: c = p[0] | (p[1] << 8) | (p[2] << 16); break;
+			case 4: c = *(const IUINT32*)p; break;
+			}
+			if (c == key) continue;
+		}
+		switch (pixsize) {
+		case 1: dst[0] = (char)p[0]; break;
+		case 2: *(IUINT16*)dst = *(const IUINT16*)p; break;
+		case 3: dst[0] = (char)p[0]; dst[1] = (char)p[1];
+				dst[2] = (char)p[2]; break;
+		case 4: *(IUINT32*)dst = *(const IUINT32*)p; break;
+		}
+	}
+}
+
+// equal lanes of one pixel size
+static inline __m128i ipixel_simd_cmp_sse2(__m128i x, __m128i key,
+	int pixsize)
+{
+	if (pixsize == 1) return _mm_cmpeq_epi8(x, key);
+	if (pixsize == 2) return _mm_cmpeq_epi16(x, key);
+	return _mm_cmpeq_epi32(x, key);
+}
+
+// reverse pixel order of a register
+static inline __m128i ipixel_simd_reverse_sse2(__m128i x, int pixsize)
+{
+	if (pixsize == 4) return _mm_shuffle_epi32(x, 0x1b);
+	if (pixsize == 1) {
+		x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+	}
+	x = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0x1b), 0x1b);
+	return _mm_shuffle_epi32(x, 0x4e);
+}
+
+// write s over d except colour key pixels (m set)
+static inline void ipixel_simd_store_sse2(char *dst, __m128i s,
+	__m128i m)
+{
+	int bits = _mm_movemask_epi8(m);
+	if (bits == 0) {
+		_mm_storeu_si128((__m128i*)dst, s);
+	}
+	else if (bits != 0xffff) {
+		__m128i d = _mm_loadu_si128((const __m128i*)dst);
+		d = _mm_or_si128(_mm_and_si128(m, d), _mm_andnot_si128(m, s));
+		_mm_storeu_si128((__m128i*)dst, d);
+	}
+}
+
+static void ipixel_simd_copy_sse2(char *dst, const char *src, long size)
+{
+	__m128i x0, x1, x2, x3;
+	for (; size >= 64; size -= 64, dst += 64, src += 64) {
+		x0 = _mm_loadu_si128((const __m128i*)src + 0);
+		x1 = _mm_loadu_si128((const __m128i*)src + 1);
+		x2 = _mm_loadu_si128((const __m128i*)src + 2);
+		x3 = _mm_loadu_si128((const __m128i*)src + 3);
+		_mm_storeu_si128((__m128i*)dst + 0, x0);
+		_mm_storeu_si128((__m128i*)dst + 1, x1);
+		_mm_storeu_si128((__m128i*)dst + 2, x2);
+		_mm_storeu_si128((__m128i*)dst + 3, x3);
+	}
+	for (; size >= 16; size -= 16, dst += 16, src += 16) {
+		x0 = _mm_loadu_si128((const __m128i*)src);
+		_mm_storeu_si128((__m128i*)dst, x0);
+	}
+	if (size > 0) memcpy(dst, src, size);
+}
+
+// 24 bits: 16 pixels in three registers, mixed groups go scalar
+static void ipixel_simd_mask24_sse2(char *dst, const char *src, int w,
+	IUINT32 key)
+{
+	unsigned char pattern[48];
+	unsigned long long e, p, all = 0x249249249249ULL;
+	__m128i s0, s1, s2, k0, k1, k2;
+	int i;
+	for (i = 0; i < 48; i++) {
+		pattern[i] = (unsigned char)(key >> ((i % 3) * 8));
+	}
+	k0 = _mm_loadu_si128((const __m128i*)pattern + 0);
+	k1 = _mm_loadu_si128((const __m128i*)pattern + 1);
+	k2 = _mm_loadu_si128((const __m128i*)pattern + 2);
+	for (; w >= 16; w -= 16, dst += 48, src += 48) {
+		s0 = _mm_loadu_si128((const __m128i*)src + 0);
+		s1 = _mm_loadu_si128((const __m128i*)src + 1);
+		s2 = _mm_loadu_si128((const __m128i*)src + 2);
+		e = (unsigned long long)_mm_movemask_epi8(_mm_cmpeq_epi8(s0, k0));
+		e |= (unsigned long long)_mm_movemask_epi8(_mm_cmpeq_epi8(s1, k1))
+			<< 16;
+		e |= (unsigned long long)_mm_movemask_epi8(_mm_cmpeq_epi8(s2, k2))
+			<< 32;
+		p = e & (e >> 1) & (e >> 2) & all;
+		if (p == 0) {
+			_mm_storeu_si128((__m128i*)dst + 0, s0);
+			_mm_storeu_si128((__m128i*)dst + 1, s1);
+			_mm_storeu_si128((__m128i*)dst + 2, s2);
+		}
+		else if (p != all) {
+			ipixel_simd_pixels(dst, src, 16, 3, 3, 1, key);
+		}
+	}
+	ipixel_simd_pixels(dst, src, w, 3, 3, 1, key);
+}
+
+static void ipixel_simd_mask_sse2(char *dst, const char *src, int w,
+	int pixsize, IUINT32 key)
+{
+	__m128i k = _mm_set1_epi32((int)key);
+	__m128i s;
+	int n = 16 / pixsize;
+	if (pixsize == 3) {
+		ipixel_simd_mask24_sse2(dst, src, w, key);
+		return;
+	}
+	for (; w >= n; w -= n, dst += 16, src += 16) {
+		s = _mm_loadu_si128((const __m128i*)src);
+		ipixel_simd_store_sse2(dst, s, ipixel_simd_cmp_sse2(s, k, pixsize));
+	}
+	ipixel_simd_pixels(dst, src, w, pixsize, pixsize, 1, key);
+}
+
+// src is the first pixel of the source row, read from the right end
+static void ipixel_simd_flip_sse2(char *dst, const char *src, int w,
+	int pixsize, int masked, IUINT32 key)
+{
+	const char *end = src + w * pixsize;
+	__m128i k = _mm_set1_epi32((int)key);
+	__m128i s;
+	int n = 16 / pixsize;
+	for (; w >= n; w -= n, dst += 16) {
+		end -= 16;
+		s = _mm_loadu_si128((const __m128i*)end);
+		s = ipixel_simd_reverse_sse2(s, pixsize);
+		if (masked == 0) _mm_storeu_si128((__m128i*)dst, s);
+		else ipixel_simd_store_sse2(dst, s,
+				ipixel_simd_cmp_sse2(s, k, pixsize));
+	}
+	ipixel_simd_pixels(dst, end - pixsize, w, pixsize, -pixsize,
+		masked, key);
+}
+
+static int ipixel_simd_blitn_sse2(char *dst, long pitch1, const char *src,
+	long pitch2, int w, int h, int pixsize, long linesize)
+{
+	for (; h > 0; h--, dst += pitch1, src += pitch2) {
+		ipixel_simd_copy_sse2(dst, src, linesize);
+	}
+	return 0;
+}
+
+static int ipixel_simd_blitm_sse2(char *dst, long pitch1, const char *src,
+	long pitch2, int w, int h, int pixsize, long linesize,
+	unsigned long mask)
+{
+	IUINT32 key = ipixel_simd_key(pixsize, mask);
+	for (; h > 0; h--, dst += pitch1, src += pitch2) {
+		ipixel_simd_mask_sse2(dst, src, w, pixsize, key);
+	}
+	return 0;
+}
+
+static int ipixel_simd_blitf_sse2(char *dst, long pitch1, const char *src,
+	long pitch2, int w, int h, int pixsize, long linesize,
+	unsigned long mask, int flag)
+{
+	IUINT32 key = ipixel_simd_key(pixsize, mask);
+	int masked = (flag & IBLIT_MASK)? 1 : 0;
+	if (flag & IBLIT_VFLIP) pitch2 = -pitch2;
+	if ((flag & IBLIT_HFLIP) == 0) {
+		for (; h > 0; h--, dst += pitch1, src += pitch2) {
+			if (masked == 0) ipixel_simd_copy_sse2(dst, src, linesize);
+			else ipixel_simd_mask_sse2(dst, src, w, pixsize, key);
+		}
+		return 0;
+	}
+	if (pixsize == 3) return -1;
+	for (; h > 0; h--, dst += pitch1, src += pitch2) {
+		ipixel_simd_flip_sse2(dst, src, w, pixsize, masked, key);
+	}
+	return 0;
+}
+
+
+//---------------------------------------------------------------------
+// AVX2 blitters: 32 bytes per step, the rest of a row goes to sse2
+// after vzeroupper (the sse2 code is not vex encoded)
+//---------------------------------------------------------------------
+IPIXEL_SIMD_TARGET("avx2")
+static inline __m256i ipixel_simd_cmp_avx2(__m256i x, __m256i key,
+	int pixsize)
+{
+	if (pixsize == 1) return _mm256_cmpeq_epi8(x, key);
+	if (pixsize == 2) return _mm256_cmpeq_epi16(x, key);
+	return _mm256_cmpeq_epi32(x, key);
+}
+
+IPIXEL_SIMD_TARGET("avx2")
+static inline __m256i ipixel_simd_reverse_avx2(__m256i x, int pixsize)
+{
+	if (pixsize == 4) {
+		__m256i index = _mm256_set_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+		return _mm256_permutevar8x32_epi32(x, index);
+	}
+	if (pixsize == 2) {
+		x = _mm256_shuffle_epi8(x, _mm256_set_epi8(
+			1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+			1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14));
+	}	else {
+		x = _mm256_shuffle_epi8(x, _mm256_set_epi8(
+			0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+			0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+	}
+	return _mm256_permute4x64_epi64(x, 0x4e);
+}
+
+IPIXEL_SIMD_TARGET("avx2")
+static inline void ipixel_simd_store_avx2(char *dst, __m256i s,
+	__m256i m)
+{
+	int bits = _mm256_movemask_epi8(m);
+	if (bits == 0) {
+		_mm256_storeu_si256((__m256i*)dst, s);
+	}
+	else if (bits != -1) {
+		__m256i d = _mm256_loadu_si256((const __m256i*)dst);
+		_mm256_storeu_si256((__m256i*)dst, _mm256_blendv_epi8(s, d, m));
+	}
+}
+
+IPIXEL_SIMD_TARGET("avx2")
+static void ipixel_simd_copy_avx2(char *dst, const char *src, long size)
+{
+	__m256i x0, x1, x2, x3;
+	for (; size >= 128; size -= 128, dst += 128, src += 128) {
+		x0 = _mm256_loadu_si256((const __m256i*)src + 0);
+		x1 = _mm256_loadu_si256((const __m256i*)src + 1);
+		x2 = _mm256_loadu_si256((const __m256i*)src + 2);
+		x3 = _mm256_loadu_si256((const __m256i*)src + 3);
+		_mm256_storeu_si256((__m256i*)dst + 0, x0);
+		_mm256_storeu_si256((__m256i*)dst + 1, x1);
+		_mm256_storeu_si256((__m256i*)dst + 2, x2);
+		_mm256_storeu_si256((__m256i*)dst + 3, x3);
+	}
+	for (; size >= 32; size -= 32, dst += 32, src += 32) {
+		x0 = _mm256_loadu_si256((const __m256i*)src);
+		_mm256_storeu_si256((__m256i*)dst, x0);
+	}
+	_mm256_zeroupper();
+	if (size > 0) ipixel_simd_copy_sse2(dst, src, size);
+}
+
+IPIXEL_SIMD_TARGET("avx2")
+static void ipixel_simd_mask_avx2(char *dst, const char *src, int w,
+	int pixsize, IUINT32 key)
+{
+	__m256i k = _mm256_set1_epi32((int)key);
+	__m256i s;
+	int n = 32 / pixsize;
+	if (pixsize == 3) {
+		ipixel_simd_mask24_sse2(dst, src, w, key);
+		return;
+	}
+	for (; w >= n; w -= n, dst += 32, src += 32) {
+		s = _mm256_loadu_si256((const __m256i*)src);
+		ipixel_simd_store_avx2(dst, s, ipixel_simd_cmp_avx2(s, k, pixsize));
+	}
+	_mm256_zeroupper();
+	ipixel_simd_mask_sse2(dst, src, w, pixsize, key);
+}
+
+IPIXEL_SIMD_TARGET("avx2")
+static void ipixel_simd_flip_avx2(char *dst, const char *src, int w,
+	int pixsize, int masked, IUINT32 key)
+{
+	const char *end = src + w * pixsize;
+	__m256i k = _mm256_set1_epi32((int)key);
+	__m256i s;
+	int n = 32 / pixsize;
+	for (; w >= n; w -= n, dst += 32) {
+		end -= 32;
+		s = _mm256_loadu_si256((const __m256i*)end);
+		s = ipixel_simd_reverse_avx2(s, pixsize);
+		if (masked == 0) _mm256_storeu_si256((__m256i*)dst, s);
+		else ipixel_simd_store_avx2(dst, s,
+				ipixel_simd_cmp_avx2(s, k, pixsize));
+	}
+	_mm256_zeroupper();
+	ipixel_simd_flip_sse2(dst, src, w, pixsize, masked, key);
+}
+
+IPIXEL_SIMD_TARGET("avx2")
+static int ipixel_simd_blitn_avx2(char *dst, long pitch1, const char *src,
+	long pitch2, int w, int h, int pixsize, long linesize)
+{
+	for (; h > 0; h--, dst += pitch1, src += pitch2) {
+		ipixel_simd_copy_avx2(dst, src, linesize);
+	}
+	return 0;
+}
+
+IPIXEL_SIMD_TARGET("avx2")
+static int ipixel_simd_blitm_avx2(char *dst, long pitch1, const char *src,
+	long pitch2, int w, int h, int pixsize, long linesize,
+	unsigned long mask)
+{
+	IUINT32 key = ipixel_simd_key(pixsize, mask);
+	for (; h > 0; h--, dst += pitch1, src += pitch2) {
+		ipixel_simd_mask_avx2(dst, src, w, pixsize, key);
+	}
+	return 0;
+}
+
+IPIXEL_SIMD_TARGET("avx2")
+static int ipixel_simd_blitf_avx2(char *dst, long pitch1, const char *src,
+	long pitch2, int w, int h, int pixsize, long linesize,
+	unsigned long mask, int flag)
+{
+	IUINT32 key = ipixel_simd_key(pixsize, mask);
+	int masked = (flag & IBLIT_MASK)? 1 : 0;
+	if (flag & IBLIT_VFLIP) pitch2 = -pitch2;
+	if ((flag & IBLIT_HFLIP) == 0) {
+		for (; h > 0; h--, dst += pitch1, src += pitch2) {
+			if (masked == 0) ipixel_simd_copy_avx2(dst, src, linesize);
+			else ipixel_simd_mask_avx2(dst, src, w, pixsize, key);
+		}
+		return 0;
+	}
+	if (pixsize == 3) return -1;
+	for (; h > 0; h--, dst += pitch1, src += pitch2) {
+		ipixel_simd_flip_avx2(dst, src, w, pixsize, masked, key);
+	}
+	return 0;
+}
+
+
+//---------------------------------------------------------------------
+// vector primitives: the compositors below are written once against
+// these names and instantiated for sse2 (4 pixels) and avx2 (8 pixels).
+// words are A8R8G8B8 channels unpacked in B, G, R, A order.
+//---------------------------------------------------------------------
+#define IPIXEL_SIMD_V(isa, name) ipixel_simd_##isa##_##name
+
+#define ipixel_simd_sse2_load(p) _mm_loadu_si128((const __m128i*)(p))
+#define ipixel_simd_sse2_store(p, x) _mm_storeu_si128((__m128i*)(p), x)
+#define ipixel_simd_sse2_zero() _mm_setzero_si128()
+#define ipixel_simd_sse2_set32(x) _mm_set1_epi32((int)(x))
+#define ipixel_simd_sse2_set16(x) _mm_set1_epi16((short)(x))
+#define ipixel_simd_sse2_set8(x) _mm_set1_epi8((char)(x))
+#define ipixel_simd_sse2_lo(x) _mm_unpacklo_epi8(x, _mm_setzero_si128())
+#define ipixel_simd_sse2_hi(x) _mm_unpackhi_epi8(x, _mm_setzero_si128())
+#define ipixel_simd_sse2_pack(x, y) _mm_packus_epi16(x, y)
+#define ipixel_simd_sse2_add16(x, y) _mm_add_epi16(x, y)
+#define ipixel_simd_sse2_sub16(x, y) _mm_sub_epi16(x, y)
+#define ipixel_simd_sse2_mul16(x, y) _mm_mullo_epi16(x, y)
+#define ipixel_simd_sse2_min16(x, y) _mm_min_epi16(x, y)
+#define ipixel_simd_sse2_srl16(x, n) _mm_srli_epi16(x, n)
+#define ipixel_simd_sse2_gt16(x, y) _mm_cmpgt_epi16(x, y)
+#define ipixel_simd_sse2_and(x, y) _mm_and_si128(x, y)
+#define ipixel_simd_sse2_or(x, y) _mm_or_si128(x, y)
+#define ipixel_simd_sse2_xor(x, y) _mm_xor_si128(x, y)
+#define ipixel_simd_sse2_adds8(x, y) _mm_adds_epu8(x, y)
+#define ipixel_simd_sse2_subs8(x, y) _mm_subs_epu8(x, y)
+#define ipixel_simd_sse2_sub8(x, y) _mm_sub_epi8(x, y)
+#define ipixel_simd_sse2_min8(x, y) _mm_min_epu8(x, y)
+#define ipixel_simd_sse2_max8(x, y) _mm_max_epu8(x, y)
+#define ipixel_simd_sse2_avg8(x, y) _mm_avg_epu8(x, y)
+#define ipixel_simd_sse2_add32(x, y) _mm_add_epi32(x, y)
+#define ipixel_simd_sse2_srl32(x, n) _mm_srli_epi32(x, n)
+#define ipixel_simd_sse2_eq32(x, y) _mm_cmpeq_epi32(x, y)
+#define ipixel_simd_sse2_all(m) (_mm_movemask_epi8(m) == 0xffff)
+#define ipixel_simd_sse2_alpha16(x) \
+	_mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xff), 0xff)
+#define ipixel_simd_sse2_amask16() \
+	_mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0)
+#define ipixel_simd_sse2_leave()
+#define ipixel_simd_sse2_load4(p) _mm_set_epi32((int)(p)[3], (int)(p)[2], \
+	(int)(p)[1], (int)(p)[0])
+
+static inline __m128i ipixel_simd_sse2_select(__m128i m, __m128i a,
+	__m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b));
+}
+
+// words: floor(x * 255 / a), lanes of x >= a are undefined
+static inline __m128i ipixel_simd_sse2_div16(__m128i x, __m128i a)
+{
+	__m128i z = _mm_setzero_si128();
+	__m128 k = _mm_set1_ps(255.0f);
+	__m128 x0 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(x, z)), k);
+	__m128 x1 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(x, z)), k);
+	__m128 a0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(a, z));
+	__m128 a1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(a, z));
+	return _mm_packs_epi32(_mm_cvttps_epi32(_mm_div_ps(x0, a0)),
+		_mm_cvttps_epi32(_mm_div_ps(x1, a1)));
+}
+
+#define ipixel_simd_avx2_load(p) _mm256_loadu_si256((const __m256i*)(p))
+#define ipixel_simd_avx2_store(p, x) _mm256_storeu_si256((__m256i*)(p), x)
+#define ipixel_simd_avx2_zero() _mm256_setzero_si256()
+#define ipixel_simd_avx2_set32(x) _mm256_set1_epi32((int)(x))
+#define ipixel_simd_avx2_set16(x) _mm256_set1_epi16((short)(x))
+#define ipixel_simd_avx2_set8(x) _mm256_set1_epi8((char)(x))
+#define ipixel_simd_avx2_lo(x) _mm256_unpacklo_epi8(x, _mm256_setzero_si256())
+#define ipixel_simd_avx2_hi(x) _mm256_unpackhi_epi8(x, _mm256_setzero_si256())
+#define ipixel_simd_avx2_pack(x, y) _mm256_packus_epi16(x, y)
+#define ipixel_simd_avx2_add16(x, y) _mm256_add_epi16(x, y)
+#define ipixel_simd_avx2_sub16(x, y) _mm256_sub_epi16(x, y)
+#define ipixel_simd_avx2_mul16(x, y) _mm256_mullo_epi16(x, y)
+#define ipixel_simd_avx2_min16(x, y) _mm256_min_epi16(x, y)
+#define ipixel_simd_avx2_srl16(x, n) _mm256_srli_epi16(x, n)
+#define ipixel_simd_avx2_gt16(x, y) _mm256_cmpgt_epi16(x, y)
+#define ipixel_simd_avx2_and(x, y) _mm256_and_si256(x, y)
+#define ipixel_simd_avx2_or(x, y) _mm256_or_si256(x, y)
+#define ipixel_simd_avx2_xor(x, y) _mm256_xor_si256(x, y)
+#define ipixel_simd_avx2_adds8(x, y) _mm256_adds_epu8(x, y)
+#define ipixel_simd_avx2_subs8(x, y) _mm256_subs_epu8(x, y)
+#define ipixel_simd_avx2_sub8(x, y) _mm256_sub_epi8(x, y)
+#define ipixel_simd_avx2_min8(x, y) _mm256_min_epu8(x, y)
+#define ipixel_simd_avx2_max8(x, y) _mm256_max_epu8(x, y)
+#define ipixel_simd_avx2_avg8(x, y) _mm256_avg_epu8(x, y)
+#define ipixel_simd_avx2_add32(x, y) _mm256_add_epi32(x, y)
+#define ipixel_simd_avx2_srl32(x, n) _mm256_srli_epi32(x, n)
+#define ipixel_simd_avx2_eq32(x, y) _mm256_cmpeq_epi32(x, y)
+#define ipixel_simd_avx2_all(m) (_mm256_movemask_epi8(m) == -1)
+#define ipixel_simd_avx2_alpha16(x) \
+	_mm256_shufflehi_epi16(_mm256_shufflelo_epi16(x, 0xff), 0xff)
+#define ipixel_simd_avx2_amask16() _mm256_set_epi16(-1, 0, 0, 0, \
+	-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0)
+#define ipixel_simd_avx2_leave() _mm256_zeroupper()
+#define ipixel_simd_avx2_load4(p) _mm256_set_epi32((int)(p)[7], \
+	(int)(p)[6], (int)(p)[5], (int)(p)[4], (int)(p)[3], (int)(p)[2], \
+	(int)(p)[1], (int)(p)[0])
+
+IPIXEL_SIMD_TARGET("avx2")
+static inline __m256i ipixel_simd_avx2_select(__m256i m, __m256i a,
+	__m256i b)
+{
+	return _mm256_blendv_epi8(b, a, m);
+}
+
+IPIXEL_SIMD_TARGET("avx2")
+static inline __m256i ipixel_simd_avx2_div16(__m256i x, __m256i a)
+{
+	__m256i z = _mm256_setzero_si256();
+	__m256 k = _mm256_set1_ps(255.0f);
+	__m256 x0 = _mm256_mul_ps(_mm256_cvtepi32_ps(
+		_mm256_unpacklo_epi16(x, z)), k);
+	__m256 x1 = _mm256_mul_ps(_mm256_cvtepi32_ps(
+		_mm256_unpackhi_epi16(x, z)), k);
+	__m256 a0 = _mm256_cvtepi32_ps(_mm256_unpacklo_epi16(a, z));
+	__m256 a1 = _mm256_cvtepi32_ps(_mm256_unpackhi_epi16(a, z));
+	return _mm256_packs_epi32(_mm256_cvttps_epi32(_mm256_div_ps(x0, a0)),
+		_mm256_cvttps_epi32(_mm256_div_ps(x1, a1)));
+}
+
+
+//---------------------------------------------------------------------
+// compositor kernels, bit exact with ipixel_comp_* in ibmbits.c.
+// porter duff factors: 0 zero, 1 one, 2 sa, 3 1 - sa, 4 da, 5 1 - da,
+// -1 means PLUS. 'normal' operators premultiply first (_ipixel_mullut)
+// and divide by the result alpha after (_ipixel_divlut).
+//---------------------------------------------------------------------
+#define IPIXEL_SIMD_KERNELS(isa, target, V, N) \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_mul255(V x, V y) \
+{ \
+	V t = IPIXEL_SIMD_V(isa, mul16)(x, y); \
+	V u = IPIXEL_SIMD_V(isa, add16)(t, IPIXEL_SIMD_V(isa, set16)(257)); \
+	t = IPIXEL_SIMD_V(isa, add16)(t, IPIXEL_SIMD_V(isa, srl16)(u, 8)); \
+	return IPIXEL_SIMD_V(isa, srl16)(t, 8); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_factor(V x, int code, V sa, V da) \
+{ \
+	V k = IPIXEL_SIMD_V(isa, set16)(255); \
+	switch (code) { \
+	case 1: return x; \
+	case 2: return ipixel_simd_##isa##_mul255(x, sa); \
+	case 3: return ipixel_simd_##isa##_mul255(x, \
+				IPIXEL_SIMD_V(isa, sub16)(k, sa)); \
+	case 4: return ipixel_simd_##isa##_mul255(x, da); \
+	case 5: return ipixel_simd_##isa##_mul255(x, \
+				IPIXEL_SIMD_V(isa, sub16)(k, da)); \
+	} \
+	return IPIXEL_SIMD_V(isa, zero)(); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_porter(V s, V d, int fs, int fd, \
+	int normal) \
+{ \
+	V amask = IPIXEL_SIMD_V(isa, amask16)(); \
+	V sa = IPIXEL_SIMD_V(isa, alpha16)(s); \
+	V da = IPIXEL_SIMD_V(isa, alpha16)(d); \
+	V r, ra, q; \
+	if (normal) { \
+		s = IPIXEL_SIMD_V(isa, select)(amask, s, \
+			ipixel_simd_##isa##_mul255(s, sa)); \
+		d = IPIXEL_SIMD_V(isa, select)(amask, d, \
+			ipixel_simd_##isa##_mul255(d, da)); \
+	} \
+	if (fs < 0) { \
+		r = IPIXEL_SIMD_V(isa, min16)(IPIXEL_SIMD_V(isa, add16)(s, d), \
+			IPIXEL_SIMD_V(isa, set16)(255)); \
+	}	else { \
+		r = IPIXEL_SIMD_V(isa, add16)( \
+			ipixel_simd_##isa##_factor(s, fs, sa, da), \
+			ipixel_simd_##isa##_factor(d, fd, sa, da)); \
+	} \
+	if (normal) { \
+		ra = IPIXEL_SIMD_V(isa, alpha16)(r); \
+		q = IPIXEL_SIMD_V(isa, div16)(r, ra); \
+		q = IPIXEL_SIMD_V(isa, select)(IPIXEL_SIMD_V(isa, gt16)(ra, r), \
+			q, IPIXEL_SIMD_V(isa, set16)(255)); \
+		r = IPIXEL_SIMD_V(isa, select)(amask, r, q); \
+	} \
+	return r; \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_duff(V s, V d, int fs, int fd, \
+	int normal) \
+{ \
+	return IPIXEL_SIMD_V(isa, pack)( \
+		ipixel_simd_##isa##_porter(IPIXEL_SIMD_V(isa, lo)(s), \
+			IPIXEL_SIMD_V(isa, lo)(d), fs, fd, normal), \
+		ipixel_simd_##isa##_porter(IPIXEL_SIMD_V(isa, hi)(s), \
+			IPIXEL_SIMD_V(isa, hi)(d), fs, fd, normal)); \
+} \
+/* per pixel: source alpha zero keeps dest */ \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_keep(V s, V d, V r) \
+{ \
+	V m = IPIXEL_SIMD_V(isa, eq32)(IPIXEL_SIMD_V(isa, srl32)(s, 24), \
+		IPIXEL_SIMD_V(isa, zero)()); \
+	return IPIXEL_SIMD_V(isa, select)(m, d, r); \
+} \
+/* rgb from r, alpha byte from a */ \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_rgba(V r, V a) \
+{ \
+	V m = IPIXEL_SIMD_V(isa, set32)(0xff000000); \
+	return IPIXEL_SIMD_V(isa, select)(m, a, r); \
+} \
+/* IBLEND_NORMAL_FAST, lut entries are fetched by scalar code */ \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_blend(V s, V d) \
+{ \
+	IUINT32 ip[N], fp[N]; \
+	V f, f0, f1, s0, s1, d0, d1, k, r, m; \
+	int i; \
+	f = IPIXEL_SIMD_V(isa, or)( \
+		IPIXEL_SIMD_V(isa, and)(IPIXEL_SIMD_V(isa, srl32)(d, 20), \
+			IPIXEL_SIMD_V(isa, set32)(0xf80)), \
+		IPIXEL_SIMD_V(isa, and)(IPIXEL_SIMD_V(isa, srl32)(s, 25), \
+			IPIXEL_SIMD_V(isa, set32)(0x7e))); \
+	IPIXEL_SIMD_V(isa, store)(ip, f); \
+	for (i = 0; i < N; i++) { \
+		const unsigned char *lut = ipixel_blend_lut + ip[i]; \
+		fp[i] = ((IUINT32)lut[1] << 24) | ((IUINT32)lut[0] * 0x10101); \
+	} \
+	f = IPIXEL_SIMD_V(isa, load4)(fp); \
+	f0 = IPIXEL_SIMD_V(isa, lo)(f); \
+	f1 = IPIXEL_SIMD_V(isa, hi)(f); \
+	f0 = IPIXEL_SIMD_V(isa, add16)(f0, IPIXEL_SIMD_V(isa, srl16)(f0, 7)); \
+	f1 = IPIXEL_SIMD_V(isa, add16)(f1, IPIXEL_SIMD_V(isa, srl16)(f1, 7)); \
+	k = IPIXEL_SIMD_V(isa, set16)(256); \
+	s0 = IPIXEL_SIMD_V(isa, lo)(s); \
+	s1 = IPIXEL_SIMD_V(isa, hi)(s); \
+	d0 = IPIXEL_SIMD_V(isa, lo)(d); \
+	d1 = IPIXEL_SIMD_V(isa, hi)(d); \
+	d0 = IPIXEL_SIMD_V(isa, add16)(IPIXEL_SIMD_V(isa, mul16)(s0, f0), \
+		IPIXEL_SIMD_V(isa, mul16)(d0, IPIXEL_SIMD_V(isa, sub16)(k, f0))); \
+	d1 = IPIXEL_SIMD_V(isa, add16)(IPIXEL_SIMD_V(isa, mul16)(s1, f1), \
+		IPIXEL_SIMD_V(isa, mul16)(d1, IPIXEL_SIMD_V(isa, sub16)(k, f1))); \
+	r = IPIXEL_SIMD_V(isa, pack)(IPIXEL_SIMD_V(isa, srl16)(d0, 8), \
+		IPIXEL_SIMD_V(isa, srl16)(d1, 8)); \
+	r = ipixel_simd_##isa##_rgba(r, f); \
+	m = IPIXEL_SIMD_V(isa, eq32)(IPIXEL_SIMD_V(isa, srl32)(s, 24), \
+		IPIXEL_SIMD_V(isa, set32)(255)); \
+	r = IPIXEL_SIMD_V(isa, select)(m, s, r); \
+	return ipixel_simd_##isa##_keep(s, d, r); \
+} \
+/* IBLEND_PARGB: d * (255 - sa) / 255 + s, source alpha 0 keeps dest */ \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_preblend(V s, V d) \
+{ \
+	V sa = IPIXEL_SIMD_V(isa, sub16)(IPIXEL_SIMD_V(isa, set16)(255), \
+		IPIXEL_SIMD_V(isa, alpha16)(IPIXEL_SIMD_V(isa, lo)(s))); \
+	V sb = IPIXEL_SIMD_V(isa, sub16)(IPIXEL_SIMD_V(isa, set16)(255), \
+		IPIXEL_SIMD_V(isa, alpha16)(IPIXEL_SIMD_V(isa, hi)(s))); \
+	V d0 = IPIXEL_SIMD_V(isa, mul16)(IPIXEL_SIMD_V(isa, lo)(d), sa); \
+	V d1 = IPIXEL_SIMD_V(isa, mul16)(IPIXEL_SIMD_V(isa, hi)(d), sb); \
+	V r; \
+	d0 = IPIXEL_SIMD_V(isa, add16)(d0, IPIXEL_SIMD_V(isa, srl16)(d0, 8)); \
+	d1 = IPIXEL_SIMD_V(isa, add16)(d1, IPIXEL_SIMD_V(isa, srl16)(d1, 8)); \
+	r = IPIXEL_SIMD_V(isa, pack)(IPIXEL_SIMD_V(isa, srl16)(d0, 8), \
+		IPIXEL_SIMD_V(isa, srl16)(d1, 8)); \
+	r = IPIXEL_SIMD_V(isa, add32)(r, s); \
+	return ipixel_simd_##isa##_keep(s, d, r); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_allanon(V s, V d) \
+{ \
+	V r = IPIXEL_SIMD_V(isa, avg8)(s, d); \
+	V b = IPIXEL_SIMD_V(isa, and)(IPIXEL_SIMD_V(isa, xor)(s, d), \
+		IPIXEL_SIMD_V(isa, set8)(1)); \
+	return ipixel_simd_##isa##_keep(s, d, IPIXEL_SIMD_V(isa, sub8)(r, b)); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_tint(V s, V d) \
+{ \
+	V r = IPIXEL_SIMD_V(isa, pack)( \
+		ipixel_simd_##isa##_mul255(IPIXEL_SIMD_V(isa, lo)(s), \
+			IPIXEL_SIMD_V(isa, lo)(d)), \
+		ipixel_simd_##isa##_mul255(IPIXEL_SIMD_V(isa, hi)(s), \
+			IPIXEL_SIMD_V(isa, hi)(d))); \
+	return ipixel_simd_##isa##_keep(s, d, ipixel_simd_##isa##_rgba(r, d)); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_diff(V s, V d) \
+{ \
+	V r = IPIXEL_SIMD_V(isa, or)(IPIXEL_SIMD_V(isa, subs8)(s, d), \
+		IPIXEL_SIMD_V(isa, subs8)(d, s)); \
+	r = ipixel_simd_##isa##_rgba(r, IPIXEL_SIMD_V(isa, max8)(s, d)); \
+	return ipixel_simd_##isa##_keep(s, d, r); \
+} \
+/* 255 - ((255 - d) * (255 - s) >> 8) */ \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_screen16(V s, V d) \
+{ \
+	V k = IPIXEL_SIMD_V(isa, set16)(255); \
+	V t = IPIXEL_SIMD_V(isa, mul16)(IPIXEL_SIMD_V(isa, sub16)(k, d), \
+		IPIXEL_SIMD_V(isa, sub16)(k, s)); \
+	return IPIXEL_SIMD_V(isa, sub16)(k, IPIXEL_SIMD_V(isa, srl16)(t, 8)); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_screen(V s, V d) \
+{ \
+	V r = IPIXEL_SIMD_V(isa, pack)( \
+		ipixel_simd_##isa##_screen16(IPIXEL_SIMD_V(isa, lo)(s), \
+			IPIXEL_SIMD_V(isa, lo)(d)), \
+		ipixel_simd_##isa##_screen16(IPIXEL_SIMD_V(isa, hi)(s), \
+			IPIXEL_SIMD_V(isa, hi)(d))); \
+	r = ipixel_simd_##isa##_rgba(r, IPIXEL_SIMD_V(isa, max8)(s, d)); \
+	return ipixel_simd_##isa##_keep(s, d, r); \
+} \
+/* (d * screen + (255 - d) * (d * s >> 8)) >> 8 */ \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_overlay16(V s, V d) \
+{ \
+	V k = IPIXEL_SIMD_V(isa, set16)(255); \
+	V ts = ipixel_simd_##isa##_screen16(s, d); \
+	V tm = IPIXEL_SIMD_V(isa, srl16)(IPIXEL_SIMD_V(isa, mul16)(d, s), 8); \
+	ts = IPIXEL_SIMD_V(isa, add16)(IPIXEL_SIMD_V(isa, mul16)(d, ts), \
+		IPIXEL_SIMD_V(isa, mul16)(IPIXEL_SIMD_V(isa, sub16)(k, d), tm)); \
+	return IPIXEL_SIMD_V(isa, srl16)(ts, 8); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_overlay(V s, V d) \
+{ \
+	V r = IPIXEL_SIMD_V(isa, pack)( \
+		ipixel_simd_##isa##_overlay16(IPIXEL_SIMD_V(isa, lo)(s), \
+			IPIXEL_SIMD_V(isa, lo)(d)), \
+		ipixel_simd_##isa##_overlay16(IPIXEL_SIMD_V(isa, hi)(s), \
+			IPIXEL_SIMD_V(isa, hi)(d))); \
+	r = ipixel_simd_##isa##_rgba(r, IPIXEL_SIMD_V(isa, max8)(s, d)); \
+	return ipixel_simd_##isa##_keep(s, d, r); \
+}
+
+
+//---------------------------------------------------------------------
+// scanline compositors: early out on a whole vector when every source
+// alpha is zero (1), every source pixel is zero (2), or every source
+// alpha is 255 and the operator reduces to a copy (4). the tail goes
+// to the builtin compositor. SRC, DST and CLEAR keep the builtin
+// memcpy / memset.
+//---------------------------------------------------------------------
+#define IPIXEL_SIMD_COMP(isa, target, V, N, name, op, early, expr) \
+IPIXEL_SIMD_TARGET(target) \
+static void ipixel_simd_comp_##name##_##isa(IUINT32 *dst, \
+	const IUINT32 *src, int w) \
+{ \
+	V s, d, a; \
+	for (; w >= N; w -= N, dst += N, src += N) { \
+		s = IPIXEL_SIMD_V(isa, load)(src); \
+		if (early) { \
+			a = IPIXEL_SIMD_V(isa, srl32)(s, 24); \
+			if (((early) & 1) && IPIXEL_SIMD_V(isa, all)( \
+				IPIXEL_SIMD_V(isa, eq32)(a, IPIXEL_SIMD_V(isa, zero)()))) \
+				continue; \
+			if (((early) & 2) && IPIXEL_SIMD_V(isa, all)( \
+				IPIXEL_SIMD_V(isa, eq32)(s, IPIXEL_SIMD_V(isa, zero)()))) \
+				continue; \
+			if (((early) & 4) && IPIXEL_SIMD_V(isa, all)( \
+				IPIXEL_SIMD_V(isa, eq32)(a, \
+					IPIXEL_SIMD_V(isa, set32)(255)))) { \
+				IPIXEL_SIMD_V(isa, store)(dst, s); \
+				continue; \
+			} \
+		} \
+		d = IPIXEL_SIMD_V(isa, load)(dst); \
+		d = expr; \
+		IPIXEL_SIMD_V(isa, store)(dst, d); \
+	} \
+	IPIXEL_SIMD_V(isa, leave)(); \
+	if (w > 0) { \
+		ipixel_composite_get(IPIXEL_OP_##op, 1)(dst, src, w); \
+	} \
+}
+
+#define IPIXEL_SIMD_DUFF(isa, target, V, N, name, op, early, fs, fd, n) \
+	IPIXEL_SIMD_COMP(isa, target, V, N, name, op, early, \
+		ipixel_simd_##isa##_duff(s, d, fs, fd, n))
+
+#define IPIXEL_SIMD_COMPOSITE_MAIN(isa, target, V, N) \
+IPIXEL_SIMD_KERNELS(isa, target, V, N) \
+IPIXEL_SIMD_COMP(isa, target, V, N, blend, BLEND, 5, \
+	ipixel_simd_##isa##_blend(s, d)) \
+IPIXEL_SIMD_COMP(isa, target, V, N, add, ADD, 2, \
+	IPIXEL_SIMD_V(isa, adds8)(d, s)) \
+IPIXEL_SIMD_COMP(isa, target, V, N, sub, SUB, 2, \
+	IPIXEL_SIMD_V(isa, subs8)(d, s)) \
+IPIXEL_SIMD_COMP(isa, target, V, N, sub_inv, SUB_INV, 0, \
+	IPIXEL_SIMD_V(isa, subs8)(s, d)) \
+IPIXEL_SIMD_DUFF(isa, target, V, N, xor, XOR, 0, 5, 3, 1) \
+IPIXEL_SIMD_DUFF(isa, target, V, N, plus, PLUS, 0, -1, -1, 1) \
+IPIXEL_SIMD_DUFF(isa, target, V, N, src_atop, SRC_ATOP, 0, 4, 3, 1) \
+IPIXEL_SIMD_DUFF(isa, target, V, N, src_in, SRC_IN, 0, 4, 0, 1) \
+IPIXEL_SIMD_DUFF(isa, target, V, N, src_out, SRC_OUT, 0, 5, 0, 1) \
+IPIXEL_SIMD_DUFF(isa, target, V, N, src_over, SRC_OVER, 4, 1, 3, 1) \
+IPIXEL_SIMD_DUFF(isa, target, V, N, dst_atop, DST_ATOP, 0, 5, 2, 1) \
+IPIXEL_SIMD_DUFF(isa, target, V, N, dst_in, DST_IN, 0, 0, 2, 1) \
+IPIXEL_SIMD_DUFF(isa, target, V, N, dst_out, DST_OUT, 0, 0, 3, 1) \
+IPIXEL_SIMD_DUFF(isa, target, V, N, dst_over, DST_OVER, 0, 5, 1, 1) \
+IPIXEL_SIMD_DUFF(isa, target, V, N, pre_xor, PREMUL_XOR, 2, 5, 3, 0) \
+IPIXEL_SIMD_DUFF(isa, target, V, N, pre_plus, PREMUL_PLUS, 2, -1, -1, 0) \
+IPIXEL_SIMD_DUFF(isa, target, V, N, pre_src_atop, PREMUL_SRC_ATOP, 2, \
+	4, 3, 0) \
+IPIXEL_SIMD_DUFF(isa, target, V, N, pre_src_in, PREMUL_SRC_IN, 0, \
+	4, 0, 0) \
+IPIXEL_SIMD_DUFF(isa, target, V, N, pre_src_out, PREMUL_SRC_OUT, 0, \
+	5, 0, 0) \
+IPIXEL_SIMD_DUFF(isa, target, V, N, pre_src_over, PREMUL_SRC_OVER, 6, \
+	1, 3, 0) \
+IPIXEL_SIMD_DUFF(isa, target, V, N, pre_dst_atop, PREMUL_DST_ATOP, 0, \
+	5, 2, 0) \
+IPIXEL_SIMD_DUFF(isa, target, V, N, pre_dst_in, PREMUL_DST_IN, 0, \
+	0, 2, 0) \
+IPIXEL_SIMD_DUFF(isa, target, V, N, pre_dst_out, PREMUL_DST_OUT, 1, \
+	0, 3, 0) \
+IPIXEL_SIMD_DUFF(isa, target, V, N, pre_dst_over, PREMUL_DST_OVER, 2, \
+	5, 1, 0) \
+IPIXEL_SIMD_COMP(isa, target, V, N, preblend, PREMUL_BLEND, 5, \
+	ipixel_simd_##isa##_preblend(s, d)) \
+IPIXEL_SIMD_COMP(isa, target, V, N, allanon, ALLANON, 1, \
+	ipixel_simd_##isa##_allanon(s, d)) \
+IPIXEL_SIMD_COMP(isa, target, V, N, tint, TINT, 1, \
+	ipixel_simd_##isa##_tint(s, d)) \
+IPIXEL_SIMD_COMP(isa, target, V, N, diff, DIFF, 1, \
+	ipixel_simd_##isa##_diff(s, d)) \
+IPIXEL_SIMD_COMP(isa, target, V, N, darken, DARKEN, 1, \
+	ipixel_simd_##isa##_keep(s, d, IPIXEL_SIMD_V(isa, min8)(s, d))) \
+IPIXEL_SIMD_COMP(isa, target, V, N, lighten, LIGHTEN, 1, \
+	ipixel_simd_##isa##_keep(s, d, IPIXEL_SIMD_V(isa, max8)(s, d))) \
+IPIXEL_SIMD_COMP(isa, target, V, N, screen, SCREEN, 1, \
+	ipixel_simd_##isa##_screen(s, d)) \
+IPIXEL_SIMD_COMP(isa, target, V, N, overlay, OVERLAY, 1, \
+	ipixel_simd_##isa##_overlay(s, d)) \
+static void ipixel_simd_composite_##isa(void) \
+{ \
+	/* the lut lookups of four pixels do not beat the scalar code */ \
+	if (N > 4) { \
+		ipixel_composite_set(IPIXEL_OP_BLEND, \
+			ipixel_simd_comp_blend_##isa); \
+	} \
+	ipixel_composite_set(IPIXEL_OP_ADD, ipixel_simd_comp_add_##isa); \
+	ipixel_composite_set(IPIXEL_OP_SUB, ipixel_simd_comp_sub_##isa); \
+	ipixel_composite_set(IPIXEL_OP_SUB_INV, \
+		ipixel_simd_comp_sub_inv_##isa); \
+	ipixel_composite_set(IPIXEL_OP_XOR, ipixel_simd_comp_xor_##isa); \
+	ipixel_composite_set(IPIXEL_OP_PLUS, ipixel_simd_comp_plus_##isa); \
+	ipixel_composite_set(IPIXEL_OP_SRC_ATOP, \
+		ipixel_simd_comp_src_atop_##isa); \
+	ipixel_composite_set(IPIXEL_OP_SRC_IN, ipixel_simd_comp_src_in_##isa); \
+	ipixel_composite_set(IPIXEL_OP_SRC_OUT, \
+		ipixel_simd_comp_src_out_##isa); \
+	ipixel_composite_set(IPIXEL_OP_SRC_OVER, \
+		ipixel_simd_comp_src_over_##isa); \
+	ipixel_composite_set(IPIXEL_OP_DST_ATOP, \
+		ipixel_simd_comp_dst_atop_##isa); \
+	ipixel_composite_set(IPIXEL_OP_DST_IN, ipixel_simd_comp_dst_in_##isa); \
+	ipixel_composite_set(IPIXEL_OP_DST_OUT, \
+		ipixel_simd_comp_dst_out_##isa); \
+	ipixel_composite_set(IPIXEL_OP_DST_OVER, \
+		ipixel_simd_comp_dst_over_##isa); \
+	ipixel_composite_set(IPIXEL_OP_PREMUL_XOR, \
+		ipixel_simd_comp_pre_xor_##isa); \
+	ipixel_composite_set(IPIXEL_OP_PREMUL_PLUS, \
+		ipixel_simd_comp_pre_plus_##isa); \
+	ipixel_composite_set(IPIXEL_OP_PREMUL_SRC_ATOP, \
+		ipixel_simd_comp_pre_src_atop_##isa); \
+	ipixel_composite_set(IPIXEL_OP_PREMUL_SRC_IN, \
+		ipixel_simd_comp_pre_src_in_##isa); \
+	ipixel_composite_set(IPIXEL_OP_PREMUL_SRC_OUT, \
+		ipixel_simd_comp_pre_src_out_##isa); \
+	ipixel_composite_set(IPIXEL_OP_PREMUL_SRC_OVER, \
+		ipixel_simd_comp_pre_src_over_##isa); \
+	ipixel_composite_set(IPIXEL_OP_PREMUL_DST_ATOP, \
+		ipixel_simd_comp_pre_dst_atop_##isa); \
+	ipixel_composite_set(IPIXEL_OP_PREMUL_DST_IN, \
+		ipixel_simd_comp_pre_dst_in_##isa); \
+	ipixel_composite_set(IPIXEL_OP_PREMUL_DST_OUT, \
+		ipixel_simd_comp_pre_dst_out_##isa); \
+	ipixel_composite_set(IPIXEL_OP_PREMUL_DST_OVER, \
+		ipixel_simd_comp_pre_dst_over_##isa); \
+	ipixel_composite_set(IPIXEL_OP_PREMUL_BLEND, \
+		ipixel_simd_comp_preblend_##isa); \
+	ipixel_composite_set(IPIXEL_OP_ALLANON, ipixel_simd_comp_allanon_##isa); \
+	ipixel_composite_set(IPIXEL_OP_TINT, ipixel_simd_comp_tint_##isa); \
+	ipixel_composite_set(IPIXEL_OP_DIFF, ipixel_simd_comp_diff_##isa); \
+	ipixel_composite_set(IPIXEL_OP_DARKEN, ipixel_simd_comp_darken_##isa); \
+	ipixel_composite_set(IPIXEL_OP_LIGHTEN, \
+		ipixel_simd_comp_lighten_##isa); \
+	ipixel_composite_set(IPIXEL_OP_SCREEN, ipixel_simd_comp_screen_##isa); \
+	ipixel_composite_set(IPIXEL_OP_OVERLAY, \
+		ipixel_simd_comp_overlay_##isa); \
+}
+
+IPIXEL_SIMD_COMPOSITE_MAIN(sse2, "sse2", __m128i, 4)
+IPIXEL_SIMD_COMPOSITE_MAIN(avx2, "avx2", __m256i, 8)
+
+#undef IPIXEL_SIMD_COMPOSITE_MAIN
+#undef IPIXEL_SIMD_DUFF
+#undef IPIXEL_SIMD_COMP
+#undef IPIXEL_SIMD_KERNELS
+
+
+//---------------------------------------------------------------------
+// card operations, bit exact with ipixel_card_*_default in ibmbits.c.
+// over truncates the scaled destination like IBLEND_PARGB and adds the
+// card as 32 bits integers. a tail shorter than a vector goes through
+// a zero padded buffer.
+//---------------------------------------------------------------------
+#define ipixel_simd_sse2_sll32(x, n) _mm_slli_epi32(x, n)
+#define ipixel_simd_sse2_unlo32(x, y) _mm_unpacklo_epi32(x, y)
+#define ipixel_simd_sse2_unhi32(x, y) _mm_unpackhi_epi32(x, y)
+#define ipixel_simd_sse2_rev32(x) _mm_shuffle_epi32(x, 0x1b)
+#define ipixel_simd_sse2_cover32(p) _mm_unpacklo_epi16(_mm_unpacklo_epi8( \
+	_mm_cvtsi32_si128(*(const int*)(p)), _mm_setzero_si128()), \
+	_mm_setzero_si128())
+
+#define ipixel_simd_avx2_sll32(x, n) _mm256_slli_epi32(x, n)
+#define ipixel_simd_avx2_unlo32(x, y) _mm256_unpacklo_epi32(x, y)
+#define ipixel_simd_avx2_unhi32(x, y) _mm256_unpackhi_epi32(x, y)
+#define ipixel_simd_avx2_rev32(x) _mm256_permutevar8x32_epi32(x, \
+	_mm256_set_epi32(0, 1, 2, 3, 4, 5, 6, 7))
+#define ipixel_simd_avx2_cover32(p) _mm256_cvtepu8_epi32( \
+	_mm_loadl_epi64((const __m128i*)(p)))
+
+// copy 'size' pixels into an n pixels buffer, zero padded
+static void ipixel_simd_card_pad(IUINT32 *buf, const IUINT32 *src,
+	int size, int n)
+{
+	int i;
+	for (i = 0; i < n; i++) buf[i] = (i < size)? src[i] : 0;
+}
+
+static void ipixel_simd_cover_pad(IUINT8 *buf, const IUINT8 *src,
+	int size, int n)
+{
+	int i;
+	for (i = 0; i < n; i++) buf[i] = (i < size && src)? src[i] : 0;
+}
+
+#define IPIXEL_SIMD_CARDS(isa, target, V, N) \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_norm16(V x) \
+{ \
+	return IPIXEL_SIMD_V(isa, add16)(x, IPIXEL_SIMD_V(isa, srl16)(x, 7)); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_scale(V c, V f0, V f1) \
+{ \
+	V c0 = IPIXEL_SIMD_V(isa, mul16)(IPIXEL_SIMD_V(isa, lo)(c), f0); \
+	V c1 = IPIXEL_SIMD_V(isa, mul16)(IPIXEL_SIMD_V(isa, hi)(c), f1); \
+	return IPIXEL_SIMD_V(isa, pack)(IPIXEL_SIMD_V(isa, srl16)(c0, 8), \
+		IPIXEL_SIMD_V(isa, srl16)(c1, 8)); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_mask(V c, V m) \
+{ \
+	V m0 = ipixel_simd_##isa##_norm16(IPIXEL_SIMD_V(isa, lo)(m)); \
+	V m1 = ipixel_simd_##isa##_norm16(IPIXEL_SIMD_V(isa, hi)(m)); \
+	return ipixel_simd_##isa##_scale(c, m0, m1); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_cover(V c, V cc) \
+{ \
+	V t = IPIXEL_SIMD_V(isa, mul16)(IPIXEL_SIMD_V(isa, srl32)(c, 24), cc); \
+	V u = IPIXEL_SIMD_V(isa, add32)(t, IPIXEL_SIMD_V(isa, set32)(257)); \
+	t = IPIXEL_SIMD_V(isa, add32)(t, IPIXEL_SIMD_V(isa, srl32)(u, 8)); \
+	t = IPIXEL_SIMD_V(isa, sll32)(IPIXEL_SIMD_V(isa, srl32)(t, 8), 24); \
+	c = IPIXEL_SIMD_V(isa, and)(c, IPIXEL_SIMD_V(isa, set32)(0xffffff)); \
+	return IPIXEL_SIMD_V(isa, or)(c, t); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_trunc255(V x, V y) \
+{ \
+	V t = IPIXEL_SIMD_V(isa, mul16)(x, y); \
+	t = IPIXEL_SIMD_V(isa, add16)(t, IPIXEL_SIMD_V(isa, srl16)(t, 8)); \
+	return IPIXEL_SIMD_V(isa, srl16)(t, 8); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_over(V d, V s, const IUINT8 *cover) \
+{ \
+	V s0, s1, d0, d1, n; \
+	if (cover == NULL) { \
+		V full = IPIXEL_SIMD_V(isa, set32)(0xff000000); \
+		if (IPIXEL_SIMD_V(isa, all)(IPIXEL_SIMD_V(isa, eq32)( \
+			IPIXEL_SIMD_V(isa, and)(s, full), full))) \
+			return s; \
+	}	else { \
+		n = IPIXEL_SIMD_V(isa, cover32)(cover); \
+		n = ipixel_simd_##isa##_norm16(n); \
+		n = IPIXEL_SIMD_V(isa, or)(n, IPIXEL_SIMD_V(isa, sll32)(n, 16)); \
+		s = ipixel_simd_##isa##_scale(s, IPIXEL_SIMD_V(isa, unlo32)(n, n), \
+			IPIXEL_SIMD_V(isa, unhi32)(n, n)); \
+	} \
+	s0 = IPIXEL_SIMD_V(isa, lo)(s); \
+	s1 = IPIXEL_SIMD_V(isa, hi)(s); \
+	d0 = IPIXEL_SIMD_V(isa, lo)(d); \
+	d1 = IPIXEL_SIMD_V(isa, hi)(d); \
+	n = IPIXEL_SIMD_V(isa, set16)(255); \
+	d0 = ipixel_simd_##isa##_trunc255(d0, IPIXEL_SIMD_V(isa, sub16)(n, \
+		IPIXEL_SIMD_V(isa, alpha16)(s0))); \
+	d1 = ipixel_simd_##isa##_trunc255(d1, IPIXEL_SIMD_V(isa, sub16)(n, \
+		IPIXEL_SIMD_V(isa, alpha16)(s1))); \
+	return IPIXEL_SIMD_V(isa, add32)(IPIXEL_SIMD_V(isa, pack)(d0, d1), s); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static void ipixel_simd_card_multi_##isa(IUINT32 *card, int size, \
+	IUINT32 color) \
+{ \
+	IUINT32 buf[N]; \
+	V f; \
+	if (color == 0xffffffff) return; \
+	f = IPIXEL_SIMD_V(isa, lo)(IPIXEL_SIMD_V(isa, set32)(color)); \
+	f = ipixel_simd_##isa##_norm16(f); \
+	for (; size >= N; size -= N, card += N) { \
+		V c = IPIXEL_SIMD_V(isa, load)(card); \
+		c = ipixel_simd_##isa##_scale(c, f, f); \
+		IPIXEL_SIMD_V(isa, store)(card, c); \
+	} \
+	if (size > 0) { \
+		ipixel_simd_card_pad(buf, card, size, N); \
+		IPIXEL_SIMD_V(isa, store)(buf, ipixel_simd_##isa##_scale( \
+			IPIXEL_SIMD_V(isa, load)(buf), f, f)); \
+		memcpy(card, buf, size * sizeof(IUINT32)); \
+	} \
+	IPIXEL_SIMD_V(isa, leave)(); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static void ipixel_simd_card_mask_##isa(IUINT32 *card, int size, \
+	const IUINT32 *mask) \
+{ \
+	IUINT32 buf[N], mbuf[N]; \
+	for (; size >= N; size -= N, card += N, mask += N) { \
+		V c = IPIXEL_SIMD_V(isa, load)(card); \
+		V m = IPIXEL_SIMD_V(isa, load)(mask); \
+		IPIXEL_SIMD_V(isa, store)(card, ipixel_simd_##isa##_mask(c, m)); \
+	} \
+	if (size > 0) { \
+		ipixel_simd_card_pad(buf, card, size, N); \
+		ipixel_simd_card_pad(mbuf, mask, size, N); \
+		IPIXEL_SIMD_V(isa, store)(buf, ipixel_simd_##isa##_mask( \
+			IPIXEL_SIMD_V(isa, load)(buf), \
+			IPIXEL_SIMD_V(isa, load)(mbuf))); \
+		memcpy(card, buf, size * sizeof(IUINT32)); \
+	} \
+	IPIXEL_SIMD_V(isa, leave)(); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static void ipixel_simd_card_cover_##isa(IUINT32 *card, int size, \
+	const IUINT8 *cover) \
+{ \
+	IUINT32 buf[N]; \
+	IUINT8 vbuf[N]; \
+	for (; size >= N; size -= N, card += N, cover += N) { \
+		V c = IPIXEL_SIMD_V(isa, load)(card); \
+		V cc = IPIXEL_SIMD_V(isa, cover32)(cover); \
+		IPIXEL_SIMD_V(isa, store)(card, ipixel_simd_##isa##_cover(c, cc)); \
+	} \
+	if (size > 0) { \
+		ipixel_simd_card_pad(buf, card, size, N); \
+		ipixel_simd_cover_pad(vbuf, cover, size, N); \
+		IPIXEL_SIMD_V(isa, store)(buf, ipixel_simd_##isa##_cover( \
+			IPIXEL_SIMD_V(isa, load)(buf), \
+			IPIXEL_SIMD_V(isa, cover32)(vbuf))); \
+		memcpy(card, buf, size * sizeof(IUINT32)); \
+	} \
+	IPIXEL_SIMD_V(isa, leave)(); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static void ipixel_simd_card_over_##isa(IUINT32 *dst, int size, \
+	const IUINT32 *card, const IUINT8 *cover) \
+{ \
+	IUINT32 dbuf[N], cbuf[N]; \
+	IUINT8 vbuf[N]; \
+	V d, s; \
+	for (; size >= N; size -= N, dst += N, card += N) { \
+		s = IPIXEL_SIMD_V(isa, load)(card); \
+		d = IPIXEL_SIMD_V(isa, load)(dst); \
+		d = ipixel_simd_##isa##_over(d, s, cover); \
+		IPIXEL_SIMD_V(isa, store)(dst, d); \
+		if (cover) cover += N; \
+	} \
+	if (size > 0) { \
+		ipixel_simd_card_pad(dbuf, dst, size, N); \
+		ipixel_simd_card_pad(cbuf, card, size, N); \
+		ipixel_simd_cover_pad(vbuf, cover, size, N); \
+		s = IPIXEL_SIMD_V(isa, load)(cbuf); \
+		d = IPIXEL_SIMD_V(isa, load)(dbuf); \
+		d = ipixel_simd_##isa##_over(d, s, cover? vbuf : NULL); \
+		IPIXEL_SIMD_V(isa, store)(dbuf, d); \
+		memcpy(dst, dbuf, size * sizeof(IUINT32)); \
+	} \
+	IPIXEL_SIMD_V(isa, leave)(); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static void ipixel_simd_card_reverse_##isa(IUINT32 *card, int size) \
+{ \
+	IUINT32 *p1 = card, *p2 = card + size; \
+	IUINT32 value; \
+	for (; p2 - p1 >= 2 * N; p1 += N) { \
+		V x, y; \
+		p2 -= N; \
+		x = IPIXEL_SIMD_V(isa, load)(p1); \
+		y = IPIXEL_SIMD_V(isa, load)(p2); \
+		IPIXEL_SIMD_V(isa, store)(p1, IPIXEL_SIMD_V(isa, rev32)(y)); \
+		IPIXEL_SIMD_V(isa, store)(p2, IPIXEL_SIMD_V(isa, rev32)(x)); \
+	} \
+	IPIXEL_SIMD_V(isa, leave)(); \
+	for (p2--; p1 < p2; p1++, p2--) { \
+		value = *p1; \
+		*p1 = *p2; \
+		*p2 = value; \
+	} \
+} \
+static void ipixel_simd_card_##isa(void) \
+{ \
+	ipixel_card_set_proc(0, (void*)ipixel_simd_card_multi_##isa); \
+	ipixel_card_set_proc(1, (void*)ipixel_simd_card_mask_##isa); \
+	ipixel_card_set_proc(2, (void*)ipixel_simd_card_cover_##isa); \
+	ipixel_card_set_proc(3, (void*)ipixel_simd_card_over_##isa); \
+	ipixel_card_set_proc(5, (void*)ipixel_simd_card_reverse_##isa); \
+}
+
+IPIXEL_SIMD_CARDS(sse2, "sse2", __m128i, 4)
+IPIXEL_SIMD_CARDS(avx2, "avx2", __m256i, 8)
+
+#undef IPIXEL_SIMD_CARDS
+
+
+// card permute with pshufb: byte i of every pixel takes byte b[i]
+IPIXEL_SIMD_TARGET("ssse3")
+static void ipixel_simd_card_permute_ssse3(IUINT32 *card, int w,
+	int b0, int b1, int b2, int b3)
+{
+	IUINT32 buf[4];
+	IUINT32 key = (b0 & 3) | ((b1 & 3) << 8) | ((b2 & 3) << 16) |
+		((IUINT32)(b3 & 3) << 24);
+	__m128i m = _mm_add_epi8(_mm_set1_epi32((int)key),
+		_mm_set_epi32(0x0c0c0c0c, 0x08080808, 0x04040404, 0));
+	for (; w >= 4; w -= 4, card += 4) {
+		__m128i c = _mm_loadu_si128((const __m128i*)card);
+		_mm_storeu_si128((__m128i*)card, _mm_shuffle_epi8(c, m));
+	}
+	if (w > 0) {
+		ipixel_simd_card_pad(buf, card, w, 4);
+		_mm_storeu_si128((__m128i*)buf, _mm_shuffle_epi8(
+			_mm_loadu_si128((const __m128i*)buf), m));
+		memcpy(card, buf, w * sizeof(IUINT32));
+	}
+}
+
+IPIXEL_SIMD_TARGET("avx2")
+static void ipixel_simd_card_permute_avx2(IUINT32 *card, int w,
+	int b0, int b1, int b2, int b3)
+{
+	IUINT32 key = (b0 & 3) | ((b1 & 3) << 8) | ((b2 & 3) << 16) |
+		((IUINT32)(b3 & 3) << 24);
+	__m256i m = _mm256_add_epi8(_mm256_set1_epi32((int)key),
+		_mm256_set_epi32(0x0c0c0c0c, 0x08080808, 0x04040404, 0,
+			0x0c0c0c0c, 0x08080808, 0x04040404, 0));
+	for (; w >= 8; w -= 8, card += 8) {
+		__m256i c = _mm256_loadu_si256((const __m256i*)card);
+		_mm256_storeu_si256((__m256i*)card, _mm256_shuffle_epi8(c, m));
+	}
+	_mm256_zeroupper();
+	if (w > 0) {
+		ipixel_simd_card_permute_ssse3(card, w, b0, b1, b2, b3);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// 24 bits: pshufb expands 4 packed pixels to 32 bits or packs them
+// back, a mask per (24 bits, 32 bits) format pair. used by the fetch
+// and store procedures of R8G8B8 / B8G8R8 and by the converters
+// between them and the eight A/X 32 bits formats.
+//---------------------------------------------------------------------
+
+// byte offset of r, g, b, a in the 32 bits formats 0..7, 24 bits last
+static const int ipixel_simd_bytepos[10][4] = {
+	{ 2, 1, 0, 3 }, { 0, 1, 2, 3 }, { 3, 2, 1, 0 }, { 1, 2, 3, 0 },
+	{ 2, 1, 0, 3 }, { 0, 1, 2, 3 }, { 3, 2, 1, 0 }, { 1, 2, 3, 0 },
+	{ 2, 1, 0, -1 }, { 0, 1, 2, -1 },
+};
+
+// [R8G8B8, B8G8R8][32 bits format]: expanding and packing masks
+static IUINT8 ipixel_simd_expand24_mask[2][8][16];
+static IUINT8 ipixel_simd_pack24_mask[2][8][16];
+static IUINT32 ipixel_simd_expand24_alpha[8];
+static ipixel_once_t ipixel_simd_mask24_once = IPIXEL_ONCE_INIT;
+
+static void ipixel_simd_mask24_build(void)
+{
+	int s, d, i, c;
+	for (s = 0; s < 2; s++) {
+		const int *p24 = ipixel_simd_bytepos[8 + s];
+		for (d = 0; d < 8; d++) {
+			const int *p32 = ipixel_simd_bytepos[d];
+			IUINT8 *expand = ipixel_simd_expand24_mask[s][d];
+			IUINT8 *pack = ipixel_simd_pack24_mask[s][d];
+			memset(expand, 0x80, 16);
+			memset(pack, 0x80, 16);
+			for (i = 0; i < 4; i++) {
+				for (c = 0; c < 3; c++) {
+					expand[i * 4 + p32[c]] = (IUINT8)(i * 3 + p24[c]);
+					pack[i * 3 + p24[c]] = (IUINT8)(i * 4 + p32[c]);
+				}
+			}
+			ipixel_simd_expand24_alpha[d] = (d < 4)? 
+				(0xffu << (p32[3] * 8)) : 0;
+		}
+	}
+}
+
+IPIXEL_SIMD_TARGET("ssse3")
+static void ipixel_simd_expand24_ssse3(IUINT32 *dst, const IUINT8 *src,
+	int w, const IUINT8 *mask, IUINT32 alpha)
+{
+	__m128i m = _mm_loadu_si128((const __m128i*)mask);
+	__m128i a = _mm_set1_epi32((int)alpha);
+	int k;
+	for (; w >= 6; w -= 4, dst += 4, src += 12) {
+		__m128i c = _mm_loadu_si128((const __m128i*)src);
+		c = _mm_or_si128(_mm_shuffle_epi8(c, m), a);
+		_mm_storeu_si128((__m128i*)dst, c);
+	}
+	for (; w > 0; w--, dst++, src += 3) {
+		IUINT32 c = alpha;
+		for (k = 0; k < 4; k++) {
+			if (mask[k] < 3) c |= ((IUINT32)src[mask[k]]) << (k * 8);
+		}
+		dst[0] = c;
+	}
+}
+
+IPIXEL_SIMD_TARGET("ssse3")
+static void ipixel_simd_pack24_ssse3(IUINT8 *dst, const IUINT32 *src,
+	int w, const IUINT8 *mask)
+{
+	__m128i m = _mm_loadu_si128((const __m128i*)mask);
+	for (; w >= 6; w -= 4, dst += 12, src += 4) {
+		__m128i c = _mm_loadu_si128((const __m128i*)src);
+		_mm_storeu_si128((__m128i*)dst, _mm_shuffle_epi8(c, m));
+	}
+	for (; w > 0; w--, dst += 3, src++) {
+		const IUINT8 *p = (const IUINT8*)src;
+		dst[0] = p[mask[0]];
+		dst[1] = p[mask[1]];
+		dst[2] = p[mask[2]];
+	}
+}
+
+IPIXEL_SIMD_TARGET("avx2")
+static void ipixel_simd_expand24_avx2(IUINT32 *dst, const IUINT8 *src,
+	int w, const IUINT8 *mask, IUINT32 alpha)
+{
+	__m256i m = _mm256_broadcastsi128_si256(
+		_mm_loadu_si128((const __m128i*)mask));
+	__m256i a = _mm256_set1_epi32((int)alpha);
+	for (; w >= 10; w -= 8, dst += 8, src += 24) {
+		__m256i c = _mm256_castsi128_si256(
+			_mm_loadu_si128((const __m128i*)src));
+		c = _mm256_inserti128_si256(c,
+			_mm_loadu_si128((const __m128i*)(src + 12)), 1);
+		c = _mm256_or_si256(_mm256_shuffle_epi8(c, m), a);
+		_mm256_storeu_si256((__m256i*)dst, c);
+	}
+	_mm256_zeroupper();
+	ipixel_simd_expand24_ssse3(dst, src, w, mask, alpha);
+}
+
+IPIXEL_SIMD_TARGET("avx2")
+static void ipixel_simd_pack24_avx2(IUINT8 *dst, const IUINT32 *src,
+	int w, const IUINT8 *mask)
+{
+	__m256i m = _mm256_broadcastsi128_si256(
+		_mm_loadu_si128((const __m128i*)mask));
+	for (; w >= 10; w -= 8, dst += 24, src += 8) {
+		__m256i c = _mm256_loadu_si256((const __m256i*)src);
+		c = _mm256_shuffle_epi8(c, m);
+		_mm_storeu_si128((__m128i*)dst, _mm256_castsi256_si128(c));
+		_mm_storeu_si128((__m128i*)(dst + 12),
+			_mm256_extracti128_si256(c, 1));
+	}
+	_mm256_zeroupper();
+	ipixel_simd_pack24_ssse3(dst, src, w, mask);
+}
+
+static void (*ipixel_simd_expand24)(IUINT32*, const IUINT8*, int,
+	const IUINT8*, IUINT32) = ipixel_simd_expand24_ssse3;
+
+static void (*ipixel_simd_pack24)(IUINT8*, const IUINT32*, int,
+	const IUINT8*) = ipixel_simd_pack24_ssse3;
+
+static void ipixel_simd_fetch_R8G8B8(const void *bits, int x, int w,
+	IUINT32 *buffer, const iColorIndex *idx)
+{
+	ipixel_simd_expand24(buffer, (const IUINT8*)bits + x * 3, w,
+		ipixel_simd_expand24_mask[0][0], 0xff000000);
+}
+
+static void ipixel_simd_fetch_B8G8R8(const void *bits, int x, int w,
+	IUINT32 *buffer, const iColorIndex *idx)
+{
+	ipixel_simd_expand24(buffer, (const IUINT8*)bits + x * 3, w,
+		ipixel_simd_expand24_mask[1][0], 0xff000000);
+}
+
+static void ipixel_simd_store_R8G8B8(void *bits, const IUINT32 *values,
+	int x, int w, const iColorIndex *idx)
+{
+	ipixel_simd_pack24((IUINT8*)bits + x * 3, values, w,
+		ipixel_simd_pack24_mask[0][0]);
+}
+
+static void ipixel_simd_store_B8G8R8(void *bits, const IUINT32 *values,
+	int x, int w, const iColorIndex *idx)
+{
+	ipixel_simd_pack24((IUINT8*)bits + x * 3, values, w,
+		ipixel_simd_pack24_mask[1][0]);
+}
+
+// converter rows, returns nonzero for h-flip (ipixel_convert falls
+// back to ipixel_blend)
+static int ipixel_simd_cvt24(void *dbits, long dpitch, int dx,
+	const void *sbits, long spitch, int sx, int w, int h, int flip,
+	int expand, int s24, int d32)
+{
+	if (flip & IPIXEL_FLIP_HFLIP) return -1;
+	if (flip & IPIXEL_FLIP_VFLIP) {
+		sbits = (const IUINT8*)sbits + spitch * (h - 1);
+		spitch = -spitch;
+	}
+	for (; h > 0; h--) {
+		if (expand) {
+			ipixel_simd_expand24((IUINT32*)dbits + dx,
+				(const IUINT8*)sbits + sx * 3, w,
+				ipixel_simd_expand24_mask[s24][d32],
+				ipixel_simd_expand24_alpha[d32]);
+		}	else {
+			ipixel_simd_pack24((IUINT8*)dbits + dx * 3,
+				(const IUINT32*)sbits + sx, w,
+				ipixel_simd_pack24_mask[s24][d32]);
+		}
+		sbits = (const IUINT8*)sbits + spitch;
+		dbits = (IUINT8*)dbits + dpitch;
+	}
+	return 0;
+}
+
+#define IPIXEL_SIMD_CVT24(dfmt, sfmt, expand, s24, d32) \
+static int ipixel_simd_cvt_##dfmt##_##sfmt(void *dbits, long dpitch, \
+	int dx, const void *sbits, long spitch, int sx, int w, int h, \
+	IUINT32 mask, int flip, const iColorIndex *didx, \
+	const iColorIndex *sidx) \
+{ \
+	return ipixel_simd_cvt24(dbits, dpitch, dx, sbits, spitch, sx, \
+		w, h, flip, expand, s24, d32); \
+}
+
+#define IPIXEL_SIMD_CVT24_PAIR(f32, d32) \
+	IPIXEL_SIMD_CVT24(f32, R8G8B8, 1, 0, d32) \
+	IPIXEL_SIMD_CVT24(f32, B8G8R8, 1, 1, d32) \
+	IPIXEL_SIMD_CVT24(R8G8B8, f32, 0, 0, d32) \
+	IPIXEL_SIMD_CVT24(B8G8R8, f32, 0, 1, d32)
+
+IPIXEL_SIMD_CVT24_PAIR(A8R8G8B8, 0)
+IPIXEL_SIMD_CVT24_PAIR(A8B8G8R8, 1)
+IPIXEL_SIMD_CVT24_PAIR(R8G8B8A8, 2)
+IPIXEL_SIMD_CVT24_PAIR(B8G8R8A8, 3)
+IPIXEL_SIMD_CVT24_PAIR(X8R8G8B8, 4)
+IPIXEL_SIMD_CVT24_PAIR(X8B8G8R8, 5)
+IPIXEL_SIMD_CVT24_PAIR(R8G8B8X8, 6)
+IPIXEL_SIMD_CVT24_PAIR(B8G8R8X8, 7)
+
+#undef IPIXEL_SIMD_CVT24_PAIR
+#undef IPIXEL_SIMD_CVT24
+
+#define IPIXEL_SIMD_CVT24_ENTRY(f32) \
+	{ IPIX_FMT_##f32, IPIX_FMT_R8G8B8, ipixel_simd_cvt_##f32##_R8G8B8 }, \
+	{ IPIX_FMT_##f32, IPIX_FMT_B8G8R8, ipixel_simd_cvt_##f32##_B8G8R8 }, \
+	{ IPIX_FMT_R8G8B8, IPIX_FMT_##f32, ipixel_simd_cvt_R8G8B8_##f32 }, \
+	{ IPIX_FMT_B8G8R8, IPIX_FMT_##f32, ipixel_simd_cvt_B8G8R8_##f32 }
+
+static const struct { int dfmt, sfmt; iPixelCvt proc; } 
+ipixel_simd_cvt24_list[] = {
+	IPIXEL_SIMD_CVT24_ENTRY(A8R8G8B8),
+	IPIXEL_SIMD_CVT24_ENTRY(A8B8G8R8),
+	IPIXEL_SIMD_CVT24_ENTRY(R8G8B8A8),
+	IPIXEL_SIMD_CVT24_ENTRY(B8G8R8A8),
+	IPIXEL_SIMD_CVT24_ENTRY(X8R8G8B8),
+	IPIXEL_SIMD_CVT24_ENTRY(X8B8G8R8),
+	IPIXEL_SIMD_CVT24_ENTRY(R8G8B8X8),
+	IPIXEL_SIMD_CVT24_ENTRY(B8G8R8X8),
+	{ -1, -1, NULL },
+};
+
+#undef IPIXEL_SIMD_CVT24_ENTRY
+
+// install the 24 bits procedures, 'level' picks the row kernels
+static void ipixel_simd_init_24(int level)
+{
+	int i;
+	IPIXEL_ONCE(&ipixel_simd_mask24_once, ipixel_simd_mask24_build);
+	if (level >= IPIXEL_SIMD_AVX2) {
+		ipixel_simd_expand24 = ipixel_simd_expand24_avx2;
+		ipixel_simd_pack24 = ipixel_simd_pack24_avx2;
+	}	else {
+		ipixel_simd_expand24 = ipixel_simd_expand24_ssse3;
+		ipixel_simd_pack24 = ipixel_simd_pack24_ssse3;
+	}
+	ipixel_set_proc(IPIX_FMT_R8G8B8, IPIXEL_PROC_TYPE_FETCH,
+		(void*)ipixel_simd_fetch_R8G8B8);
+	ipixel_set_proc(IPIX_FMT_B8G8R8, IPIXEL_PROC_TYPE_FETCH,
+		(void*)ipixel_simd_fetch_B8G8R8);
+	ipixel_set_proc(IPIX_FMT_R8G8B8, IPIXEL_PROC_TYPE_STORE,
+		(void*)ipixel_simd_store_R8G8B8);
+	ipixel_set_proc(IPIX_FMT_B8G8R8, IPIXEL_PROC_TYPE_STORE,
+		(void*)ipixel_simd_store_B8G8R8);
+	for (i = 0; ipixel_simd_cvt24_list[i].proc; i++) {
+		ipixel_cvt_set(ipixel_simd_cvt24_list[i].dfmt,
+			ipixel_simd_cvt24_list[i].sfmt, 0,
+			ipixel_simd_cvt24_list[i].proc);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// 16 bits: the 565 / 1555 / 5551 / 4444 families unpacked and packed
+// arithmetically, matching _ipixel_scale_n: 1, 5 and 6 bits fields
+// expand to floor(x * 255 / max) = mulhi(x << pre[n], mul[n]). the 4
+// bits table is piecewise: floor(j * 115 / 7) for the low 3 bits j,
+// plus 139 + (j > 0) when the top bit is set. field layouts are
+// constants of each procedure.
+//---------------------------------------------------------------------
+#define ipixel_simd_sse2_sll16(x, n) _mm_slli_epi16(x, n)
+#define ipixel_simd_sse2_srlv16(x, n) _mm_srl_epi16(x, _mm_cvtsi32_si128(n))
+#define ipixel_simd_sse2_sllv16(x, n) _mm_sll_epi16(x, _mm_cvtsi32_si128(n))
+#define ipixel_simd_sse2_mulhi16(x, y) _mm_mulhi_epu16(x, y)
+#define ipixel_simd_sse2_unlo16(x, y) _mm_unpacklo_epi16(x, y)
+#define ipixel_simd_sse2_unhi16(x, y) _mm_unpackhi_epi16(x, y)
+#define ipixel_simd_sse2_inter0(x, y) (x)
+#define ipixel_simd_sse2_inter1(x, y) (y)
+#define ipixel_simd_sse2_pack32(x, y) _mm_packs_epi32(x, y)
+
+#define ipixel_simd_avx2_sll16(x, n) _mm256_slli_epi16(x, n)
+#define ipixel_simd_avx2_srlv16(x, n) \
+	_mm256_srl_epi16(x, _mm_cvtsi32_si128(n))
+#define ipixel_simd_avx2_sllv16(x, n) \
+	_mm256_sll_epi16(x, _mm_cvtsi32_si128(n))
+#define ipixel_simd_avx2_mulhi16(x, y) _mm256_mulhi_epu16(x, y)
+#define ipixel_simd_avx2_unlo16(x, y) _mm256_unpacklo_epi16(x, y)
+#define ipixel_simd_avx2_unhi16(x, y) _mm256_unpackhi_epi16(x, y)
+#define ipixel_simd_avx2_inter0(x, y) _mm256_permute2x128_si256(x, y, 0x20)
+#define ipixel_simd_avx2_inter1(x, y) _mm256_permute2x128_si256(x, y, 0x31)
+#define ipixel_simd_avx2_pack32(x, y) \
+	_mm256_permute4x64_epi64(_mm256_packs_epi32(x, y), 0xd8)
+
+static const int ipixel_simd_pre16[7] = { 0, 15, 0, 0, 5, 4, 3 };
+static const int ipixel_simd_mul16[7] = { 0, 510, 0, 0, 33646, 33693, 
+	33159 };
+
+#define IPIXEL_SIMD_PACK16(isa, target, V, N) \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_expand16(V v, int shift, int bits) \
+{ \
+	V t; \
+	if (bits == 0) return IPIXEL_SIMD_V(isa, set16)(255); \
+	t = IPIXEL_SIMD_V(isa, srlv16)(v, shift); \
+	t = IPIXEL_SIMD_V(isa, and)(t, IPIXEL_SIMD_V(isa, set16)( \
+		(1 << bits) - 1)); \
+	if (bits == 4) { \
+		V j = IPIXEL_SIMD_V(isa, and)(t, IPIXEL_SIMD_V(isa, set16)(7)); \
+		V h = IPIXEL_SIMD_V(isa, gt16)(t, IPIXEL_SIMD_V(isa, set16)(7)); \
+		V k = IPIXEL_SIMD_V(isa, min16)(j, IPIXEL_SIMD_V(isa, set16)(1)); \
+		k = IPIXEL_SIMD_V(isa, add16)(k, IPIXEL_SIMD_V(isa, set16)(139)); \
+		t = IPIXEL_SIMD_V(isa, mulhi16)(IPIXEL_SIMD_V(isa, sll16)(j, 5), \
+			IPIXEL_SIMD_V(isa, set16)(ipixel_simd_mul16[4])); \
+		return IPIXEL_SIMD_V(isa, add16)(t, \
+			IPIXEL_SIMD_V(isa, and)(h, k)); \
+	} \
+	t = IPIXEL_SIMD_V(isa, sllv16)(t, ipixel_simd_pre16[bits]); \
+	return IPIXEL_SIMD_V(isa, mulhi16)(t, \
+		IPIXEL_SIMD_V(isa, set16)(ipixel_simd_mul16[bits])); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_shrink16(V p0, V p1, int pos, \
+	int shift, int bits) \
+{ \
+	V m = IPIXEL_SIMD_V(isa, set32)(0xff); \
+	V c0 = IPIXEL_SIMD_V(isa, and)(IPIXEL_SIMD_V(isa, srl32)(p0, pos), m); \
+	V c1 = IPIXEL_SIMD_V(isa, and)(IPIXEL_SIMD_V(isa, srl32)(p1, pos), m); \
+	V c = IPIXEL_SIMD_V(isa, pack32)(c0, c1); \
+	if (bits == 0) return IPIXEL_SIMD_V(isa, zero)(); \
+	c = IPIXEL_SIMD_V(isa, srlv16)(c, 8 - bits); \
+	return IPIXEL_SIMD_V(isa, sllv16)(c, shift); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static inline void ipixel_simd_##isa##_fetch16(IUINT32 *dst, \
+	const IUINT16 *src, int w, int rs, int rb, int gs, int gb, \
+	int bs, int bb, int as, int ab) \
+{ \
+	IUINT32 obuf[N * 2]; \
+	IUINT16 ibuf[N * 2]; \
+	V v, r, g, b, a, lo, hi; \
+	for (; w > 0; w -= N * 2, dst += N * 2, src += N * 2) { \
+		if (w >= N * 2) { \
+			v = IPIXEL_SIMD_V(isa, load)(src); \
+		}	else { \
+			memset(ibuf, 0, sizeof(ibuf)); \
+			memcpy(ibuf, src, w * sizeof(IUINT16)); \
+			v = IPIXEL_SIMD_V(isa, load)(ibuf); \
+		} \
+		r = ipixel_simd_##isa##_expand16(v, rs, rb); \
+		g = ipixel_simd_##isa##_expand16(v, gs, gb); \
+		b = ipixel_simd_##isa##_expand16(v, bs, bb); \
+		a = ipixel_simd_##isa##_expand16(v, as, ab); \
+		b = IPIXEL_SIMD_V(isa, or)(b, IPIXEL_SIMD_V(isa, sll16)(g, 8)); \
+		r = IPIXEL_SIMD_V(isa, or)(r, IPIXEL_SIMD_V(isa, sll16)(a, 8)); \
+		lo = IPIXEL_SIMD_V(isa, unlo16)(b, r); \
+		hi = IPIXEL_SIMD_V(isa, unhi16)(b, r); \
+		if (w >= N * 2) { \
+			IPIXEL_SIMD_V(isa, store)(dst, \
+				IPIXEL_SIMD_V(isa, inter0)(lo, hi)); \
+			IPIXEL_SIMD_V(isa, store)(dst + N, \
+				IPIXEL_SIMD_V(isa, inter1)(lo, hi)); \
+		}	else { \
+			IPIXEL_SIMD_V(isa, store)(obuf, \
+				IPIXEL_SIMD_V(isa, inter0)(lo, hi)); \
+			IPIXEL_SIMD_V(isa, store)(obuf + N, \
+				IPIXEL_SIMD_V(isa, inter1)(lo, hi)); \
+			memcpy(dst, obuf, w * sizeof(IUINT32)); \
+			break; \
+		} \
+	} \
+	IPIXEL_SIMD_V(isa, leave)(); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static inline void ipixel_simd_##isa##_store16(IUINT16 *dst, \
+	const IUINT32 *src, int w, int rs, int rb, int gs, int gb, \
+	int bs, int bb, int as, int ab) \
+{ \
+	IUINT32 ibuf[N * 2]; \
+	IUINT16 obuf[N * 2]; \
+	V p0, p1, v; \
+	for (; w > 0; w -= N * 2, dst += N * 2, src += N * 2) { \
+		if (w >= N * 2) { \
+			p0 = IPIXEL_SIMD_V(isa, load)(src); \
+			p1 = IPIXEL_SIMD_V(isa, load)(src + N); \
+		}	else { \
+			ipixel_simd_card_pad(ibuf, src, w, N * 2); \
+			p0 = IPIXEL_SIMD_V(isa, load)(ibuf); \
+			p1 = IPIXEL_SIMD_V(isa, load)(ibuf + N); \
+		} \
+		v = ipixel_simd_##isa##_shrink16(p0, p1, 16, rs, rb); \
+		v = IPIXEL_SIMD_V(isa, or)(v, \
+			ipixel_simd_##isa##_shrink16(p0, p1, 8, gs, gb)); \
+		v = IPIXEL_SIMD_V(isa, or)(v, \
+			ipixel_simd_##isa##_shrink16(p0, p1, 0, bs, bb)); \
+		v = IPIXEL_SIMD_V(isa, or)(v, \
+			ipixel_simd_##isa##_shrink16(p0, p1, 24, as, ab)); \
+		if (w >= N * 2) { \
+			IPIXEL_SIMD_V(isa, store)(dst, v); \
+		}	else { \
+			IPIXEL_SIMD_V(isa, store)(obuf, v); \
+			memcpy(dst, obuf, w * sizeof(IUINT16)); \
+			break; \
+		} \
+	} \
+	IPIXEL_SIMD_V(isa, leave)(); \
+}
+
+IPIXEL_SIMD_PACK16(sse2, "sse2", __m128i, 4)
+IPIXEL_SIMD_PACK16(avx2, "avx2", __m256i, 8)
+
+#undef IPIXEL_SIMD_PACK16
+
+// fetch / store procedures of one format, fields: shift, bits of rgba
+#define IPIXEL_SIMD_ACCESS16(isa, target, fmt, layout) \
+IPIXEL_SIMD_TARGET(target) \
+static void ipixel_simd_fetch_##fmt##_##isa(const void *bits, int x, \
+	int w, IUINT32 *buffer, const iColorIndex *idx) \
+{ \
+	ipixel_simd_##isa##_fetch16(buffer, (const IUINT16*)bits + x, w, \
+		layout); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static void ipixel_simd_store_##fmt##_##isa(void *bits, \
+	const IUINT32 *values, int x, int w, const iColorIndex *idx) \
+{ \
+	ipixel_simd_##isa##_store16((IUINT16*)bits + x, values, w, \
+		layout); \
+}
+
+#define IPIXEL_SIMD_LAYOUT(rs, rb, gs, gb, bs, bb, as, ab) \
+	rs, rb, gs, gb, bs, bb, as, ab
+
+#define IPIXEL_SIMD_FORMATS16(ITEM, isa, target) \
+	ITEM(isa, target, R5G6B5, IPIXEL_SIMD_LAYOUT(11, 5, 5, 6, 0, 5, 0, 0)) \
+	ITEM(isa, target, B5G6R5, IPIXEL_SIMD_LAYOUT(0, 5, 5, 6, 11, 5, 0, 0)) \
+	ITEM(isa, target, X1R5G5B5, IPIXEL_SIMD_LAYOUT(10, 5, 5, 5, 0, 5, 0, 0)) \
+	ITEM(isa, target, X1B5G5R5, IPIXEL_SIMD_LAYOUT(0, 5, 5, 5, 10, 5, 0, 0)) \
+	ITEM(isa, target, R5G5B5X1, IPIXEL_SIMD_LAYOUT(11, 5, 6, 5, 1, 5, 0, 0)) \
+	ITEM(isa, target, B5G5R5X1, IPIXEL_SIMD_LAYOUT(1, 5, 6, 5, 11, 5, 0, 0)) \
+	ITEM(isa, target, A1R5G5B5, IPIXEL_SIMD_LAYOUT(10, 5, 5, 5, 0, 5, 15, 1)) \
+	ITEM(isa, target, A1B5G5R5, IPIXEL_SIMD_LAYOUT(0, 5, 5, 5, 10, 5, 15, 1)) \
+	ITEM(isa, target, R5G5B5A1, IPIXEL_SIMD_LAYOUT(11, 5, 6, 5, 1, 5, 0, 1)) \
+	ITEM(isa, target, B5G5R5A1, IPIXEL_SIMD_LAYOUT(1, 5, 6, 5, 11, 5, 0, 1)) \
+	ITEM(isa, target, X4R4G4B4, IPIXEL_SIMD_LAYOUT(8, 4, 4, 4, 0, 4, 0, 0)) \
+	ITEM(isa, target, X4B4G4R4, IPIXEL_SIMD_LAYOUT(0, 4, 4, 4, 8, 4, 0, 0)) \
+	ITEM(isa, target, R4G4B4X4, IPIXEL_SIMD_LAYOUT(12, 4, 8, 4, 4, 4, 0, 0)) \
+	ITEM(isa, target, B4G4R4X4, IPIXEL_SIMD_LAYOUT(4, 4, 8, 4, 12, 4, 0, 0)) \
+	ITEM(isa, target, A4R4G4B4, IPIXEL_SIMD_LAYOUT(8, 4, 4, 4, 0, 4, 12, 4)) \
+	ITEM(isa, target, A4B4G4R4, IPIXEL_SIMD_LAYOUT(0, 4, 4, 4, 8, 4, 12, 4)) \
+	ITEM(isa, target, R4G4B4A4, IPIXEL_SIMD_LAYOUT(12, 4, 8, 4, 4, 4, 0, 4)) \
+	ITEM(isa, target, B4G4R4A4, IPIXEL_SIMD_LAYOUT(4, 4, 8, 4, 12, 4, 0, 4))
+
+IPIXEL_SIMD_FORMATS16(IPIXEL_SIMD_ACCESS16, sse2, "sse2")
+IPIXEL_SIMD_FORMATS16(IPIXEL_SIMD_ACCESS16, avx2, "avx2")
+
+#define IPIXEL_SIMD_ACCESS16_ENTRY(isa, target, fmt, layout) \
+	{ IPIX_FMT_##fmt, ipixel_simd_fetch_##fmt##_##isa, \
+	  ipixel_simd_store_##fmt##_##isa },
+
+typedef struct { int fmt; iFetchProc fetch; iStoreProc store; } 
+	iSimdAccess16;
+
+static const iSimdAccess16 ipixel_simd_access16_sse2[] = {
+	IPIXEL_SIMD_FORMATS16(IPIXEL_SIMD_ACCESS16_ENTRY, sse2, "sse2")
+	{ -1, NULL, NULL },
+};
+
+static const iSimdAccess16 ipixel_simd_access16_avx2[] = {
+	IPIXEL_SIMD_FORMATS16(IPIXEL_SIMD_ACCESS16_ENTRY, avx2, "avx2")
+	{ -1, NULL, NULL },
+};
+
+#undef IPIXEL_SIMD_ACCESS16_ENTRY
+#undef IPIXEL_SIMD_FORMATS16
+#undef IPIXEL_SIMD_LAYOUT
+#undef IPIXEL_SIMD_ACCESS16
+
+// install the 16 bits procedures. the fetchers replace the ACCURATE
+// procedures only, NORMAL access keeps the lut unless ipixel_simd_lut16(0)
+static void ipixel_simd_init_16(const iSimdAccess16 *list)
+{
+	for (; list->fetch; list++) {
+		ipixel_set_proc(list->fmt, IPIXEL_PROC_TYPE_STORE,
+			(void*)list->store);
+		ipixel_set_proc(list->fmt, IPIXEL_PROC_TYPE_FETCH,
+			(void*)list->fetch);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// P8R8G8B8 fetch / store, from and to A8R8G8B8 with the formulas of
+// IPIXEL_FROM_P8R8G8B8 and IPIXEL_TO_P8R8G8B8. the division is done
+// by div16 in floats, exact for these magnitudes.
+//---------------------------------------------------------------------
+#define IPIXEL_SIMD_PMUL(isa, target, V, N) \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_unpmul(V x) \
+{ \
+	V a = IPIXEL_SIMD_V(isa, alpha16)(x); \
+	V q = ipixel_simd_##isa##_div16(x, a); \
+	q = ipixel_simd_##isa##_select(IPIXEL_SIMD_V(isa, amask16)(), x, q); \
+	return IPIXEL_SIMD_V(isa, and)(q, IPIXEL_SIMD_V(isa, gt16)(a, \
+		IPIXEL_SIMD_V(isa, zero)())); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_pmul(V x) \
+{ \
+	V a = ipixel_simd_##isa##_norm16(IPIXEL_SIMD_V(isa, alpha16)(x)); \
+	V p = IPIXEL_SIMD_V(isa, srl16)(IPIXEL_SIMD_V(isa, mul16)(x, a), 8); \
+	return ipixel_simd_##isa##_select(IPIXEL_SIMD_V(isa, amask16)(), x, p); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static void ipixel_simd_fetch_P8R8G8B8_##isa(const void *bits, int x, \
+	int w, IUINT32 *buffer, const iColorIndex *idx) \
+{ \
+	const IUINT32 *src = (const IUINT32*)bits + x; \
+	IUINT32 c; \
+	V s; \
+	for (; w >= N; w -= N, src += N, buffer += N) { \
+		s = IPIXEL_SIMD_V(isa, load)(src); \
+		s = IPIXEL_SIMD_V(isa, pack)( \
+			ipixel_simd_##isa##_unpmul(IPIXEL_SIMD_V(isa, lo)(s)), \
+			ipixel_simd_##isa##_unpmul(IPIXEL_SIMD_V(isa, hi)(s))); \
+		IPIXEL_SIMD_V(isa, store)(buffer, s); \
+	} \
+	IPIXEL_SIMD_V(isa, leave)(); \
+	for (; w > 0; w--) { \
+		c = *src++; \
+		*buffer++ = IPIXEL_FROM_P8R8G8B8(c); \
+	} \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static void ipixel_simd_store_P8R8G8B8_##isa(void *bits, \
+	const IUINT32 *values, int x, int w, const iColorIndex *idx) \
+{ \
+	IUINT32 *dst = (IUINT32*)bits + x; \
+	IUINT32 c; \
+	V s; \
+	for (; w >= N; w -= N, dst += N, values += N) { \
+		s = IPIXEL_SIMD_V(isa, load)(values); \
+		s = IPIXEL_SIMD_V(isa, pack)( \
+			ipixel_simd_##isa##_pmul(IPIXEL_SIMD_V(isa, lo)(s)), \
+			ipixel_simd_##isa##_pmul(IPIXEL_SIMD_V(isa, hi)(s))); \
+		IPIXEL_SIMD_V(isa, store)(dst, s); \
+	} \
+	IPIXEL_SIMD_V(isa, leave)(); \
+	for (; w > 0; w--) { \
+		c = *values++; \
+		*dst++ = IPIXEL_TO_P8R8G8B8(c); \
+	} \
+}
+
+IPIXEL_SIMD_PMUL(sse2, "sse2", __m128i, 4)
+IPIXEL_SIMD_PMUL(avx2, "avx2", __m256i, 8)
+
+#undef IPIXEL_SIMD_PMUL
+
+
+//---------------------------------------------------------------------
+// AVX2 drawing for the eight A/X 32 bits formats, eight pixels per
+// iteration, same layout and formulas as the sse2 drawers in
+// ibmsse2.c: channels unpacked to B, G, R, A words, shufin / shufout
+// reorder the dest words, isx selects IBLEND_STATIC and a zero X byte.
+//---------------------------------------------------------------------
+#define ipixel_simd_avx2_shuf16(x, imm) \
+	_mm256_shufflehi_epi16(_mm256_shufflelo_epi16(x, imm), imm)
+
+IPIXEL_SIMD_TARGET("avx2")
+static inline void ipixel_simd_avx2_spread(__m256i x, __m256i *lo,
+	__m256i *hi)
+{
+	x = _mm256_or_si256(x, _mm256_slli_epi32(x, 16));
+	*lo = _mm256_unpacklo_epi32(x, x);
+	*hi = _mm256_unpackhi_epi32(x, x);
+}
+
+// IBLEND_STATIC: (s * a + d * (256 - a)) >> 8, a in [0, 256]
+IPIXEL_SIMD_TARGET("avx2")
+static inline __m256i ipixel_simd_avx2_lerp(__m256i s, __m256i d,
+	__m256i a)
+{
+	__m256i n = _mm256_sub_epi16(_mm256_set1_epi16(256), a);
+	s = _mm256_add_epi16(_mm256_mullo_epi16(s, a),
+		_mm256_mullo_epi16(d, n));
+	return _mm256_srli_epi16(s, 8);
+}
+
+// IBLEND_NORMAL_FAST: factor and result alpha from ipixel_blend_lut
+IPIXEL_SIMD_TARGET("avx2")
+static inline void ipixel_simd_avx2_lerp_lut(__m256i s0, __m256i s1,
+	__m256i *d0, __m256i *d1, __m256i ea)
+{
+	__m256i amask = ipixel_simd_avx2_amask16();
+	__m256i da = _mm256_castps_si256(_mm256_shuffle_ps(
+		_mm256_castsi256_ps(_mm256_srli_epi64(*d0, 48)),
+		_mm256_castsi256_ps(_mm256_srli_epi64(*d1, 48)), 0x88));
+	__m256i pos, f, fa, f0, f1, a0, a1;
+	int index[8];
+	pos = _mm256_slli_epi32(_mm256_and_si256(da,
+		_mm256_set1_epi32(0xf8)), 4);
+	ea = _mm256_srli_epi32(_mm256_and_si256(ea,
+		_mm256_set1_epi32(0xfc)), 1);
+	_mm256_storeu_si256((__m256i*)index, _mm256_or_si256(pos, ea));
+	f = _mm256_set_epi32(
+		*(const unsigned short*)(ipixel_blend_lut + index[7]),
+		*(const unsigned short*)(ipixel_blend_lut + index[6]),
+		*(const unsigned short*)(ipixel_blend_lut + index[5]),
+		*(const unsigned short*)(ipixel_blend_lut + index[4]),
+		*(const unsigned short*)(ipixel_blend_lut + index[3]),
+		*(const unsigned short*)(ipixel_blend_lut + index[2]),
+		*(const unsigned short*)(ipixel_blend_lut + index[1]),
+		*(const unsigned short*)(ipixel_blend_lut + index[0]));
+	fa = _mm256_srli_epi32(f, 8);
+	f = ipixel_simd_avx2_norm16(_mm256_and_si256(f,
+		_mm256_set1_epi32(0xff)));
+	ipixel_simd_avx2_spread(f, &f0, &f1);
+	ipixel_simd_avx2_spread(fa, &a0, &a1);
+	f0 = ipixel_simd_avx2_select(amask, _mm256_set1_epi16(256), f0);
+	f1 = ipixel_simd_avx2_select(amask, _mm256_set1_epi16(256), f1);
+	*d0 = ipixel_simd_avx2_lerp(ipixel_simd_avx2_select(amask, a0, s0),
+		*d0, f0);
+	*d1 = ipixel_simd_avx2_lerp(ipixel_simd_avx2_select(amask, a1, s1),
+		*d1, f1);
+}
+
+// IBLEND_SRCOVER: d * (255 - a) / 255 + s
+IPIXEL_SIMD_TARGET("avx2")
+static inline __m256i ipixel_simd_avx2_srcover(__m256i s, __m256i d,
+	__m256i a)
+{
+	return _mm256_add_epi16(ipixel_simd_avx2_mul255(d,
+		_mm256_sub_epi16(_mm256_set1_epi16(255), a)), s);
+}
+
+// IBLEND_ADDITIVE: d + (s * x) >> 8, saturated by the final pack
+IPIXEL_SIMD_TARGET("avx2")
+static inline __m256i ipixel_simd_avx2_additive(__m256i s, __m256i d,
+	__m256i x)
+{
+	s = _mm256_srli_epi16(_mm256_mullo_epi16(s, x), 8);
+	return _mm256_add_epi16(s, d);
+}
+
+#define IPIXEL_SIMD_AVX2_DRAW(fmt, shufin, shufout, isx) \
+IPIXEL_SIMD_TARGET("avx2") \
+static inline __m256i ipixel_simd_avx2_pack_##fmt(__m256i lo, __m256i hi) \
+{ \
+	if (isx) { \
+		__m256i m = _mm256_set_epi16(0, -1, -1, -1, 0, -1, -1, -1, \
+			0, -1, -1, -1, 0, -1, -1, -1); \
+		lo = _mm256_and_si256(lo, m); \
+		hi = _mm256_and_si256(hi, m); \
+	} \
+	lo = ipixel_simd_avx2_shuf16(lo, shufout); \
+	hi = ipixel_simd_avx2_shuf16(hi, shufout); \
+	return _mm256_packus_epi16(lo, hi); \
+} \
+IPIXEL_SIMD_TARGET("avx2") \
+static inline __m256i ipixel_simd_avx2_card_##fmt(__m256i s) \
+{ \
+	return ipixel_simd_avx2_pack_##fmt(ipixel_simd_avx2_lo(s), \
+		ipixel_simd_avx2_hi(s)); \
+} \
+IPIXEL_SIMD_TARGET("avx2") \
+static inline __m256i ipixel_simd_avx2_oct_##fmt(__m256i d, __m256i s, \
+	__m256i ea, __m256i ncv, __m256i skip, __m256i solid, int op) \
+{ \
+	__m256i amask = ipixel_simd_avx2_amask16(); \
+	__m256i s0 = ipixel_simd_avx2_lo(s); \
+	__m256i s1 = ipixel_simd_avx2_hi(s); \
+	__m256i d0 = ipixel_simd_avx2_shuf16(ipixel_simd_avx2_lo(d), shufin); \
+	__m256i d1 = ipixel_simd_avx2_shuf16(ipixel_simd_avx2_hi(d), shufin); \
+	__m256i a0, a1, n0, n1, r; \
+	ipixel_simd_avx2_spread(ea, &a0, &a1); \
+	if (op == 0) { \
+		if (isx) { \
+			d0 = ipixel_simd_avx2_lerp(s0, d0, \
+				ipixel_simd_avx2_norm16(a0)); \
+			d1 = ipixel_simd_avx2_lerp(s1, d1, \
+				ipixel_simd_avx2_norm16(a1)); \
+		}	else { \
+			ipixel_simd_avx2_lerp_lut(s0, s1, &d0, &d1, ea); \
+		} \
+	} \
+	else if (op == 1) { \
+		ipixel_simd_avx2_spread(ncv, &n0, &n1); \
+		s0 = _mm256_srli_epi16(_mm256_mullo_epi16(s0, n0), 8); \
+		s1 = _mm256_srli_epi16(_mm256_mullo_epi16(s1, n1), 8); \
+		d0 = ipixel_simd_avx2_srcover(ipixel_simd_avx2_select(amask, \
+			a0, s0), d0, a0); \
+		d1 = ipixel_simd_avx2_srcover(ipixel_simd_avx2_select(amask, \
+			a1, s1), d1, a1); \
+	} \
+	else { \
+		n0 = ipixel_simd_avx2_select(amask, _mm256_set1_epi16(256), \
+			ipixel_simd_avx2_norm16(a0)); \
+		n1 = ipixel_simd_avx2_select(amask, _mm256_set1_epi16(256), \
+			ipixel_simd_avx2_norm16(a1)); \
+		d0 = ipixel_simd_avx2_additive(ipixel_simd_avx2_select(amask, \
+			a0, s0), d0, n0); \
+		d1 = ipixel_simd_avx2_additive(ipixel_simd_avx2_select(amask, \
+			a1, s1), d1, n1); \
+	} \
+	r = ipixel_simd_avx2_select(skip, d, \
+		ipixel_simd_avx2_pack_##fmt(d0, d1)); \
+	if (op == 0) \
+		r = ipixel_simd_avx2_select(solid, ipixel_simd_avx2_card_##fmt(s), r); \
+	return r; \
+}
+
+// hline drawing: op 0 blend, 1 srcover, 2 additive. a vector whose
+// coverage is all 0 is skipped, all 255 (solid colour) is stored.
+#define IPIXEL_SIMD_AVX2_HLINE(fmt, op) \
+IPIXEL_SIMD_TARGET("avx2") \
+static void ipixel_simd_hline_##fmt##_##op##_avx2(void *bits, \
+	int startx, int w, IUINT32 color, const IUINT8 *cover, \
+	const iColorIndex *index) \
+{ \
+	IUINT8 *dst = (IUINT8*)bits + startx * 4; \
+	IUINT32 alpha = color >> 24; \
+	__m256i zero = _mm256_setzero_si256(); \
+	__m256i full = _mm256_set1_epi32(255); \
+	__m256i ncv = _mm256_set1_epi32(256); \
+	__m256i s = _mm256_set1_epi32((int)color); \
+	__m256i na = _mm256_set1_epi32(_ipixel_norm(alpha)); \
+	__m256i ea = _mm256_set1_epi32(alpha); \
+	__m256i cc, skip = zero, solid = zero, d; \
+	if (alpha == 0) return; \
+	if (cover == NULL) { \
+		if (alpha == 255 && op != 2) { \
+			d = ipixel_simd_avx2_card_##fmt(s); \
+			for (; w >= 8; w -= 8, dst += 32) \
+				_mm256_storeu_si256((__m256i*)dst, d); \
+			for (; w > 0; w--, dst += 4) \
+				*(IUINT32*)dst = (IUINT32)_mm256_cvtsi256_si32(d); \
+			_mm256_zeroupper(); \
+			return; \
+		} \
+		for (; w >= 8; w -= 8, dst += 32) { \
+			d = _mm256_loadu_si256((const __m256i*)dst); \
+			d = ipixel_simd_avx2_oct_##fmt(d, s, ea, ncv, skip, solid, op); \
+			_mm256_storeu_si256((__m256i*)dst, d); \
+		} \
+	}	else { \
+		for (; w >= 8; w -= 8, dst += 32, cover += 8) { \
+			cc = ipixel_simd_avx2_cover32(cover); \
+			skip = _mm256_cmpeq_epi32(cc, zero); \
+			if (ipixel_simd_avx2_all(skip)) continue; \
+			ncv = ipixel_simd_avx2_norm16(cc); \
+			if (alpha == 255) ea = cc; \
+			else ea = _mm256_srli_epi32(_mm256_mullo_epi16(cc, na), 8); \
+			solid = _mm256_cmpeq_epi32(ea, full); \
+			if (op != 2 && ipixel_simd_avx2_all(solid)) { \
+				_mm256_storeu_si256((__m256i*)dst, \
+					ipixel_simd_avx2_card_##fmt(s)); \
+				continue; \
+			} \
+			d = _mm256_loadu_si256((const __m256i*)dst); \
+			d = ipixel_simd_avx2_oct_##fmt(d, s, ea, ncv, skip, solid, op); \
+			_mm256_storeu_si256((__m256i*)dst, d); \
+		} \
+	} \
+	_mm256_zeroupper(); \
+	if (w > 0) { \
+		ipixel_get_hline_proc(IPIX_FMT_##fmt, op, 1)(dst, 0, w, color, \
+			cover, index); \
+	} \
+}
+
+// span drawing: op 0 blend, 1 srcover, 2 additive
+#define IPIXEL_SIMD_AVX2_SPAN(fmt, op) \
+IPIXEL_SIMD_TARGET("avx2") \
+static void ipixel_simd_span_##fmt##_##op##_avx2(void *bits, \
+	int startx, int w, const IUINT32 *card, const IUINT8 *cover, \
+	const iColorIndex *index) \
+{ \
+	IUINT8 *dst = (IUINT8*)bits + startx * 4; \
+	__m256i zero = _mm256_setzero_si256(); \
+	__m256i full = _mm256_set1_epi32(255); \
+	__m256i ncv = _mm256_set1_epi32(256); \
+	__m256i s, a, ea, cc, skip, solid, d; \
+	for (; w >= 8; w -= 8, dst += 32, card += 8) { \
+		s = _mm256_loadu_si256((const __m256i*)card); \
+		a = _mm256_srli_epi32(s, 24); \
+		if (cover == NULL) { \
+			ea = a; \
+			skip = _mm256_cmpeq_epi32(a, zero); \
+		}	else { \
+			cc = ipixel_simd_avx2_cover32(cover); \
+			cover += 8; \
+			ncv = ipixel_simd_avx2_norm16(cc); \
+			ea = _mm256_srli_epi32(_mm256_mullo_epi16(a, ncv), 8); \
+			skip = _mm256_cmpeq_epi32(cc, zero); \
+			if (op == 2) { \
+				skip = _mm256_or_si256(skip, _mm256_cmpeq_epi32(a, zero)); \
+			} \
+		} \
+		if (ipixel_simd_avx2_all(skip)) continue; \
+		solid = _mm256_cmpeq_epi32(ea, full); \
+		if (op != 2 && ipixel_simd_avx2_all(solid)) { \
+			_mm256_storeu_si256((__m256i*)dst, \
+				ipixel_simd_avx2_card_##fmt(s)); \
+			continue; \
+		} \
+		d = _mm256_loadu_si256((const __m256i*)dst); \
+		d = ipixel_simd_avx2_oct_##fmt(d, s, ea, ncv, skip, solid, op); \
+		_mm256_storeu_si256((__m256i*)dst, d); \
+	} \
+	_mm256_zeroupper(); \
+	if (w > 0) { \
+		ipixel_get_span_proc(IPIX_FMT_##fmt, op, 1)(dst, 0, w, card, \
+			cover, index); \
+	} \
+}
+
+#define IPIXEL_SIMD_AVX2_DRAW_MAIN(fmt, shufin, shufout, isx) \
+	IPIXEL_SIMD_AVX2_DRAW(fmt, shufin, shufout, isx) \
+	IPIXEL_SIMD_AVX2_HLINE(fmt, 0) \
+	IPIXEL_SIMD_AVX2_HLINE(fmt, 1) \
+	IPIXEL_SIMD_AVX2_HLINE(fmt, 2) \
+	IPIXEL_SIMD_AVX2_SPAN(fmt, 0) \
+	IPIXEL_SIMD_AVX2_SPAN(fmt, 1) \
+	IPIXEL_SIMD_AVX2_SPAN(fmt, 2)
+
+IPIXEL_SIMD_AVX2_DRAW_MAIN(A8R8G8B8, 0xe4, 0xe4, 0)
+IPIXEL_SIMD_AVX2_DRAW_MAIN(A8B8G8R8, 0xc6, 0xc6, 0)
+IPIXEL_SIMD_AVX2_DRAW_MAIN(R8G8B8A8, 0x39, 0x93, 0)
+IPIXEL_SIMD_AVX2_DRAW_MAIN(B8G8R8A8, 0x1b, 0x1b, 0)
+IPIXEL_SIMD_AVX2_DRAW_MAIN(X8R8G8B8, 0xe4, 0xe4, 1)
+IPIXEL_SIMD_AVX2_DRAW_MAIN(X8B8G8R8, 0xc6, 0xc6, 1)
+IPIXEL_SIMD_AVX2_DRAW_MAIN(R8G8B8X8, 0x39, 0x93, 1)
+IPIXEL_SIMD_AVX2_DRAW_MAIN(B8G8R8X8, 0x1b, 0x1b, 1)
+
+#undef IPIXEL_SIMD_AVX2_DRAW_MAIN
+#undef IPIXEL_SIMD_AVX2_HLINE
+#undef IPIXEL_SIMD_AVX2_SPAN
+
+#define IPIXEL_SIMD_AVX2_DRAW_SET(fmt) do { \
+		ipixel_set_hline_proc(IPIX_FMT_##fmt, 0, \
+			ipixel_simd_hline_##fmt##_0_avx2); \
+		ipixel_set_hline_proc(IPIX_FMT_##fmt, 1, \
+			ipixel_simd_hline_##fmt##_1_avx2); \
+		ipixel_set_hline_proc(IPIX_FMT_##fmt, 2, \
+			ipixel_simd_hline_##fmt##_2_avx2); \
+		ipixel_set_span_proc(IPIX_FMT_##fmt, 0, \
+			ipixel_simd_span_##fmt##_0_avx2); \
+		ipixel_set_span_proc(IPIX_FMT_##fmt, 1, \
+			ipixel_simd_span_##fmt##_1_avx2); \
+		ipixel_set_span_proc(IPIX_FMT_##fmt, 2, \
+			ipixel_simd_span_##fmt##_2_avx2); \
+	}	while (0)
+
+static void ipixel_simd_draw_avx2(void)
+{
+	IPIXEL_SIMD_AVX2_DRAW_SET(A8R8G8B8);
+	IPIXEL_SIMD_AVX2_DRAW_SET(A8B8G8R8);
+	IPIXEL_SIMD_AVX2_DRAW_SET(R8G8B8A8);
+	IPIXEL_SIMD_AVX2_DRAW_SET(B8G8R8A8);
+	IPIXEL_SIMD_AVX2_DRAW_SET(X8R8G8B8);
+	IPIXEL_SIMD_AVX2_DRAW_SET(X8B8G8R8);
+	IPIXEL_SIMD_AVX2_DRAW_SET(R8G8B8X8);
+	IPIXEL_SIMD_AVX2_DRAW_SET(B8G8R8X8);
+}
+
+#undef IPIXEL_SIMD_AVX2_DRAW_SET
+
+
+//---------------------------------------------------------------------
+// 24 bits, 565 and P8R8G8B8 drawing: chunks of the row are fetched
+// into a 32 bits buffer, drawn by the X8R8G8B8 procedure installed
+// (sse2 or avx2) and stored back. blend of the 24 bits and 565 formats
+// is IBLEND_STATIC like X8R8G8B8, and fetch + store is lossless for
+// them, so pixels left alone by the drawer come back unchanged. the
+// ACCURATE fetch expands 565 like the builtin drawers, the lut doesn't.
+//---------------------------------------------------------------------
+#define IPIXEL_SIMD_CHUNK	256
+
+static void ipixel_simd_hline_wide(int fmt, int op, void *bits,
+	int startx, int w, IUINT32 color, const IUINT8 *cover,
+	const iColorIndex *index)
+{
+	IUINT32 buffer[IPIXEL_SIMD_CHUNK];
+	iFetchProc fetch = ipixel_get_fetch(fmt, IPIXEL_ACCESS_MODE_ACCURATE);
+	iStoreProc store = ipixel_get_store(fmt, IPIXEL_ACCESS_MODE_NORMAL);
+	iHLineDrawProc draw = ipixel_get_hline_proc(IPIX_FMT_X8R8G8B8, op, 0);
+	IUINT32 alpha = color >> 24;
+	int i, n;
+	if (alpha == 0) return;
+	// srcover with cover scales alpha and colour with different rounding,
+	// a channel can reach 256 and each format packs the carry its own
+	// way, so the builtin procedure draws it
+	if (op == 1 && cover != NULL && alpha != 255) {
+		ipixel_get_hline_proc(fmt, 1, 1)(bits, startx, w, color, cover,
+			index);
+		return;
+	}
+	if (cover == NULL && alpha == 255 && op != 2) {
+		for (i = 0; i < IPIXEL_SIMD_CHUNK && i < w; i++) 
+			buffer[i] = color;
+		for (; w > 0; w -= n, startx += n) {
+			n = (w < IPIXEL_SIMD_CHUNK)? w : IPIXEL_SIMD_CHUNK;
+			store(bits, buffer, startx, n, index);
+		}
+		return;
+	}
+	for (; w > 0; w -= n, startx += n) {
+		n = (w < IPIXEL_SIMD_CHUNK)? w : IPIXEL_SIMD_CHUNK;
+		if (cover) {
+			// skip a run of zero coverage
+			for (i = 0; i < n && cover[i] == 0; i++);
+			if (i > 0) {
+				n = i;
+				cover += n;
+				continue;
+			}
+		}
+		fetch(bits, startx, n, buffer, index);
+		draw(buffer, 0, n, color, cover, index);
+		store(bits, buffer, startx, n, index);
+		if (cover) cover += n;
+	}
+}
+
+#define IPIXEL_SIMD_HLINE_WIDE(fmt, op) \
+static void ipixel_simd_hline_##fmt##_##op(void *bits, int startx, \
+	int w, IUINT32 color, const IUINT8 *cover, const iColorIndex *index) \
+{ \
+	ipixel_simd_hline_wide(IPIX_FMT_##fmt, op, bits, startx, w, color, \
+		cover, index); \
+}
+
+#define IPIXEL_SIMD_HLINE_WIDE_MAIN(fmt) \
+	IPIXEL_SIMD_HLINE_WIDE(fmt, 0) \
+	IPIXEL_SIMD_HLINE_WIDE(fmt, 1) \
+	IPIXEL_SIMD_HLINE_WIDE(fmt, 2)
+
+IPIXEL_SIMD_HLINE_WIDE_MAIN(R8G8B8)
+IPIXEL_SIMD_HLINE_WIDE_MAIN(B8G8R8)
+IPIXEL_SIMD_HLINE_WIDE_MAIN(R5G6B5)
+IPIXEL_SIMD_HLINE_WIDE_MAIN(B5G6R5)
+
+#undef IPIXEL_SIMD_HLINE_WIDE_MAIN
+#undef IPIXEL_SIMD_HLINE_WIDE
+
+// span pixel classes: 0 left alone, 1 stored opaque, 2 blended
+static inline int ipixel_simd_span_class(const IUINT32 *card,
+	const IUINT8 *cover, int op, int i)
+{
+	IUINT32 a = card[i] >> 24;
+	if (cover == NULL) {
+		if (a == 0) return 0;
+		return (a == 255 && op != 2)? 1 : 2;
+	}
+	if (cover[i] == 0 || (op == 2 && a == 0)) return 0;
+	return (a == 255 && cover[i] == 255 && op != 2)? 1 : 2;
+}
+
+// class shared by n pixels, 2 unless they all are 0 or all are 1
+static inline int ipixel_simd_span_block(const IUINT32 *card,
+	const IUINT8 *cover, int op, int n)
+{
+	IUINT32 amin = 0xffffffff, amax = 0, cmin = 0xff, cmax = 0;
+	int i;
+	for (i = 0; i < n; i++) {
+		amin &= card[i];
+		amax |= card[i];
+	}
+	amin >>= 24;
+	amax >>= 24;
+	if (cover == NULL) {
+		if (amax == 0) return 0;
+		return (amin == 255 && op != 2)? 1 : 2;
+	}
+	for (i = 0; i < n; i++) {
+		cmin &= cover[i];
+		cmax |= cover[i];
+	}
+	if (cmax == 0 || (op == 2 && amax == 0)) return 0;
+	return (amin == 255 && cmin == 255 && op != 2)? 1 : 2;
+}
+
+// runs are detected on blocks of this many pixels
+#define IPIXEL_SIMD_RUN		16
+
+// spans of R8G8B8, B8G8R8, R5G6B5, B5G6R5 draw with the X8R8G8B8 span
+// procedure, P8R8G8B8 with the A8R8G8B8 one: its fetch / store round
+// trip is lossy, so pixels the builtin leaves alone are put back.
+static void ipixel_simd_span_wide(int fmt, int op, void *bits,
+	int startx, int w, const IUINT32 *card, const IUINT8 *cover,
+	const iColorIndex *index)
+{
+	IUINT32 buffer[IPIXEL_SIMD_CHUNK];
+	IUINT32 saved[IPIXEL_SIMD_CHUNK];
+	int pmul = (fmt == IPIX_FMT_P8R8G8B8);
+	iFetchProc fetch = ipixel_get_fetch(fmt, IPIXEL_ACCESS_MODE_ACCURATE);
+	iStoreProc store = ipixel_get_store(fmt, IPIXEL_ACCESS_MODE_NORMAL);
+	iSpanDrawProc draw = ipixel_get_span_proc(pmul? IPIX_FMT_A8R8G8B8 :
+		IPIX_FMT_X8R8G8B8, op, 0);
+	int i, k, n, r;
+	for (; w > 0; w -= n, startx += n, card += n) {
+		n = (w < IPIXEL_SIMD_CHUNK)? w : IPIXEL_SIMD_CHUNK;
+		k = 2;
+		r = n;
+		if (n >= IPIXEL_SIMD_RUN) {
+			k = ipixel_simd_span_block(card, cover, op, IPIXEL_SIMD_RUN);
+			for (r = IPIXEL_SIMD_RUN; r + IPIXEL_SIMD_RUN <= n; ) {
+				if (ipixel_simd_span_block(card + r, cover? cover + r : NULL,
+					op, IPIXEL_SIMD_RUN) != k) break;
+				r += IPIXEL_SIMD_RUN;
+			}
+			if (n - r < IPIXEL_SIMD_RUN && k == 2) r = n;
+		}
+		n = r;
+		if (k == 1) {
+			store(bits, card, startx, n, index);
+		}
+		else if (k == 2) {
+			if (pmul) {
+				memcpy(saved, (IUINT32*)bits + startx, n * sizeof(IUINT32));
+			}
+			fetch(bits, startx, n, buffer, index);
+			draw(buffer, 0, n, card, cover, index);
+			store(bits, buffer, startx, n, index);
+			if (pmul) {
+				IUINT32 *dst = (IUINT32*)bits + startx;
+				for (i = 0; i < n; i++) {
+					if (ipixel_simd_span_class(card, cover, op, i) == 0)
+						dst[i] = saved[i];
+				}
+			}
+		}
+		if (cover) cover += n;
+	}
+}
+
+#define IPIXEL_SIMD_SPAN_WIDE(fmt, op) \
+static void ipixel_simd_span_##fmt##_##op(void *bits, int startx, \
+	int w, const IUINT32 *card, const IUINT8 *cover, \
+	const iColorIndex *index) \
+{ \
+	ipixel_simd_span_wide(IPIX_FMT_##fmt, op, bits, startx, w, card, \
+		cover, index); \
+}
+
+#define IPIXEL_SIMD_SPAN_WIDE_MAIN(fmt) \
+	IPIXEL_SIMD_SPAN_WIDE(fmt, 0) \
+	IPIXEL_SIMD_SPAN_WIDE(fmt, 1) \
+	IPIXEL_SIMD_SPAN_WIDE(fmt, 2)
+
+IPIXEL_SIMD_SPAN_WIDE_MAIN(P8R8G8B8)
+IPIXEL_SIMD_SPAN_WIDE_MAIN(R8G8B8)
+IPIXEL_SIMD_SPAN_WIDE_MAIN(B8G8R8)
+IPIXEL_SIMD_SPAN_WIDE_MAIN(R5G6B5)
+IPIXEL_SIMD_SPAN_WIDE_MAIN(B5G6R5)
+
+#undef IPIXEL_SIMD_SPAN_WIDE_MAIN
+#undef IPIXEL_SIMD_SPAN_WIDE
+
+#define IPIXEL_SIMD_HLINE_WIDE_SET(fmt) do { \
+		ipixel_set_hline_proc(IPIX_FMT_##fmt, 0, \
+			ipixel_simd_hline_##fmt##_0); \
+		ipixel_set_hline_proc(IPIX_FMT_##fmt, 1, \
+			ipixel_simd_hline_##fmt##_1); \
+		ipixel_set_hline_proc(IPIX_FMT_##fmt, 2, \
+			ipixel_simd_hline_##fmt##_2); \
+	}	while (0)
+
+#define IPIXEL_SIMD_SPAN_WIDE_SET(fmt) do { \
+		ipixel_set_span_proc(IPIX_FMT_##fmt, 0, \
+			ipixel_simd_span_##fmt##_0); \
+		ipixel_set_span_proc(IPIX_FMT_##fmt, 1, \
+			ipixel_simd_span_##fmt##_1); \
+		ipixel_set_span_proc(IPIX_FMT_##fmt, 2, \
+			ipixel_simd_span_##fmt##_2); \
+	}	while (0)
+
+static void ipixel_simd_draw_wide(void)
+{
+	IPIXEL_SIMD_HLINE_WIDE_SET(R8G8B8);
+	IPIXEL_SIMD_HLINE_WIDE_SET(B8G8R8);
+	IPIXEL_SIMD_HLINE_WIDE_SET(R5G6B5);
+	IPIXEL_SIMD_HLINE_WIDE_SET(B5G6R5);
+	IPIXEL_SIMD_SPAN_WIDE_SET(P8R8G8B8);
+	IPIXEL_SIMD_SPAN_WIDE_SET(R8G8B8);
+	IPIXEL_SIMD_SPAN_WIDE_SET(B8G8R8);
+	IPIXEL_SIMD_SPAN_WIDE_SET(R5G6B5);
+	IPIXEL_SIMD_SPAN_WIDE_SET(B5G6R5);
+}
+
+#undef IPIXEL_SIMD_HLINE_WIDE_SET
+#undef IPIXEL_SIMD_SPAN_WIDE_SET
+
+
+//---------------------------------------------------------------------
+// bilinear scanline fetchers for A8R8G8B8 / X8R8G8B8, scale and affine
+// transforms. blocks whose samples and right / lower neighbours are all
+// inside the clip are interpolated N pixels at a time, the others go
+// to the builtin procedure. ipixel_biline_interp computes
+// (c00 * (256-dx) * (256-dy) + ... + c11 * dx * dy) >> 16; it is done
+// vertically in words then horizontally as 32 bits mulhi / mullo sums,
+// so the results are the same.
+//---------------------------------------------------------------------
+#define ipixel_simd_sse2_unlo64(x, y) _mm_unpacklo_epi64(x, y)
+#define ipixel_simd_sse2_unhi64(x, y) _mm_unpackhi_epi64(x, y)
+#define ipixel_simd_sse2_shuf32(x, imm) _mm_shuffle_epi32(x, imm)
+#define ipixel_simd_sse2_eq16(x, y) _mm_cmpeq_epi16(x, y)
+#define ipixel_simd_sse2_addus16(x, y) _mm_adds_epu16(x, y)
+#define ipixel_simd_sse2_set32x(a, b, c, d, e, f, g, h) \
+	_mm_set_epi32(d, c, b, a)
+#define ipixel_simd_sse2_pairs(p, a, b, c, d) _mm_unpacklo_epi64( \
+	_mm_loadl_epi64((const __m128i*)((p)[a])), \
+	_mm_loadl_epi64((const __m128i*)((p)[b])))
+
+#define ipixel_simd_avx2_unlo64(x, y) _mm256_unpacklo_epi64(x, y)
+#define ipixel_simd_avx2_unhi64(x, y) _mm256_unpackhi_epi64(x, y)
+#define ipixel_simd_avx2_shuf32(x, imm) _mm256_shuffle_epi32(x, imm)
+#define ipixel_simd_avx2_eq16(x, y) _mm256_cmpeq_epi16(x, y)
+#define ipixel_simd_avx2_addus16(x, y) _mm256_adds_epu16(x, y)
+#define ipixel_simd_avx2_set32x(a, b, c, d, e, f, g, h) \
+	_mm256_set_epi32(h, g, f, e, d, c, b, a)
+#define ipixel_simd_avx2_pairs(p, a, b, c, d) _mm256_inserti128_si256( \
+	_mm256_castsi128_si256(ipixel_simd_sse2_pairs(p, a, b, 0, 0)), \
+	ipixel_simd_sse2_pairs(p, c, d, 0, 0), 1)
+
+#define IPIXEL_SIMD_BILINEAR(isa, target, V, N) \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_vert(V t, V b, V w) \
+{ \
+	V n = IPIXEL_SIMD_V(isa, sub16)(IPIXEL_SIMD_V(isa, set16)(256), w); \
+	return IPIXEL_SIMD_V(isa, add16)(IPIXEL_SIMD_V(isa, mul16)(t, n), \
+		IPIXEL_SIMD_V(isa, mul16)(b, w)); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_horz(V l, V r, V w) \
+{ \
+	V n = IPIXEL_SIMD_V(isa, sub16)(IPIXEL_SIMD_V(isa, set16)(256), w); \
+	V l1 = IPIXEL_SIMD_V(isa, mul16)(l, n); \
+	V l2 = IPIXEL_SIMD_V(isa, mul16)(r, w); \
+	V h = IPIXEL_SIMD_V(isa, add16)(IPIXEL_SIMD_V(isa, mulhi16)(l, n), \
+		IPIXEL_SIMD_V(isa, mulhi16)(r, w)); \
+	V c = IPIXEL_SIMD_V(isa, eq16)(IPIXEL_SIMD_V(isa, add16)(l1, l2), \
+		IPIXEL_SIMD_V(isa, addus16)(l1, l2)); \
+	c = IPIXEL_SIMD_V(isa, add16)(c, IPIXEL_SIMD_V(isa, set16)(1)); \
+	return IPIXEL_SIMD_V(isa, add16)(h, c); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static inline V ipixel_simd_##isa##_bilinear(const IUINT32 **pt, \
+	const IUINT32 **pb, V dx, V dy) \
+{ \
+	V wx = IPIXEL_SIMD_V(isa, or)(dx, IPIXEL_SIMD_V(isa, sll32)(dx, 16)); \
+	V wy = IPIXEL_SIMD_V(isa, or)(dy, IPIXEL_SIMD_V(isa, sll32)(dy, 16)); \
+	V t0 = IPIXEL_SIMD_V(isa, pairs)(pt, 0, 1, 4, 5); \
+	V t1 = IPIXEL_SIMD_V(isa, pairs)(pt, 2, 3, 6, 7); \
+	V b0 = IPIXEL_SIMD_V(isa, pairs)(pb, 0, 1, 4, 5); \
+	V b1 = IPIXEL_SIMD_V(isa, pairs)(pb, 2, 3, 6, 7); \
+	V v0, v1, v2, v3, p0, p1; \
+	v0 = ipixel_simd_##isa##_vert(IPIXEL_SIMD_V(isa, lo)(t0), \
+		IPIXEL_SIMD_V(isa, lo)(b0), IPIXEL_SIMD_V(isa, shuf32)(wy, 0x00)); \
+	v1 = ipixel_simd_##isa##_vert(IPIXEL_SIMD_V(isa, hi)(t0), \
+		IPIXEL_SIMD_V(isa, hi)(b0), IPIXEL_SIMD_V(isa, shuf32)(wy, 0x55)); \
+	v2 = ipixel_simd_##isa##_vert(IPIXEL_SIMD_V(isa, lo)(t1), \
+		IPIXEL_SIMD_V(isa, lo)(b1), IPIXEL_SIMD_V(isa, shuf32)(wy, 0xaa)); \
+	v3 = ipixel_simd_##isa##_vert(IPIXEL_SIMD_V(isa, hi)(t1), \
+		IPIXEL_SIMD_V(isa, hi)(b1), IPIXEL_SIMD_V(isa, shuf32)(wy, 0xff)); \
+	p0 = ipixel_simd_##isa##_horz(IPIXEL_SIMD_V(isa, unlo64)(v0, v1), \
+		IPIXEL_SIMD_V(isa, unhi64)(v0, v1), \
+		IPIXEL_SIMD_V(isa, unlo32)(wx, wx)); \
+	p1 = ipixel_simd_##isa##_horz(IPIXEL_SIMD_V(isa, unlo64)(v2, v3), \
+		IPIXEL_SIMD_V(isa, unhi64)(v2, v3), \
+		IPIXEL_SIMD_V(isa, unhi32)(wx, wx)); \
+	return IPIXEL_SIMD_V(isa, pack)(p0, p1); \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static void ipixel_simd_bilinear_scale_##isa(const IBITMAP *bmp, \
+	IUINT32 *card, int width, const cfixed *source, const cfixed *step, \
+	const IUINT8 *cover, const IRECT *clip) \
+{ \
+	int pixfmt = ibitmap_pixfmt_guess(bmp); \
+	int overflow = ibitmap_imode_const(bmp, overflow); \
+	int mode = (overflow == IBOM_TRANSPARENT)? \
+		IBITMAP_FETCH_SCALE_BILINEAR : IBITMAP_FETCH_REPEAT_SCALE_BILINEAR; \
+	iBitmapFetchProc proc = ibitmap_scanline_get_proc(pixfmt, mode, 1); \
+	cfixed x = source[0] - cfixed_const_half; \
+	cfixed y = source[1] - cfixed_const_half; \
+	cfixed du = step[0]; \
+	cfixed left = cfixed_from_int(clip->left); \
+	cfixed right = cfixed_from_int(clip->right - 1); \
+	IUINT32 mask = (pixfmt == IPIX_FMT_X8R8G8B8)? 0xff000000 : 0; \
+	const IUINT32 *pt[8], *pb[8]; \
+	const IUINT32 *top, *bot; \
+	cfixed pos[3]; \
+	V dy, dx, xs, vm; \
+	int y1, y2, i; \
+	y1 = cfixed_to_int(y); \
+	y2 = y1 + 1; \
+	if (ibitmap_filter_sample(bmp) != IPIXEL_FILTER_BILINEAR || \
+		overflow > IBOM_REPEAT || (overflow == IBOM_TRANSPARENT && \
+		(y1 < clip->top || y2 >= clip->bottom))) { \
+		proc(bmp, card, width, source, step, cover, clip); \
+		return; \
+	} \
+	if (y1 < clip->top) y1 = clip->top; \
+	else if (y1 >= clip->bottom) y1 = clip->bottom - 1; \
+	if (y2 < clip->top) y2 = clip->top; \
+	else if (y2 >= clip->bottom) y2 = clip->bottom - 1; \
+	top = (const IUINT32*)bmp->line[y1]; \
+	bot = (const IUINT32*)bmp->line[y2]; \
+	dy = IPIXEL_SIMD_V(isa, set32)((y >> 8) & 0xff); \
+	vm = IPIXEL_SIMD_V(isa, set32)(mask); \
+	xs = IPIXEL_SIMD_V(isa, set32x)(0, du, du * 2, du * 3, du * 4, \
+		du * 5, du * 6, du * 7); \
+	pos[1] = source[1]; \
+	pos[2] = source[2]; \
+	for (; width >= N; width -= N, card += N, x += du * N) { \
+		cfixed xl = x + du * (N - 1); \
+		if (x < left || x >= right || xl < left || xl >= right) { \
+			pos[0] = x + cfixed_const_half; \
+			proc(bmp, card, N, pos, step, cover, clip); \
+			continue; \
+		} \
+		for (i = 0; i < N; i++) { \
+			int x1 = cfixed_to_int(x + du * i); \
+			pt[i] = top + x1; \
+			pb[i] = bot + x1; \
+		} \
+		dx = IPIXEL_SIMD_V(isa, add32)(IPIXEL_SIMD_V(isa, set32)(x), xs); \
+		dx = IPIXEL_SIMD_V(isa, and)(IPIXEL_SIMD_V(isa, srl32)(dx, 8), \
+			IPIXEL_SIMD_V(isa, set32)(0xff)); \
+		IPIXEL_SIMD_V(isa, store)(card, IPIXEL_SIMD_V(isa, or)(vm, \
+			ipixel_simd_##isa##_bilinear(pt, pb, dx, dy))); \
+	} \
+	IPIXEL_SIMD_V(isa, leave)(); \
+	if (width > 0) { \
+		pos[0] = x + cfixed_const_half; \
+		proc(bmp, card, width, pos, step, cover, clip); \
+	} \
+} \
+IPIXEL_SIMD_TARGET(target) \
+static void ipixel_simd_bilinear_affine_##isa(const IBITMAP *bmp, \
+	IUINT32 *card, int width, const cfixed *source, const cfixed *step, \
+	const IUINT8 *cover, const IRECT *clip) \
+{ \
+	int pixfmt = ibitmap_pixfmt_guess(bmp); \
+	iBitmapFetchProc proc = ibitmap_scanline_get_proc(pixfmt, \
+		IBITMAP_FETCH_GENERAL_BILINEAR, 1); \
+	cfixed u = source[0] - cfixed_const_half; \
+	cfixed v = source[1] - cfixed_const_half; \
+	cfixed du = step[0], dv = step[1]; \
+	IUINT32 mask = (pixfmt == IPIX_FMT_X8R8G8B8)? 0xff000000 : 0; \
+	const IUINT32 *pt[8], *pb[8]; \
+	cfixed pos[3]; \
+	V vm, su, sv, dx, dy; \
+	int i; \
+	if (ibitmap_filter_sample(bmp) != IPIXEL_FILTER_BILINEAR || \
+		source[2] != cfixed_const_1 || step[2] != 0) { \
+		proc(bmp, card, width, source, step, cover, clip); \
+		return; \
+	} \
+	vm = IPIXEL_SIMD_V(isa, set32)(mask); \
+	su = IPIXEL_SIMD_V(isa, set32x)(0, du, du * 2, du * 3, du * 4, \
+		du * 5, du * 6, du * 7); \
+	sv = IPIXEL_SIMD_V(isa, set32x)(0, dv, dv * 2, dv * 3, dv * 4, \
+		dv * 5, dv * 6, dv * 7); \
+	pos[2] = source[2]; \
+	for (; width >= N; width -= N, card += N, u += du * N, v += dv * N) { \
+		int x1 = cfixed_to_int(u), x2 = cfixed_to_int(u + du * (N - 1)); \
+		int y1 = cfixed_to_int(v), y2 = cfixed_to_int(v + dv * (N - 1)); \
+		/* coordinates are linear, the block ends bound them */ \
+		if (x1 < clip->left || x2 < clip->left || \
+			x1 + 1 >= clip->right || x2 + 1 >= clip->right || \
+			y1 < clip->top || y2 < clip->top || \
+			y1 + 1 >= clip->bottom || y2 + 1 >= clip->bottom) { \
+			pos[0] = u + cfixed_const_half; \
+			pos[1] = v + cfixed_const_half; \
+			proc(bmp, card, N, pos, step, cover, clip); \
+			continue; \
+		} \
+		for (i = 0; i < N; i++) { \
+			x1 = cfixed_to_int(u + du * i); \
+			y1 = cfixed_to_int(v + dv * i); \
+			pt[i] = (const IUINT32*)bmp->line[y1] + x1; \
+			pb[i] = (const IUINT32*)bmp->line[y1 + 1] + x1; \
+		} \
+		dx = IPIXEL_SIMD_V(isa, add32)(IPIXEL_SIMD_V(isa, set32)(u), su); \
+		dy = IPIXEL_SIMD_V(isa, add32)(IPIXEL_SIMD_V(isa, set32)(v), sv); \
+		dx = IPIXEL_SIMD_V(isa, and)(IPIXEL_SIMD_V(isa, srl32)(dx, 8), \
+			IPIXEL_SIMD_V(isa, set32)(0xff)); \
+		dy = IPIXEL_SIMD_V(isa, and)(IPIXEL_SIMD_V(isa, srl32)(dy, 8), \
+			IPIXEL_SIMD_V(isa, set32)(0xff)); \
+		IPIXEL_SIMD_V(isa, store)(card, IPIXEL_SIMD_V(isa, or)(vm, \
+			ipixel_simd_##isa##_bilinear(pt, pb, dx, dy))); \
+	} \
+	IPIXEL_SIMD_V(isa, leave)(); \
+	if (width > 0) { \
+		pos[0] = u + cfixed_const_half; \
+		pos[1] = v + cfixed_const_half; \
+		proc(bmp, card, width, pos, step, cover, clip); \
+	} \
+}
+
+IPIXEL_SIMD_BILINEAR(sse2, "sse2", __m128i, 4)
+IPIXEL_SIMD_BILINEAR(avx2, "avx2", __m256i, 8)
+
+#undef IPIXEL_SIMD_BILINEAR
+
+// install for A8R8G8B8 and X8R8G8B8
+static void ipixel_simd_bilinear_set(iBitmapFetchProc scale,
+	iBitmapFetchProc affine)
+{
+	static const int fmts[2] = { IPIX_FMT_A8R8G8B8, IPIX_FMT_X8R8G8B8 };
+	int i;
+	for (i = 0; i < 2; i++) {
+		ibitmap_scanline_set_proc(fmts[i], IBITMAP_FETCH_GENERAL_BILINEAR,
+			affine);
+		ibitmap_scanline_set_proc(fmts[i], IBITMAP_FETCH_SCALE_BILINEAR,
+			scale);
+		ibitmap_scanline_set_proc(fmts[i], 
+			IBITMAP_FETCH_REPEAT_SCALE_BILINEAR, scale);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// box filter column sums: sum[i] += src[i] * weight
+//---------------------------------------------------------------------
+static void ipixel_simd_box_column_c(IUINT32 *sum, const IUINT8 *src,
+	IUINT32 weight, int size)
+{
+	for (; size > 0; size--) {
+		*sum++ += (IUINT32)(*src++) * weight;
+	}
+}
+
+// 16 bits products are split by mullo / mulhi, weight must fit 16 bits
+IPIXEL_SIMD_TARGET("sse2")
+static void ipixel_simd_box_column_sse2(IUINT32 *sum, const IUINT8 *src,
+	IUINT32 weight, int size)
+{
+	__m128i z = _mm_setzero_si128();
+	__m128i w = _mm_set1_epi16((short)weight);
+	if (weight > 0xffff) {
+		ipixel_simd_box_column_c(sum, src, weight, size);
+		return;
+	}
+	for (; size >= 16; size -= 16, src += 16, sum += 16) {
+		__m128i s = _mm_loadu_si128((const __m128i*)src);
+		__m128i a = _mm_unpacklo_epi8(s, z);
+		__m128i b = _mm_unpackhi_epi8(s, z);
+		__m128i al = _mm_mullo_epi16(a, w);
+		__m128i ah = _mm_mulhi_epu16(a, w);
+		__m128i bl = _mm_mullo_epi16(b, w);
+		__m128i bh = _mm_mulhi_epu16(b, w);
+		__m128i *d = (__m128i*)sum;
+		_mm_storeu_si128(d + 0, _mm_add_epi32(_mm_loadu_si128(d + 0),
+			_mm_unpacklo_epi16(al, ah)));
+		_mm_storeu_si128(d + 1, _mm_add_epi32(_mm_loadu_si128(d + 1),
+			_mm_unpackhi_epi16(al, ah)));
+		_mm_storeu_si128(d + 2, _mm_add_epi32(_mm_loadu_si128(d + 2),
+			_mm_unpacklo_epi16(bl, bh)));
+		_mm_storeu_si128(d + 3, _mm_add_epi32(_mm_loadu_si128(d + 3),
+			_mm_unpackhi_epi16(bl, bh)));
+	}
+	ipixel_simd_box_column_c(sum, src, weight, size);
+}
+
+// bytes are widened to 32 bits lanes in order, no lane crossing
+IPIXEL_SIMD_TARGET("avx2")
+static void ipixel_simd_box_column_avx2(IUINT32 *sum, const IUINT8 *src,
+	IUINT32 weight, int size)
+{
+	__m256i w = _mm256_set1_epi32((int)weight);
+	int k;
+	for (; size >= 32; size -= 32, src += 32, sum += 32) {
+		for (k = 0; k < 4; k++) {
+			__m256i s = _mm256_cvtepu8_epi32(
+				_mm_loadl_epi64((const __m128i*)(src + k * 8)));
+			__m256i *d = (__m256i*)(sum + k * 8);
+			_mm256_storeu_si256(d, _mm256_add_epi32(_mm256_loadu_si256(d),
+				_mm256_mullo_epi32(s, w)));
+		}
+	}
+	ipixel_simd_box_column_c(sum, src, weight, size);
+}
+
+
+//---------------------------------------------------------------------
+// bicubic / lanczos convolution: 14 bits weights, the horizontal pass
+// produces signed 8.6 fixed point channels and the vertical pass sums
+// the taps rows and saturates to A8R8G8B8, same rounding as the c code
+//---------------------------------------------------------------------
+
+// two weights in one 32 bits lane for pmaddwd
+#define ipixel_simd_kernel_pair(w, k, n) \
+	((int)(((IUINT32)(IUINT16)(((k) + 1 < (n))? (w)[(k) + 1] : 0) << 16) | \
+	(IUINT16)(w)[k]))
+
+static void ipixel_simd_kernel_vert_c(IUINT32 *card, const IINT16 **rows,
+	const IINT16 *weight, int taps, int start, int width)
+{
+	int i, k, c;
+	for (i = start; i < width; i++) {
+		IUINT32 cc = 0;
+		for (c = 0; c < 4; c++) {
+			IINT32 sum = 1 << 19;
+			for (k = 0; k < taps; k++) {
+				sum += (IINT32)rows[k][i * 4 + c] * weight[k];
+			}
+			sum >>= 20;
+			sum = (sum < 0)? 0 : ((sum > 255)? 255 : sum);
+			cc |= (IUINT32)sum << (c * 8);
+		}
+		card[i] = cc;
+	}
+}
+
+IPIXEL_SIMD_TARGET("sse2")
+static void ipixel_simd_kernel_horz_sse2(IINT16 *row, const IUINT32 *card,
+	const IINT32 *index, const IINT16 *weight, int taps, int width)
+{
+	__m128i z = _mm_setzero_si128();
+	__m128i half = _mm_set1_epi32(128);
+	int i, k;
+	for (i = 0; i < width; i++, row += 4, weight += taps) {
+		const IUINT32 *src = card + index[i];
+		__m128i sum = half;
+		for (k = 0; k < taps; k += 2) {
+			__m128i p0 = _mm_cvtsi32_si128((int)src[k]);
+			__m128i p1 = (k + 1 < taps)? 
+				_mm_cvtsi32_si128((int)src[k + 1]) : z;
+			__m128i w = _mm_set1_epi32(
+				ipixel_simd_kernel_pair(weight, k, taps));
+			__m128i p = _mm_unpacklo_epi8(_mm_unpacklo_epi8(p0, p1), z);
+			sum = _mm_add_epi32(sum, _mm_madd_epi16(p, w));
+		}
+		sum = _mm_srai_epi32(sum, 8);
+		_mm_storel_epi64((__m128i*)row, _mm_packs_epi32(sum, sum));
+	}
+}
+
+IPIXEL_SIMD_TARGET("sse2")
+static void ipixel_simd_kernel_vert_sse2(IUINT32 *card, const IINT16 **rows,
+	const IINT16 *weight, int taps, int width)
+{
+	__m128i z = _mm_setzero_si128();
+	__m128i half = _mm_set1_epi32(1 << 19);
+	int i, k, n;
+	for (i = 0; i + 4 <= width; i += 4) {
+		__m128i h[2];
+		for (n = 0; n < 2; n++) {
+			__m128i s0 = half, s1 = half;
+			for (k = 0; k < taps; k += 2) {
+				__m128i a = _mm_loadu_si128(
+					(const __m128i*)(rows[k] + i * 4 + n * 8));
+				__m128i b = (k + 1 < taps)? _mm_loadu_si128(
+					(const __m128i*)(rows[k + 1] + i * 4 + n * 8)) : z;
+				__m128i w = _mm_set1_epi32(
+					ipixel_simd_kernel_pair(weight, k, taps));
+				s0 = _mm_add_epi32(s0, 
+					_mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+				s1 = _mm_add_epi32(s1, 
+					_mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+			}
+			h[n] = _mm_packs_epi32(_mm_srai_epi32(s0, 20), 
+				_mm_srai_epi32(s1, 20));
+		}
+		_mm_storeu_si128((__m128i*)(card + i), 
+			_mm_packus_epi16(h[0], h[1]));
+	}
+	ipixel_simd_kernel_vert_c(card, rows, weight, taps, i, width);
+}
+
+IPIXEL_SIMD_TARGET("avx2")
+static void ipixel_simd_kernel_vert_avx2(IUINT32 *card, const IINT16 **rows,
+	const IINT16 *weight, int taps, int width)
+{
+	__m256i z = _mm256_setzero_si256();
+	__m256i half = _mm256_set1_epi32(1 << 19);
+	int i, k, n;
+	for (i = 0; i + 8 <= width; i += 8) {
+		__m256i h[2];
+		for (n = 0; n < 2; n++) {
+			__m256i s0 = half, s1 = half;
+			for (k = 0; k < taps; k += 2) {
+				__m256i a = _mm256_loadu_si256(
+					(const __m256i*)(rows[k] + i * 4 + n * 16));
+				__m256i b = (k + 1 < taps)? _mm256_loadu_si256(
+					(const __m256i*)(rows[k + 1] + i * 4 + n * 16)) : z;
+				__m256i w = _mm256_set1_epi32(
+					ipixel_simd_kernel_pair(weight, k, taps));
+				s0 = _mm256_add_epi32(s0, 
+					_mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w));
+				s1 = _mm256_add_epi32(s1, 
+					_mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w));
+			}
+			h[n] = _mm256_packs_epi32(_mm256_srai_epi32(s0, 20), 
+				_mm256_srai_epi32(s1, 20));
+		}
+		_mm256_storeu_si256((__m256i*)(card + i), _mm256_permute4x64_epi64(
+			_mm256_packus_epi16(h[0], h[1]), 0xd8));
+	}
+	ipixel_simd_kernel_vert_c(card, rows, weight, taps, i, width);
+}
+
+
+//---------------------------------------------------------------------
+// SSE2: blitters, compositors, cards, the mmx / sse2 span drawers and
+// the 24 bits / 565 / P8R8G8B8 drawers, the bilinear fetchers, the
+// box filter column sums and the bicubic / lanczos convolutions
+//---------------------------------------------------------------------
+static void ipixel_simd_init_sse2(void)
+{
+#ifdef __x86__
+	pixellib_mmx_init();
+	pixellib_xmm_init();
+	// the mmx 555 span drawers round differently from the c ones and
+	// nothing replaces them below
+	ipixel_set_span_proc(IPIX_FMT_X1R5G5B5, 0, NULL);
+	ipixel_set_span_proc(IPIX_FMT_X1B5G5R5, 0, NULL);
+	ipixel_set_span_proc(IPIX_FMT_R5G5B5X1, 0, NULL);
+	ipixel_set_span_proc(IPIX_FMT_B5G5R5X1, 0, NULL);
+#endif
+	ibitmap_funcset(IBITMAP_BLITER_NORM, (void*)ipixel_simd_blitn_sse2);
+	ibitmap_funcset(IBITMAP_BLITER_MASK, (void*)ipixel_simd_blitm_sse2);
+	ibitmap_funcset(IBITMAP_BLITER_FLIP, (void*)ipixel_simd_blitf_sse2);
+	ipixel_simd_composite_sse2();
+	ipixel_simd_card_sse2();
+	ipixel_simd_init_16(ipixel_simd_access16_sse2);
+	ipixel_set_proc(IPIX_FMT_P8R8G8B8, IPIXEL_PROC_TYPE_FETCH,
+		(void*)ipixel_simd_fetch_P8R8G8B8_sse2);
+	ipixel_set_proc(IPIX_FMT_P8R8G8B8, IPIXEL_PROC_TYPE_STORE,
+		(void*)ipixel_simd_store_P8R8G8B8_sse2);
+	ipixel_simd_draw_wide();
+	ipixel_simd_bilinear_set(ipixel_simd_bilinear_scale_sse2,
+		ipixel_simd_bilinear_affine_sse2);
+	ibitmap_scale_box_set_proc(ipixel_simd_box_column_sse2);
+	ibitmap_scale_kernel_set_proc(0, (void*)ipixel_simd_kernel_horz_sse2);
+	ibitmap_scale_kernel_set_proc(1, (void*)ipixel_simd_kernel_vert_sse2);
+}
+
+
+//---------------------------------------------------------------------
+// SSSE3: byte shuffles, 24 bits fetch / store and converters
+//---------------------------------------------------------------------
+static void ipixel_simd_init_ssse3(void)
+{
+	ipixel_card_set_proc(4, (void*)ipixel_simd_card_permute_ssse3);
+	ipixel_simd_init_24(IPIXEL_SIMD_SSSE3);
+}
+
+
+//---------------------------------------------------------------------
+// AVX2
+//---------------------------------------------------------------------
+static void ipixel_simd_init_avx2(void)
+{
+	ibitmap_funcset(IBITMAP_BLITER_NORM, (void*)ipixel_simd_blitn_avx2);
+	ibitmap_funcset(IBITMAP_BLITER_MASK, (void*)ipixel_simd_blitm_avx2);
+	ibitmap_funcset(IBITMAP_BLITER_FLIP, (void*)ipixel_simd_blitf_avx2);
+	ipixel_simd_composite_avx2();
+	ipixel_simd_card_avx2();
+	ipixel_card_set_proc(4, (void*)ipixel_simd_card_permute_avx2);
+	ipixel_simd_init_24(IPIXEL_SIMD_AVX2);
+	ipixel_simd_init_16(ipixel_simd_access16_avx2);
+	ipixel_set_proc(IPIX_FMT_P8R8G8B8, IPIXEL_PROC_TYPE_FETCH,
+		(void*)ipixel_simd_fetch_P8R8G8B8_avx2);
+	ipixel_set_proc(IPIX_FMT_P8R8G8B8, IPIXEL_PROC_TYPE_STORE,
+		(void*)ipixel_simd_store_P8R8G8B8_avx2);
+	ipixel_simd_draw_avx2();
+	ipixel_simd_bilinear_set(ipixel_simd_bilinear_scale_avx2,
+		ipixel_simd_bilinear_affine_avx2);
+	ibitmap_scale_box_set_proc(ipixel_simd_box_column_avx2);
+	ibitmap_scale_kernel_set_proc(1, (void*)ipixel_simd_kernel_vert_avx2);
+}
+
+#endif
+
+
+//---------------------------------------------------------------------
+// interface
+//---------------------------------------------------------------------
+static void ipixel_simd_detect_init(void)
+{
+#ifdef IPIXEL_SIMD_X64
+	ipixel_simd_detected = ipixel_simd_probe();
+#else
+	ipixel_simd_detected = IPIXEL_SIMD_NONE;
+#endif
+}
+
+int ipixel_simd_detect(void)
+{
+	IPIXEL_ONCE(&ipixel_simd_detect_once, ipixel_simd_detect_init);
+	return ipixel_simd_detected;
+}
+
+int ipixel_simd_level(void)
+{
+	return ipixel_simd_current;
+}
+
+int ipixel_simd_select(int level)
+{
+#ifdef IPIXEL_SIMD_X64
+	int detected = ipixel_simd_detect();
+	if (level < 0 || level > detected) level = detected;
+	ipixel_simd_restore();
+	if (level >= IPIXEL_SIMD_SSE2) ipixel_simd_init_sse2();
+	if (level >= IPIXEL_SIMD_SSSE3) ipixel_simd_init_ssse3();
+	if (level >= IPIXEL_SIMD_AVX2) ipixel_simd_init_avx2();
+	ipixel_simd_current = level;
+#endif
+	return ipixel_simd_current;
+}
+
+int ipixel_simd_lut16(int enable)
+{
+	return ipixel_set_lut16(enable);
+}
+
+const char *ipixel_simd_name(int level)
+{
+	if (level < 0 || level >= IPIXEL_SIMD_COUNT) return "unknown";
+	return ipixel_simd_names[level];
+}
+
+
@@ -0,0 +1,82 @@
+//=====================================================================
+//
+// ibmsimd.h - x86-64 runtime cpu dispatch
+//
+// NOTE:
+// the library is compiled for the x86-64 baseline (sse2), kernels
+// for newer instruction sets are compiled with per-function target
+// attributes and installed at runtime through the existing hooks:
+// ipixel_set_proc, ipixel_set_span_proc, ipixel_composite_set,
+// ipixel_card_set_proc and ibitmap_funcset.
+//
+//=====================================================================
+#ifndef __IBMSIMD_H__
+#define __IBMSIMD_H__
+
+
+//---------------------------------------------------------------------
+// instruction set levels, each level includes all lower levels
+//---------------------------------------------------------------------
+#define IPIXEL_SIMD_AUTO		-1		// highest level supported
+#define IPIXEL_SIMD_NONE		0		// portable c implementation
+#define IPIXEL_SIMD_SSE2		1
+#define IPIXEL_SIMD_SSSE3		2
+#define IPIXEL_SIMD_SSE41		3		// no kernels yet, same as SSSE3
+#define IPIXEL_SIMD_AVX2		4
+#define IPIXEL_SIMD_AVX512BW	5		// no kernels yet, same as AVX2
+#define IPIXEL_SIMD_COUNT		6
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//---------------------------------------------------------------------
+// interface
+//---------------------------------------------------------------------
+
+// highest level supported by both cpu and os (cpuid + xgetbv),
+// detected once (thread safe). returns IPIXEL_SIMD_NONE on other
+// architectures.
+int ipixel_simd_detect(void);
+
+// level currently installed, IPIXEL_SIMD_NONE before selecting
+int ipixel_simd_level(void);
+
+// restore builtin procedures then install kernels up to 'level',
+// levels above ipixel_simd_detect() are clamped. returns the level
+// installed. it is not thread safe, call it before drawing. does
+// nothing on other architectures.
+// the restore resets every hook this file may install, for all
+// formats / ops / ids, whoever installed the current procedure:
+// fetch / store / fetchpixel procs, span and hline drawers, 
+// compositors, card procs 0-5, 24 bits converters, blitters, scanline
+// fetchers and the box / kernel scaling passes. procedures installed
+// by the application through ipixel_set_proc, ipixel_card_set_proc and
+// the other hooks are lost, install them again after selecting (note
+// iscreen_init selects IPIXEL_SIMD_AUTO).
+// SSE4.1 and AVX-512BW are detected and reported but install no extra
+// kernels: selecting them gives the SSSE3 and AVX2 procedures.
+int ipixel_simd_select(int level);
+
+// 16 bits formats (565, 1555, 5551, 4444 families) in NORMAL access
+// mode are fetched by the builtin 512 entries lut (enable = 1, default,
+// same output at every level) or by the exact bit expansion of the
+// ACCURATE procedures (enable = 0, simd when a level is installed; some
+// channels come out one higher than the lut, e.g. 565 green 21 gives
+// 0x55 instead of 0x54). fetchpixel follows the same choice. the
+// ACCURATE procedures are always replaced by the simd fetchers, stores
+// are always simd. same as ipixel_set_lut16, returns previous setting.
+int ipixel_simd_lut16(int enable);
+
+// level name: "c", "sse2", "ssse3", "sse4.1", "avx2", "avx512bw"
+const char *ipixel_simd_name(int level);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+
@@ -13,6 +13,10 @@
 #include "ibmcols.h"
 #include "ibmsse2.h"
 
+#ifdef __ARCH_SSE2__
+#include <emmintrin.h>
+#endif
+
 
 #ifdef _MSC_VER
 #pragma warning(disable: 4799)
@@ -219,28 +223,23 @@ void ipixel_lut_2_to_4(int sfmt, int dfmt, IUINT32 *table);
 
 static IUINT8 _ipixel_alpha_mask_lut[4096];
 
-static int _ipixel_cvt_lut_inited = 0;
+static ipixel_once_t _ipixel_cvt_lut_once = IPIXEL_ONCE_INIT;
 
 static void _ipixel_cvt_lut_init(void)
 {
 	int i;
 
-	if (_ipixel_cvt_lut_inited) return;
-
 	for (i = 0; i < 4096; i++) {
 		int alpha = _ipixel_scale_6[i >> 6];
 		int mask = _ipixel_scale_6[i & 63];
 		int result = alpha * mask / 255;
 		_ipixel_alpha_mask_lut[i] = result;
 	}
-
-	_ipixel_cvt_lut_inited = 1;
 }
 
 
 static inline void _ipixel_cvt_init(void) {
-	if (_ipixel_cvt_lut_inited == 0) 
-		_ipixel_cvt_lut_init();
+	IPIXEL_ONCE(&_ipixel_cvt_lut_once, _ipixel_cvt_lut_init);
 }
 
 
@@ -668,264 +667,422 @@ static inline void _ipixel_fill_322(void *bits, int startx, int w, IUINT32 c)
 //---------------------------------------------------------------------
 // initialize mmx
 //---------------------------------------------------------------------
-int pixellib_mmx_init(void)
+static ipixel_once_t pixellib_mmx_once = IPIXEL_ONCE_INIT;
+
+static void pixellib_mmx_detect(void)
 {
-	static int inited = 0;
-	if (inited) return 0;
 	_x86_detect();
 	_ipixel_cvt_init();
+}
+
+int pixellib_mmx_init(void)
+{
+	IPIXEL_ONCE(&pixellib_mmx_once, pixellib_mmx_detect);
 	if (!X86_FEATURE(X86_FEATURE_MMX)) 
 		return -1;
+	// install again every time, ipixel_simd_select may have reset them
 	pixellib_mmx_init_span();
-	inited = 1;
 	return 0;
 }
 
 
 
 //---------------------------------------------------------------------
-// sse2 instructions
+// sse2 intrinsics: four pixels per iteration. channels are unpacked
+// into 16 bits words in B, G, R, A order (the card layout), results
+// follow the scalar formulas of ibmbits.c, remaining pixels are
+// passed to the builtin procedures.
 //---------------------------------------------------------------------
-#if defined(__INLINEGNU__) && defined(__i386__)
-	#define sse2_blend_quad_main \
-	  "  movq         (%%esi), %%xmm0\n" \
-	  "  movq         0x8(%%esi), %%xmm1\n" \
-	  "  movq         (%%edi), %%mm2\n" \
-	  "  movq         0x8(%%edi), %%mm3\n" \
-	  "  movdqu       %%xmm0, %%xmm2\n" \
-	  "  movdqu       %%xmm1, %%xmm3\n" \
-	  "  psrld        $0x18, %%xmm2\n" \
-	  "  psrld        $0x18, %%xmm3\n" \
-	  "  packuswb     %%xmm2, %%xmm2\n" \
-	  "  packuswb     %%xmm3, %%xmm3\n" \
-	  "  pcmpeqb      %%xmm4, %%xmm4\n" \
-	  "  pcmpeqb      %%xmm5, %%xmm5\n" \
-	  "  punpcklwd    %%xmm2, %%xmm2\n" \
-	  "  punpcklwd    %%xmm3, %%xmm3\n" \
-	  "  punpcklbw    %%xmm7, %%xmm0\n" \
-	  "  punpcklbw    %%xmm7, %%xmm1\n" \
-	  "  punpckldq    %%xmm2, %%xmm2\n" \
-	  "  punpckldq    %%xmm3, %%xmm3\n" \
-	  "  punpcklbw    %%xmm7, %%xmm4\n" \
-	  "  punpcklbw    %%xmm7, %%xmm5\n" \
-	  "  pmullw       %%xmm2, %%xmm0\n" \
-	  "  pmullw       %%xmm3, %%xmm1\n" \
-	  "  psubb        %%xmm2, %%xmm4\n" \
-	  "  psubb        %%xmm3, %%xmm5\n" \
-	  "  movq2dq      %%mm2, %%xmm2\n"  \
-	  "  movq2dq      %%mm3, %%xmm3\n"  \
-	  "  punpcklbw    %%xmm7, %%xmm2\n" \
-	  "  punpcklbw    %%xmm7, %%xmm3\n" \
-	  "  pmullw       %%xmm4, %%xmm2\n" \
-	  "  pmullw       %%xmm5, %%xmm3\n" \
-	  "  paddw        %%xmm2, %%xmm0\n" \
-	  "  paddw        %%xmm3, %%xmm1\n" \
-	  "  movdqu       %%xmm0, %%xmm2\n" \
-	  "  movdqu       %%xmm1, %%xmm3\n" \
-	  "  psrlw        $0x8, %%xmm2\n"   \
-	  "  psrlw        $0x8, %%xmm3\n"   \
-	  "  paddw        %%xmm2, %%xmm0\n" \
-	  "  paddw        %%xmm3, %%xmm1\n" \
-	  "  psrlw        $0x8, %%xmm0\n" \
-	  "  psrlw        $0x8, %%xmm1\n" \
-	  "  packuswb     %%xmm0, %%xmm0\n" \
-	  "  packuswb     %%xmm1, %%xmm1\n" \
-	  "  movq         %%xmm0, (%%edi)\n" \
-	  "  movq         %%xmm1, 0x8(%%edi)\n" 
-
-#elif defined(__INLINEGNU__)
-	#define sse2_blend_quad_main \
-	  "  movq         (%%rsi), %%xmm0\n" \
-	  "  movq         0x8(%%rsi), %%xmm1\n" \
-	  "  movq         (%%rdi), %%mm2\n" \
-	  "  movq         0x8(%%rdi), %%mm3\n" \
-	  "  movdqu       %%xmm0, %%xmm2\n" \
-	  "  movdqu       %%xmm1, %%xmm3\n" \
-	  "  psrld        $0x18, %%xmm2\n" \
-	  "  psrld        $0x18, %%xmm3\n" \
-	  "  packuswb     %%xmm2, %%xmm2\n" \
-	  "  packuswb     %%xmm3, %%xmm3\n" \
-	  "  pcmpeqb      %%xmm4, %%xmm4\n" \
-	  "  pcmpeqb      %%xmm5, %%xmm5\n" \
-	  "  punpcklwd    %%xmm2, %%xmm2\n" \
-	  "  punpcklwd    %%xmm3, %%xmm3\n" \
-	  "  punpcklbw    %%xmm7, %%xmm0\n" \
-	  "  punpcklbw    %%xmm7, %%xmm1\n" \
-	  "  punpckldq    %%xmm2, %%xmm2\n" \
-	  "  punpckldq    %%xmm3, %%xmm3\n" \
-	  "  punpcklbw    %%xmm7, %%xmm4\n" \
-	  "  punpcklbw    %%xmm7, %%xmm5\n" \
-	  "  pmullw       %%xmm2, %%xmm0\n" \
-	  "  pmullw       %%xmm3, %%xmm1\n" \
-	  "  psubb        %%xmm2, %%xmm4\n" \
-	  "  psubb        %%xmm3, %%xmm5\n" \
-	  "  movq2dq      %%mm2, %%xmm2\n"  \
-	  "  movq2dq      %%mm3, %%xmm3\n"  \
-	  "  punpcklbw    %%xmm7, %%xmm2\n" \
-	  "  punpcklbw    %%xmm7, %%xmm3\n" \
-	  "  pmullw       %%xmm4, %%xmm2\n" \
-	  "  pmullw       %%xmm5, %%xmm3\n" \
-	  "  paddw        %%xmm2, %%xmm0\n" \
-	  "  paddw        %%xmm3, %%xmm1\n" \
-	  "  movdqu       %%xmm0, %%xmm2\n" \
-	  "  movdqu       %%xmm1, %%xmm3\n" \
-	  "  psrlw        $0x8, %%xmm2\n"   \
-	  "  psrlw        $0x8, %%xmm3\n"   \
-	  "  paddw        %%xmm2, %%xmm0\n" \
-	  "  paddw        %%xmm3, %%xmm1\n" \
-	  "  psrlw        $0x8, %%xmm0\n" \
-	  "  psrlw        $0x8, %%xmm1\n" \
-	  "  packuswb     %%xmm0, %%xmm0\n" \
-	  "  packuswb     %%xmm1, %%xmm1\n" \
-	  "  movq         %%xmm0, (%%rdi)\n" \
-	  "  movq         %%xmm1, 0x8(%%rdi)\n" 
+#ifdef __ARCH_SSE2__
 
-#elif defined(__INLINEMSC__)
-	#define sse2_blend_quad_main \
-		movq xmm0, qword ptr [esi]; \
-		movq xmm1, qword ptr [esi + 8]; \
-		movq mm2, [edi]; \
-		movq mm3, [edi + 8]; \
-		movdqu xmm2, xmm0; \
-		movdqu xmm3, xmm1; \
-		psrld xmm2, 24; \
-		psrld xmm3, 24; \
-		packuswb xmm2, xmm2; \
-		packuswb xmm3, xmm3; \
-		pcmpeqb xmm4, xmm4;	\
-		pcmpeqb xmm5, xmm5;	\
-		punpcklwd xmm2, xmm2; \
-		punpcklwd xmm3, xmm3; \
-		punpcklbw xmm0, xmm7; \
-		punpcklbw xmm1, xmm7; \
-		punpckldq xmm2, xmm2; \
-		punpckldq xmm3, xmm3; \
-		punpcklbw xmm4, xmm7; \
-		punpcklbw xmm5, xmm7; \
-		pmullw xmm0, xmm2;	\
-		pmullw xmm1, xmm3;	\
-		psubb xmm4, xmm2;	\
-		psubb xmm5, xmm3;	\
-		movq2dq xmm2, mm2;		\
-		movq2dq xmm3, mm3;		\
-		punpcklbw xmm2, xmm7; \
-		punpcklbw xmm3, xmm7; \
-		pmullw xmm2, xmm4;	  \
-		pmullw xmm3, xmm5;	  \
-		paddw xmm0, xmm2;  \
-		paddw xmm1, xmm3;  \
-		movdqu xmm2, xmm0; \
-		movdqu xmm3, xmm1; \
-		psrlw xmm2, 8;  \
-		psrlw xmm3, 8;  \
-		paddw xmm0, xmm2;  \
-		paddw xmm1, xmm3;  \
-		psrlw xmm0, 8;  \
-		psrlw xmm1, 8;  \
-		packuswb xmm0, xmm0;  \
-		packuswb xmm1, xmm1;  \
-		movq qword ptr [edi], xmm0;  \
-		movq qword ptr [edi + 8], xmm1;
+// shuffle the four words of both pixels in a register
+#define SSE2_SHUFFLE(x, imm) \
+	_mm_shufflehi_epi16(_mm_shufflelo_epi16(x, imm), imm)
 
-#endif
+// mask ? a : b
+static inline __m128i sse2_select(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
 
+// _ipixel_norm on words or 32 bits lanes
+static inline __m128i sse2_norm(__m128i x)
+{
+	return _mm_add_epi16(x, _mm_srli_epi16(x, 7));
+}
 
-void sse2_span_draw_X8R8G8B8(void *bits, int startx, int w,  
-	const IUINT32 *card, const IUINT8 *cover, const iColorIndex *index) 
+// spread 32 bits lanes to words: pixel 0, 1 in lo and 2, 3 in hi
+static inline void sse2_spread(__m128i x, __m128i *lo, __m128i *hi)
 {
-	unsigned char *ptr1 = (unsigned char*)bits + (startx << 2);
-	unsigned char *ptr2 = (unsigned char*)card;
-	int i;
+	x = _mm_or_si128(x, _mm_slli_epi32(x, 16));
+	*lo = _mm_unpacklo_epi32(x, x);
+	*hi = _mm_unpackhi_epi32(x, x);
+}
 
-	if (cover) {
-		mmx_span_draw_X8R8G8B8(bits, startx, w, card, cover, index);
-		return;
-	}
+// four coverage bytes into 32 bits lanes
+static inline __m128i sse2_load_cover(const IUINT8 *cover)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i cc = _mm_cvtsi32_si128(*(const int*)cover);
+	cc = _mm_unpacklo_epi8(cc, zero);
+	return _mm_unpacklo_epi16(cc, zero);
+}
 
-#if defined(__INLINEGNU__) && defined(__i386__)
-	__asm__ __volatile__ (
-	  ASM_BEGIN
-	  "  mov %0, %%esi\n"
-	  "  mov %1, %%edi\n"
-	  "  mov %2, %%ecx\n"
-	  "  shr $2, %%ecx\n"
-	  "  pxor %%xmm7, %%xmm7\n"
+// IBLEND_STATIC: (s * a + d * (256 - a)) >> 8, a in [0, 256]
+static inline __m128i sse2_lerp(__m128i s, __m128i d, __m128i a)
+{
+	__m128i n = _mm_sub_epi16(_mm_set1_epi16(256), a);
+	s = _mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, n));
+	return _mm_srli_epi16(s, 8);
+}
+
+// IBLEND_NORMAL_FAST: factor and result alpha come from the lut,
+// d0 / d1 are B, G, R, A words, ea is the source alpha of 4 pixels.
+static inline void sse2_lerp_lut(__m128i s0, __m128i s1, __m128i *d0,
+	__m128i *d1, __m128i ea)
+{
+	__m128i amask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+	__m128i da = _mm_castps_si128(_mm_shuffle_ps(
+		_mm_castsi128_ps(_mm_srli_epi64(*d0, 48)),
+		_mm_castsi128_ps(_mm_srli_epi64(*d1, 48)), 0x88));
+	__m128i pos, f, fa, f0, f1, a0, a1;
+	int index[4];
+	pos = _mm_slli_epi32(_mm_and_si128(da, _mm_set1_epi32(0xf8)), 4);
+	ea = _mm_srli_epi32(_mm_and_si128(ea, _mm_set1_epi32(0xfc)), 1);
+	_mm_storeu_si128((__m128i*)index, _mm_or_si128(pos, ea));
+	// two adjacent bytes of each entry: SA, FA
+	f = _mm_set_epi32(
+		*(const unsigned short*)(ipixel_blend_lut + index[3]),
+		*(const unsigned short*)(ipixel_blend_lut + index[2]),
+		*(const unsigned short*)(ipixel_blend_lut + index[1]),
+		*(const unsigned short*)(ipixel_blend_lut + index[0]));
+	fa = _mm_srli_epi32(f, 8);
+	f = sse2_norm(_mm_and_si128(f, _mm_set1_epi32(0xff)));
+	sse2_spread(f, &f0, &f1);
+	sse2_spread(fa, &a0, &a1);
+	f0 = sse2_select(amask, _mm_set1_epi16(256), f0);
+	f1 = sse2_select(amask, _mm_set1_epi16(256), f1);
+	*d0 = sse2_lerp(sse2_select(amask, a0, s0), *d0, f0);
+	*d1 = sse2_lerp(sse2_select(amask, a1, s1), *d1, f1);
+}
 
-	  "1: \n"
+// IBLEND_SRCOVER: d * (255 - a) / 255 + s
+static inline __m128i sse2_srcover(__m128i s, __m128i d, __m128i a)
+{
+	__m128i t = _mm_mullo_epi16(d, _mm_sub_epi16(_mm_set1_epi16(255), a));
+	__m128i u = _mm_srli_epi16(_mm_add_epi16(t, _mm_set1_epi16(257)), 8);
+	t = _mm_srli_epi16(_mm_add_epi16(t, u), 8);
+	return _mm_add_epi16(t, s);
+}
 
-	  sse2_blend_quad_main
-	  
-	  "  add $16, %%esi\n"
-	  "  add $16, %%edi\n"
-	  "  dec %%ecx\n"
-	  "  jnz 1b\n"
+// IBLEND_ADDITIVE: d + (s * x) >> 8, saturated by the final pack
+static inline __m128i sse2_additive(__m128i s, __m128i d, __m128i x)
+{
+	s = _mm_srli_epi16(_mm_mullo_epi16(s, x), 8);
+	return _mm_add_epi16(s, d);
+}
 
-	  ASM_ENDUP
-	  :
-	  :"m"(ptr2), "m"(ptr1), "m"(w)
-	  :"memory", "esi", "edi"
-	);
-#elif defined(__INLINEGNU__)
-	size_t x1, x2; 
-	__asm__ __volatile__ (
-	  ASM_BEGIN
-	  "  mov %%rsi, %0\n"
-	  "  mov %%rdi, %1\n"
-	  "  mov %2, %%rsi\n"
-	  "  mov %3, %%rdi\n"
-	  "  mov %4, %%ecx\n"
-	  "  shr $2, %%ecx\n"
-	  "  pxor %%xmm7, %%xmm7\n"
-
-	  "1: \n"
-
-	  sse2_blend_quad_main
-	  
-	  "  add $16, %%rsi\n"
-	  "  add $16, %%rdi\n"
-	  "  dec %%ecx\n"
-	  "  jnz 1b\n"
 
-	  ASM_ENDUP
-	  :"=m"(x1), "=m"(x2)
-	  :"m"(ptr2), "m"(ptr1), "m"(w)
-	  :"memory", "esi", "edi"
-	);
-#elif defined(__INLINEMSC__)
-	_asm {
-		mov esi, ptr2;
-		mov edi, ptr1;
-		mov ecx, w;
-		shr ecx, 2;
-		pxor xmm7, xmm7;
+//---------------------------------------------------------------------
+// 32 bits formats:
+// shufin converts unpacked dest words to B, G, R, A, shufout reverts
+// it, isx means X8 formats (IBLEND_STATIC, the X byte is stored 0).
+//---------------------------------------------------------------------
+#define SSE2_DRAW_PROC(fmt, shufin, shufout, isx) \
+static inline __m128i sse2_pack_##fmt(__m128i lo, __m128i hi) \
+{ \
+	if (isx) { \
+		__m128i m = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1); \
+		lo = _mm_and_si128(lo, m); \
+		hi = _mm_and_si128(hi, m); \
+	} \
+	lo = SSE2_SHUFFLE(lo, shufout); \
+	hi = SSE2_SHUFFLE(hi, shufout); \
+	return _mm_packus_epi16(lo, hi); \
+} \
+static inline __m128i sse2_card_##fmt(__m128i s) \
+{ \
+	__m128i zero = _mm_setzero_si128(); \
+	return sse2_pack_##fmt(_mm_unpacklo_epi8(s, zero), \
+		_mm_unpackhi_epi8(s, zero)); \
+} \
+static inline __m128i sse2_quad_##fmt(__m128i d, __m128i s, __m128i ea, \
+	__m128i ncv, __m128i skip, __m128i solid, int op) \
+{ \
+	__m128i zero = _mm_setzero_si128(); \
+	__m128i amask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0); \
+	__m128i s0 = _mm_unpacklo_epi8(s, zero); \
+	__m128i s1 = _mm_unpackhi_epi8(s, zero); \
+	__m128i d0 = SSE2_SHUFFLE(_mm_unpacklo_epi8(d, zero), shufin); \
+	__m128i d1 = SSE2_SHUFFLE(_mm_unpackhi_epi8(d, zero), shufin); \
+	__m128i a0, a1, n0, n1, r; \
+	sse2_spread(ea, &a0, &a1); \
+	if (op == 0) { \
+		if (isx) { \
+			d0 = sse2_lerp(s0, d0, sse2_norm(a0)); \
+			d1 = sse2_lerp(s1, d1, sse2_norm(a1)); \
+		}	else { \
+			sse2_lerp_lut(s0, s1, &d0, &d1, ea); \
+		} \
+	} \
+	else if (op == 1) { \
+		sse2_spread(ncv, &n0, &n1); \
+		s0 = _mm_srli_epi16(_mm_mullo_epi16(s0, n0), 8); \
+		s1 = _mm_srli_epi16(_mm_mullo_epi16(s1, n1), 8); \
+		d0 = sse2_srcover(sse2_select(amask, a0, s0), d0, a0); \
+		d1 = sse2_srcover(sse2_select(amask, a1, s1), d1, a1); \
+	} \
+	else { \
+		n0 = sse2_select(amask, _mm_set1_epi16(256), sse2_norm(a0)); \
+		n1 = sse2_select(amask, _mm_set1_epi16(256), sse2_norm(a1)); \
+		d0 = sse2_additive(sse2_select(amask, a0, s0), d0, n0); \
+		d1 = sse2_additive(sse2_select(amask, a1, s1), d1, n1); \
+	} \
+	r = sse2_select(skip, d, sse2_pack_##fmt(d0, d1)); \
+	if (op == 0) r = sse2_select(solid, sse2_card_##fmt(s), r); \
+	return r; \
+}
 
-	loop_pixel:
-		sse2_blend_quad_main
 
-		add esi, 16;
-		add edi, 16;
-		dec ecx;
-		jnz loop_pixel;
-	}
-#endif
+//---------------------------------------------------------------------
+// span drawing: op 0 blend, 1 srcover, 2 additive
+//---------------------------------------------------------------------
+#define SSE2_SPAN_DRAW_PROC(fmt, op) \
+static void sse2_span_draw_##fmt##_##op(void *bits, int startx, int w, \
+	const IUINT32 *card, const IUINT8 *cover, const iColorIndex *index) \
+{ \
+	IUINT8 *dst = (IUINT8*)bits + startx * 4; \
+	__m128i zero = _mm_setzero_si128(); \
+	__m128i full = _mm_set1_epi32(255); \
+	__m128i ncv = _mm_set1_epi32(256); \
+	__m128i s, a, ea, cc, skip, solid, d; \
+	for (; w >= 4; w -= 4, dst += 16, card += 4) { \
+		s = _mm_loadu_si128((const __m128i*)card); \
+		a = _mm_srli_epi32(s, 24); \
+		if (cover == NULL) { \
+			ea = a; \
+			skip = _mm_cmpeq_epi32(a, zero); \
+		}	else { \
+			cc = sse2_load_cover(cover); \
+			cover += 4; \
+			ncv = sse2_norm(cc); \
+			ea = _mm_srli_epi32(_mm_mullo_epi16(a, ncv), 8); \
+			skip = _mm_cmpeq_epi32(cc, zero); \
+			if (op == 2) { \
+				skip = _mm_or_si128(skip, _mm_cmpeq_epi32(a, zero)); \
+			} \
+		} \
+		if (_mm_movemask_epi8(skip) == 0xffff) continue; \
+		solid = _mm_cmpeq_epi32(ea, full); \
+		if (op != 2 && _mm_movemask_epi8(solid) == 0xffff) { \
+			_mm_storeu_si128((__m128i*)dst, sse2_card_##fmt(s)); \
+			continue; \
+		} \
+		d = _mm_loadu_si128((const __m128i*)dst); \
+		d = sse2_quad_##fmt(d, s, ea, ncv, skip, solid, op); \
+		_mm_storeu_si128((__m128i*)dst, d); \
+	} \
+	if (w > 0) { \
+		ipixel_get_span_proc(IPIX_FMT_##fmt, op, 1)(dst, 0, w, card, \
+			cover, index); \
+	} \
+}
+
+
+//---------------------------------------------------------------------
+// hline drawing: op 0 blend, 1 srcover, 2 additive
+//---------------------------------------------------------------------
+#define SSE2_HLINE_DRAW_PROC(fmt, op) \
+static void sse2_hline_draw_##fmt##_##op(void *bits, int startx, int w, \
+	IUINT32 color, const IUINT8 *cover, const iColorIndex *index) \
+{ \
+	IUINT8 *dst = (IUINT8*)bits + startx * 4; \
+	IUINT32 alpha = color >> 24; \
+	__m128i zero = _mm_setzero_si128(); \
+	__m128i full = _mm_set1_epi32(255); \
+	__m128i ncv = _mm_set1_epi32(256); \
+	__m128i s = _mm_set1_epi32((int)color); \
+	__m128i na = _mm_set1_epi32(_ipixel_norm(alpha)); \
+	__m128i ea = _mm_set1_epi32(alpha); \
+	__m128i cc, skip = zero, solid = zero, d; \
+	if (alpha == 0) return; \
+	if (cover == NULL) { \
+		if (alpha == 255 && op != 2) { \
+			d = sse2_card_##fmt(s); \
+			for (; w >= 4; w -= 4, dst += 16) \
+				_mm_storeu_si128((__m128i*)dst, d); \
+			for (; w > 0; w--, dst += 4) \
+				*(IUINT32*)dst = (IUINT32)_mm_cvtsi128_si32(d); \
+			return; \
+		} \
+		for (; w >= 4; w -= 4, dst += 16) { \
+			d = _mm_loadu_si128((const __m128i*)dst); \
+			d = sse2_quad_##fmt(d, s, ea, ncv, skip, solid, op); \
+			_mm_storeu_si128((__m128i*)dst, d); \
+		} \
+	}	else { \
+		for (; w >= 4; w -= 4, dst += 16, cover += 4) { \
+			cc = sse2_load_cover(cover); \
+			skip = _mm_cmpeq_epi32(cc, zero); \
+			if (_mm_movemask_epi8(skip) == 0xffff) continue; \
+			ncv = sse2_norm(cc); \
+			if (alpha == 255) ea = cc; \
+			else ea = _mm_srli_epi32(_mm_mullo_epi16(cc, na), 8); \
+			solid = _mm_cmpeq_epi32(ea, full); \
+			if (op != 2 && _mm_movemask_epi8(solid) == 0xffff) { \
+				_mm_storeu_si128((__m128i*)dst, sse2_card_##fmt(s)); \
+				continue; \
+			} \
+			d = _mm_loadu_si128((const __m128i*)dst); \
+			d = sse2_quad_##fmt(d, s, ea, ncv, skip, solid, op); \
+			_mm_storeu_si128((__m128i*)dst, d); \
+		} \
+	} \
+	if (w > 0) { \
+		ipixel_get_hline_proc(IPIX_FMT_##fmt, op, 1)(dst, 0, w, color, \
+			cover, index); \
+	} \
+}
 
-	ptr1 += 4 * (w & ~3);
-	ptr2 += 4 * (w & ~3);
 
-	for (i = (w & 3); i > 0; ptr1 += 4, ptr2 += 4, i--) {
-		IUINT32 c1 = *(IUINT32*)ptr1;
-		IUINT32 c2 = *(IUINT32*)ptr2;
-		*(IUINT32*)ptr1 = ipixel_sse2_blend(c1, c2);
+#define SSE2_DRAW_MAIN(fmt, shufin, shufout, isx) \
+	SSE2_DRAW_PROC(fmt, shufin, shufout, isx) \
+	SSE2_SPAN_DRAW_PROC(fmt, 0) \
+	SSE2_SPAN_DRAW_PROC(fmt, 1) \
+	SSE2_SPAN_DRAW_PROC(fmt, 2) \
+	SSE2_HLINE_DRAW_PROC(fmt, 0) \
+	SSE2_HLINE_DRAW_PROC(fmt, 1) \
+	SSE2_HLINE_DRAW_PROC(fmt, 2)
+
+SSE2_DRAW_MAIN(A8R8G8B8, 0xe4, 0xe4, 0)
+SSE2_DRAW_MAIN(A8B8G8R8, 0xc6, 0xc6, 0)
+SSE2_DRAW_MAIN(R8G8B8A8, 0x39, 0x93, 0)
+SSE2_DRAW_MAIN(B8G8R8A8, 0x1b, 0x1b, 0)
+SSE2_DRAW_MAIN(X8R8G8B8, 0xe4, 0xe4, 1)
+SSE2_DRAW_MAIN(X8B8G8R8, 0xc6, 0xc6, 1)
+SSE2_DRAW_MAIN(R8G8B8X8, 0x39, 0x93, 1)
+SSE2_DRAW_MAIN(B8G8R8X8, 0x1b, 0x1b, 1)
+
+#undef SSE2_DRAW_MAIN
+#undef SSE2_HLINE_DRAW_PROC
+#undef SSE2_SPAN_DRAW_PROC
+#undef SSE2_DRAW_PROC
+
+
+//---------------------------------------------------------------------
+// ipixel_card_over: premultiplied src over, with optional coverage
+//---------------------------------------------------------------------
+// same arithmetic as IBLEND_PARGB / IBLEND_PARGB_COVER: the scaled
+// destination is truncated with (x + (x >> 8)) >> 8 and the card is
+// added as a 32 bits integer, so the result does not depend on the cpu
+static inline __m128i sse2_card_over_quad(__m128i d, __m128i s,
+	const IUINT8 *cover)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i full = _mm_set1_epi32((int)0xff000000);
+	__m128i mask = _mm_set1_epi16(0xff);
+	__m128i s0, s1, d0, d1, a0, a1, cc, n0, n1;
+	if (cover == NULL) {
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(s, full),
+			full)) == 0xffff)
+			return s;
+		s0 = _mm_unpacklo_epi8(s, zero);
+		s1 = _mm_unpackhi_epi8(s, zero);
+	}	else {
+		cc = sse2_load_cover(cover);
+		sse2_spread(sse2_norm(cc), &n0, &n1);
+		s0 = _mm_unpacklo_epi8(s, zero);
+		s1 = _mm_unpackhi_epi8(s, zero);
+		s0 = _mm_srli_epi16(_mm_mullo_epi16(s0, n0), 8);
+		s1 = _mm_srli_epi16(_mm_mullo_epi16(s1, n1), 8);
+		s = _mm_packus_epi16(s0, s1);
 	}
+	d0 = _mm_unpacklo_epi8(d, zero);
+	d1 = _mm_unpackhi_epi8(d, zero);
+	a0 = _mm_xor_si128(SSE2_SHUFFLE(s0, 0xff), mask);
+	a1 = _mm_xor_si128(SSE2_SHUFFLE(s1, 0xff), mask);
+	d0 = _mm_mullo_epi16(d0, a0);
+	d1 = _mm_mullo_epi16(d1, a1);
+	d0 = _mm_srli_epi16(_mm_add_epi16(d0, _mm_srli_epi16(d0, 8)), 8);
+	d1 = _mm_srli_epi16(_mm_add_epi16(d1, _mm_srli_epi16(d1, 8)), 8);
+	return _mm_add_epi32(_mm_packus_epi16(d0, d1), s);
+}
 
-	immx_emms();
+// dst = card + dst * (255 - card.alpha) / 255
+static void sse2_card_over(IUINT32 *dst, int size, const IUINT32 *card,
+	const IUINT8 *cover)
+{
+	IUINT32 dbuf[4], cbuf[4];
+	IUINT8 vbuf[4];
+	__m128i d, s;
+	int i;
+	for (; size >= 4; size -= 4, dst += 4, card += 4) {
+		s = _mm_loadu_si128((const __m128i*)card);
+		d = _mm_loadu_si128((const __m128i*)dst);
+		d = sse2_card_over_quad(d, s, cover);
+		_mm_storeu_si128((__m128i*)dst, d);
+		if (cover) cover += 4;
+	}
+	if (size > 0) {
+		for (i = 0; i < 4; i++) {
+			dbuf[i] = (i < size)? dst[i] : 0;
+			cbuf[i] = (i < size)? card[i] : 0;
+			vbuf[i] = (i < size && cover)? cover[i] : 0;
+		}
+		s = _mm_loadu_si128((const __m128i*)cbuf);
+		d = _mm_loadu_si128((const __m128i*)dbuf);
+		d = sse2_card_over_quad(d, s, cover? vbuf : NULL);
+		_mm_storeu_si128((__m128i*)dbuf, d);
+		for (i = 0; i < size; i++) dst[i] = dbuf[i];
+	}
 }
 
 
+//---------------------------------------------------------------------
+// install sse2 procedures
+//---------------------------------------------------------------------
+#define SSE2_INSTALL(fmt) do { \
+		ipixel_set_span_proc(IPIX_FMT_##fmt, 0, sse2_span_draw_##fmt##_0); \
+		ipixel_set_span_proc(IPIX_FMT_##fmt, 1, sse2_span_draw_##fmt##_1); \
+		ipixel_set_span_proc(IPIX_FMT_##fmt, 2, sse2_span_draw_##fmt##_2); \
+		ipixel_set_hline_proc(IPIX_FMT_##fmt, 0, sse2_hline_draw_##fmt##_0); \
+		ipixel_set_hline_proc(IPIX_FMT_##fmt, 1, sse2_hline_draw_##fmt##_1); \
+		ipixel_set_hline_proc(IPIX_FMT_##fmt, 2, sse2_hline_draw_##fmt##_2); \
+	}	while (0)
+
+static void pixellib_xmm_init_span(void)
+{
+	SSE2_INSTALL(A8R8G8B8);
+	SSE2_INSTALL(A8B8G8R8);
+	SSE2_INSTALL(R8G8B8A8);
+	SSE2_INSTALL(B8G8R8A8);
+	SSE2_INSTALL(X8R8G8B8);
+	SSE2_INSTALL(X8B8G8R8);
+	SSE2_INSTALL(R8G8B8X8);
+	SSE2_INSTALL(B8G8R8X8);
+	ipixel_card_set_proc(3, (void*)sse2_card_over);
+}
+
+#undef SSE2_INSTALL
+
+#endif
+
+
+//---------------------------------------------------------------------
+// initialize sse2: span / hline drawing of 32 bits formats and
+// ipixel_card_over, P8R8G8B8 keeps the builtin procedures.
+//---------------------------------------------------------------------
 int pixellib_xmm_init(void)
 {
-//	ipixel_set_span_proc(IPIX_FMT_X8R8G8B8, 0, sse2_span_draw_X8R8G8B8);
+#ifdef __ARCH_SSE2__
+	_x86_detect();
+	if (!X86_FEATURE(X86_FEATURE_XMM2))
+		return -1;
+	pixellib_xmm_init_span();
 	return 0;
+#else
+	return -1;
+#endif
 }
 
 
@@ -0,0 +1,421 @@
+//=====================================================================
+//
+// ibmtask.c - parallel task execution
+//
+// NOTE:
+// for more information, please see the readme file
+//
+//=====================================================================
+
+#include "ibmtask.h"
+#include "ibmbits.h"
+
+#include <stdlib.h>
+
+#ifndef IPIXEL_TASK_SERIAL
+#if defined(_WIN32) || defined(WIN32)
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+#endif
+
+
+//---------------------------------------------------------------------
+// platform: atomics and threads
+//---------------------------------------------------------------------
+#if defined(_WIN32) || defined(WIN32)
+	#define IPIXEL_TASK_CAS(ptr, oldval, newval) \
+		(InterlockedCompareExchange((LONG volatile*)(ptr), \
+			(LONG)(newval), (LONG)(oldval)) == (LONG)(oldval))
+	#define IPIXEL_TASK_DEC(ptr) InterlockedDecrement(ptr)
+	#define IPIXEL_TASK_LOAD(ptr) (*(ptr))
+	#define IPIXEL_TASK_STORE(ptr, v) InterlockedExchange(ptr, v)
+	#define IPIXEL_TASK_YIELD() Sleep(0)
+#else
+	#define IPIXEL_TASK_CAS(ptr, oldval, newval) \
+		__sync_bool_compare_and_swap(ptr, oldval, newval)
+	#define IPIXEL_TASK_DEC(ptr) __sync_sub_and_fetch(ptr, 1)
+	#if defined(__ATOMIC_ACQUIRE)
+	#define IPIXEL_TASK_LOAD(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+	#define IPIXEL_TASK_STORE(ptr, v) __atomic_store_n(ptr, v, __ATOMIC_RELEASE)
+	#else
+	#define IPIXEL_TASK_LOAD(ptr) (*(ptr))
+	#define IPIXEL_TASK_STORE(ptr, v) (__sync_synchronize(), *(ptr) = (v))
+	#endif
+	#define IPIXEL_TASK_YIELD() sched_yield()
+#endif
+
+
+//---------------------------------------------------------------------
+// global definition
+//---------------------------------------------------------------------
+static ipixel_task_submit ipixel_task_executor = NULL;
+static void *ipixel_task_user = NULL;
+static int ipixel_task_global = 0;
+static long ipixel_task_threshold = IPIXEL_TASK_THRESHOLD;
+static IPIXEL_TLS int ipixel_task_local = 0;
+static int ipixel_task_cpus = 1;
+static ipixel_once_t ipixel_task_once = IPIXEL_ONCE_INIT;
+
+
+static void ipixel_task_detect(void)
+{
+#ifndef IPIXEL_TASK_SERIAL
+#if defined(_WIN32) || defined(WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	ipixel_task_cpus = (int)info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+	ipixel_task_cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+#endif
+	if (ipixel_task_cpus < 1) ipixel_task_cpus = 1;
+	if (ipixel_task_cpus > IPIXEL_TASK_MAX) ipixel_task_cpus = IPIXEL_TASK_MAX;
+}
+
+
+//---------------------------------------------------------------------
+// work stealing pool: every participant owns a range of item indices,
+// takes items from the front of its own range and, when it runs dry,
+// steals the back half of another range. the pool runs one batch at a
+// time, callers which find it busy (including nested calls made from
+// inside a task) run their items serially.
+//---------------------------------------------------------------------
+#ifndef IPIXEL_TASK_SERIAL
+
+typedef union
+{
+	struct {
+		ipixel_lock_t lock;
+		long begin;
+		long end;
+	}	q;
+	char padding[64];		// one cache line each
+}	iTaskQueue;
+
+#if defined(_WIN32) || defined(WIN32)
+	typedef HANDLE ipixel_thread_t;
+#else
+	typedef pthread_t ipixel_thread_t;
+#endif
+
+static iTaskQueue ipixel_task_queue[IPIXEL_TASK_MAX];
+static ipixel_thread_t ipixel_task_thread[IPIXEL_TASK_MAX];
+static int ipixel_task_workers = 0;
+static volatile long ipixel_task_busy = 0;
+static volatile long ipixel_task_active = 0;
+static ipixel_task_proc ipixel_task_proc_now = NULL;
+static void *ipixel_task_ctx_now = NULL;
+static int ipixel_task_queues = 0;
+static int ipixel_task_quit = 0;
+
+#if defined(_WIN32) || defined(WIN32)
+static HANDLE ipixel_task_event[IPIXEL_TASK_MAX];
+#else
+static pthread_mutex_t ipixel_task_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ipixel_task_cond = PTHREAD_COND_INITIALIZER;
+static long ipixel_task_epoch = 0;
+#endif
+
+
+// move the back half of another range into queue 'self'
+static int ipixel_task_steal(int self)
+{
+	int i;
+	for (i = 1; i < ipixel_task_queues; i++) {
+		iTaskQueue *victim = &ipixel_task_queue[(self + i) % 
+			ipixel_task_queues];
+		long begin = 0, end = 0;
+		ipixel_lock(&victim->q.lock);
+		if (victim->q.begin < victim->q.end) {
+			long take = (victim->q.end - victim->q.begin + 1) / 2;
+			end = victim->q.end;
+			begin = end - take;
+			victim->q.end = begin;
+		}
+		ipixel_unlock(&victim->q.lock);
+		if (begin < end) {
+			iTaskQueue *queue = &ipixel_task_queue[self];
+			ipixel_lock(&queue->q.lock);
+			queue->q.begin = begin;
+			queue->q.end = end;
+			ipixel_unlock(&queue->q.lock);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// run items until every range is empty
+static void ipixel_task_work(int self)
+{
+	iTaskQueue *queue = &ipixel_task_queue[self];
+	while (1) {
+		long index = -1;
+		ipixel_lock(&queue->q.lock);
+		if (queue->q.begin < queue->q.end) {
+			index = queue->q.begin++;
+		}
+		ipixel_unlock(&queue->q.lock);
+		if (index >= 0) {
+			ipixel_task_proc_now(ipixel_task_ctx_now, (int)index);
+		}
+		else if (ipixel_task_steal(self) == 0) {
+			break;
+		}
+	}
+}
+
+#if defined(_WIN32) || defined(WIN32)
+static unsigned __stdcall ipixel_task_entry(void *arg)
+{
+	int self = (int)(size_t)arg;
+	while (1) {
+		WaitForSingleObject(ipixel_task_event[self], INFINITE);
+		if (ipixel_task_quit) break;
+		ipixel_task_work(self);
+		IPIXEL_TASK_DEC(&ipixel_task_active);
+	}
+	return 0;
+}
+#else
+static void *ipixel_task_entry(void *arg)
+{
+	int self = (int)(size_t)arg;
+	long epoch = 0;
+	while (1) {
+		pthread_mutex_lock(&ipixel_task_mutex);
+		while (ipixel_task_epoch == epoch && ipixel_task_quit == 0) {
+			pthread_cond_wait(&ipixel_task_cond, &ipixel_task_mutex);
+		}
+		epoch = ipixel_task_epoch;
+		pthread_mutex_unlock(&ipixel_task_mutex);
+		if (ipixel_task_quit) break;
+		ipixel_task_work(self);
+		IPIXEL_TASK_DEC(&ipixel_task_active);
+	}
+	return NULL;
+}
+#endif
+
+// stop and join workers, the caller owns ipixel_task_busy
+static void ipixel_task_stop(void)
+{
+	int i;
+	if (ipixel_task_workers == 0) return;
+#if defined(_WIN32) || defined(WIN32)
+	ipixel_task_quit = 1;
+	for (i = 1; i <= ipixel_task_workers; i++) {
+		SetEvent(ipixel_task_event[i]);
+	}
+	for (i = 1; i <= ipixel_task_workers; i++) {
+		WaitForSingleObject(ipixel_task_thread[i], INFINITE);
+		CloseHandle(ipixel_task_thread[i]);
+		CloseHandle(ipixel_task_event[i]);
+	}
+#else
+	pthread_mutex_lock(&ipixel_task_mutex);
+	ipixel_task_quit = 1;
+	pthread_cond_broadcast(&ipixel_task_cond);
+	pthread_mutex_unlock(&ipixel_task_mutex);
+	for (i = 1; i <= ipixel_task_workers; i++) {
+		pthread_join(ipixel_task_thread[i], NULL);
+	}
+	ipixel_task_epoch = 0;
+#endif
+	ipixel_task_quit = 0;
+	ipixel_task_workers = 0;
+}
+
+// start workers 1..n (0 is the calling thread), returns started count
+static int ipixel_task_start(int n)
+{
+	int i;
+	for (i = 1; i <= n; i++) {
+	#if defined(_WIN32) || defined(WIN32)
+		ipixel_task_event[i] = CreateEvent(NULL, FALSE, FALSE, NULL);
+		if (ipixel_task_event[i] == NULL) break;
+		ipixel_task_thread[i] = (HANDLE)_beginthreadex(NULL, 0, 
+			ipixel_task_entry, (void*)(size_t)i, 0, NULL);
+		if (ipixel_task_thread[i] == 0) {
+			CloseHandle(ipixel_task_event[i]);
+			break;
+		}
+	#else
+		if (pthread_create(&ipixel_task_thread[i], NULL, 
+			ipixel_task_entry, (void*)(size_t)i) != 0) break;
+	#endif
+		ipixel_task_workers = i;
+	}
+	return ipixel_task_workers;
+}
+
+// run a batch on the pool, returns -1 if the pool is busy
+static int ipixel_task_pool(ipixel_task_proc proc, void *ctx, int count,
+	int threads)
+{
+	int helpers = threads - 1, queues, i;
+
+	if (!IPIXEL_TASK_CAS(&ipixel_task_busy, 0, 1)) 
+		return -1;
+
+	if (ipixel_task_workers != helpers) {
+		ipixel_task_stop();
+		ipixel_task_start(helpers);
+	}
+
+	queues = ipixel_task_workers + 1;
+	if (queues > count) queues = count;
+
+	for (i = 0; i < ipixel_task_workers + 1; i++) {
+		iTaskQueue *queue = &ipixel_task_queue[i];
+		queue->q.lock = IPIXEL_LOCK_INIT;
+		queue->q.begin = (i < queues)? ((long)count * i / queues) : 0;
+		queue->q.end = (i < queues)? ((long)count * (i + 1) / queues) : 0;
+	}
+
+	ipixel_task_proc_now = proc;
+	ipixel_task_ctx_now = ctx;
+	ipixel_task_queues = ipixel_task_workers + 1;
+	ipixel_task_active = ipixel_task_workers;
+
+#if defined(_WIN32) || defined(WIN32)
+	for (i = 1; i <= ipixel_task_workers; i++) {
+		SetEvent(ipixel_task_event[i]);
+	}
+#else
+	pthread_mutex_lock(&ipixel_task_mutex);
+	ipixel_task_epoch++;
+	pthread_cond_broadcast(&ipixel_task_cond);
+	pthread_mutex_unlock(&ipixel_task_mutex);
+#endif
+
+	ipixel_task_work(0);
+
+	while (IPIXEL_TASK_LOAD(&ipixel_task_active) != 0) {
+		IPIXEL_TASK_YIELD();
+	}
+
+	ipixel_task_proc_now = NULL;
+	ipixel_task_ctx_now = NULL;
+	IPIXEL_TASK_STORE(&ipixel_task_busy, 0);
+
+	return 0;
+}
+
+#endif
+
+
+//---------------------------------------------------------------------
+// interface
+//---------------------------------------------------------------------
+void ipixel_task_set_submit(ipixel_task_submit submit, void *user)
+{
+	ipixel_task_executor = submit;
+	ipixel_task_user = submit? user : NULL;
+}
+
+void ipixel_task_set_threads(int threads)
+{
+	if (threads < 0) threads = 0;
+	if (threads > IPIXEL_TASK_MAX) threads = IPIXEL_TASK_MAX;
+	ipixel_task_global = threads;
+}
+
+int ipixel_task_set_local(int threads)
+{
+	int previous = ipixel_task_local;
+	if (threads < 0) threads = 0;
+	if (threads > IPIXEL_TASK_MAX) threads = IPIXEL_TASK_MAX;
+	ipixel_task_local = threads;
+	return previous;
+}
+
+void ipixel_task_set_threshold(long pixels)
+{
+	ipixel_task_threshold = (pixels < 0)? IPIXEL_TASK_THRESHOLD : pixels;
+}
+
+int ipixel_task_threads(void)
+{
+	if (ipixel_task_local > 0) return ipixel_task_local;
+	if (ipixel_task_global > 0) return ipixel_task_global;
+	IPIXEL_ONCE(&ipixel_task_once, ipixel_task_detect);
+	return ipixel_task_cpus;
+}
+
+void ipixel_task_run(ipixel_task_proc proc, void *ctx, int count)
+{
+	int threads, i;
+	if (count <= 0) return;
+	threads = ipixel_task_threads();
+	if (ipixel_task_executor && threads > 1 && count > 1) {
+		ipixel_task_executor(ipixel_task_user, proc, ctx, count);
+		return;
+	}
+#ifndef IPIXEL_TASK_SERIAL
+	if (threads > 1 && count > 1) {
+		if (ipixel_task_pool(proc, ctx, count, threads) == 0)
+			return;
+	}
+#endif
+	for (i = 0; i < count; i++) proc(ctx, i);
+}
+
+void ipixel_task_shutdown(void)
+{
+#ifndef IPIXEL_TASK_SERIAL
+	while (!IPIXEL_TASK_CAS(&ipixel_task_busy, 0, 1)) {
+		IPIXEL_TASK_YIELD();
+	}
+	ipixel_task_stop();
+	IPIXEL_TASK_STORE(&ipixel_task_busy, 0);
+#endif
+}
+
+
+//---------------------------------------------------------------------
+// bands
+//---------------------------------------------------------------------
+typedef struct
+{
+	ipixel_band_proc proc;
+	void *ctx;
+	int height;
+	int count;
+}	iTaskBands;
+
+static void ipixel_task_band(void *ctx, int index)
+{
+	iTaskBands *bands = (iTaskBands*)ctx;
+	int top = (int)((long)bands->height * index / bands->count);
+	int bottom = (int)((long)bands->height * (index + 1) / bands->count);
+	if (top < bottom) bands->proc(bands->ctx, top, bottom);
+}
+
+void ipixel_task_bands(ipixel_band_proc proc, void *ctx, int width, 
+	int height)
+{
+	iTaskBands bands;
+	int threads, count;
+	if (height <= 0) return;
+	threads = ipixel_task_threads();
+	count = height / IPIXEL_TASK_ROWS;
+	if (count > threads * 4) count = threads * 4;
+	if (threads <= 1 || count <= 1 || 
+		(double)width * height < (double)ipixel_task_threshold) {
+		proc(ctx, 0, height);
+		return;
+	}
+	bands.proc = proc;
+	bands.ctx = ctx;
+	bands.height = height;
+	bands.count = count;
+	ipixel_task_run(ipixel_task_band, &bands, count);
+}
+
+
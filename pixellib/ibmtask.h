@@ -0,0 +1,94 @@
+//=====================================================================
+//
+// ibmtask.h - parallel task execution
+//
+// NOTE:
+// heavy image operations (scale, resample, convert, blend, composite,
+// filter, color transform) split the destination into horizontal bands
+// and run them through ipixel_task_run. the builtin executor keeps a
+// pool of ipixel_task_threads() - 1 workers, the calling thread works
+// on bands too and idle workers steal from busy ones. one batch runs on
+// the pool at a time, other callers (and nested calls made from inside
+// a task) run their bands serially. applications which already own a
+// thread pool can install a submit callback. define IPIXEL_TASK_SERIAL
+// to build without threads.
+//
+//=====================================================================
+#ifndef __IBMTASK_H__
+#define __IBMTASK_H__
+
+
+// upper limit of threads used by the builtin executor
+#ifndef IPIXEL_TASK_MAX
+	#define IPIXEL_TASK_MAX		64
+#endif
+
+// images with fewer pixels are processed serially by ipixel_task_bands
+#ifndef IPIXEL_TASK_THRESHOLD
+	#define IPIXEL_TASK_THRESHOLD	65536
+#endif
+
+// minimal rows of a band used by ipixel_task_bands
+#ifndef IPIXEL_TASK_ROWS
+	#define IPIXEL_TASK_ROWS		8
+#endif
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//---------------------------------------------------------------------
+// interface
+//---------------------------------------------------------------------
+
+// task body: process item 'index' of 'ctx'
+typedef void (*ipixel_task_proc)(void *ctx, int index);
+
+// executor: call proc(ctx, i) once for every i in [0, count), in any
+// order and on any threads, return only after all calls finished.
+typedef void (*ipixel_task_submit)(void *user, ipixel_task_proc proc,
+	void *ctx, int count);
+
+// install an executor, NULL restores the builtin one. not thread safe,
+// call it before drawing.
+void ipixel_task_set_submit(ipixel_task_submit submit, void *user);
+
+// threads used to split jobs, 0 (default) for the number of cpus
+void ipixel_task_set_threads(int threads);
+
+// threads used to split jobs by the calling thread only, overrides
+// ipixel_task_set_threads (1 forces serial calls), 0 to follow the
+// global setting. returns the previous value.
+int ipixel_task_set_local(int threads);
+
+// threads used to split jobs, at least 1
+int ipixel_task_threads(void);
+
+// pixel count below which ipixel_task_bands stays serial, negative
+// value restores IPIXEL_TASK_THRESHOLD
+void ipixel_task_set_threshold(long pixels);
+
+// run proc(ctx, i) for i in [0, count) with the current executor
+void ipixel_task_run(ipixel_task_proc proc, void *ctx, int count);
+
+// stop the builtin worker threads, they start again on demand
+void ipixel_task_shutdown(void);
+
+
+// band body: process rows [top, bottom)
+typedef void (*ipixel_band_proc)(void *ctx, int top, int bottom);
+
+// split 'height' rows into bands and run them with ipixel_task_run,
+// calls proc(ctx, 0, height) directly for small images
+void ipixel_task_bands(ipixel_band_proc proc, void *ctx, int width,
+	int height);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+
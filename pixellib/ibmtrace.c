@@ -0,0 +1,198 @@
+//=====================================================================
+//
+// ibmtrace.c - operation tracing (chrome trace format)
+//
+// NOTE:
+// for more information, please see the readme file
+//
+//=====================================================================
+
+#include "ibmtrace.h"
+#include "ibmbits.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32) || defined(WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#include <sys/time.h>
+#endif
+
+
+//---------------------------------------------------------------------
+// platform: thread local storage and pointer compare-and-swap
+//---------------------------------------------------------------------
+#if defined(_MSC_VER) || defined(__BORLANDC__)
+	#define IBITMAP_TRACE_TLS	__declspec(thread)
+#else
+	#define IBITMAP_TRACE_TLS	__thread
+#endif
+
+#if defined(_WIN32) || defined(WIN32)
+	#define IBITMAP_TRACE_CAS(ptr, oldval, newval) \
+		(InterlockedCompareExchangePointer((PVOID volatile*)(ptr), \
+			(PVOID)(newval), (PVOID)(oldval)) == (PVOID)(oldval))
+	#define IBITMAP_TRACE_INC(ptr) InterlockedIncrement(ptr)
+#else
+	#define IBITMAP_TRACE_CAS(ptr, oldval, newval) \
+		__sync_bool_compare_and_swap(ptr, oldval, newval)
+	#define IBITMAP_TRACE_INC(ptr) __sync_add_and_fetch(ptr, 1)
+#endif
+
+
+//---------------------------------------------------------------------
+// per-thread ring: only the owner thread writes, 'head' counts the
+// total events written and is published after the slot is filled.
+//---------------------------------------------------------------------
+typedef struct
+{
+	const char *name;
+	IINT64 ts;
+	IINT64 dur;
+	int w, h;
+	int sfmt, dfmt;
+}	iTraceEvent;
+
+typedef struct iTraceRing
+{
+	struct iTraceRing *next;
+	volatile long head;
+	int tid;
+	iTraceEvent events[IBITMAP_TRACE_SIZE];
+}	iTraceRing;
+
+static iTraceRing * volatile ibitmap_trace_rings = NULL;
+static volatile int ibitmap_trace_on = 0;
+static volatile long ibitmap_trace_tid = 0;
+static IINT64 ibitmap_trace_epoch = 0;
+
+static IBITMAP_TRACE_TLS iTraceRing *ibitmap_trace_ring = NULL;
+
+
+// monotonic clock in nanoseconds
+static IINT64 ibitmap_trace_clock(void)
+{
+#if defined(_WIN32) || defined(WIN32)
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+	if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (IINT64)((double)now.QuadPart * 1000000000.0 /
+		(double)freq.QuadPart);
+#elif defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((IINT64)ts.tv_sec) * 1000000000 + (IINT64)ts.tv_nsec;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return ((IINT64)tv.tv_sec) * 1000000000 + (IINT64)tv.tv_usec * 1000;
+#endif
+}
+
+// get ring of current thread, create and link it on first use
+static iTraceRing *ibitmap_trace_local(void)
+{
+	iTraceRing *ring = ibitmap_trace_ring;
+	iTraceRing *head;
+	if (ring != NULL) return ring;
+	ring = (iTraceRing*)malloc(sizeof(iTraceRing));
+	if (ring == NULL) return NULL;
+	ring->head = 0;
+	ring->tid = (int)IBITMAP_TRACE_INC(&ibitmap_trace_tid);
+	do {
+		head = ibitmap_trace_rings;
+		ring->next = head;
+	}	while (!IBITMAP_TRACE_CAS(&ibitmap_trace_rings, head, ring));
+	ibitmap_trace_ring = ring;
+	return ring;
+}
+
+
+//---------------------------------------------------------------------
+// interface
+//---------------------------------------------------------------------
+void ibitmap_trace_enable(int enable)
+{
+	if (ibitmap_trace_epoch == 0) {
+		ibitmap_trace_epoch = ibitmap_trace_clock() - 1;
+	}
+	ibitmap_trace_on = enable? 1 : 0;
+}
+
+void ibitmap_trace_clear(void)
+{
+	iTraceRing *ring;
+	for (ring = ibitmap_trace_rings; ring; ring = ring->next) {
+		ring->head = 0;
+	}
+}
+
+IINT64 ibitmap_trace_begin(void)
+{
+	if (ibitmap_trace_on == 0) return 0;
+	return ibitmap_trace_clock();
+}
+
+void ibitmap_trace_end(IINT64 ts, const char *name, int w, int h,
+	int sfmt, int dfmt)
+{
+	iTraceRing *ring;
+	iTraceEvent *event;
+	if (ts == 0) return;
+	ring = ibitmap_trace_local();
+	if (ring == NULL) return;
+	event = &ring->events[ring->head & (IBITMAP_TRACE_SIZE - 1)];
+	event->name = name;
+	event->ts = ts;
+	event->dur = ibitmap_trace_clock() - ts;
+	event->w = w;
+	event->h = h;
+	event->sfmt = sfmt;
+	event->dfmt = dfmt;
+	ring->head = ring->head + 1;
+}
+
+// write recorded events as chrome trace json
+int ibitmap_trace_dump(const char *filename)
+{
+	iTraceRing *ring;
+	int count = 0;
+	FILE *fp;
+
+	fp = fopen(filename, "w");
+	if (fp == NULL) return -1;
+
+	fprintf(fp, "{\"traceEvents\":[\n");
+
+	for (ring = ibitmap_trace_rings; ring; ring = ring->next) {
+		long head = ring->head;
+		long i = (head > IBITMAP_TRACE_SIZE)? head - IBITMAP_TRACE_SIZE : 0;
+		for (; i < head; i++) {
+			const iTraceEvent *e = &ring->events[i & (IBITMAP_TRACE_SIZE-1)];
+			IINT64 ts = e->ts - ibitmap_trace_epoch;
+			if (count > 0) fprintf(fp, ",\n");
+			fprintf(fp, "{\"name\":\"%s\",\"cat\":\"pixellib\",\"ph\":\"X\","
+				"\"pid\":1,\"tid\":%d,\"ts\":%ld.%03d,\"dur\":%ld.%03d,"
+				"\"args\":{\"w\":%d,\"h\":%d", e->name, ring->tid,
+				(long)(ts / 1000), (int)(ts % 1000),
+				(long)(e->dur / 1000), (int)(e->dur % 1000), e->w, e->h);
+			if (e->sfmt >= 0 && e->sfmt < IPIX_FMT_COUNT)
+				fprintf(fp, ",\"src\":\"%s\"", ipixelfmt[e->sfmt].name);
+			if (e->dfmt >= 0 && e->dfmt < IPIX_FMT_COUNT)
+				fprintf(fp, ",\"dst\":\"%s\"", ipixelfmt[e->dfmt].name);
+			fprintf(fp, "}}");
+			count++;
+		}
+	}
+
+	fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	fclose(fp);
+
+	return count;
+}
+
+
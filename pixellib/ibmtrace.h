@@ -0,0 +1,85 @@
+//=====================================================================
+//
+// ibmtrace.h - operation tracing (chrome trace format)
+//
+// NOTE:
+// top level operations (blit, scale, blend, composite, stackblur,
+// ipaint_draw_*, picture load/save) are instrumented when the library
+// is compiled with -DIBITMAP_TRACE. events are recorded in a per-thread
+// ring buffer without locking, and can be dumped as a JSON file which
+// can be loaded by chrome://tracing or https://ui.perfetto.dev
+//
+//=====================================================================
+#ifndef __IBMTRACE_H__
+#define __IBMTRACE_H__
+
+
+//---------------------------------------------------------------------
+// IINT64 definition
+//---------------------------------------------------------------------
+#ifndef __IINT64_DEFINED
+	#define __IINT64_DEFINED
+	#if defined(_MSC_VER) || defined(__BORLANDC__)
+		typedef __int64 IINT64;
+	#else
+		typedef long long IINT64;
+	#endif
+#endif
+
+
+// events per thread, must be power of 2
+#ifndef IBITMAP_TRACE_SIZE
+	#define IBITMAP_TRACE_SIZE	8192
+#endif
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//---------------------------------------------------------------------
+// interface
+//---------------------------------------------------------------------
+
+// start / stop recording (disabled by default)
+void ibitmap_trace_enable(int enable);
+
+// discard all recorded events
+void ibitmap_trace_clear(void);
+
+// write recorded events as chrome trace json, returns event count,
+// or negative for error. call it when other threads are quiet.
+int ibitmap_trace_dump(const char *filename);
+
+// returns begin timestamp in nanoseconds, zero if not recording
+IINT64 ibitmap_trace_begin(void);
+
+// record a complete event started at 'ts', pixfmt < 0 will be omitted
+void ibitmap_trace_end(IINT64 ts, const char *name, int w, int h,
+	int sfmt, int dfmt);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+//---------------------------------------------------------------------
+// instrumentation: BEGIN declares a variable, place it right after
+// the last declaration of the function.
+//---------------------------------------------------------------------
+#ifdef IBITMAP_TRACE
+	#define IBITMAP_TRACE_BEGIN(ts) \
+		IINT64 ts = ibitmap_trace_begin()
+	#define IBITMAP_TRACE_END(ts, name, w, h, sfmt, dfmt) do { \
+		if (ts) ibitmap_trace_end(ts, name, (int)(w), (int)(h), \
+			(int)(sfmt), (int)(dfmt)); } while (0)
+#else
+	#define IBITMAP_TRACE_BEGIN(ts)
+	#define IBITMAP_TRACE_END(ts, name, w, h, sfmt, dfmt) do { } while (0)
+#endif
+
+
+#endif
+
+
@@ -10,6 +10,8 @@
 #include "iblit386.h"
 #include "ibmfont.h"
 #include "ibmdata.h"
+#include "ibmtrace.h"
+#include "ibmtask.h"
 
 #include <stddef.h>
 #include <stdio.h>
@@ -197,16 +199,40 @@ ibitmap_filter_pass_32(const IUINT32 *pixel, const short *filter)
 	return IRGBA_TO_A8R8G8B8(r1, g1, b1, a1);
 }
 
-int ibitmap_filter_8(IBITMAP *dst, const IBITMAP *src, const short *filter)
+// ˲ֿsrc ֻÿд dst Լɨ
+typedef struct
+{
+	IBITMAP *dst;
+	const IBITMAP *src;
+	const short *filter;
+	ipixel_lock_t lock;
+	int retval;
+}	iFilterTask;
+
+static void ibitmap_filter_fail(iFilterTask *task, int retval)
 {
+	ipixel_lock(&task->lock);
+	task->retval = retval;
+	ipixel_unlock(&task->lock);
+}
+
+static void ibitmap_filter_8_band(void *ctx, int top, int bottom)
+{
+	iFilterTask *task = (iFilterTask*)ctx;
+	const IBITMAP *src = task->src;
+	const short *filter = task->filter;
+	IBITMAP *dst = task->dst;
 	IUINT8 *buffer, *p1, *p2, *p3, *p4, *card;
 	IUINT8 pixel[9];
 	int line, i;
 
 	buffer = (IUINT8*)malloc((src->w + 2) * 3);
-	if (buffer == NULL) return -10;
+	if (buffer == NULL) {
+		ibitmap_filter_fail(task, -10);
+		return;
+	}
 	
-	for (line = 0; line < (int)src->h; line++) {
+	for (line = top; line < bottom; line++) {
 		p1 = buffer;
 		p2 = p1 + src->w + 2;
 		p3 = p2 + src->w + 2;
@@ -225,12 +251,14 @@ int ibitmap_filter_8(IBITMAP *dst, const IBITMAP *src, const short *filter)
 	}
 
 	free(buffer);
-
-	return 0;
 }
 
-int ibitmap_filter_32(IBITMAP *dst, const IBITMAP *src, const short *filter)
+static void ibitmap_filter_32_band(void *ctx, int top, int bottom)
 {
+	iFilterTask *task = (iFilterTask*)ctx;
+	const IBITMAP *src = task->src;
+	const short *filter = task->filter;
+	IBITMAP *dst = task->dst;
 	iColorIndex *index = (iColorIndex*)dst->extra;
 	IUINT32 *buffer, *p1, *p2, *p3, *p4, *card;
 	IUINT32 pixel[9];
@@ -238,11 +266,14 @@ int ibitmap_filter_32(IBITMAP *dst, const IBITMAP *src, const short *filter)
 	int line, i;
 
 	buffer = (IUINT32*)malloc((src->w + 2) * 4 * 4);
-	if (buffer == NULL) return -10;
+	if (buffer == NULL) {
+		ibitmap_filter_fail(task, -10);
+		return;
+	}
 
 	store = ipixel_get_store(ibitmap_pixfmt_guess(dst), 0);
 
-	for (line = 0; line < (int)src->h; line++) {
+	for (line = top; line < bottom; line++) {
 		p1 = buffer;
 		p2 = p1 + src->w + 2;
 		p3 = p2 + src->w + 2;
@@ -262,7 +293,29 @@ int ibitmap_filter_32(IBITMAP *dst, const IBITMAP *src, const short *filter)
 		store(dst->line[line], p4, 0, (int)src->w, index);
 	}
 	free(buffer);
-	return 0;
+}
+
+static int ibitmap_filter_bands(IBITMAP *dst, const IBITMAP *src, 
+	const short *filter, ipixel_band_proc proc)
+{
+	iFilterTask task;
+	task.dst = dst;
+	task.src = src;
+	task.filter = filter;
+	task.lock = IPIXEL_LOCK_INIT;
+	task.retval = 0;
+	ipixel_task_bands(proc, &task, (int)src->w, (int)src->h);
+	return task.retval;
+}
+
+int ibitmap_filter_8(IBITMAP *dst, const IBITMAP *src, const short *filter)
+{
+	return ibitmap_filter_bands(dst, src, filter, ibitmap_filter_8_band);
+}
+
+int ibitmap_filter_32(IBITMAP *dst, const IBITMAP *src, const short *filter)
+{
+	return ibitmap_filter_bands(dst, src, filter, ibitmap_filter_32_band);
 }
 
 
@@ -440,14 +493,79 @@ int ibitmap_channel_set(IBITMAP *dst, int dx, int dy, const IBITMAP *src,
 //---------------------------------------------------------------------
 // ͼ£մϵ˳ÿɨߵһupdater
 //---------------------------------------------------------------------
-int ibitmap_update(IBITMAP *dst, const IRECT *bound, 
-	iBitmapUpdate updater, int readonly, void *user)
+typedef struct
 {
+	IBITMAP *dst;
+	iBitmapUpdate updater;
+	void *user;
+	int readonly;
+	int fmt, cl, ct, cw;
+	iFetchProc fetch;
+	iStoreProc store;
+	iColorIndex *index;
+	ipixel_lock_t lock;
+	int retval;
+}	iUpdateTask;
+
+static int ibitmap_update_status(iUpdateTask *task, int retval)
+{
+	ipixel_lock(&task->lock);
+	if (task->retval == 0) task->retval = retval;
+	retval = task->retval;
+	ipixel_unlock(&task->lock);
+	return retval;
+}
+
+//  [top, bottom) Уһ龡ֹͣ
+static void ibitmap_update_band(void *ctx, int top, int bottom)
+{
+	iUpdateTask *task = (iUpdateTask*)ctx;
 	unsigned char _buffer[IBITMAP_STACK_BUFFER];
 	unsigned char *buffer = _buffer;
+	IBITMAP *dst = task->dst;
+	int cl = task->cl, cw = task->cw;
+	int j;
+
+	if (cw * 4 > IBITMAP_STACK_BUFFER && task->fmt != IPIX_FMT_A8R8G8B8) {
+		buffer = (unsigned char*)malloc(cw * 4);
+		if (buffer == NULL) {
+			ibitmap_update_status(task, -2);
+			return;
+		}
+	}
+
+	for (j = top; j < bottom; j++) {
+		int y = j + task->ct;
+		int retval;
+		if (ibitmap_update_status(task, 0) < 0) break;
+		if (task->fmt == IPIX_FMT_A8R8G8B8) {
+			IUINT32 *card = (IUINT32*)dst->line[y] + cl;
+			retval = task->updater(cl, y, cw, card, task->user);
+		}	else {
+			IUINT32 *card = (IUINT32*)buffer;
+			task->fetch(dst->line[y], cl, cw, card, task->index);
+			retval = task->updater(cl, y, cw, card, task->user);
+			if (retval >= 0 && task->readonly == 0) {
+				task->store(dst->line[y], card, cl, cw, task->index);
+			}
+		}
+		if (retval < 0) {
+			ibitmap_update_status(task, retval);
+			break;
+		}
+	}
+
+	if (buffer != _buffer) {
+		free(buffer);
+	}
+}
+
+static int ibitmap_update_bands(IBITMAP *dst, const IRECT *bound, 
+	iBitmapUpdate updater, int readonly, void *user, int parallel)
+{
+	iUpdateTask task;
 	int cl, ct, cr, cb, cw, ch;
-	int fmt, j;
-	long size;
+	int fmt;
 
 	if (bound == NULL) {
 		cl = ct = 0;
@@ -466,52 +584,48 @@ int ibitmap_update(IBITMAP *dst, const IRECT *bound,
 
 	cw = cr - cl;
 	ch = cb - ct;
-	size = cw * 4;
 
 	if (cw <= 0 || ch <= 0)
 		return -1;
 
 	fmt = ibitmap_pixfmt_guess(dst);
 
-	if (size > IBITMAP_STACK_BUFFER && fmt != IPIX_FMT_A8R8G8B8) {
-		buffer = (unsigned char*)malloc(size);
+	task.dst = dst;
+	task.updater = updater;
+	task.user = user;
+	task.readonly = readonly;
+	task.fmt = fmt;
+	task.cl = cl;
+	task.ct = ct;
+	task.cw = cw;
+	task.fetch = ipixel_get_fetch(fmt, 0);
+	task.store = ipixel_get_store(fmt, 0);
+	task.index = (iColorIndex*)(dst->extra);
+	task.lock = IPIXEL_LOCK_INIT;
+	task.retval = 0;
+
+	if (task.index == NULL) task.index = _ipixel_src_index;
+
+	if (parallel) {
+		ipixel_task_bands(ibitmap_update_band, &task, cw, ch);
+	}	else {
+		ibitmap_update_band(&task, 0, ch);
 	}
 
-	if (buffer) {
-		iFetchProc fetch;
-		iStoreProc store;
-		iColorIndex *index;
-		fetch = ipixel_get_fetch(fmt, 0);
-		store = ipixel_get_store(fmt, 0);
-	
-		index = (iColorIndex*)(dst->extra);
-		if (index == NULL) index = _ipixel_src_index;
-
-		for (j = 0; j < ch; j++) {
-			int y = j + ct;
-			if (fmt == IPIX_FMT_A8R8G8B8) {
-				IUINT32 *card = (IUINT32*)dst->line[y] + cl;
-				int retval;
-				retval = updater(cl, y, cw, card, user);
-				if (retval < 0) return retval;
-			}	else {
-				IUINT32 *card = (IUINT32*)buffer;
-				int retval;
-				fetch(dst->line[y], cl, cw, card, index);
-				retval = updater(cl, y, cw, card, user);
-				if (retval < 0) return retval;
-				if (readonly == 0) {
-					store(dst->line[y], card, cl, cw, index);
-				}
-			}
-		}
-	}
+	return task.retval;
+}
 
-	if (buffer != _buffer) {
-		free(buffer);
-	}
+int ibitmap_update(IBITMAP *dst, const IRECT *bound, 
+	iBitmapUpdate updater, int readonly, void *user)
+{
+	return ibitmap_update_bands(dst, bound, updater, readonly, user, 0);
+}
 
-	return 0;
+// ͼ£ɨ߷ֿڶ߳ϵ updater
+int ibitmap_update_parallel(IBITMAP *dst, const IRECT *bound, 
+	iBitmapUpdate updater, int readonly, void *user)
+{
+	return ibitmap_update_bands(dst, bound, updater, readonly, user, 1);
 }
 
 
@@ -580,9 +694,11 @@ static const IINT32 g_stack_blur8_shr[255] = {
 };
 
 
-void ipixel_stackblur_4(void *src, long pitch, int w, int h, int rx, int ry)
+// ˮƽģ [y0, y1) 
+static void ipixel_stackblur_4_rows(void *src, long pitch, int w, int y0,
+	int y1, int rx)
 {
-	unsigned x, y, xp, yp, i;
+	unsigned x, y, xp, i;
 	unsigned stack_ptr;
 	unsigned stack_start;
 
@@ -604,7 +720,6 @@ void ipixel_stackblur_4(void *src, long pitch, int w, int h, int rx, int ry)
 	IUINT32 sum_out_a;
 
 	IUINT32 wm  = (IUINT32)w - 1;
-	IUINT32 hm  = (IUINT32)h - 1;
 
 	IUINT32 div;
 	IUINT32 mul_sum;
@@ -612,246 +727,334 @@ void ipixel_stackblur_4(void *src, long pitch, int w, int h, int rx, int ry)
 
 	IUINT32 stack[512];
 
-	if (rx > 0) {
-		if (rx > 254) rx = 254;
-		div = rx * 2 + 1;
-		mul_sum = g_stack_blur8_mul[rx];
-		shr_sum = g_stack_blur8_shr[rx];
+	if (rx > 254) rx = 254;
+	div = rx * 2 + 1;
+	mul_sum = g_stack_blur8_mul[rx];
+	shr_sum = g_stack_blur8_shr[rx];
+
+	for (y = (IUINT32)y0; y < (IUINT32)y1; y++) {
+		sum_r = 
+		sum_g = 
+		sum_b = 
+		sum_a = 
+		sum_in_r = 
+		sum_in_g = 
+		sum_in_b = 
+		sum_in_a = 
+		sum_out_r = 
+		sum_out_g = 
+		sum_out_b = 
+		sum_out_a = 0;
+
+		src_pix_ptr = (unsigned char*)src + y * pitch;
+
+		for (i = 0; i <= (IUINT32)rx; i++) {
+			stack_pix_ptr    = (unsigned char*)&stack[i];
+			stack_pix_ptr[0] = src_pix_ptr[0];
+			stack_pix_ptr[1] = src_pix_ptr[1];
+			stack_pix_ptr[2] = src_pix_ptr[2];
+			stack_pix_ptr[3] = src_pix_ptr[3];
+			sum_r           += src_pix_ptr[0] * (i + 1);
+			sum_g           += src_pix_ptr[1] * (i + 1);
+			sum_b           += src_pix_ptr[2] * (i + 1);
+			sum_a           += src_pix_ptr[3] * (i + 1);
+			sum_out_r       += src_pix_ptr[0];
+			sum_out_g       += src_pix_ptr[1];
+			sum_out_b       += src_pix_ptr[2];
+			sum_out_a       += src_pix_ptr[3];
+		}
+		for (i = 1; i <= (IUINT32)rx; i++) {
+			if (i <= wm) src_pix_ptr += 4;
+			stack_pix_ptr = (unsigned char*)&stack[i + rx];
+			stack_pix_ptr[0] = src_pix_ptr[0];
+			stack_pix_ptr[1] = src_pix_ptr[1];
+			stack_pix_ptr[2] = src_pix_ptr[2];
+			stack_pix_ptr[3] = src_pix_ptr[3];
+			sum_r           += src_pix_ptr[0] * (rx + 1 - i);
+			sum_g           += src_pix_ptr[1] * (rx + 1 - i);
+			sum_b           += src_pix_ptr[2] * (rx + 1 - i);
+			sum_a           += src_pix_ptr[3] * (rx + 1 - i);
+			sum_in_r        += src_pix_ptr[0];
+			sum_in_g        += src_pix_ptr[1];
+			sum_in_b        += src_pix_ptr[2];
+			sum_in_a        += src_pix_ptr[3];
+		}
 
-		for (y = 0; y < (IUINT32)h; y++) {
-			sum_r = 
-			sum_g = 
-			sum_b = 
-			sum_a = 
-			sum_in_r = 
-			sum_in_g = 
-			sum_in_b = 
-			sum_in_a = 
-			sum_out_r = 
-			sum_out_g = 
-			sum_out_b = 
-			sum_out_a = 0;
-
-			src_pix_ptr = (unsigned char*)src + y * pitch;
-
-			for (i = 0; i <= (IUINT32)rx; i++) {
-				stack_pix_ptr    = (unsigned char*)&stack[i];
-				stack_pix_ptr[0] = src_pix_ptr[0];
-				stack_pix_ptr[1] = src_pix_ptr[1];
-				stack_pix_ptr[2] = src_pix_ptr[2];
-				stack_pix_ptr[3] = src_pix_ptr[3];
-				sum_r           += src_pix_ptr[0] * (i + 1);
-				sum_g           += src_pix_ptr[1] * (i + 1);
-				sum_b           += src_pix_ptr[2] * (i + 1);
-				sum_a           += src_pix_ptr[3] * (i + 1);
-				sum_out_r       += src_pix_ptr[0];
-				sum_out_g       += src_pix_ptr[1];
-				sum_out_b       += src_pix_ptr[2];
-				sum_out_a       += src_pix_ptr[3];
-			}
-			for (i = 1; i <= (IUINT32)rx; i++) {
-				if (i <= wm) src_pix_ptr += 4;
-				stack_pix_ptr = (unsigned char*)&stack[i + rx];
-				stack_pix_ptr[0] = src_pix_ptr[0];
-				stack_pix_ptr[1] = src_pix_ptr[1];
-				stack_pix_ptr[2] = src_pix_ptr[2];
-				stack_pix_ptr[3] = src_pix_ptr[3];
-				sum_r           += src_pix_ptr[0] * (rx + 1 - i);
-				sum_g           += src_pix_ptr[1] * (rx + 1 - i);
-				sum_b           += src_pix_ptr[2] * (rx + 1 - i);
-				sum_a           += src_pix_ptr[3] * (rx + 1 - i);
-				sum_in_r        += src_pix_ptr[0];
-				sum_in_g        += src_pix_ptr[1];
-				sum_in_b        += src_pix_ptr[2];
-				sum_in_a        += src_pix_ptr[3];
-			}
+		stack_ptr = rx;
+		xp = rx;
+		if (xp > wm) xp = wm;
 
-			stack_ptr = rx;
-			xp = rx;
-			if (xp > wm) xp = wm;
-
-			src_pix_ptr = (unsigned char*)src + y * pitch + xp * 4;
-			dst_pix_ptr = (unsigned char*)src + y * pitch;
-
-			for (x = 0; x < (IUINT32)w; x++) {
-				dst_pix_ptr[0] = (IUINT8)((sum_r * mul_sum) >> shr_sum);
-				dst_pix_ptr[1] = (IUINT8)((sum_g * mul_sum) >> shr_sum);
-				dst_pix_ptr[2] = (IUINT8)((sum_b * mul_sum) >> shr_sum);
-				dst_pix_ptr[3] = (IUINT8)((sum_a * mul_sum) >> shr_sum);
-				dst_pix_ptr += 4;
-
-				sum_r -= sum_out_r;
-				sum_g -= sum_out_g;
-				sum_b -= sum_out_b;
-				sum_a -= sum_out_a;
-
-				stack_start = stack_ptr + div - rx;
-				if (stack_start >= div) stack_start -= div;
-				stack_pix_ptr = (unsigned char*)&stack[stack_start];
-
-				sum_out_r -= stack_pix_ptr[0];
-				sum_out_g -= stack_pix_ptr[1];
-				sum_out_b -= stack_pix_ptr[2];
-				sum_out_a -= stack_pix_ptr[3];
-
-				if(xp < wm) {
-					src_pix_ptr += 4;
-					++xp;
-				}
+		src_pix_ptr = (unsigned char*)src + y * pitch + xp * 4;
+		dst_pix_ptr = (unsigned char*)src + y * pitch;
 
-				stack_pix_ptr[0] = src_pix_ptr[0];
-				stack_pix_ptr[1] = src_pix_ptr[1];
-				stack_pix_ptr[2] = src_pix_ptr[2];
-				stack_pix_ptr[3] = src_pix_ptr[3];
-
-				sum_in_r += src_pix_ptr[0];
-				sum_in_g += src_pix_ptr[1];
-				sum_in_b += src_pix_ptr[2];
-				sum_in_a += src_pix_ptr[3];
-				sum_r    += sum_in_r;
-				sum_g    += sum_in_g;
-				sum_b    += sum_in_b;
-				sum_a    += sum_in_a;
-
-				++stack_ptr;
-				if (stack_ptr >= div) stack_ptr = 0;
-				stack_pix_ptr = (unsigned char*)&stack[stack_ptr];
-
-				sum_out_r += stack_pix_ptr[0];
-				sum_out_g += stack_pix_ptr[1];
-				sum_out_b += stack_pix_ptr[2];
-				sum_out_a += stack_pix_ptr[3];
-				sum_in_r  -= stack_pix_ptr[0];
-				sum_in_g  -= stack_pix_ptr[1];
-				sum_in_b  -= stack_pix_ptr[2];
-				sum_in_a  -= stack_pix_ptr[3];
+		for (x = 0; x < (IUINT32)w; x++) {
+			dst_pix_ptr[0] = (IUINT8)((sum_r * mul_sum) >> shr_sum);
+			dst_pix_ptr[1] = (IUINT8)((sum_g * mul_sum) >> shr_sum);
+			dst_pix_ptr[2] = (IUINT8)((sum_b * mul_sum) >> shr_sum);
+			dst_pix_ptr[3] = (IUINT8)((sum_a * mul_sum) >> shr_sum);
+			dst_pix_ptr += 4;
+
+			sum_r -= sum_out_r;
+			sum_g -= sum_out_g;
+			sum_b -= sum_out_b;
+			sum_a -= sum_out_a;
+
+			stack_start = stack_ptr + div - rx;
+			if (stack_start >= div) stack_start -= div;
+			stack_pix_ptr = (unsigned char*)&stack[stack_start];
+
+			sum_out_r -= stack_pix_ptr[0];
+			sum_out_g -= stack_pix_ptr[1];
+			sum_out_b -= stack_pix_ptr[2];
+			sum_out_a -= stack_pix_ptr[3];
+
+			if(xp < wm) {
+				src_pix_ptr += 4;
+				++xp;
 			}
+
+			stack_pix_ptr[0] = src_pix_ptr[0];
+			stack_pix_ptr[1] = src_pix_ptr[1];
+			stack_pix_ptr[2] = src_pix_ptr[2];
+			stack_pix_ptr[3] = src_pix_ptr[3];
+
+			sum_in_r += src_pix_ptr[0];
+			sum_in_g += src_pix_ptr[1];
+			sum_in_b += src_pix_ptr[2];
+			sum_in_a += src_pix_ptr[3];
+			sum_r    += sum_in_r;
+			sum_g    += sum_in_g;
+			sum_b    += sum_in_b;
+			sum_a    += sum_in_a;
+
+			++stack_ptr;
+			if (stack_ptr >= div) stack_ptr = 0;
+			stack_pix_ptr = (unsigned char*)&stack[stack_ptr];
+
+			sum_out_r += stack_pix_ptr[0];
+			sum_out_g += stack_pix_ptr[1];
+			sum_out_b += stack_pix_ptr[2];
+			sum_out_a += stack_pix_ptr[3];
+			sum_in_r  -= stack_pix_ptr[0];
+			sum_in_g  -= stack_pix_ptr[1];
+			sum_in_b  -= stack_pix_ptr[2];
+			sum_in_a  -= stack_pix_ptr[3];
 		}
 	}
+}
 
-	if (ry > 0) {
-		if (ry > 254) ry = 254;
-		div = ry * 2 + 1;
-		mul_sum = g_stack_blur8_mul[ry];
-		shr_sum = g_stack_blur8_shr[ry];
+// ֱģ [x0, x1) 
+static void ipixel_stackblur_4_cols(void *src, long pitch, int h, int x0,
+	int x1, int ry)
+{
+	unsigned x, y, yp, i;
+	unsigned stack_ptr;
+	unsigned stack_start;
 
-		for (x = 0; x < (IUINT32)w; x++) {
-			sum_r = 
-			sum_g = 
-			sum_b = 
-			sum_a = 
-			sum_in_r = 
-			sum_in_g = 
-			sum_in_b = 
-			sum_in_a = 
-			sum_out_r = 
-			sum_out_g = 
-			sum_out_b = 
-			sum_out_a = 0;
-
-			src_pix_ptr = (unsigned char*)src + x * 4;
-
-			for (i = 0; i <= (IUINT32)ry; i++) {
-				stack_pix_ptr    = (unsigned char*)&stack[i];
-				stack_pix_ptr[0] = src_pix_ptr[0];
-				stack_pix_ptr[1] = src_pix_ptr[1];
-				stack_pix_ptr[2] = src_pix_ptr[2];
-				stack_pix_ptr[3] = src_pix_ptr[3];
-				sum_r           += src_pix_ptr[0] * (i + 1);
-				sum_g           += src_pix_ptr[1] * (i + 1);
-				sum_b           += src_pix_ptr[2] * (i + 1);
-				sum_a           += src_pix_ptr[3] * (i + 1);
-				sum_out_r       += src_pix_ptr[0];
-				sum_out_g       += src_pix_ptr[1];
-				sum_out_b       += src_pix_ptr[2];
-				sum_out_a       += src_pix_ptr[3];
-			}
-			for (i = 1; i <= (IUINT32)ry; i++) {
-				if (i <= hm) src_pix_ptr += pitch; 
-				stack_pix_ptr = (unsigned char*)&stack[i + ry];
-				stack_pix_ptr[0] = src_pix_ptr[0];
-				stack_pix_ptr[1] = src_pix_ptr[1];
-				stack_pix_ptr[2] = src_pix_ptr[2];
-				stack_pix_ptr[3] = src_pix_ptr[3];
-				sum_r           += src_pix_ptr[0] * (ry + 1 - i);
-				sum_g           += src_pix_ptr[1] * (ry + 1 - i);
-				sum_b           += src_pix_ptr[2] * (ry + 1 - i);
-				sum_a           += src_pix_ptr[3] * (ry + 1 - i);
-				sum_in_r        += src_pix_ptr[0];
-				sum_in_g        += src_pix_ptr[1];
-				sum_in_b        += src_pix_ptr[2];
-				sum_in_a        += src_pix_ptr[3];
-			}
+	const unsigned char * src_pix_ptr;
+	unsigned char * dst_pix_ptr;
+	unsigned char * stack_pix_ptr;
 
-			stack_ptr = ry;
-			yp = ry;
-			if(yp > hm) yp = hm;
-
-			src_pix_ptr = (unsigned char*)src + yp * pitch + x * 4;
-			dst_pix_ptr = (unsigned char*)src + x * 4;
-
-			for (y = 0; y < (IUINT32)h; y++) {
-				dst_pix_ptr[0] = (IUINT8)((sum_r * mul_sum) >> shr_sum);
-				dst_pix_ptr[1] = (IUINT8)((sum_g * mul_sum) >> shr_sum);
-				dst_pix_ptr[2] = (IUINT8)((sum_b * mul_sum) >> shr_sum);
-				dst_pix_ptr[3] = (IUINT8)((sum_a * mul_sum) >> shr_sum);
-				dst_pix_ptr += pitch;
-
-				sum_r -= sum_out_r;
-				sum_g -= sum_out_g;
-				sum_b -= sum_out_b;
-				sum_a -= sum_out_a;
-
-				stack_start = stack_ptr + div - ry;
-				if (stack_start >= div) stack_start -= div;
-
-				stack_pix_ptr = (unsigned char*)&stack[stack_start];
-				sum_out_r -= stack_pix_ptr[0];
-				sum_out_g -= stack_pix_ptr[1];
-				sum_out_b -= stack_pix_ptr[2];
-				sum_out_a -= stack_pix_ptr[3];
-
-				if (yp < hm) {
-					src_pix_ptr += pitch;
-					++yp;
-				}
+	IUINT32 sum_r;
+	IUINT32 sum_g;
+	IUINT32 sum_b;
+	IUINT32 sum_a;
+	IUINT32 sum_in_r;
+	IUINT32 sum_in_g;
+	IUINT32 sum_in_b;
+	IUINT32 sum_in_a;
+	IUINT32 sum_out_r;
+	IUINT32 sum_out_g;
+	IUINT32 sum_out_b;
+	IUINT32 sum_out_a;
+
+	IUINT32 hm  = (IUINT32)h - 1;
+
+	IUINT32 div;
+	IUINT32 mul_sum;
+	IUINT32 shr_sum;
 
-				stack_pix_ptr[0] = src_pix_ptr[0];
-				stack_pix_ptr[1] = src_pix_ptr[1];
-				stack_pix_ptr[2] = src_pix_ptr[2];
-				stack_pix_ptr[3] = src_pix_ptr[3];
-
-				sum_in_r += src_pix_ptr[0];
-				sum_in_g += src_pix_ptr[1];
-				sum_in_b += src_pix_ptr[2];
-				sum_in_a += src_pix_ptr[3];
-				sum_r    += sum_in_r;
-				sum_g    += sum_in_g;
-				sum_b    += sum_in_b;
-				sum_a    += sum_in_a;
-
-				++stack_ptr;
-				if (stack_ptr >= div) stack_ptr = 0;
-				stack_pix_ptr = (unsigned char*)&stack[stack_ptr];
-
-				sum_out_r += stack_pix_ptr[0];
-				sum_out_g += stack_pix_ptr[1];
-				sum_out_b += stack_pix_ptr[2];
-				sum_out_a += stack_pix_ptr[3];
-				sum_in_r  -= stack_pix_ptr[0];
-				sum_in_g  -= stack_pix_ptr[1];
-				sum_in_b  -= stack_pix_ptr[2];
-				sum_in_a  -= stack_pix_ptr[3];
+	IUINT32 stack[512];
+
+	if (ry > 254) ry = 254;
+	div = ry * 2 + 1;
+	mul_sum = g_stack_blur8_mul[ry];
+	shr_sum = g_stack_blur8_shr[ry];
+
+	for (x = (IUINT32)x0; x < (IUINT32)x1; x++) {
+		sum_r = 
+		sum_g = 
+		sum_b = 
+		sum_a = 
+		sum_in_r = 
+		sum_in_g = 
+		sum_in_b = 
+		sum_in_a = 
+		sum_out_r = 
+		sum_out_g = 
+		sum_out_b = 
+		sum_out_a = 0;
+
+		src_pix_ptr = (unsigned char*)src + x * 4;
+
+		for (i = 0; i <= (IUINT32)ry; i++) {
+			stack_pix_ptr    = (unsigned char*)&stack[i];
+			stack_pix_ptr[0] = src_pix_ptr[0];
+			stack_pix_ptr[1] = src_pix_ptr[1];
+			stack_pix_ptr[2] = src_pix_ptr[2];
+			stack_pix_ptr[3] = src_pix_ptr[3];
+			sum_r           += src_pix_ptr[0] * (i + 1);
+			sum_g           += src_pix_ptr[1] * (i + 1);
+			sum_b           += src_pix_ptr[2] * (i + 1);
+			sum_a           += src_pix_ptr[3] * (i + 1);
+			sum_out_r       += src_pix_ptr[0];
+			sum_out_g       += src_pix_ptr[1];
+			sum_out_b       += src_pix_ptr[2];
+			sum_out_a       += src_pix_ptr[3];
+		}
+		for (i = 1; i <= (IUINT32)ry; i++) {
+			if (i <= hm) src_pix_ptr += pitch; 
+			stack_pix_ptr = (unsigned char*)&stack[i + ry];
+			stack_pix_ptr[0] = src_pix_ptr[0];
+			stack_pix_ptr[1] = src_pix_ptr[1];
+			stack_pix_ptr[2] = src_pix_ptr[2];
+			stack_pix_ptr[3] = src_pix_ptr[3];
+			sum_r           += src_pix_ptr[0] * (ry + 1 - i);
+			sum_g           += src_pix_ptr[1] * (ry + 1 - i);
+			sum_b           += src_pix_ptr[2] * (ry + 1 - i);
+			sum_a           += src_pix_ptr[3] * (ry + 1 - i);
+			sum_in_r        += src_pix_ptr[0];
+			sum_in_g        += src_pix_ptr[1];
+			sum_in_b        += src_pix_ptr[2];
+			sum_in_a        += src_pix_ptr[3];
+		}
+
+		stack_ptr = ry;
+		yp = ry;
+		if(yp > hm) yp = hm;
+
+		src_pix_ptr = (unsigned char*)src + yp * pitch + x * 4;
+		dst_pix_ptr = (unsigned char*)src + x * 4;
+
+		for (y = 0; y < (IUINT32)h; y++) {
+			dst_pix_ptr[0] = (IUINT8)((sum_r * mul_sum) >> shr_sum);
+			dst_pix_ptr[1] = (IUINT8)((sum_g * mul_sum) >> shr_sum);
+			dst_pix_ptr[2] = (IUINT8)((sum_b * mul_sum) >> shr_sum);
+			dst_pix_ptr[3] = (IUINT8)((sum_a * mul_sum) >> shr_sum);
+			dst_pix_ptr += pitch;
+
+			sum_r -= sum_out_r;
+			sum_g -= sum_out_g;
+			sum_b -= sum_out_b;
+			sum_a -= sum_out_a;
+
+			stack_start = stack_ptr + div - ry;
+			if (stack_start >= div) stack_start -= div;
+
+			stack_pix_ptr = (unsigned char*)&stack[stack_start];
+			sum_out_r -= stack_pix_ptr[0];
+			sum_out_g -= stack_pix_ptr[1];
+			sum_out_b -= stack_pix_ptr[2];
+			sum_out_a -= stack_pix_ptr[3];
+
+			if (yp < hm) {
+				src_pix_ptr += pitch;
+				++yp;
 			}
+
+			stack_pix_ptr[0] = src_pix_ptr[0];
+			stack_pix_ptr[1] = src_pix_ptr[1];
+			stack_pix_ptr[2] = src_pix_ptr[2];
+			stack_pix_ptr[3] = src_pix_ptr[3];
+
+			sum_in_r += src_pix_ptr[0];
+			sum_in_g += src_pix_ptr[1];
+			sum_in_b += src_pix_ptr[2];
+			sum_in_a += src_pix_ptr[3];
+			sum_r    += sum_in_r;
+			sum_g    += sum_in_g;
+			sum_b    += sum_in_b;
+			sum_a    += sum_in_a;
+
+			++stack_ptr;
+			if (stack_ptr >= div) stack_ptr = 0;
+			stack_pix_ptr = (unsigned char*)&stack[stack_ptr];
+
+			sum_out_r += stack_pix_ptr[0];
+			sum_out_g += stack_pix_ptr[1];
+			sum_out_b += stack_pix_ptr[2];
+			sum_out_a += stack_pix_ptr[3];
+			sum_in_r  -= stack_pix_ptr[0];
+			sum_in_g  -= stack_pix_ptr[1];
+			sum_in_b  -= stack_pix_ptr[2];
+			sum_in_a  -= stack_pix_ptr[3];
 		}
 	}
 }
 
+// ֱÿд64 ֽڣһУ̲ͬ߳
+// дͬһ
+#define IPIXEL_STACKBLUR_STRIP	16
+
+// ֿˮƽзֿ飬ֱдֿ
+typedef struct
+{
+	void *src;
+	long pitch;
+	int w, h, rx, ry;
+	int lead;			// ׸дǰһе
+}	iStackBlurTask;
+
+static void ipixel_stackblur_4_hband(void *ctx, int top, int bottom)
+{
+	iStackBlurTask *task = (iStackBlurTask*)ctx;
+	ipixel_stackblur_4_rows(task->src, task->pitch, task->w, top, bottom,
+		task->rx);
+}
+
+static void ipixel_stackblur_4_vband(void *ctx, int top, int bottom)
+{
+	iStackBlurTask *task = (iStackBlurTask*)ctx;
+	int x0 = top * IPIXEL_STACKBLUR_STRIP - task->lead;
+	int x1 = bottom * IPIXEL_STACKBLUR_STRIP - task->lead;
+	if (x0 < 0) x0 = 0;
+	if (x1 > task->w) x1 = task->w;
+	if (x0 < x1) {
+		ipixel_stackblur_4_cols(task->src, task->pitch, task->h, x0, x1,
+			task->ry);
+	}
+}
+
+// Ȱвˮƽģٰждֱģ
+void ipixel_stackblur_4(void *src, long pitch, int w, int h, int rx, int ry)
+{
+	iStackBlurTask task;
+	if (w <= 0 || h <= 0) return;
+	task.src = src;
+	task.pitch = pitch;
+	task.w = w;
+	task.h = h;
+	task.rx = (rx > 254)? 254 : rx;
+	task.ry = (ry > 254)? 254 : ry;
+	task.lead = (int)(((size_t)src & 63) >> 2);
+	if (task.rx > 0) {
+		ipixel_task_bands(ipixel_stackblur_4_hband, &task, w, h);
+	}
+	if (task.ry > 0) {
+		int strips = (w + task.lead + IPIXEL_STACKBLUR_STRIP - 1) / 
+			IPIXEL_STACKBLUR_STRIP;
+		// дɨ߽ ipixel_task_bandsԼΪ w * h
+		ipixel_task_bands(ipixel_stackblur_4_vband, &task, 
+			h * IPIXEL_STACKBLUR_STRIP, strips);
+	}
+}
+
 // ͼģ
 void ibitmap_stackblur(IBITMAP *src, int rx, int ry, const IRECT *bound)
 {
 	int x, y, w, h;
 	IRECT rect;
+	IBITMAP_TRACE_BEGIN(tracets);
 
 	if (bound == NULL) {
 		bound = &rect;
@@ -881,11 +1084,16 @@ void ibitmap_stackblur(IBITMAP *src, int rx, int ry, const IRECT *bound)
 			w, h, rx, ry);
 		ibitmap_convert(src, x, y, newbmp, 0, 0, w, h, NULL, 0);
 		ibitmap_release(newbmp);
+		IBITMAP_TRACE_END(tracets, "ibitmap_stackblur", w, h,
+			ibitmap_pixfmt_guess(src), -1);
 		return;
 	}
 
 	ipixel_stackblur_4((char*)src->line[y] + x * 4, (long)src->pitch,
 		w, h, rx, ry);
+
+	IBITMAP_TRACE_END(tracets, "ibitmap_stackblur", w, h,
+		ibitmap_pixfmt_guess(src), -1);
 }
 
 // Ӱ
@@ -1182,25 +1390,25 @@ void ibitmap_color_transform(IBITMAP *dst, const IRECT *b, const float *t)
 		dst[3] = cfixed_from_float(src[3]);
 		dst[4] = cfixed_from_float(src[4]);
 	}
-	ibitmap_update(dst, b, i_update_trans, 0, transform);
+	ibitmap_update_parallel(dst, b, i_update_trans, 0, transform);
 }
 
 // ɫʱãӷ
 void ibitmap_color_add(IBITMAP *dst, const IRECT *b, IUINT32 color)
 {
-	ibitmap_update(dst, b, i_update_add, 0, &color);
+	ibitmap_update_parallel(dst, b, i_update_add, 0, &color);
 }
 
 // ɫʱã
 void ibitmap_color_sub(IBITMAP *dst, const IRECT *b, IUINT32 color)
 {
-	ibitmap_update(dst, b, i_update_sub, 0, &color);
+	ibitmap_update_parallel(dst, b, i_update_sub, 0, &color);
 }
 
 // ɫʱã˷
 void ibitmap_color_mul(IBITMAP *dst, const IRECT *b, IUINT32 color)
 {
-	ibitmap_update(dst, b, i_update_mul, 0, &color);
+	ibitmap_update_parallel(dst, b, i_update_mul, 0, &color);
 }
 
 
@@ -1668,8 +1876,6 @@ int cvector_push(struct CVECTOR *vector, const void *data, size_t size)
 //---------------------------------------------------------------------
 // ԭʼͼ
 //---------------------------------------------------------------------
-static struct CVECTOR ipixel_scratch = { 0, 0, 0 };
-
 // 
 int ipixel_render_traps(IBITMAP *dst, const ipixel_trapezoid_t *traps, 
 	int ntraps, IBITMAP *alpha, const ipixel_source_t *src, int isadd,
@@ -1683,7 +1889,8 @@ int ipixel_render_traps(IBITMAP *dst, const ipixel_trapezoid_t *traps,
 	iColorIndex *index;
 	IUINT32 color;
 	IUINT32 *card;
-	long size;
+	char *data;
+	long size, cardsize;
 
 	if (ipixel_trapezoid_bound(traps, ntraps, &bound) == 0)
 		return -1;
@@ -1698,6 +1905,16 @@ int ipixel_render_traps(IBITMAP *dst, const ipixel_trapezoid_t *traps,
 
 	ipixel_rect_intersection(&bound, clip);
 
+	if (bound.right <= bound.left || bound.bottom <= bound.top)
+		return -2;
+
+	if (alpha == NULL) {
+		alpha = ipixel_scratch_alpha(bound.right - bound.left, 
+			bound.bottom - bound.top);
+		if (alpha == NULL) return -3;
+		ibitmap_imode(alpha, subpixel) = ibitmap_imode(dst, subpixel);
+	}
+
 	if (bound.right - bound.left > (int)alpha->w) 
 		bound.right = bound.left + (int)alpha->w;
 
@@ -1714,24 +1931,33 @@ int ipixel_render_traps(IBITMAP *dst, const ipixel_trapezoid_t *traps,
 
 	ipixel_rect_offset(&bound, -cx, -cy);
 	
-	if (scratch == NULL) scratch = &ipixel_scratch;
 	size = (ch + 5) * sizeof(ipixel_span_t) * 2;
 
-	if (src->type != IPIXEL_SOURCE_SOLID) 
-		size += ch * sizeof(IUINT32);
+	// ǴɫԴǰ cw ص card 16 ֽڶٷ spans
+	cardsize = 0;
+	if (src->type != IPIXEL_SOURCE_SOLID) {
+		cardsize = ((long)cw * (long)sizeof(IUINT32) + 15) & ~15L;
+		size += cardsize;
+	}
 	
-	if (size > (long)scratch->size) {
-		if (cvector_resize(scratch, size) != 0)
-			return -3;
+	if (scratch == NULL) {
+		data = (char*)ipixel_scratch(IPIXEL_SCRATCH_SPANS, size);
+		if (data == NULL) return -3;
+	}	else {
+		if (size > (long)scratch->size) {
+			if (cvector_resize(scratch, size) != 0)
+				return -3;
+		}
+		data = (char*)scratch->data;
 	}
 
 	if (src->type == IPIXEL_SOURCE_SOLID) {
-		spans = (ipixel_span_t*)scratch->data;
+		spans = (ipixel_span_t*)data;
 		card = NULL;
 		color = src->source.solid.color;
 	}	else {
-		spans = (ipixel_span_t*)(scratch->data + sizeof(IUINT32) * cw);
-		card = (IUINT32*)scratch->data;
+		spans = (ipixel_span_t*)(data + cardsize);
+		card = (IUINT32*)data;
 		color = 0;
 	}
 
@@ -1782,48 +2008,42 @@ int ipixel_render_polygon(IBITMAP *dst, const ipixel_point_fixed_t *pts,
 	char _buffer[IBITMAP_STACK_BUFFER];
 	char *buffer = _buffer;
 	ipixel_trapezoid_t *traps;
+	void *workmem;
 	int ntraps;
 	long size;
-	int retval;
 
 	if (npts < 3) return -10;
 
 	size = sizeof(ipixel_trapezoid_t) * npts * 2;
 	if (size > IBITMAP_STACK_BUFFER) {
-		buffer = (char*)malloc(size);
+		buffer = (char*)ipixel_scratch(IPIXEL_SCRATCH_TRAPS, size);
 		if (buffer == NULL) return -20;
 	}
 
 	traps = (ipixel_trapezoid_t*)buffer;
 	size = sizeof(ipixel_point_fixed_t) * npts;
 
-	if (scratch == NULL) scratch = &ipixel_scratch;
-
-	if (size > (long)scratch->size) {
-		if (cvector_resize(scratch, size) != 0) {
-			retval = -30;
-			goto exit_label;
+	if (scratch == NULL) {
+		workmem = ipixel_scratch(IPIXEL_SCRATCH_POINTS, size);
+		if (workmem == NULL) return -30;
+	}	else {
+		if (size > (long)scratch->size) {
+			if (cvector_resize(scratch, size) != 0) 
+				return -30;
 		}
+		workmem = scratch->data;
 	}
 
-	ntraps = ipixel_traps_from_polygon(traps, pts, npts, 0, scratch->data);
+	ntraps = ipixel_traps_from_polygon(traps, pts, npts, 0, workmem);
 
 	if (ntraps == 0) {
-		ntraps = ipixel_traps_from_polygon(traps, pts, npts, 1, 
-			scratch->data);
-		if (ntraps == 0) {
-			retval = -40;
-			goto exit_label;
-		}
+		ntraps = ipixel_traps_from_polygon(traps, pts, npts, 1, workmem);
+		if (ntraps == 0) 
+			return -40;
 	}
 
-	retval = ipixel_render_traps(dst, traps, ntraps, alpha, src, 
+	return ipixel_render_traps(dst, traps, ntraps, alpha, src, 
 		isadditive, clip, scratch);
-
-exit_label:
-	if (buffer != _buffer) free(buffer);
-
-	return retval;
 }
 
 
@@ -2063,12 +2283,21 @@ void ipaint_anti_aliasing(ipaint_t *paint, int level)
 	}
 }
 
+// trace event with the size and format of the paint target
+#define IPAINT_TRACE_END(ts, name, paint) \
+	IBITMAP_TRACE_END(ts, name, (paint)->image->w, (paint)->image->h, \
+		-1, ibitmap_pixfmt_guess((paint)->image))
+
 int ipaint_draw_polygon(ipaint_t *paint, const ipixel_point_t *pts, int n)
 {
+	int retval;
+	IBITMAP_TRACE_BEGIN(tracets);
 	ipaint_point_reset(paint);
 	if (ipaint_point_append(paint, pts, n) != 0)
 		return -100;
-	return ipaint_draw_primitive(paint);
+	retval = ipaint_draw_primitive(paint);
+	IPAINT_TRACE_END(tracets, "ipaint_draw_polygon", paint);
+	return retval;
 }
 
 
@@ -2076,6 +2305,7 @@ int ipaint_draw_line(ipaint_t *paint, double x1, double y1, double x2,
 	double y2)
 {
 	double dx, dy, dist, nx, ny, hx, hy, half;
+	IBITMAP_TRACE_BEGIN(tracets);
 	ipaint_point_reset(paint);
 
 	dx = x2 - x1;
@@ -2145,6 +2375,8 @@ int ipaint_draw_line(ipaint_t *paint, double x1, double y1, double x2,
 
 	ipaint_draw_primitive(paint);
 
+	IPAINT_TRACE_END(tracets, "ipaint_draw_line", paint);
+
 	return 0;
 }
 
@@ -2162,6 +2394,7 @@ int ipaint_draw_ellipse(ipaint_t *paint, double x, double y, double rx,
 	int count, ntraps, i;
 	double theta, dt;
 	long size;
+	IBITMAP_TRACE_BEGIN(tracets);
 
 	if (rm < 2) count = 4;
 	else if (rm < 10) count = 5;
@@ -2228,7 +2461,11 @@ int ipaint_draw_ellipse(ipaint_t *paint, double x, double y, double rx,
 		traps[ntraps++] = t;
 	}
 	
-	return ipaint_draw_traps(paint, traps, ntraps);
+	i = ipaint_draw_traps(paint, traps, ntraps);
+
+	IPAINT_TRACE_END(tracets, "ipaint_draw_ellipse", paint);
+
+	return i;
 }
 
 int ipaint_draw_circle(ipaint_t *paint, double x, double y, double r)
@@ -2308,6 +2545,7 @@ int ipaint_draw(ipaint_t *paint, int x, int y, const IBITMAP *src,
 	const IRECT *bound, IUINT32 color, int flags)
 {
 	int sx, sy, sw, sh;
+	IBITMAP_TRACE_BEGIN(tracets);
 	if (bound == NULL) {
 		sx = sy = 0;
 		sw = (int)src->w;
@@ -2320,6 +2558,7 @@ int ipaint_draw(ipaint_t *paint, int x, int y, const IBITMAP *src,
 	}
 	ibitmap_blend(paint->image, x, y, src, sx, sy, sw, sh,
 		color, &paint->clip, flags);
+	IPAINT_TRACE_END(tracets, "ipaint_draw", paint);
 	return 0;
 }
 
@@ -2688,7 +2927,7 @@ void ibitmap_adjust_hsv(IBITMAP *bmp, float hue, float saturation,
 	hsv.H = (float)hue;
 	hsv.S = (float)saturation;
 	hsv.V = (float)value;
-	ibitmap_update(bmp, bound, ibitmap_update_hsv, 0, &hsv);
+	ibitmap_update_parallel(bmp, bound, ibitmap_update_hsv, 0, &hsv);
 }
 
 
@@ -2700,7 +2939,7 @@ void ibitmap_adjust_hsl(IBITMAP *bmp, float hue, float saturation,
 	hsv.H = (float)hue;
 	hsv.S = (float)saturation;
 	hsv.V = (float)lightness;
-	ibitmap_update(bmp, bound, ibitmap_update_hsl, 0, &hsv);
+	ibitmap_update_parallel(bmp, bound, ibitmap_update_hsl, 0, &hsv);
 }
 
 
@@ -50,6 +50,11 @@ typedef int (*iBitmapUpdate)(int x, int y, int w, IUINT32 *card, void *user);
 int ibitmap_update(IBITMAP *dst, const IRECT *bound, 
 	iBitmapUpdate updater, int readonly, void *user);
 
+// ͼ£ɨ߷ֿڶ߳ϵupdater˳ȷ
+// updater̰߳ȫظɨ߾ֹͣѲָ£
+int ibitmap_update_parallel(IBITMAP *dst, const IRECT *bound, 
+	iBitmapUpdate updater, int readonly, void *user);
+
 
 //---------------------------------------------------------------------
 // Ч
@@ -114,6 +119,9 @@ int cvector_push(struct CVECTOR *vector, const void *data, size_t size);
 // ԭʼͼ
 //---------------------------------------------------------------------
 
+// alpha Ϊ NULL ʱʹõǰ̵߳λͼģʽȡ dst ģ
+// scratch Ϊ NULL ʱʹõǰ̵߳Ĺڴ棬 ipixel_scratch
+
 // 
 int ipixel_render_traps(IBITMAP *dst, const ipixel_trapezoid_t *traps, 
 	int ntraps, IBITMAP *alpha, const ipixel_source_t *src, int isadditive,
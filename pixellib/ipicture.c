@@ -15,6 +15,7 @@
 #include "ibmbits.h"
 #include "ibmcols.h"
 #include "ipicture.h"
+#include "ibmtrace.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -1029,6 +1030,7 @@ int isave_bmp_stream(IMDIO *stream, struct IBITMAP *bmp, const IRGB *pal)
 	int bpp;
 	int filler;
 	int fmt;
+	IBITMAP_TRACE_BEGIN(tracets);
 
 	assert(bmp);
 	assert(stream);
@@ -1104,6 +1106,8 @@ int isave_bmp_stream(IMDIO *stream, struct IBITMAP *bmp, const IRGB *pal)
 		for (i = 0; i < (long)filler; i++) is_putc(stream, 0);
 	}
 
+	IBITMAP_TRACE_END(tracets, "isave_bmp_stream", bmp->w, bmp->h, fmt, -1);
+
 	return 0;
 }
 
@@ -1358,6 +1362,7 @@ int isave_tga_stream(IMDIO *stream, struct IBITMAP *bmp, const IRGB *pal)
 	long x, y, depth, n;
 	IRGB tmppal[256];
 	int fmt;
+	IBITMAP_TRACE_BEGIN(tracets);
 
 	assert(bmp);
 	assert(stream);
@@ -1423,6 +1428,8 @@ int isave_tga_stream(IMDIO *stream, struct IBITMAP *bmp, const IRGB *pal)
 		}
 	}
 
+	IBITMAP_TRACE_END(tracets, "isave_tga_stream", bmp->w, bmp->h, fmt, -1);
+
 	return 0;
 }
 
@@ -1446,14 +1453,17 @@ int isave_tga_file(const char *file, struct IBITMAP *bmp, const IRGB *pal)
 // Add new loader to load other picture formats
 //---------------------------------------------------------------------
 static IPICLOADER iloader_table[256];
+static ipixel_once_t iloader_table_once = IPIXEL_ONCE_INIT;
 
-void iloader_table_init(void)
+static void iloader_table_clear(void)
 {
-	static int inited = 0;
 	int i;
-	if (inited) return;
 	for (i = 0; i < 256; i++) iloader_table[i] = NULL;
-	inited = 1;
+}
+
+void iloader_table_init(void)
+{
+	IPIXEL_ONCE(&iloader_table_once, iloader_table_clear);
 }
 
 
@@ -1476,8 +1486,10 @@ IPICLOADER ipic_loader(unsigned char firstbyte, IPICLOADER loader)
 //---------------------------------------------------------------------
 struct IBITMAP *iload_picture(IMDIO *stream, IRGB *pal)
 {
+	struct IBITMAP *bmp;
 	unsigned char firstbyte;
 	int ch;
+	IBITMAP_TRACE_BEGIN(tracets);
 
 	assert(stream);
 
@@ -1489,16 +1501,23 @@ struct IBITMAP *iload_picture(IMDIO *stream, IRGB *pal)
 
 	firstbyte = (unsigned char)(ch & 0xff);
 	if (iloader_table[firstbyte] != NULL) {
-		return iloader_table[firstbyte](stream, pal);
+		bmp = iloader_table[firstbyte](stream, pal);
 	}
-
-	if (ch == 'B') {
-		return iload_bmp_stream(stream, pal);
+	else if (ch == 'B') {
+		bmp = iload_bmp_stream(stream, pal);
 	}	else 
 	if (ch == 'G') {
-		return iload_gif_stream(stream, pal);
-	}	
-	return iload_tga_stream(stream, pal);
+		bmp = iload_gif_stream(stream, pal);
+	}	else {
+		bmp = iload_tga_stream(stream, pal);
+	}
+
+	if (bmp != NULL) {
+		IBITMAP_TRACE_END(tracets, "iload_picture", bmp->w, bmp->h, -1,
+			_ibitmap_guess_pixfmt(bmp));
+	}
+
+	return bmp;
 }
 
 
@@ -2403,6 +2422,7 @@ int isave_gif_stream(IMDIO *stream, struct IBITMAP *bmp, const IRGB *pal)
 	IGIFDESC *gif;
 	long flags;
 	long hotxy;
+	IBITMAP_TRACE_BEGIN(tracets);
 
 	assert(stream && bmp);
 
@@ -2427,6 +2447,10 @@ int isave_gif_stream(IMDIO *stream, struct IBITMAP *bmp, const IRGB *pal)
 	ipic_gif_close(gif);
 
 	free(gif);
+
+	IBITMAP_TRACE_END(tracets, "isave_gif_stream", bmp->w, bmp->h,
+		_ibitmap_guess_pixfmt(bmp), -1);
+
 	return 0;
 }
 
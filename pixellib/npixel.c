@@ -9,6 +9,7 @@
 #include "ipicture.h"
 #include "ikitwin.h"
 #include "ibmsse2.h"
+#include "ibmsimd.h"
 
 #ifdef _WIN32
 #include "mswindx.h"
@@ -38,6 +39,7 @@ typedef struct {
 //! mode: lib
 //! src: ikitwin.c, mswindx.c, ibmfont.c, ibmsse2.c, ibmwink.c
 //! src: ibitmap.c, ibmbits.c, iblit386.c, ibmcols.c, ipicture.c, ibmdata.c
+//! src: ibmtrace.c, ibmsimd.c, ibmtask.c
 
 
 //=====================================================================
@@ -251,10 +253,12 @@ int iscreen_init_main(int w, int h, int bpp)
 int iscreen_init(int w, int h, int bpp)
 {
 	init_allocator();
+	pixellib_init();
 #ifdef __x86__
 	_x86_choose_blitter();
 	pixellib_mmx_init();
 #endif
+	ipixel_simd_select(IPIXEL_SIMD_AUTO);
 	return iscreen_init_main(w, h, bpp);
 }
 
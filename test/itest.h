@@ -0,0 +1,97 @@
+//=====================================================================
+//
+// itest.h - shared helpers for the pixellib regression tests
+//
+// NOTE:
+// the tests are standalone programs, build them directly with the
+// library sources, see the header of each test_*.c file. every test
+// prints its failures and returns non-zero when any check failed.
+//
+//=====================================================================
+#ifndef __ITEST_H__
+#define __ITEST_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ibmbits.h"
+#include "ibmcols.h"
+
+#if defined(__GNUC__)
+#define ITEST_STATIC static __attribute__((unused))
+#else
+#define ITEST_STATIC static
+#endif
+
+
+//---------------------------------------------------------------------
+// checks
+//---------------------------------------------------------------------
+ITEST_STATIC int itest_checks = 0;
+ITEST_STATIC int itest_failures = 0;
+
+#define ITEST_CHECK(cond, ...) do { \
+		itest_checks++; \
+		if (!(cond)) { \
+			itest_failures++; \
+			printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+			printf(__VA_ARGS__); \
+			printf("\n"); \
+		} \
+	}	while (0)
+
+ITEST_STATIC int itest_report(const char *name)
+{
+	printf("%s: %d checks, %d failures\n", name, itest_checks, 
+		itest_failures);
+	return (itest_failures == 0)? 0 : 1;
+}
+
+
+//---------------------------------------------------------------------
+// random numbers (xorshift32, fixed seed for reproducible runs)
+//---------------------------------------------------------------------
+ITEST_STATIC IUINT32 itest_seed = 0x12345678;
+
+ITEST_STATIC IUINT32 itest_random(void)
+{
+	IUINT32 x = itest_seed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	itest_seed = x;
+	return x;
+}
+
+
+//---------------------------------------------------------------------
+// bitmaps
+//---------------------------------------------------------------------
+ITEST_STATIC IBITMAP *itest_bitmap(int w, int h, int fmt)
+{
+	IBITMAP *bmp = ibitmap_create(w, h, ipixelfmt[fmt].bpp);
+	if (bmp == NULL) {
+		printf("out of memory\n");
+		exit(2);
+	}
+	ibitmap_pixfmt_set(bmp, fmt);
+	memset(bmp->pixel, 0, bmp->pitch * bmp->h);
+	return bmp;
+}
+
+ITEST_STATIC void itest_fill(IBITMAP *bmp)
+{
+	int i, j;
+	for (j = 0; j < (int)bmp->h; j++) {
+		IUINT8 *line = (IUINT8*)bmp->line[j];
+		for (i = 0; i < (int)bmp->pitch; i++) {
+			line[i] = (IUINT8)(itest_random() >> 24);
+		}
+	}
+}
+
+
+#endif
+
+
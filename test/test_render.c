@@ -0,0 +1,74 @@
+//=====================================================================
+//
+// test_render.c - polygon renderer regressions
+//
+// build:
+//   cc -O2 -I../pixellib -o test_render test_render.c
+//      ../pixellib/ibitmap.c ../pixellib/ibmbits.c ../pixellib/ibmcols.c
+//      ../pixellib/ibmdata.c ../pixellib/ibmwink.c ../pixellib/ibmfont.c
+//      ../pixellib/iblit386.c ../pixellib/ibmtask.c -lpthread -lm
+//
+//=====================================================================
+#include "itest.h"
+#include "ibmdata.h"
+#include "ibmwink.h"
+
+
+//---------------------------------------------------------------------
+// wide and short shapes with a bitmap source: the card of the source
+// fetch needs the full width of the bound, not its height
+//---------------------------------------------------------------------
+static void test_wide_source(int w, int h)
+{
+	IBITMAP *dst = itest_bitmap(w, h, IPIX_FMT_A8R8G8B8);
+	IBITMAP *tex = itest_bitmap(w, h, IPIX_FMT_A8R8G8B8);
+	ipixel_point_fixed_t pts[4];
+	ipixel_source_t source;
+	int hr, i, j, count = 0;
+
+	itest_fill(tex);
+	for (j = 0; j < h; j++) {
+		IUINT32 *line = (IUINT32*)tex->line[j];
+		for (i = 0; i < w; i++) line[i] |= 0xff000000;
+	}
+
+	ipixel_source_init_bitmap(&source, tex);
+
+	pts[0].x = cfixed_from_int(0);
+	pts[0].y = cfixed_from_int(1);
+	pts[1].x = cfixed_from_int(w);
+	pts[1].y = cfixed_from_int(1);
+	pts[2].x = cfixed_from_int(w);
+	pts[2].y = cfixed_from_int(h - 1);
+	pts[3].x = cfixed_from_int(0);
+	pts[3].y = cfixed_from_int(h - 1);
+
+	hr = ipixel_render_polygon(dst, pts, 4, NULL, &source, 0, NULL, NULL);
+	ITEST_CHECK(hr == 0, "render %dx%d returned %d", w, h, hr);
+
+	for (j = 1; j < h - 1; j++) {
+		const IUINT32 *d = (const IUINT32*)dst->line[j];
+		const IUINT32 *s = (const IUINT32*)tex->line[j];
+		for (i = 0; i < w; i++) {
+			if (d[i] != s[i]) count++;
+		}
+	}
+
+	ITEST_CHECK(count == 0, "render %dx%d: %d pixels differ from source",
+		w, h, count);
+
+	ibitmap_release(dst);
+	ibitmap_release(tex);
+}
+
+
+int main(void)
+{
+	test_wide_source(4000, 4);
+	test_wide_source(1500, 3);
+	test_wide_source(64, 64);
+	ipixel_scratch_release();
+	return itest_report("test_render");
+}
+
+
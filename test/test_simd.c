@@ -0,0 +1,608 @@
+//=====================================================================
+//
+// test_simd.c - simd procedures against the builtin c procedures
+//
+// every procedure installed by ipixel_simd_select must give the same
+// bytes as the portable c implementation, so output does not depend on
+// the cpu. each level is compared with level 0 for: card over and the
+// other card procedures, 16 bits fetch / store, the compositors, the
+// blitters, 24 bits and P8R8G8B8 fetch / store and converters, span and
+// hline drawers, bilinear fetchers, box and kernel scaling, and whole
+// operations on R5G6B5 targets.
+//
+// build:
+//   cc -O2 -I../pixellib -o test_simd test_simd.c
+//      ../pixellib/ibitmap.c ../pixellib/ibmbits.c ../pixellib/ibmcols.c
+//      ../pixellib/ibmsse2.c ../pixellib/ibmsimd.c ../pixellib/ibmtask.c
+//      ../pixellib/iblit386.c -lpthread -lm
+//
+// build it with -O0 too: intrinsics taking an immediate only accept a
+// constant expression there, so a debug build catches what -O2 folds.
+//
+//=====================================================================
+#include "itest.h"
+#include "ibmsse2.h"
+#include "ibmsimd.h"
+
+
+//---------------------------------------------------------------------
+// data
+//---------------------------------------------------------------------
+#define TEST_PIXELS		4099
+
+static IUINT32 test_dst[TEST_PIXELS];
+static IUINT32 test_card[TEST_PIXELS];
+static IUINT8 test_cover[TEST_PIXELS];
+static IUINT32 test_expect[2][TEST_PIXELS];
+
+// random premultiplied A8R8G8B8 pixel, with extra transparent and
+// opaque pixels
+static IUINT32 test_random_parg(void)
+{
+	IUINT32 c = itest_random();
+	IUINT32 a = c >> 24;
+	IUINT32 r, g, b;
+	switch (itest_random() & 7) {
+	case 0: return 0;
+	case 1: a = 255; break;
+	}
+	r = ((c >> 16) & 0xff) * a / 255;
+	g = ((c >> 8) & 0xff) * a / 255;
+	b = (c & 0xff) * a / 255;
+	return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+static void test_init_data(void)
+{
+	int i;
+	for (i = 0; i < TEST_PIXELS; i++) {
+		IUINT32 c = itest_random();
+		test_dst[i] = test_random_parg();
+		test_card[i] = test_random_parg();
+		test_cover[i] = (IUINT8)(c >> 24);
+		if ((c & 3) == 0) test_cover[i] = 0;
+		if ((c & 3) == 1) test_cover[i] = 255;
+	}
+}
+
+
+//---------------------------------------------------------------------
+// ipixel_card_over, runs of every length up to 33 then the rest
+//---------------------------------------------------------------------
+static void test_card_over_run(IUINT32 *out, const IUINT8 *cover)
+{
+	int pos, size;
+	memcpy(out, test_dst, sizeof(test_dst));
+	for (pos = 0, size = 1; pos < TEST_PIXELS; pos += size, size++) {
+		if (size > 33) size = TEST_PIXELS - pos;
+		if (pos + size > TEST_PIXELS) size = TEST_PIXELS - pos;
+		ipixel_card_over(out + pos, size, test_card + pos, 
+			cover? cover + pos : NULL);
+	}
+}
+
+static void test_card_over_expect(void)
+{
+	test_card_over_run(test_expect[0], NULL);
+	test_card_over_run(test_expect[1], test_cover);
+}
+
+static void test_card_over(const char *name)
+{
+	static IUINT32 out[TEST_PIXELS];
+	int k, i, count;
+	for (k = 0; k < 2; k++) {
+		test_card_over_run(out, k? test_cover : NULL);
+		for (i = 0, count = 0; i < TEST_PIXELS; i++) {
+			if (out[i] != test_expect[k][i]) count++;
+		}
+		ITEST_CHECK(count == 0, "%s: card over (cover %d): %d pixels differ",
+			name, k, count);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// 16 bits formats: NORMAL fetch keeps the lut output at every level,
+// ACCURATE fetch equals the builtin procedures, fetchpixel agrees with
+// fetch, stores equal the level 0 stores
+//---------------------------------------------------------------------
+static IUINT16 test_values16[65536];
+static IUINT32 test_fetch16[IPIX_FMT_COUNT][65536];
+static IUINT16 test_store16[IPIX_FMT_COUNT][TEST_PIXELS];
+
+static void test_init_16(void)
+{
+	int i;
+	for (i = 0; i < 65536; i++) test_values16[i] = (IUINT16)i;
+}
+
+static int test_is_16(int fmt)
+{
+	return ipixelfmt[fmt].bpp == 16 && ipixelfmt[fmt].type != 
+		IPIX_FMT_TYPE_INDEX;
+}
+
+static void test_expect_16(void)
+{
+	int fmt;
+	for (fmt = 0; fmt < IPIX_FMT_COUNT; fmt++) {
+		if (!test_is_16(fmt)) continue;
+		ipixel_get_fetch(fmt, IPIXEL_ACCESS_MODE_NORMAL)(test_values16, 0,
+			65536, test_fetch16[fmt], NULL);
+		ipixel_get_store(fmt, IPIXEL_ACCESS_MODE_NORMAL)(test_store16[fmt],
+			test_card, 0, TEST_PIXELS, NULL);
+	}
+}
+
+static void test_access_16(const char *name)
+{
+	static IUINT32 out[65536], builtin[65536];
+	static IUINT16 stored[TEST_PIXELS];
+	int fmt, i, count, mode;
+	for (fmt = 0; fmt < IPIX_FMT_COUNT; fmt++) {
+		iFetchPixelProc pixel;
+		if (!test_is_16(fmt)) continue;
+		ipixel_get_fetch(fmt, IPIXEL_ACCESS_MODE_NORMAL)(test_values16, 0,
+			65536, out, NULL);
+		for (i = 0, count = 0; i < 65536; i++) {
+			if (out[i] != test_fetch16[fmt][i]) count++;
+		}
+		ITEST_CHECK(count == 0, "%s: %s normal fetch: %d values differ",
+			name, ipixelfmt[fmt].name, count);
+		ipixel_get_store(fmt, IPIXEL_ACCESS_MODE_NORMAL)(stored, test_card,
+			0, TEST_PIXELS, NULL);
+		ITEST_CHECK(memcmp(stored, test_store16[fmt], sizeof(stored)) == 0,
+			"%s: %s store differs", name, ipixelfmt[fmt].name);
+		ipixel_get_fetch(fmt, IPIXEL_ACCESS_MODE_BUILTIN)(test_values16, 0,
+			65536, builtin, NULL);
+		for (mode = 0; mode < 2; mode++) {
+			int access = IPIXEL_ACCESS_MODE_ACCURATE;
+			int previous = 1;
+			if (mode) previous = ipixel_set_lut16(0);
+			if (mode) access = IPIXEL_ACCESS_MODE_NORMAL;
+			ipixel_get_fetch(fmt, access)(test_values16, 0, 65536, out, 
+				NULL);
+			pixel = ipixel_get_fetchpixel(fmt, access);
+			for (i = 0, count = 0; i < 65536; i++) {
+				if (out[i] != builtin[i]) count++;
+				else if (pixel(test_values16, i, NULL) != out[i]) count++;
+			}
+			ITEST_CHECK(count == 0, "%s: %s %s fetch: %d values differ",
+				name, ipixelfmt[fmt].name, mode? "lut16(0)" : "accurate",
+				count);
+			if (mode) ipixel_set_lut16(previous);
+		}
+	}
+}
+
+
+//---------------------------------------------------------------------
+// whole operations on 16 bits targets
+//---------------------------------------------------------------------
+#define TEST_OPS	4
+
+static IBITMAP *test_ops[TEST_OPS];
+
+static IBITMAP *test_operation(int op)
+{
+	IBITMAP *src = itest_bitmap(157, 93, IPIX_FMT_A8R8G8B8);
+	IBITMAP *dst = itest_bitmap(211, 129, IPIX_FMT_R5G6B5);
+	IUINT32 seed = itest_seed;
+	IRECT rd = { 3, 5, 203, 121 }, rs = { 1, 2, 150, 90 };
+	itest_seed = 0x2468ace;
+	itest_fill(src);
+	itest_fill(dst);
+	itest_seed = seed;
+	switch (op) {
+	case 0:
+		ibitmap_blend(dst, 4, 6, src, 0, 0, 157, 93, 0xc0ffffff, NULL, 0);
+		break;
+	case 1:
+		ibitmap_composite(dst, 4, 6, src, 0, 0, 157, 93, NULL, 
+			IPIXEL_OP_SRC_OVER, 0);
+		break;
+	case 2:
+		ibitmap_filter_set(src, IPIXEL_FILTER_BILINEAR);
+		ibitmap_convert(src, 0, 0, dst, 0, 0, 157, 93, NULL, 0);
+		ibitmap_scale(dst, &rd, src, &rs, NULL, 0);
+		break;
+	case 3:
+		ibitmap_convert(src, 0, 0, dst, 0, 0, 157, 93, NULL, 0);
+		break;
+	}
+	ibitmap_release(op == 3? dst : src);
+	return (op == 3)? src : dst;
+}
+
+static int test_same(const IBITMAP *a, const IBITMAP *b)
+{
+	int j;
+	for (j = 0; j < (int)a->h; j++) {
+		if (memcmp(a->line[j], b->line[j], a->w * (a->bpp / 8)) != 0)
+			return 0;
+	}
+	return 1;
+}
+
+static void test_operations(const char *name)
+{
+	int op;
+	for (op = 0; op < TEST_OPS; op++) {
+		IBITMAP *bmp = test_operation(op);
+		ITEST_CHECK(test_same(bmp, test_ops[op]), "%s: operation %d differs",
+			name, op);
+		ibitmap_release(bmp);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// hook families: each one writes its results to the output stream,
+// which is saved at level 0 and compared byte for byte at the others
+//---------------------------------------------------------------------
+static IUINT8 *test_stream = NULL;
+static long test_stream_size = 0;
+static long test_stream_capacity = 0;
+
+static void test_emit(const void *data, long size)
+{
+	if (test_stream_size + size > test_stream_capacity) {
+		long capacity = test_stream_capacity * 2 + size + 65536;
+		test_stream = (IUINT8*)realloc(test_stream, capacity);
+		if (test_stream == NULL) {
+			printf("out of memory\n");
+			exit(2);
+		}
+		test_stream_capacity = capacity;
+	}
+	memcpy(test_stream + test_stream_size, data, size);
+	test_stream_size += size;
+}
+
+static void test_emit_bitmap(const IBITMAP *bmp)
+{
+	int j;
+	for (j = 0; j < (int)bmp->h; j++) {
+		test_emit(bmp->line[j], (long)bmp->w * ((bmp->bpp + 7) / 8));
+	}
+}
+
+// runs of every length up to 33 then the rest, like the card over test
+static int test_next_run(int pos, int size)
+{
+	size++;
+	if (size > 33) size = TEST_PIXELS - pos;
+	if (pos + size > TEST_PIXELS) size = TEST_PIXELS - pos;
+	return size;
+}
+
+// random premultiplied pixels in a bitmap, for P8R8G8B8
+static void test_fill_parg(IBITMAP *bmp)
+{
+	int i, j;
+	for (j = 0; j < (int)bmp->h; j++) {
+		IUINT32 *line = (IUINT32*)bmp->line[j];
+		for (i = 0; i < (int)bmp->w; i++) line[i] = test_random_parg();
+	}
+}
+
+static int test_is_drawable(int fmt)
+{
+	return ipixelfmt[fmt].bpp >= 15 && ipixelfmt[fmt].type != 
+		IPIX_FMT_TYPE_INDEX;
+}
+
+
+// compositors: every operator on premultiplied cards
+static void test_family_composite(void)
+{
+	static IUINT32 out[TEST_PIXELS];
+	int op, pos, size;
+	for (op = 0; op <= IPIXEL_OP_OVERLAY; op++) {
+		iPixelComposite composite = ipixel_composite_get(op, 0);
+		memcpy(out, test_dst, sizeof(out));
+		for (pos = 0, size = 0; pos < TEST_PIXELS; pos += size) {
+			size = test_next_run(pos, size);
+			composite(out + pos, test_card + pos, size);
+		}
+		test_emit(out, sizeof(out));
+	}
+}
+
+
+// card procedures: multi, mask, cover, permute and reverse
+static void test_family_cards(void)
+{
+	static IUINT32 out[TEST_PIXELS];
+	int k, pos, size;
+	for (k = 0; k < 5; k++) {
+		memcpy(out, test_card, sizeof(out));
+		for (pos = 0, size = 0; pos < TEST_PIXELS; pos += size) {
+			size = test_next_run(pos, size);
+			switch (k) {
+			case 0: ipixel_card_multi(out + pos, size, test_dst[pos]); break;
+			case 1: ipixel_card_mask(out + pos, size, test_dst + pos); break;
+			case 2: ipixel_card_cover(out + pos, size, test_cover + pos);
+				break;
+			case 3: ipixel_card_permute(out + pos, size, pos & 3, 
+						(pos >> 2) & 3, 3 - (pos & 3), 2); 
+				break;
+			case 4: ipixel_card_reverse(out + pos, size); break;
+			}
+		}
+		test_emit(out, sizeof(out));
+	}
+}
+
+
+// blitters: 8, 16, 24 and 32 bits, plain, colour key and flips, at
+// odd offsets so rows start unaligned
+static void test_family_blit(void)
+{
+	static const int fmts[4] = { IPIX_FMT_G8, IPIX_FMT_R5G6B5, 
+		IPIX_FMT_R8G8B8, IPIX_FMT_A8R8G8B8 };
+	int i, mode;
+	for (i = 0; i < 4; i++) {
+		IBITMAP *src = itest_bitmap(173, 41, fmts[i]);
+		int nbytes = ipixelfmt[fmts[i]].bpp / 8;
+		int x, y;
+		itest_fill(src);
+		// frequent colour key pixels
+		for (y = 0; y < (int)src->h; y++) {
+			for (x = y & 3; x < (int)src->w; x += 5) {
+				memset((IUINT8*)src->line[y] + x * nbytes, 0x5a, nbytes);
+			}
+		}
+		ibitmap_setmask(src, (nbytes == 1)? 0x5a : (nbytes == 2)? 0x5a5a :
+			(nbytes == 3)? 0x5a5a5a : 0x5a5a5a5a);
+		for (mode = 0; mode < 8; mode++) {
+			IBITMAP *dst = itest_bitmap(181, 47, fmts[i]);
+			int flags = ((mode & 1)? IBLIT_MASK : 0) | 
+				((mode & 2)? IBLIT_HFLIP : 0) | ((mode & 4)? IBLIT_VFLIP : 0);
+			itest_fill(dst);
+			ibitmap_blit(dst, 3, 2, src, 1, 1, 169, 39, flags);
+			ibitmap_blit(dst, 0, 0, src, 2, 0, 7, 5, flags);
+			test_emit_bitmap(dst);
+			ibitmap_release(dst);
+		}
+		ibitmap_release(src);
+	}
+}
+
+
+// fetch / store of R8G8B8, B8G8R8 and P8R8G8B8 (valid premultiplied
+// input for the P8R8G8B8 fetch), and the 24 <-> 32 bits converters
+static void test_family_access(void)
+{
+	static const int fmts[3] = { IPIX_FMT_R8G8B8, IPIX_FMT_B8G8R8, 
+		IPIX_FMT_P8R8G8B8 };
+	static IUINT32 bits[TEST_PIXELS], out[TEST_PIXELS];
+	int i, mode, pos, size, dfmt, flip;
+	for (i = 0; i < 3; i++) {
+		for (mode = 0; mode < 2; mode++) {
+			int access = mode? IPIXEL_ACCESS_MODE_ACCURATE : 
+				IPIXEL_ACCESS_MODE_NORMAL;
+			iFetchProc fetch = ipixel_get_fetch(fmts[i], access);
+			iStoreProc store = ipixel_get_store(fmts[i], access);
+			memcpy(bits, test_dst, sizeof(bits));
+			for (pos = 0, size = 0; pos < TEST_PIXELS; pos += size) {
+				size = test_next_run(pos, size);
+				fetch(bits, pos * 3 / 4, size, out + pos, NULL);
+			}
+			test_emit(out, sizeof(out));
+			for (pos = 0, size = 0; pos < TEST_PIXELS; pos += size) {
+				size = test_next_run(pos, size);
+				store(bits, test_card + pos, pos * 3 / 4, size, NULL);
+			}
+			test_emit(bits, sizeof(bits));
+		}
+	}
+	for (i = 0; i < 2; i++) {
+		for (dfmt = IPIX_FMT_A8R8G8B8; dfmt <= IPIX_FMT_B8G8R8X8; dfmt++) {
+			for (flip = 0; flip < 2; flip++) {
+				int mode = flip? IBLIT_HFLIP : 0;
+				IBITMAP *b24 = itest_bitmap(97, 13, fmts[i]);
+				IBITMAP *b32 = itest_bitmap(97, 13, dfmt);
+				itest_fill(b24);
+				itest_fill(b32);
+				ibitmap_convert(b32, 1, 0, b24, 2, 1, 93, 12, NULL, mode);
+				test_emit_bitmap(b32);
+				itest_fill(b32);
+				ibitmap_convert(b24, 2, 1, b32, 1, 0, 93, 12, NULL, mode);
+				test_emit_bitmap(b24);
+				ibitmap_release(b24);
+				ibitmap_release(b32);
+			}
+		}
+	}
+}
+
+
+// span and hline drawers of every direct colour format, with and 
+// without cover; P8R8G8B8 rows hold valid premultiplied pixels
+static void test_family_draw(void)
+{
+	int fmt, op, k, pos, size;
+	for (fmt = 0; fmt < IPIX_FMT_COUNT; fmt++) {
+		IBITMAP *bmp;
+		if (!test_is_drawable(fmt)) continue;
+		bmp = itest_bitmap(TEST_PIXELS, 1, fmt);
+		for (op = 0; op < 3; op++) {
+			for (k = 0; k < 4; k++) {
+				const IUINT8 *cover = (k & 1)? test_cover : NULL;
+				void *bits = bmp->line[0];
+				if (fmt == IPIX_FMT_P8R8G8B8) test_fill_parg(bmp);
+				else itest_fill(bmp);
+				for (pos = 0, size = 0; pos < TEST_PIXELS; pos += size) {
+					size = test_next_run(pos, size);
+					if (k < 2) {
+						ipixel_get_span_proc(fmt, op, 0)(bits, pos, size,
+							test_card + pos, cover? cover + pos : NULL, 
+							NULL);
+					}	else {
+						ipixel_get_hline_proc(fmt, op, 0)(bits, pos, size,
+							test_card[pos], cover? cover + pos : NULL, 
+							NULL);
+					}
+				}
+				test_emit_bitmap(bmp);
+			}
+		}
+		ibitmap_release(bmp);
+	}
+}
+
+
+// bilinear scanline fetchers, scale and affine, inside and across the
+// clip, for A8R8G8B8 and X8R8G8B8 sources
+static void test_family_bilinear(void)
+{
+	static const int fmts[2] = { IPIX_FMT_A8R8G8B8, IPIX_FMT_X8R8G8B8 };
+	static const int modes[3] = { IBITMAP_FETCH_SCALE_BILINEAR,
+		IBITMAP_FETCH_REPEAT_SCALE_BILINEAR, 
+		IBITMAP_FETCH_GENERAL_BILINEAR };
+	static IUINT32 card[300];
+	int i, m, j;
+	for (i = 0; i < 2; i++) {
+		IBITMAP *src = itest_bitmap(67, 45, fmts[i]);
+		IRECT clip = { 2, 1, 63, 44 };
+		itest_fill(src);
+		ibitmap_filter_set(src, IPIXEL_FILTER_BILINEAR);
+		for (m = 0; m < 3; m++) {
+			iBitmapFetchProc proc = ibitmap_scanline_get_proc(fmts[i], 
+				modes[m], 0);
+			for (j = 0; j < 40; j++) {
+				cfixed pos[3], step[3];
+				pos[0] = cfixed_from_double(-3.3 + j * 0.17);
+				pos[1] = cfixed_from_double(-1.7 + j * 1.13);
+				pos[2] = cfixed_const_1;
+				step[0] = cfixed_from_double(0.23 + j * 0.01);
+				step[1] = (m == 2)? cfixed_from_double(0.071) : 0;
+				step[2] = 0;
+				proc(src, card, 300, pos, step, NULL, &clip);
+				test_emit(card, sizeof(card));
+			}
+		}
+		ibitmap_release(src);
+	}
+}
+
+
+// box filter reductions and the bicubic / lanczos passes
+static void test_family_scale(void)
+{
+	static const int filters[3] = { IPIXEL_FILTER_BOX, 
+		IPIXEL_FILTER_BICUBIC, IPIXEL_FILTER_LANCZOS };
+	static const int sizes[3][2] = { { 61, 37 }, { 241, 150 }, { 83, 173 } };
+	int f, s;
+	for (f = 0; f < 3; f++) {
+		IBITMAP *src = itest_bitmap(157, 93, IPIX_FMT_A8R8G8B8);
+		itest_fill(src);
+		ibitmap_filter_set(src, (enum IPIXELFILTER)filters[f]);
+		for (s = 0; s < 3; s++) {
+			IBITMAP *dst = itest_bitmap(sizes[s][0], sizes[s][1], 
+				IPIX_FMT_A8R8G8B8);
+			ibitmap_scale(dst, NULL, src, NULL, NULL, 0);
+			test_emit_bitmap(dst);
+			ibitmap_release(dst);
+		}
+		ibitmap_release(src);
+	}
+}
+
+
+typedef void (*TestFamily)(void);
+
+#define TEST_FAMILIES	7
+
+static const struct { const char *name; TestFamily run; } 
+test_families[TEST_FAMILIES] = {
+	{ "compositors", test_family_composite },
+	{ "card procedures", test_family_cards },
+	{ "blitters", test_family_blit },
+	{ "24 bits / P8R8G8B8 access and converters", test_family_access },
+	{ "span / hline drawers", test_family_draw },
+	{ "bilinear fetchers", test_family_bilinear },
+	{ "box / kernel scaling", test_family_scale },
+};
+
+static IUINT8 *test_family_expect[TEST_FAMILIES];
+static long test_family_size[TEST_FAMILIES];
+
+// same random inputs at every level
+static void test_family_run(int index)
+{
+	IUINT32 seed = itest_seed;
+	itest_seed = 0x13579bd ^ (IUINT32)index;
+	test_stream_size = 0;
+	test_families[index].run();
+	itest_seed = seed;
+}
+
+static void test_families_expect(void)
+{
+	int i;
+	for (i = 0; i < TEST_FAMILIES; i++) {
+		test_family_run(i);
+		test_family_expect[i] = (IUINT8*)malloc(test_stream_size);
+		memcpy(test_family_expect[i], test_stream, test_stream_size);
+		test_family_size[i] = test_stream_size;
+	}
+}
+
+static void test_families_check(const char *name)
+{
+	int i;
+	for (i = 0; i < TEST_FAMILIES; i++) {
+		long k = 0;
+		test_family_run(i);
+		if (test_stream_size == test_family_size[i]) {
+			for (; k < test_stream_size; k++) {
+				if (test_stream[k] != test_family_expect[i][k]) break;
+			}
+		}
+		ITEST_CHECK(k == test_family_size[i], 
+			"%s: %s: first difference at byte %ld of %ld", name,
+			test_families[i].name, k, test_family_size[i]);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// main
+//---------------------------------------------------------------------
+int main(void)
+{
+	int level;
+
+	test_init_data();
+
+	ipixel_simd_select(IPIXEL_SIMD_NONE);
+	test_card_over_expect();
+	test_init_16();
+	test_expect_16();
+	for (level = 0; level < TEST_OPS; level++) {
+		test_ops[level] = test_operation(level);
+	}
+	test_access_16("c");
+	test_families_expect();
+
+	if (pixellib_xmm_init() == 0) {
+		test_card_over("pixellib_xmm_init");
+	}
+
+	for (level = IPIXEL_SIMD_SSE2; level <= ipixel_simd_detect(); level++) {
+		if (ipixel_simd_select(level) != level) continue;
+		test_card_over(ipixel_simd_name(level));
+		test_access_16(ipixel_simd_name(level));
+		test_operations(ipixel_simd_name(level));
+		test_families_check(ipixel_simd_name(level));
+	}
+
+	ipixel_simd_select(IPIXEL_SIMD_NONE);
+
+	return itest_report("test_simd");
+}
+
+
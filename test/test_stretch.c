@@ -0,0 +1,81 @@
+//=====================================================================
+//
+// test_stretch.c - integer factor ibitmap_stretch regressions
+//
+// exact integer factors take the pixel replication path, which must
+// give the same bytes as sampling the source rectangle with x / fx and
+// y / fy, and leave the pixels around the target rectangle alone.
+//
+// build:
+//   cc -O2 -I../pixellib -o test_stretch test_stretch.c
+//      ../pixellib/ibitmap.c ../pixellib/ibmbits.c ../pixellib/ibmcols.c
+//      ../pixellib/ibmtask.c -lpthread -lm
+//
+//=====================================================================
+#include "itest.h"
+
+
+//---------------------------------------------------------------------
+// stretch one source rectangle by fx, fy and compare every byte
+//---------------------------------------------------------------------
+static void test_stretch(int fmt, int fx, int fy, int mode)
+{
+	int nbytes = (ipixelfmt[fmt].bpp + 7) / 8;
+	int sx = 3, sy = 2, sw = 13, sh = 5;
+	int dx = 1, dy = 3, dw = sw * fx, dh = sh * fy;
+	IBITMAP *src = itest_bitmap(sw + 7, sh + 4, fmt);
+	IBITMAP *dst = itest_bitmap(dw + 5, dh + 6, fmt);
+	IBITMAP *ref = itest_bitmap(dw + 5, dh + 6, fmt);
+	int i, j, hr, count = 0;
+
+	itest_fill(src);
+	itest_fill(dst);
+	memcpy(ref->pixel, dst->pixel, dst->pitch * dst->h);
+
+	for (j = 0; j < dh; j++) {
+		int y = (mode & IBLIT_VFLIP)? (sh - 1 - j / fy) : (j / fy);
+		const IUINT8 *s = (const IUINT8*)src->line[sy + y];
+		IUINT8 *d = (IUINT8*)ref->line[dy + j];
+		for (i = 0; i < dw; i++) {
+			int x = (mode & IBLIT_HFLIP)? (sw - 1 - i / fx) : (i / fx);
+			memcpy(d + (dx + i) * nbytes, s + (sx + x) * nbytes, nbytes);
+		}
+	}
+
+	hr = ibitmap_stretch(dst, dx, dy, dw, dh, src, sx, sy, sw, sh, mode);
+	ITEST_CHECK(hr == 0, "stretch returned %d", hr);
+
+	for (j = 0; j < (int)dst->h; j++) {
+		if (memcmp(dst->line[j], ref->line[j], dst->pitch) != 0) count++;
+	}
+
+	ITEST_CHECK(count == 0, "%d bpp x%d y%d mode %d: %d rows differ",
+		ipixelfmt[fmt].bpp, fx, fy, mode, count);
+
+	ibitmap_release(src);
+	ibitmap_release(dst);
+	ibitmap_release(ref);
+}
+
+
+int main(void)
+{
+	static const int formats[] = { IPIX_FMT_G8, IPIX_FMT_R5G6B5,
+		IPIX_FMT_R8G8B8, IPIX_FMT_A8R8G8B8 };
+	int i, fx, fy, mode;
+	for (i = 0; i < 4; i++) {
+		for (fx = 1; fx <= 5; fx++) {
+			for (fy = 1; fy <= 3; fy++) {
+				if (fx == 1 && fy == 1) continue;
+				for (mode = 0; mode < 4; mode++) {
+					test_stretch(formats[i], fx, fy,
+						((mode & 1)? IBLIT_HFLIP : 0) |
+						((mode & 2)? IBLIT_VFLIP : 0));
+				}
+			}
+		}
+	}
+	return itest_report("test_stretch");
+}
+
+
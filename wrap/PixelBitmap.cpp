@@ -1101,6 +1101,11 @@ void Source::SetBound(const IRECT *bound)
 	ipixel_source_set_bound(&source, bound);
 }
 
+void Source::SetMipmap(IMIPMAP *mipmap)
+{
+	ipixel_source_set_mipmap(&source, mipmap);
+}
+
 int Source::FetchScanline(int x, int y, int width, IUINT32 *card, const IUINT8 *mask)
 {
 	return ipixel_source_fetch(&source, x, y, width, card, mask);
@@ -1370,5 +1375,6 @@ NAMESPACE_END(Pixel)
 //! src: PixelBitmap.cpp
 //! src: ikitwin.c, mswindx.c, ibmfont.c, ibmsse2.c, ibmwink.c, npixel.c
 //! src: ibitmap.c, ibmbits.c, iblit386.c, ibmcols.c, ipicture.c, ibmdata.c
+//! src: ibmtask.c, ibmsimd.c, ibmtrace.c
 
 
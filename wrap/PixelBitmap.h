@@ -77,6 +77,10 @@ enum Filter
 {
 	BILINEAR = 0,
 	NEAREST = 1,
+	BOX = 2,
+	BICUBIC = 3,
+	LANCZOS = 4,
+	TRILINEAR = 5,
 };
 
 // Խ
@@ -381,6 +385,7 @@ public:
 	void SetOverflow(enum OverflowMode mode = OM_REPEAT, IUINT32 transparent = 0);
 	void SetFilter(enum Filter filter = BILINEAR);
 	void SetBound(const IRECT *bound = NULL);
+	void SetMipmap(IMIPMAP *mipmap = NULL);
 
 	//////////////////////// ؼӿ ////////////////////////	
 	int FetchScanline(int x, int y, int width, IUINT32 *card, const IUINT8 *mask = NULL);
@@ -754,5 +754,6 @@ NAMESPACE_END(Pixel)
 //! src: PixelBitmap.cpp
 //! src: ikitwin.c, mswindx.c, ibmfont.c, ibmsse2.c, ibmwink.c, npixel.c
 //! src: ibitmap.c, ibmbits.c, iblit386.c, ibmcols.c, ipicture.c, ibmdata.c
+//! src: ibmtask.c, ibmsimd.c, ibmtrace.c
 
 